@@ -195,7 +195,6 @@ handle_create_volume (UDisksManagerBTRFS    *manager,
   GError *error = NULL;
   GPtrArray *devices = NULL;
   GList *objects = NULL;
-  GList *l;
 
   daemon = udisks_module_get_daemon (UDISKS_MODULE (l_manager->module));
 
@@ -247,11 +246,12 @@ handle_create_volume (UDisksManagerBTRFS    *manager,
       goto out;
     }
 
-  /* Trigger uevent on all block devices */
-  for (l = objects; l; l = g_list_next (l))
+  /* Trigger uevent on all block devices at once */
+  if (!udisks_daemon_util_trigger_uevents_sync (daemon, (const gchar * const *) devices->pdata,
+                                                UDISKS_DEFAULT_WAIT_TIMEOUT, &error))
     {
-      udisks_linux_block_object_trigger_uevent_sync (UDISKS_LINUX_BLOCK_OBJECT (l->data),
-                                                     UDISKS_DEFAULT_WAIT_TIMEOUT);
+      udisks_debug ("Error waiting for uevents after creating volume: %s", error->message);
+      g_clear_error (&error);
     }
 
   /* Complete DBus call. */
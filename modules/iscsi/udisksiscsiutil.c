@@ -157,19 +157,15 @@ iscsi_make_node (struct libiscsi_node *node,
 }
 
 static gint
-iscsi_perform_login_action (UDisksLinuxModuleISCSI     *module,
+iscsi_perform_login_action (struct libiscsi_context    *ctx,
                             libiscsi_login_action       action,
                             struct libiscsi_node       *node,
                             struct libiscsi_auth_info  *auth_info,
                             gchar                     **errorstr)
 {
-  struct libiscsi_context *ctx;
   gint err;
 
-  g_return_val_if_fail (UDISKS_IS_LINUX_MODULE_ISCSI (module), 1);
-
-  /* Get a libiscsi context. */
-  ctx = udisks_linux_module_iscsi_get_libiscsi_context (module);
+  g_return_val_if_fail (ctx, ISCSI_ERR_INVAL);
 
   if (action == ACTION_LOGIN &&
       auth_info && auth_info->method == libiscsi_auth_chap)
@@ -188,6 +184,20 @@ iscsi_perform_login_action (UDisksLinuxModuleISCSI     *module,
   return err;
 }
 
+static struct libiscsi_context *
+iscsi_acquire_context (UDisksLinuxModuleISCSI  *module,
+                       const gchar             *portal,
+                       gchar                  **errorstr)
+{
+  struct libiscsi_context *ctx;
+
+  ctx = udisks_linux_module_iscsi_acquire_libiscsi_context (module, portal);
+  if (ctx == NULL && errorstr)
+    *errorstr = g_strdup ("Failed to initialize libiscsi.");
+
+  return ctx;
+}
+
 static gint
 iscsi_node_set_parameters (struct libiscsi_context *ctx,
                            struct libiscsi_node    *node,
@@ -282,6 +292,7 @@ iscsi_login (UDisksLinuxModuleISCSI *module,
   const gchar *password = NULL;
   const gchar *reverse_username = NULL;
   const gchar *reverse_password = NULL;
+  gchar *portal;
   gint err;
 
   g_return_val_if_fail (UDISKS_IS_LINUX_MODULE_ISCSI (module), 1);
@@ -304,11 +315,17 @@ iscsi_login (UDisksLinuxModuleISCSI *module,
   /* Create iscsi node. */
   iscsi_make_node (&node, name, tpgt, address, port, iface);
 
-  /* Get iscsi context. */
-  ctx = udisks_linux_module_iscsi_get_libiscsi_context (module);
+  /* Get iscsi context, waiting if too many logins are in progress. */
+  portal = udisks_linux_module_iscsi_make_portal_key (address, port);
+  ctx = iscsi_acquire_context (module, portal, errorstr);
+  if (ctx == NULL)
+    {
+      err = ISCSI_ERR_NOMEM;
+      goto out;
+    }
 
   /* Login */
-  err = iscsi_perform_login_action (module,
+  err = iscsi_perform_login_action (ctx,
                                     ACTION_LOGIN,
                                     &node,
                                     &auth_info,
@@ -320,6 +337,10 @@ iscsi_login (UDisksLinuxModuleISCSI *module,
       err = iscsi_node_set_parameters (ctx, &node, params_without_chap);
     }
 
+  udisks_linux_module_iscsi_release_libiscsi_context (module, portal, ctx);
+
+ out:
+  g_free (portal);
   g_variant_unref (params_without_chap);
 
   return err;
@@ -337,6 +358,7 @@ iscsi_logout (UDisksLinuxModuleISCSI *module,
 {
   struct libiscsi_context *ctx;
   struct libiscsi_node node = {0,};
+  gchar *portal;
   gint err;
 
   g_return_val_if_fail (UDISKS_IS_LINUX_MODULE_ISCSI (module), 1);
@@ -345,10 +367,16 @@ iscsi_logout (UDisksLinuxModuleISCSI *module,
   iscsi_make_node (&node, name, tpgt, address, port, iface);
 
   /* Get iscsi context. */
-  ctx = udisks_linux_module_iscsi_get_libiscsi_context (module);
+  portal = udisks_linux_module_iscsi_make_portal_key (address, port);
+  ctx = iscsi_acquire_context (module, portal, errorstr);
+  if (ctx == NULL)
+    {
+      g_free (portal);
+      return ISCSI_ERR_NOMEM;
+    }
 
   /* Logout */
-  err = iscsi_perform_login_action (module,
+  err = iscsi_perform_login_action (ctx,
                                     ACTION_LOGOUT,
                                     &node,
                                     NULL,
@@ -361,9 +389,39 @@ iscsi_logout (UDisksLinuxModuleISCSI *module,
 
     }
 
+  udisks_linux_module_iscsi_release_libiscsi_context (module, portal, ctx);
+  g_free (portal);
+
   return err;
 }
 
+static gchar *
+iscsi_make_discovery_cache_key (const gchar *portal,
+                                const gchar *username,
+                                const gchar *password,
+                                const gchar *reverse_username,
+                                const gchar *reverse_password)
+{
+  gchar *credentials;
+  gchar *checksum;
+  gchar *ret;
+
+  /* Don't keep the passwords around in plain text. */
+  credentials = g_strjoin ("\n",
+                           username ? username : "",
+                           password ? password : "",
+                           reverse_username ? reverse_username : "",
+                           reverse_password ? reverse_password : "",
+                           NULL);
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, credentials, -1);
+  ret = g_strdup_printf ("%s/%s", portal, checksum);
+
+  g_free (checksum);
+  g_free (credentials);
+
+  return ret;
+}
+
 gint
 iscsi_discover_send_targets (UDisksLinuxModuleISCSI *module,
                              const gchar            *address,
@@ -375,23 +433,51 @@ iscsi_discover_send_targets (UDisksLinuxModuleISCSI *module,
 {
   struct libiscsi_context *ctx;
   struct libiscsi_auth_info auth_info = {0,};
-  struct libiscsi_node *found_nodes;
+  struct libiscsi_node *found_nodes = NULL;
   const gchar *username = NULL;
   const gchar *password = NULL;
   const gchar *reverse_username = NULL;
   const gchar *reverse_password = NULL;
+  gboolean no_cache = FALSE;
+  gchar *portal;
+  gchar *cache_key;
+  GVariant *cached_nodes;
   gint err;
 
   g_return_val_if_fail (UDISKS_IS_LINUX_MODULE_ISCSI (module), 1);
 
-  ctx = udisks_linux_module_iscsi_get_libiscsi_context (module);
-
   /* Optional data for CHAP authentication. */
   iscsi_params_get_chap_data (params,
                               &username,
                               &password,
                               &reverse_username,
                               &reverse_password);
+  g_variant_lookup (params, "no-cache", "b", &no_cache);
+
+  /* Results are cached per portal and credentials. */
+  portal = udisks_linux_module_iscsi_make_portal_key (address, port);
+  cache_key = iscsi_make_discovery_cache_key (portal,
+                                              username,
+                                              password,
+                                              reverse_username,
+                                              reverse_password);
+  if (!no_cache)
+    {
+      cached_nodes = udisks_linux_module_iscsi_lookup_discovery_cache (module, cache_key, nodes_cnt);
+      if (cached_nodes != NULL)
+        {
+          *nodes = cached_nodes;
+          err = 0;
+          goto out;
+        }
+    }
+
+  ctx = iscsi_acquire_context (module, portal, errorstr);
+  if (ctx == NULL)
+    {
+      err = ISCSI_ERR_NOMEM;
+      goto out;
+    }
 
   /* Prepare authentication data */
   iscsi_make_auth_info (&auth_info,
@@ -409,13 +495,24 @@ iscsi_discover_send_targets (UDisksLinuxModuleISCSI *module,
                                        &found_nodes);
 
   if (err == 0)
-      *nodes = iscsi_libiscsi_nodes_to_gvariant (found_nodes, *nodes_cnt);
+    {
+      *nodes = g_variant_ref_sink (iscsi_libiscsi_nodes_to_gvariant (found_nodes, *nodes_cnt));
+      udisks_linux_module_iscsi_update_discovery_cache (module, cache_key, *nodes, *nodes_cnt);
+    }
   else if (errorstr)
+    {
       *errorstr = g_strdup (libiscsi_get_error_string (ctx));
+    }
+
+  udisks_linux_module_iscsi_release_libiscsi_context (module, portal, ctx);
 
   /* Release the resources */
   iscsi_libiscsi_nodes_free (found_nodes);
 
+ out:
+  g_free (cache_key);
+  g_free (portal);
+
   return err;
 }
 
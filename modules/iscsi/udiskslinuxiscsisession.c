@@ -142,15 +142,9 @@ handle_logout_interface (UDisksISCSISession    *session,
   tpgt = udisks_iscsi_session_get_tpgt (session);
   port = udisks_iscsi_session_get_persistent_port (session);
 
-  /* Enter a critical section. */
-  udisks_linux_module_iscsi_lock_libiscsi_context (module);
-
   /* Logout */
   err = iscsi_logout (module, name, tpgt, address, port, arg_iface, arg_options, &errorstr);
 
-  /* Leave the critical section. */
-  udisks_linux_module_iscsi_unlock_libiscsi_context (module);
-
   if (err != 0)
     {
       /* Logout failed. */
@@ -19,6 +19,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include <libiscsi.h>
 #include <src/udisksdaemon.h>
 #include <src/udiskslogging.h>
@@ -283,21 +285,24 @@ udisks_linux_iscsi_session_object_make_object_path (const gchar *session_id)
 gchar *
 udisks_linux_iscsi_session_object_get_session_id_from_sysfs_path (const gchar *sysfs_path)
 {
-  GRegex *regex;
-  GMatchInfo *match_info;
-  GError *error = NULL;
-  gchar *rval = NULL;
+  const gchar *p;
 
-  /* Search for session ID */
-  regex = g_regex_new ("session[0-9]+", 0, 0, &error);
-  g_regex_match (regex, sysfs_path, 0, &match_info);
-  if (g_match_info_matches (match_info))
-    rval = g_match_info_fetch (match_info, 0);
+  if (sysfs_path == NULL)
+    return NULL;
 
-  g_match_info_free (match_info);
-  g_regex_unref (regex);
+  /* Search for session ID, i.e. the first "session[0-9]+" occurrence.  This
+   * is called for every block uevent so avoid compiling a regex here. */
+  for (p = strstr (sysfs_path, "session"); p != NULL; p = strstr (p + 1, "session"))
+    {
+      gsize len = strlen ("session");
 
-  return rval;
+      while (g_ascii_isdigit (p[len]))
+        len++;
+      if (len > strlen ("session"))
+        return g_strndup (p, len);
+    }
+
+  return NULL;
 }
 
 /**
@@ -327,21 +332,20 @@ udisks_linux_iscsi_session_object_update_iface (UDisksLinuxISCSISessionObject *s
 
   g_return_if_fail (UDISKS_IS_LINUX_ISCSI_SESSION_OBJECT (session_object));
 
-  ctx = udisks_linux_module_iscsi_get_libiscsi_context (session_object->module);
-
-  /* Enter a critical section. */
-  udisks_linux_module_iscsi_lock_libiscsi_context (session_object->module);
+  /* Get a context from the pool; session info is read locally, not from a portal. */
+  ctx = udisks_linux_module_iscsi_acquire_libiscsi_context (session_object->module, NULL);
+  if (ctx == NULL)
+    return;
 
   /* Get session info */
   if (libiscsi_get_session_info_by_id (ctx, &session_info, session_object->session_id) != 0)
     {
-      udisks_linux_module_iscsi_unlock_libiscsi_context (session_object->module);
+      udisks_linux_module_iscsi_release_libiscsi_context (session_object->module, NULL, ctx);
       udisks_critical ("Can not retrieve session information for %s", session_object->session_id);
       return;
     }
 
-  /* Leave the critical section. */
-  udisks_linux_module_iscsi_unlock_libiscsi_context (session_object->module);
+  udisks_linux_module_iscsi_release_libiscsi_context (session_object->module, NULL, ctx);
 
   /* Set properties */
   iface = UDISKS_ISCSI_SESSION (session_object->iface_iscsi_session);
@@ -408,10 +412,23 @@ udisks_linux_iscsi_session_object_housekeeping (UDisksModuleObject  *object,
   return TRUE;
 }
 
+static gchar **
+udisks_linux_iscsi_session_object_get_claim_keys (UDisksModuleObject *object)
+{
+  UDisksLinuxISCSISessionObject *session_object = UDISKS_LINUX_ISCSI_SESSION_OBJECT (object);
+  gchar **keys;
+
+  /* Claim keys are session IDs, see udisks_linux_module_iscsi_filter_uevent(). */
+  keys = g_new0 (gchar *, 2);
+  keys[0] = g_strdup (session_object->session_id);
+  return keys;
+}
+
 /* -------------------------------------------------------------------------- */
 
 void udisks_linux_iscsi_session_object_iface_init (UDisksModuleObjectIface *iface)
 {
   iface->process_uevent = udisks_linux_iscsi_session_object_process_uevent;
   iface->housekeeping = udisks_linux_iscsi_session_object_housekeeping;
+  iface->get_claim_keys = udisks_linux_iscsi_session_object_get_claim_keys;
 }
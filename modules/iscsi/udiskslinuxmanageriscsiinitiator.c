@@ -448,11 +448,16 @@ discover_firmware (UDisksManagerISCSIInitiator  *object,
   struct libiscsi_node *found_nodes;
   gint rval;
 
-  /* Enter a critical section. */
-  udisks_linux_module_iscsi_lock_libiscsi_context (manager->module);
+  /* Get a context from the pool. */
+  ctx = udisks_linux_module_iscsi_acquire_libiscsi_context (manager->module, NULL);
+  if (ctx == NULL)
+    {
+      if (errorstr)
+        *errorstr = g_strdup ("Failed to initialize libiscsi.");
+      return 1;
+    }
 
   /* Discovery */
-  ctx = udisks_linux_module_iscsi_get_libiscsi_context (manager->module);
   rval = libiscsi_discover_firmware (ctx, nodes_cnt, &found_nodes);
 
   if (rval == 0)
@@ -460,8 +465,7 @@ discover_firmware (UDisksManagerISCSIInitiator  *object,
   else if (errorstr)
     *errorstr = g_strdup (libiscsi_get_error_string (ctx));
 
-  /* Leave the critical section. */
-  udisks_linux_module_iscsi_unlock_libiscsi_context (manager->module);
+  udisks_linux_module_iscsi_release_libiscsi_context (manager->module, NULL, ctx);
 
   /* Release the resources */
   iscsi_libiscsi_nodes_free (found_nodes);
@@ -493,15 +497,9 @@ handle_discover_send_targets (UDisksManagerISCSIInitiator *object,
                                      N_("Authentication is required to discover targets"),
                                      invocation);
 
-  /* Enter a critical section. */
-  udisks_linux_module_iscsi_lock_libiscsi_context (manager->module);
-
   /* Perform the discovery. */
   err = iscsi_discover_send_targets (manager->module, arg_address, arg_port, arg_options, &nodes, &nodes_cnt, &errorstr);
 
-  /* Leave the critical section. */
-  udisks_linux_module_iscsi_unlock_libiscsi_context (manager->module);
-
   if (err != 0)
     {
       /* Discovery failed. */
@@ -517,6 +515,8 @@ handle_discover_send_targets (UDisksManagerISCSIInitiator *object,
   udisks_manager_iscsi_initiator_complete_discover_send_targets (object, invocation, nodes, nodes_cnt);
 
 out:
+  if (nodes != NULL)
+    g_variant_unref (nodes);
   g_free (errorstr);
 
   /* Indicate that we handled the method invocation. */
@@ -568,65 +568,49 @@ out:
   return TRUE;
 }
 
+/* Logs in to the node and waits for its objects to appear, may be called from any thread */
 static gboolean
-handle_login (UDisksManagerISCSIInitiator *object,
-              GDBusMethodInvocation       *invocation,
-              const gchar                 *arg_name,
-              gint                         arg_tpgt,
-              const gchar                 *arg_address,
-              gint                         arg_port,
-              const gchar                 *arg_iface,
-              GVariant                    *arg_options)
+login_and_wait (UDisksLinuxManagerISCSIInitiator  *manager,
+                const gchar                       *name,
+                gint                               tpgt,
+                const gchar                       *address,
+                gint                               port,
+                const gchar                       *iface,
+                GVariant                          *options,
+                GError                           **error)
 {
-  UDisksLinuxManagerISCSIInitiator *manager = UDISKS_LINUX_MANAGER_ISCSI_INITIATOR (object);
   UDisksDaemon *daemon;
-  gint err = 0;
-  gchar *errorstr = NULL;
-  GError *error = NULL;
   UDisksObject *iscsi_object = NULL;
   UDisksObject *iscsi_session_object = NULL;
+  gchar *errorstr = NULL;
+  gboolean ret = FALSE;
+  gint err;
 
   daemon = udisks_module_get_daemon (UDISKS_MODULE (manager->module));
 
-  /* Policy check. */
-  UDISKS_DAEMON_CHECK_AUTHORIZATION (daemon,
-                                     NULL,
-                                     ISCSI_MODULE_POLICY_ACTION_ID,
-                                     arg_options,
-                                     N_("Authentication is required to perform iSCSI login"),
-                                     invocation);
-
-  /* Enter a critical section. */
-  udisks_linux_module_iscsi_lock_libiscsi_context (manager->module);
-
   /* Login */
-  err = iscsi_login (manager->module, arg_name, arg_tpgt, arg_address, arg_port, arg_iface, arg_options, &errorstr);
-
-  /* Leave the critical section. */
-  udisks_linux_module_iscsi_unlock_libiscsi_context (manager->module);
-
+  err = iscsi_login (manager->module, name, tpgt, address, port, iface, options, &errorstr);
   if (err != 0)
     {
       /* Login failed. */
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             iscsi_error_to_udisks_error (err),
-                                             N_("Login failed: %s"),
-                                             errorstr);
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   iscsi_error_to_udisks_error (err),
+                   N_("Login failed: %s"),
+                   errorstr);
       goto out;
     }
 
   /* sit and wait until the device appears on dbus */
   iscsi_object = udisks_daemon_wait_for_object_sync (daemon,
                                                      wait_for_iscsi_object,
-                                                     g_strdup (arg_name),
+                                                     g_strdup (name),
                                                      g_free,
                                                      UDISKS_DEFAULT_WAIT_TIMEOUT,
-                                                     &error);
-   if (iscsi_object == NULL)
+                                                     error);
+  if (iscsi_object == NULL)
     {
-      g_prefix_error (&error, "Error waiting for iSCSI device to appear: ");
-      g_dbus_method_invocation_take_error (invocation, error);
+      g_prefix_error (error, "Error waiting for iSCSI device to appear: ");
       goto out;
     }
 
@@ -634,25 +618,194 @@ handle_login (UDisksManagerISCSIInitiator *object,
     {
       iscsi_session_object = udisks_daemon_wait_for_object_sync (daemon,
                                                                  wait_for_iscsi_session_object,
-                                                                 g_strdup (arg_name),
+                                                                 g_strdup (name),
                                                                  g_free,
                                                                  UDISKS_DEFAULT_WAIT_TIMEOUT,
-                                                                 &error);
+                                                                 error);
       if (iscsi_session_object == NULL)
         {
-          g_prefix_error (&error, "Error waiting for iSCSI session object to appear: ");
-          g_dbus_method_invocation_take_error (invocation, error);
+          g_prefix_error (error, "Error waiting for iSCSI session object to appear: ");
           goto out;
         }
     }
 
-  /* Complete DBus call. */
-  udisks_manager_iscsi_initiator_complete_login (object, invocation);
+  ret = TRUE;
 
 out:
   g_clear_object (&iscsi_object);
   g_clear_object (&iscsi_session_object);
   g_free (errorstr);
+  return ret;
+}
+
+static gboolean
+handle_login (UDisksManagerISCSIInitiator *object,
+              GDBusMethodInvocation       *invocation,
+              const gchar                 *arg_name,
+              gint                         arg_tpgt,
+              const gchar                 *arg_address,
+              gint                         arg_port,
+              const gchar                 *arg_iface,
+              GVariant                    *arg_options)
+{
+  UDisksLinuxManagerISCSIInitiator *manager = UDISKS_LINUX_MANAGER_ISCSI_INITIATOR (object);
+  UDisksDaemon *daemon;
+  GError *error = NULL;
+
+  daemon = udisks_module_get_daemon (UDISKS_MODULE (manager->module));
+
+  /* Policy check. */
+  UDISKS_DAEMON_CHECK_AUTHORIZATION (daemon,
+                                     NULL,
+                                     ISCSI_MODULE_POLICY_ACTION_ID,
+                                     arg_options,
+                                     N_("Authentication is required to perform iSCSI login"),
+                                     invocation);
+
+  if (!login_and_wait (manager, arg_name, arg_tpgt, arg_address, arg_port, arg_iface, arg_options, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  /* Complete DBus call. */
+  udisks_manager_iscsi_initiator_complete_login (object, invocation);
+
+out:
+  /* Indicate that we handled the method invocation. */
+  return TRUE;
+}
+
+typedef struct
+{
+  gchar  *name;
+  gint    tpgt;
+  gchar  *address;
+  gint    port;
+  gchar  *iface;
+  GError *error;
+} LoginManyTarget;
+
+typedef struct
+{
+  UDisksLinuxManagerISCSIInitiator *manager;
+  GVariant                         *options;
+} LoginManyData;
+
+static void
+login_many_target_free (LoginManyTarget *target)
+{
+  g_free (target->name);
+  g_free (target->address);
+  g_free (target->iface);
+  g_clear_error (&target->error);
+  g_free (target);
+}
+
+static void
+login_many_worker (gpointer data,
+                   gpointer user_data)
+{
+  LoginManyTarget *target = data;
+  LoginManyData *login_data = user_data;
+
+  login_and_wait (login_data->manager,
+                  target->name,
+                  target->tpgt,
+                  target->address,
+                  target->port,
+                  target->iface,
+                  login_data->options,
+                  &target->error);
+}
+
+static gboolean
+handle_login_many (UDisksManagerISCSIInitiator *object,
+                   GDBusMethodInvocation       *invocation,
+                   GVariant                    *arg_nodes,
+                   GVariant                    *arg_options)
+{
+  UDisksLinuxManagerISCSIInitiator *manager = UDISKS_LINUX_MANAGER_ISCSI_INITIATOR (object);
+  UDisksDaemon *daemon;
+  LoginManyData login_data;
+  GPtrArray *targets = NULL;
+  GThreadPool *pool;
+  GVariantBuilder builder;
+  GVariantIter iter;
+  LoginManyTarget *target;
+  GError *error = NULL;
+  guint n;
+
+  daemon = udisks_module_get_daemon (UDISKS_MODULE (manager->module));
+
+  /* Policy check. */
+  UDISKS_DAEMON_CHECK_AUTHORIZATION (daemon,
+                                     NULL,
+                                     ISCSI_MODULE_POLICY_ACTION_ID,
+                                     arg_options,
+                                     N_("Authentication is required to perform iSCSI login"),
+                                     invocation);
+
+  targets = g_ptr_array_new_with_free_func ((GDestroyNotify) login_many_target_free);
+  g_variant_iter_init (&iter, arg_nodes);
+  target = g_new0 (LoginManyTarget, 1);
+  while (g_variant_iter_next (&iter, "(sisis)",
+                              &target->name,
+                              &target->tpgt,
+                              &target->address,
+                              &target->port,
+                              &target->iface))
+    {
+      g_ptr_array_add (targets, target);
+      target = g_new0 (LoginManyTarget, 1);
+    }
+  g_free (target);
+
+  /* The module limits the number of logins in flight, overall and per
+   * portal, so the pool only needs enough threads to reach that limit. */
+  login_data.manager = manager;
+  login_data.options = arg_options;
+  if (targets->len > 0)
+    {
+      pool = g_thread_pool_new (login_many_worker,
+                                &login_data,
+                                MIN (targets->len, udisks_linux_module_iscsi_get_max_concurrent_logins (manager->module)),
+                                FALSE,
+                                &error);
+      if (pool == NULL)
+        {
+          g_dbus_method_invocation_take_error (invocation, error);
+          goto out;
+        }
+      for (n = 0; n < targets->len; n++)
+        g_thread_pool_push (pool, targets->pdata[n], NULL);
+
+      /* wait for all logins to finish */
+      g_thread_pool_free (pool, FALSE, TRUE);
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sisisbs)"));
+  for (n = 0; n < targets->len; n++)
+    {
+      target = targets->pdata[n];
+      if (target->error != NULL)
+        udisks_warning ("iSCSI: Login to %s at %s:%d failed: %s",
+                        target->name, target->address, target->port, target->error->message);
+      g_variant_builder_add (&builder, "(sisisbs)",
+                             target->name,
+                             target->tpgt,
+                             target->address,
+                             target->port,
+                             target->iface,
+                             target->error == NULL,
+                             target->error != NULL ? target->error->message : "");
+    }
+
+  /* Complete DBus call. */
+  udisks_manager_iscsi_initiator_complete_login_many (object, invocation, g_variant_builder_end (&builder));
+
+out:
+  g_clear_pointer (&targets, g_ptr_array_unref);
 
   /* Indicate that we handled the method invocation. */
   return TRUE;
@@ -684,15 +837,9 @@ handle_logout(UDisksManagerISCSIInitiator *object,
                                      N_("Authentication is required to perform iSCSI logout"),
                                      invocation);
 
-  /* Enter a critical section. */
-  udisks_linux_module_iscsi_lock_libiscsi_context (manager->module);
-
   /* Logout */
   err = iscsi_logout (manager->module, arg_name, arg_tpgt, arg_address, arg_port, arg_iface, arg_options, &errorstr);
 
-  /* Leave the critical section. */
-  udisks_linux_module_iscsi_unlock_libiscsi_context (manager->module);
-
   if (err != 0)
     {
       /* Logout failed. */
@@ -754,5 +901,6 @@ udisks_linux_manager_iscsi_initiator_iface_init (UDisksManagerISCSIInitiatorIfac
   iface->handle_discover_send_targets = handle_discover_send_targets;
   iface->handle_discover_firmware = handle_discover_firmware;
   iface->handle_login = handle_login;
+  iface->handle_login_many = handle_login_many;
   iface->handle_logout = handle_logout;
 }
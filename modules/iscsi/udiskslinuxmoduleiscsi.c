@@ -23,6 +23,7 @@
 #include <libiscsi.h>
 
 #include <src/udisksdaemon.h>
+#include <src/udisksconfigmanager.h>
 #include <src/udiskslogging.h>
 #include <src/udiskslinuxdevice.h>
 #include <src/udisksmodulemanager.h>
@@ -43,8 +44,41 @@
  * @short_description: iSCSI module.
  *
  * The iSCSI module.
+ *
+ * libiscsi calls are not thread-safe for a single context, so the
+ * module keeps a pool of contexts, each used by one thread at a time.
+ * The number of contexts in use is limited both globally and per
+ * portal, so that logins to different targets can proceed in parallel
+ * without overloading a single portal. The limits and the lifetime of
+ * cached SendTargets discovery results can be set in the
+ * <filename>modules.conf.d/udisks2_iscsi.conf</filename> file in the
+ * udisks2 configuration directory:
+ * <programlisting>
+ * [iSCSI]
+ * max_concurrent_logins=16
+ * max_logins_per_portal=4
+ * discovery_cache_ttl=60
+ * </programlisting>
  */
 
+#define ISCSI_CONF_PATH "modules.conf.d"
+#define ISCSI_CONF_FILE "udisks2_iscsi.conf"
+#define ISCSI_CONF_GROUP_NAME "iSCSI"
+#define ISCSI_CONF_MAX_CONCURRENT_LOGINS_KEY "max_concurrent_logins"
+#define ISCSI_CONF_MAX_LOGINS_PER_PORTAL_KEY "max_logins_per_portal"
+#define ISCSI_CONF_DISCOVERY_CACHE_TTL_KEY "discovery_cache_ttl"
+
+#define ISCSI_DEFAULT_MAX_CONCURRENT_LOGINS 16
+#define ISCSI_DEFAULT_MAX_LOGINS_PER_PORTAL 4
+#define ISCSI_DEFAULT_DISCOVERY_CACHE_TTL   60
+
+typedef struct
+{
+  GVariant *nodes;
+  gint      nodes_cnt;
+  gint64    expires;
+} DiscoveryCacheEntry;
+
 /**
  * UDisksLinuxModuleISCSI:
  *
@@ -54,8 +88,18 @@
 struct _UDisksLinuxModuleISCSI {
   UDisksModule parent_instance;
 
-  GMutex libiscsi_mutex;
-  struct libiscsi_context *iscsi_ctx;
+  /* libiscsi context pool, protected by pool_mutex */
+  GMutex pool_mutex;
+  GCond pool_cond;
+  GQueue idle_contexts;
+  guint n_busy_contexts;
+  GHashTable *busy_portals;   /* portal -> number of contexts in use */
+  guint max_concurrent_logins;
+  guint max_logins_per_portal;
+
+  GMutex discovery_cache_mutex;
+  GHashTable *discovery_cache;  /* key -> DiscoveryCacheEntry */
+  guint discovery_cache_ttl;
 };
 
 typedef struct _UDisksLinuxModuleISCSIClass UDisksLinuxModuleISCSIClass;
@@ -66,6 +110,13 @@ struct _UDisksLinuxModuleISCSIClass {
 
 static void initable_iface_init (GInitableIface *initable_iface);
 
+static void
+discovery_cache_entry_free (DiscoveryCacheEntry *entry)
+{
+  g_variant_unref (entry->nodes);
+  g_free (entry);
+}
+
 G_DEFINE_TYPE_WITH_CODE (UDisksLinuxModuleISCSI, udisks_linux_module_iscsi, UDISKS_TYPE_MODULE,
                          G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE, initable_iface_init));
 
@@ -75,7 +126,17 @@ udisks_linux_module_iscsi_init (UDisksLinuxModuleISCSI *module)
 {
   g_return_if_fail (UDISKS_IS_LINUX_MODULE_ISCSI (module));
 
-  g_mutex_init (&module->libiscsi_mutex);
+  g_mutex_init (&module->pool_mutex);
+  g_cond_init (&module->pool_cond);
+  g_queue_init (&module->idle_contexts);
+  module->busy_portals = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  module->max_concurrent_logins = ISCSI_DEFAULT_MAX_CONCURRENT_LOGINS;
+  module->max_logins_per_portal = ISCSI_DEFAULT_MAX_LOGINS_PER_PORTAL;
+
+  g_mutex_init (&module->discovery_cache_mutex);
+  module->discovery_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                                   (GDestroyNotify) discovery_cache_entry_free);
+  module->discovery_cache_ttl = ISCSI_DEFAULT_DISCOVERY_CACHE_TTL;
 }
 
 static void
@@ -89,9 +150,16 @@ static void
 udisks_linux_module_iscsi_finalize (GObject *object)
 {
   UDisksLinuxModuleISCSI *module = UDISKS_LINUX_MODULE_ISCSI (object);
+  struct libiscsi_context *ctx;
 
-  if (module->iscsi_ctx)
-    libiscsi_cleanup (module->iscsi_ctx);
+  while ((ctx = g_queue_pop_head (&module->idle_contexts)) != NULL)
+    libiscsi_cleanup (ctx);
+  g_hash_table_unref (module->busy_portals);
+  g_cond_clear (&module->pool_cond);
+  g_mutex_clear (&module->pool_mutex);
+
+  g_hash_table_unref (module->discovery_cache);
+  g_mutex_clear (&module->discovery_cache_mutex);
 
   if (G_OBJECT_CLASS (udisks_linux_module_iscsi_parent_class)->finalize)
     G_OBJECT_CLASS (udisks_linux_module_iscsi_parent_class)->finalize (object);
@@ -140,20 +208,86 @@ udisks_module_iscsi_new (UDisksDaemon  *daemon,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static void
+read_uint (GKeyFile    *key_file,
+           const gchar *key,
+           guint       *out_value)
+{
+  GError *error = NULL;
+  gint value;
+
+  if (!g_key_file_has_key (key_file, ISCSI_CONF_GROUP_NAME, key, NULL))
+    return;
+
+  value = g_key_file_get_integer (key_file, ISCSI_CONF_GROUP_NAME, key, &error);
+  if (error != NULL || value < 0)
+    {
+      udisks_warning ("iSCSI: Invalid value used for '%s': %s; defaulting to %u",
+                      key, error != NULL ? error->message : "negative number", *out_value);
+      g_clear_error (&error);
+      return;
+    }
+  *out_value = value;
+}
+
+static void
+load_module_conf (UDisksLinuxModuleISCSI *module)
+{
+  UDisksConfigManager *config_manager;
+  GKeyFile *key_file;
+  GError *error = NULL;
+  gchar *conf_path;
+
+  config_manager = udisks_daemon_get_config_manager (udisks_module_get_daemon (UDISKS_MODULE (module)));
+
+  /* This should give us '/etc/udisks2/modules.conf.d/udisks2_iscsi.conf' */
+  conf_path = g_build_filename (udisks_config_manager_get_config_dir (config_manager),
+                                ISCSI_CONF_PATH,
+                                ISCSI_CONF_FILE,
+                                NULL);
+
+  key_file = g_key_file_new ();
+  if (g_key_file_load_from_file (key_file, conf_path, G_KEY_FILE_NONE, &error))
+    {
+      read_uint (key_file, ISCSI_CONF_MAX_CONCURRENT_LOGINS_KEY, &module->max_concurrent_logins);
+      read_uint (key_file, ISCSI_CONF_MAX_LOGINS_PER_PORTAL_KEY, &module->max_logins_per_portal);
+      read_uint (key_file, ISCSI_CONF_DISCOVERY_CACHE_TTL_KEY, &module->discovery_cache_ttl);
+    }
+  else if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+    {
+      /* ignore the error and continue with defaults */
+      udisks_warning ("iSCSI: Failed to load config file %s, continuing with defaults: %s",
+                      conf_path, error->message);
+    }
+  g_clear_error (&error);
+
+  /* zero would block all logins */
+  module->max_concurrent_logins = MAX (module->max_concurrent_logins, 1);
+  module->max_logins_per_portal = MAX (module->max_logins_per_portal, 1);
+
+  g_key_file_free (key_file);
+  g_free (conf_path);
+}
+
 static gboolean
 initable_init (GInitable     *initable,
                GCancellable  *cancellable,
                GError       **error)
 {
   UDisksLinuxModuleISCSI *module = UDISKS_LINUX_MODULE_ISCSI (initable);
+  struct libiscsi_context *ctx;
 
-  module->iscsi_ctx = libiscsi_init ();
-  if (! module->iscsi_ctx)
+  load_module_conf (module);
+
+  /* Make sure libiscsi works at all, the context is the first one in the pool. */
+  ctx = libiscsi_init ();
+  if (! ctx)
     {
       g_set_error_literal (error, UDISKS_ERROR, UDISKS_ERROR_ISCSI_DAEMON_TRANSPORT_FAILED,
                            "Failed to initialize libiscsi.");
       return FALSE;
     }
+  g_queue_push_head (&module->idle_contexts, ctx);
 
   return TRUE;
 }
@@ -166,25 +300,191 @@ initable_iface_init (GInitableIface *initable_iface)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-void
-udisks_linux_module_iscsi_lock_libiscsi_context (UDisksLinuxModuleISCSI *module)
+/**
+ * udisks_linux_module_iscsi_acquire_libiscsi_context:
+ * @module: A #UDisksLinuxModuleISCSI.
+ * @portal: (allow-none): The portal the context will be used for, as returned by udisks_linux_module_iscsi_make_portal_key(), or %NULL.
+ *
+ * Gets a libiscsi context for exclusive use by the calling thread,
+ * blocking while the maximum number of contexts are in use overall or
+ * for @portal. Operations not connecting to any portal should pass
+ * %NULL for @portal.
+ *
+ * Returns: A libiscsi context or %NULL if libiscsi could not be
+ *   initialized. Return it with
+ *   udisks_linux_module_iscsi_release_libiscsi_context().
+ */
+struct libiscsi_context *
+udisks_linux_module_iscsi_acquire_libiscsi_context (UDisksLinuxModuleISCSI *module,
+                                                    const gchar            *portal)
 {
-  g_return_if_fail (UDISKS_IS_LINUX_MODULE_ISCSI (module));
-  g_mutex_lock (&module->libiscsi_mutex);
+  struct libiscsi_context *ctx;
+
+  g_return_val_if_fail (UDISKS_IS_LINUX_MODULE_ISCSI (module), NULL);
+
+  g_mutex_lock (&module->pool_mutex);
+  while (module->n_busy_contexts >= module->max_concurrent_logins ||
+         (portal != NULL &&
+          GPOINTER_TO_UINT (g_hash_table_lookup (module->busy_portals, portal)) >= module->max_logins_per_portal))
+    g_cond_wait (&module->pool_cond, &module->pool_mutex);
+
+  module->n_busy_contexts++;
+  if (portal != NULL)
+    g_hash_table_insert (module->busy_portals,
+                         g_strdup (portal),
+                         GUINT_TO_POINTER (GPOINTER_TO_UINT (g_hash_table_lookup (module->busy_portals, portal)) + 1));
+  ctx = g_queue_pop_head (&module->idle_contexts);
+  g_mutex_unlock (&module->pool_mutex);
+
+  if (ctx == NULL)
+    {
+      ctx = libiscsi_init ();
+      if (ctx == NULL)
+        {
+          udisks_warning ("iSCSI: Failed to initialize libiscsi");
+          udisks_linux_module_iscsi_release_libiscsi_context (module, portal, NULL);
+        }
+    }
+
+  return ctx;
 }
 
+/**
+ * udisks_linux_module_iscsi_release_libiscsi_context:
+ * @module: A #UDisksLinuxModuleISCSI.
+ * @portal: (allow-none): The portal passed to udisks_linux_module_iscsi_acquire_libiscsi_context().
+ * @ctx: (allow-none): The context returned by udisks_linux_module_iscsi_acquire_libiscsi_context().
+ *
+ * Returns @ctx to the pool, waking up threads waiting for a context.
+ */
 void
-udisks_linux_module_iscsi_unlock_libiscsi_context (UDisksLinuxModuleISCSI *module)
+udisks_linux_module_iscsi_release_libiscsi_context (UDisksLinuxModuleISCSI  *module,
+                                                    const gchar             *portal,
+                                                    struct libiscsi_context *ctx)
 {
+  guint portal_busy;
+
   g_return_if_fail (UDISKS_IS_LINUX_MODULE_ISCSI (module));
-  g_mutex_unlock (&module->libiscsi_mutex);
+
+  g_mutex_lock (&module->pool_mutex);
+  if (ctx != NULL)
+    g_queue_push_head (&module->idle_contexts, ctx);
+
+  g_warn_if_fail (module->n_busy_contexts > 0);
+  module->n_busy_contexts--;
+  if (portal != NULL)
+    {
+      portal_busy = GPOINTER_TO_UINT (g_hash_table_lookup (module->busy_portals, portal));
+      if (portal_busy > 1)
+        g_hash_table_insert (module->busy_portals, g_strdup (portal), GUINT_TO_POINTER (portal_busy - 1));
+      else
+        g_hash_table_remove (module->busy_portals, portal);
+    }
+  g_cond_broadcast (&module->pool_cond);
+  g_mutex_unlock (&module->pool_mutex);
 }
 
-struct libiscsi_context *
-udisks_linux_module_iscsi_get_libiscsi_context (UDisksLinuxModuleISCSI *module)
+/**
+ * udisks_linux_module_iscsi_make_portal_key:
+ * @address: Portal hostname or IP-address.
+ * @port: Portal port number.
+ *
+ * Returns: (transfer full): A string identifying the portal. Free with g_free().
+ */
+gchar *
+udisks_linux_module_iscsi_make_portal_key (const gchar *address,
+                                           gint         port)
+{
+  return g_strdup_printf ("%s:%d", address, port);
+}
+
+/**
+ * udisks_linux_module_iscsi_get_max_concurrent_logins:
+ * @module: A #UDisksLinuxModuleISCSI.
+ *
+ * Returns: The maximum number of libiscsi contexts used at the same time.
+ */
+guint
+udisks_linux_module_iscsi_get_max_concurrent_logins (UDisksLinuxModuleISCSI *module)
 {
+  g_return_val_if_fail (UDISKS_IS_LINUX_MODULE_ISCSI (module), 1);
+  return module->max_concurrent_logins;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_linux_module_iscsi_lookup_discovery_cache:
+ * @module: A #UDisksLinuxModuleISCSI.
+ * @key: The discovery cache key.
+ * @out_nodes_cnt: Return location for the number of nodes.
+ *
+ * Looks up discovery results stored with
+ * udisks_linux_module_iscsi_update_discovery_cache() that have not
+ * expired yet.
+ *
+ * Returns: (transfer full): The discovered nodes or %NULL. Free with g_variant_unref().
+ */
+GVariant *
+udisks_linux_module_iscsi_lookup_discovery_cache (UDisksLinuxModuleISCSI *module,
+                                                  const gchar            *key,
+                                                  gint                   *out_nodes_cnt)
+{
+  DiscoveryCacheEntry *entry;
+  GVariant *ret = NULL;
+
   g_return_val_if_fail (UDISKS_IS_LINUX_MODULE_ISCSI (module), NULL);
-  return module->iscsi_ctx;
+
+  g_mutex_lock (&module->discovery_cache_mutex);
+  entry = g_hash_table_lookup (module->discovery_cache, key);
+  if (entry != NULL)
+    {
+      if (entry->expires > g_get_monotonic_time ())
+        {
+          ret = g_variant_ref (entry->nodes);
+          *out_nodes_cnt = entry->nodes_cnt;
+        }
+      else
+        {
+          g_hash_table_remove (module->discovery_cache, key);
+        }
+    }
+  g_mutex_unlock (&module->discovery_cache_mutex);
+
+  return ret;
+}
+
+/**
+ * udisks_linux_module_iscsi_update_discovery_cache:
+ * @module: A #UDisksLinuxModuleISCSI.
+ * @key: The discovery cache key.
+ * @nodes: The discovered nodes.
+ * @nodes_cnt: The number of nodes.
+ *
+ * Stores discovery results for the configured time to live. Does
+ * nothing if the cache is disabled.
+ */
+void
+udisks_linux_module_iscsi_update_discovery_cache (UDisksLinuxModuleISCSI *module,
+                                                  const gchar            *key,
+                                                  GVariant               *nodes,
+                                                  gint                    nodes_cnt)
+{
+  DiscoveryCacheEntry *entry;
+
+  g_return_if_fail (UDISKS_IS_LINUX_MODULE_ISCSI (module));
+
+  if (module->discovery_cache_ttl == 0)
+    return;
+
+  entry = g_new0 (DiscoveryCacheEntry, 1);
+  entry->nodes = g_variant_ref_sink (nodes);
+  entry->nodes_cnt = nodes_cnt;
+  entry->expires = g_get_monotonic_time () + (gint64) module->discovery_cache_ttl * G_USEC_PER_SEC;
+
+  g_mutex_lock (&module->discovery_cache_mutex);
+  g_hash_table_replace (module->discovery_cache, g_strdup (key), entry);
+  g_mutex_unlock (&module->discovery_cache_mutex);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -253,6 +553,25 @@ udisks_linux_module_iscsi_new_object (UDisksModule      *module,
   return NULL;
 }
 
+static gboolean
+udisks_linux_module_iscsi_filter_uevent (UDisksModule       *module,
+                                         const gchar        *action,
+                                         UDisksLinuxDevice  *device,
+                                         gchar             **out_claim_key)
+{
+#ifdef HAVE_LIBISCSI_GET_SESSION_INFOS
+  const gchar *sysfs_path;
+
+  /* Only devices within an iSCSI session are of interest, keyed by the session ID. */
+  sysfs_path = g_udev_device_get_sysfs_path (device->udev_device);
+  *out_claim_key = udisks_linux_iscsi_session_object_get_session_id_from_sysfs_path (sysfs_path);
+  return *out_claim_key != NULL;
+#else
+  *out_claim_key = NULL;
+  return FALSE;
+#endif /* HAVE_LIBISCSI_GET_SESSION_INFOS */
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static void
@@ -268,4 +587,5 @@ udisks_linux_module_iscsi_class_init (UDisksLinuxModuleISCSIClass *klass)
   module_class = UDISKS_MODULE_CLASS (klass);
   module_class->new_manager = udisks_linux_module_iscsi_new_manager;
   module_class->new_object = udisks_linux_module_iscsi_new_object;
+  module_class->filter_uevent = udisks_linux_module_iscsi_filter_uevent;
 }
@@ -42,9 +42,22 @@ UDisksModule            *udisks_module_iscsi_new              (UDisksDaemon  *da
                                                                GCancellable  *cancellable,
                                                                GError       **error);
 
-struct libiscsi_context *udisks_linux_module_iscsi_get_libiscsi_context    (UDisksLinuxModuleISCSI *module);
-void                     udisks_linux_module_iscsi_lock_libiscsi_context   (UDisksLinuxModuleISCSI *module);
-void                     udisks_linux_module_iscsi_unlock_libiscsi_context (UDisksLinuxModuleISCSI *module);
+struct libiscsi_context *udisks_linux_module_iscsi_acquire_libiscsi_context  (UDisksLinuxModuleISCSI  *module,
+                                                                              const gchar             *portal);
+void                     udisks_linux_module_iscsi_release_libiscsi_context  (UDisksLinuxModuleISCSI  *module,
+                                                                              const gchar             *portal,
+                                                                              struct libiscsi_context *ctx);
+gchar                   *udisks_linux_module_iscsi_make_portal_key           (const gchar             *address,
+                                                                              gint                     port);
+guint                    udisks_linux_module_iscsi_get_max_concurrent_logins (UDisksLinuxModuleISCSI  *module);
+
+GVariant                *udisks_linux_module_iscsi_lookup_discovery_cache    (UDisksLinuxModuleISCSI  *module,
+                                                                              const gchar             *key,
+                                                                              gint                    *out_nodes_cnt);
+void                     udisks_linux_module_iscsi_update_discovery_cache    (UDisksLinuxModuleISCSI  *module,
+                                                                              const gchar             *key,
+                                                                              GVariant                *nodes,
+                                                                              gint                     nodes_cnt);
 
 G_END_DECLS
 
@@ -356,7 +356,9 @@ fi
 %{_datadir}/polkit-1/actions/org.freedesktop.UDisks2.lvm2.policy
 
 %files -n %{name}-iscsi
+%dir %{_sysconfdir}/udisks2/modules.conf.d
 %{_libdir}/udisks2/modules/libudisks2_iscsi.so
+%config(noreplace) %{_sysconfdir}/udisks2/modules.conf.d/udisks2_iscsi.conf
 %{_datadir}/polkit-1/actions/org.freedesktop.UDisks2.iscsi.policy
 
 %files -n lib%{name}-devel
@@ -29,6 +29,7 @@
 #include "udiskslogging.h"
 #include "udisksdaemontypes.h"
 #include "udisksdaemon.h"
+#include "udisksconfigmanager.h"
 
 /* ---------------------------------------------------------------------------------------------------- */
 
@@ -100,6 +101,15 @@ on_sigint (gpointer user_data)
   return G_SOURCE_CONTINUE; /* We will manually remove the source using g_source_remove */
 }
 
+static gboolean
+on_sighup (gpointer user_data)
+{
+  udisks_info ("Caught SIGHUP. Reloading the job limits");
+  if (the_daemon != NULL)
+    udisks_config_manager_reload_job_limits (udisks_daemon_get_config_manager (the_daemon));
+  return G_SOURCE_CONTINUE; /* We will manually remove the source using g_source_remove */
+}
+
 int
 main (int    argc,
       char **argv)
@@ -109,12 +119,14 @@ main (int    argc,
   gint ret;
   guint name_owner_id;
   guint sigint_id;
+  guint sighup_id;
 
   ret = 1;
   loop = NULL;
   opt_context = NULL;
   name_owner_id = 0;
   sigint_id = 0;
+  sighup_id = 0;
 
   /* avoid gvfs (http://bugzilla.gnome.org/show_bug.cgi?id=526454) */
   if (!g_setenv ("GIO_USE_VFS", "local", TRUE))
@@ -166,6 +178,12 @@ main (int    argc,
                                           NULL); /* GDestroyNotify */
     }
 
+  sighup_id = g_unix_signal_add_full (G_PRIORITY_DEFAULT,
+                                      SIGHUP,
+                                      on_sighup,
+                                      NULL,  /* user_data */
+                                      NULL); /* GDestroyNotify */
+
   enable_tcrypt = g_file_test ("/etc/udisks2/tcrypt.conf", G_FILE_TEST_IS_REGULAR);
 
   name_owner_id = g_bus_own_name (G_BUS_TYPE_SYSTEM,
@@ -188,6 +206,8 @@ main (int    argc,
  out:
   if (sigint_id > 0)
     g_source_remove (sigint_id);
+  if (sighup_id > 0)
+    g_source_remove (sighup_id);
   if (the_daemon != NULL)
     g_object_unref (the_daemon);
   if (name_owner_id != 0)
@@ -124,6 +124,47 @@ class UdisksISCSITest(udiskstestcase.UdisksTestCase):
         objects = udisks.GetManagedObjects(dbus_interface='org.freedesktop.DBus.ObjectManager')
         self.assertNotIn(dbus_path, objects.keys())
 
+    def test_login_many(self):
+        manager = self.get_object('/Manager')
+        nodes, _ = manager.DiscoverSendTargets(self.address, self.port, self.no_options,
+                                               dbus_interface=self.iface_prefix + '.Manager.ISCSI.Initiator',
+                                               timeout=self.iscsi_timeout)
+
+        node = next((node for node in nodes if node[0] == self.noauth_iqn), None)
+        self.assertIsNotNone(node)
+
+        # a second discovery is answered from the cache
+        cached_nodes, _ = manager.DiscoverSendTargets(self.address, self.port, self.no_options,
+                                                      dbus_interface=self.iface_prefix + '.Manager.ISCSI.Initiator',
+                                                      timeout=self.iscsi_timeout)
+        self.assertEqual(sorted(nodes), sorted(cached_nodes))
+
+        (iqn, tpg, host, port, iface) = node
+        bad_node = ('iqn.2003-01.udisks.test:iscsi-test-nonexistent', tpg, host, port, iface)
+
+        self.addCleanup(self._force_lougout, self.noauth_iqn)
+        results = manager.LoginMany([node, bad_node], self.no_options,
+                                    dbus_interface=self.iface_prefix + '.Manager.ISCSI.Initiator',
+                                    timeout=self.iscsi_timeout)
+        self.assertEqual(len(results), 2)
+
+        good = next(r for r in results if r[0] == iqn)
+        self.assertTrue(good[5])
+        self.assertEqual(good[6], '')
+        bad = next(r for r in results if r[0] == bad_node[0])
+        self.assertFalse(bad[5])
+        self.assertNotEqual(bad[6], '')
+
+        devs = glob.glob('/dev/disk/by-path/*%s*' % iqn)
+        self.assertEqual(len(devs), 1)
+
+        manager.Logout(iqn, tpg, host, port, iface, self.no_options,
+                       dbus_interface=self.iface_prefix + '.Manager.ISCSI.Initiator',
+                       timeout=self.iscsi_timeout)
+
+        devs = glob.glob('/dev/disk/by-path/*%s*' % iqn)
+        self.assertEqual(len(devs), 0)
+
     def test_login_chap_auth(self):
         self._set_initiator_name()  # set initiator name to the one set in targetcli config
 
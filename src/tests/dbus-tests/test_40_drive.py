@@ -81,6 +81,51 @@ class UdisksDriveTest(udiskstestcase.UdisksTestCase):
         conf_value.assertIsNotNone()
         self.assertEqual(int(conf_value.value['ata-pm-standby']), 286)
 
+    def test_35_setqueueconfiguration(self):
+        ''' Test of Drive.SetQueueConfiguration method '''
+        dev = os.path.basename(self.cd_dev)
+        self.addCleanup(self.cd_drive.SetConfiguration, dbus.Dictionary(signature='sv'), self.no_options)
+
+        # other settings are kept
+        self.cd_drive.SetConfiguration({'ata-pm-standby': 286}, self.no_options)
+
+        conf = dbus.Dictionary(signature='sv')
+        conf['queue-read-ahead-kb'] = dbus.UInt32(64)
+        conf['queue-rq-affinity'] = dbus.UInt32(2)
+        self.cd_drive.SetQueueConfiguration(conf, self.no_options)
+
+        conf_value = self.get_property(self.cd_drive, '.Drive', 'Configuration')
+        conf_value.assertIsNotNone()
+        conf_value.assertEqual(64, getter=lambda c: int(c.get('queue-read-ahead-kb', 0)))
+        self.assertEqual(int(conf_value.value['queue-rq-affinity']), 2)
+        self.assertEqual(int(conf_value.value['ata-pm-standby']), 286)
+
+        # the settings are applied to the block device
+        for _ in range(20):
+            if self.read_file('/sys/block/%s/queue/read_ahead_kb' % dev).strip() == '64':
+                break
+            time.sleep(0.5)
+        self.assertEqual(self.read_file('/sys/block/%s/queue/read_ahead_kb' % dev).strip(), '64')
+        self.assertEqual(self.read_file('/sys/block/%s/queue/rq_affinity' % dev).strip(), '2')
+
+        # unknown key
+        with self.assertRaises(dbus.exceptions.DBusException):
+            self.cd_drive.SetQueueConfiguration({'queue-foo': dbus.UInt32(1)}, self.no_options)
+
+        # wrong type
+        with self.assertRaises(dbus.exceptions.DBusException):
+            self.cd_drive.SetQueueConfiguration({'queue-read-ahead-kb': 'many'}, self.no_options)
+
+        # scheduler not available for the drive
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, 'is not available'):
+            self.cd_drive.SetQueueConfiguration({'queue-scheduler': 'no-such-scheduler'}, self.no_options)
+
+        # invalid values
+        with self.assertRaises(dbus.exceptions.DBusException):
+            self.cd_drive.SetQueueConfiguration({'queue-rq-affinity': dbus.UInt32(3)}, self.no_options)
+        with self.assertRaises(dbus.exceptions.DBusException):
+            self.cd_drive.SetQueueConfiguration({'queue-write-cache': 'write sometimes'}, self.no_options)
+
     def test_40_properties(self):
         ''' Test of Drive properties values '''
 
@@ -2,10 +2,19 @@ import copy
 import dbus
 import glob
 import fcntl
+import hashlib
 import os
+import six
+import tempfile
+import threading
 import time
 import unittest
 
+import gi
+gi.require_version('GLib', '2.0')
+from gi.repository import GLib
+
+import safe_dbus
 import udiskstestcase
 
 
@@ -75,6 +84,250 @@ class UdisksBlockTest(udiskstestcase.UdisksTestCase):
         _ret, sys_fstype = self.run_command('lsblk -d -no FSTYPE %s' % self.vdevs[0])
         self.assertEqual(sys_fstype, '')
 
+    def test_format_many(self):
+        disks = [self.get_object('/block_devices/' + os.path.basename(dev)) for dev in self.vdevs[:2]]
+        manager = self.get_interface(self.get_object('/Manager'), '.Manager')
+
+        devices = [(disks[0].object_path, 'xfs', dbus.Dictionary(signature='sv')),
+                   (disks[1].object_path, 'ext4', dbus.Dictionary({'label': 'many'}, signature='sv'))]
+        results = manager.FormatMany(devices, self.no_options)
+        self.assertEqual(len(results), 2)
+        for (path, success, message), disk in zip(results, disks):
+            self.assertEqual(path, disk.object_path)
+            self.assertTrue(success, message)
+            self.assertEqual(message, '')
+
+        self.get_property(disks[0], '.Block', 'IdType').assertEqual('xfs')
+        self.get_property(disks[1], '.Block', 'IdType').assertEqual('ext4')
+        self.get_property(disks[1], '.Block', 'IdLabel').assertEqual('many')
+
+        _ret, sys_fstype = self.run_command('lsblk -d -no FSTYPE %s' % self.vdevs[1])
+        self.assertEqual(sys_fstype, 'ext4')
+
+        # a device failing doesn't fail the whole call
+        devices = [(disks[0].object_path, 'empty', dbus.Dictionary(signature='sv')),
+                   (disks[1].object_path, 'nilfs3', dbus.Dictionary(signature='sv'))]
+        results = manager.FormatMany(devices, self.no_options)
+        self.assertTrue(results[0][1])
+        self.assertFalse(results[1][1])
+        self.assertIn('nilfs3', results[1][2])
+        self.get_property(disks[0], '.Block', 'IdType').assertEqual('')
+
+        # the same device twice
+        devices = [(disks[0].object_path, 'xfs', dbus.Dictionary(signature='sv')),
+                   (disks[0].object_path, 'ext4', dbus.Dictionary(signature='sv'))]
+        with self.assertRaises(dbus.exceptions.DBusException):
+            manager.FormatMany(devices, self.no_options)
+
+        # a disk and its partition
+        disks[0].Format('dos', self.no_options, dbus_interface=self.iface_prefix + '.Block')
+        part_path = disks[0].CreatePartition(dbus.UInt64(1024**2), dbus.UInt64(10 * 1024**2),
+                                             '', '', self.no_options,
+                                             dbus_interface=self.iface_prefix + '.PartitionTable')
+        devices = [(disks[0].object_path, 'xfs', dbus.Dictionary(signature='sv')),
+                   (part_path, 'ext4', dbus.Dictionary(signature='sv'))]
+        with self.assertRaises(dbus.exceptions.DBusException):
+            manager.FormatMany(devices, self.no_options)
+
+        self.wipe_fs(self.vdevs[0])
+        self.wipe_fs(self.vdevs[1])
+
+    def test_format_many_job_limit(self):
+        '''FormatMany() on two partitions of one disk with one job per drive'''
+        disk = self.get_object('/block_devices/' + os.path.basename(self.vdevs[0]))
+        manager = self.get_interface(self.get_object('/Manager'), '.Manager')
+        self.addCleanup(self.wipe_fs, self.vdevs[0])
+
+        disk.Format('gpt', self.no_options, dbus_interface=self.iface_prefix + '.Block')
+        parts = [disk.CreatePartition(dbus.UInt64(n * 50 * 1024**2 + 1024**2), dbus.UInt64(40 * 1024**2),
+                                      '', '', self.no_options,
+                                      dbus_interface=self.iface_prefix + '.PartitionTable')
+                 for n in range(2)]
+
+        self.set_job_limits(per_drive=1)
+
+        # the devices must not wait for each other's slot while waiting for
+        # each other to settle
+        devices = [(part, 'ext4', dbus.Dictionary(signature='sv')) for part in parts]
+        results = manager.FormatMany(devices, self.no_options, timeout=120)
+        self.assertEqual(len(results), 2)
+        for (path, success, message), part in zip(results, parts):
+            self.assertEqual(path, part)
+            self.assertTrue(success, message)
+        for part in parts:
+            self.get_property(self.get_object(part), '.Block', 'IdType').assertEqual('ext4')
+
+    def _create_partition(self, disk, offset, size):
+        path = disk.CreatePartition(dbus.UInt64(offset), dbus.UInt64(size), '', '', self.no_options,
+                                    dbus_interface=self.iface_prefix + '.PartitionTable')
+        self.udev_settle()
+        return self.get_object(path)
+
+    def _get_device_path(self, obj):
+        return self.ay_to_str(self.get_property_raw(obj, '.Block', 'Device'))
+
+    def _assert_built_on(self, base, top):
+        '''FormatMany() refuses @base and @top together if @top is built on @base'''
+        manager = self.get_interface(self.get_object('/Manager'), '.Manager')
+        devices = [(base.object_path, 'ext4', dbus.Dictionary(signature='sv')),
+                   (top.object_path, 'ext4', dbus.Dictionary(signature='sv'))]
+        msg = r'Device %s is built on %s' % (self._get_device_path(top), self._get_device_path(base))
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            manager.FormatMany(devices, self.no_options)
+
+    def _create_luks_partition(self, disk):
+        '''Creates a partition with an unlocked LUKS device on @disk'''
+        disk.Format('gpt', self.no_options, dbus_interface=self.iface_prefix + '.Block')
+        self.addCleanup(self.wipe_fs, self.vdevs[0])
+        # don't leave the LUKS header behind for the next partition created here
+        self.addCleanup(self.run_command, 'dd if=/dev/zero of=%s bs=1MiB count=51 oflag=direct' % self.vdevs[0])
+        part = self._create_partition(disk, 1024**2, 50 * 1024**2)
+        part.Format('xfs', {'encrypt.passphrase': 'test'}, dbus_interface=self.iface_prefix + '.Block')
+        self.udev_settle()
+
+        cleartext_path = self.get_property_raw(part, '.Encrypted', 'CleartextDevice')
+        self.assertNotEqual(cleartext_path, '/')
+        return part, self.get_object(cleartext_path)
+
+    def test_device_graph_descendants(self):
+        disk = self.get_object('/block_devices/' + os.path.basename(self.vdevs[0]))
+        part, cleartext = self._create_luks_partition(disk)
+        self.addCleanup(self._close_luks, part)
+
+        # direct children and devices further up the stack
+        self._assert_built_on(disk, part)
+        self._assert_built_on(part, cleartext)
+        self._assert_built_on(disk, cleartext)
+
+        self.get_property(cleartext, '.Block', 'CryptoBackingDevice').assertEqual(part.object_path)
+
+    def test_device_graph_busy_teardown(self):
+        disk = self.get_object('/block_devices/' + os.path.basename(self.vdevs[0]))
+        part, cleartext = self._create_luks_partition(disk)
+        cleartext_path = cleartext.object_path
+        drive = self.get_interface(self.get_property_raw(disk, '.Block', 'Drive'), '.Drive')
+
+        # the busy check finds the unlocked device on a partition of the drive
+        msg = r'Cannot eject drive in use: Encrypted device %s is unlocked' % self._get_device_path(part)
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            drive.Eject(self.no_options)
+
+        # tearing down the disk locks the cleartext device before the
+        # partition it is built on goes away
+        disk.Format('empty', {'tear-down': True}, dbus_interface=self.iface_prefix + '.Block')
+        self.udev_settle()
+        self.assertIsNone(self.get_object(cleartext_path))
+        self.get_property(disk, '.Block', 'IdType').assertEqual('')
+        _ret, out = self.run_command('lsblk -no NAME %s' % self.vdevs[0])
+        self.assertEqual(len(out.strip().splitlines()), 1)
+
+    def test_device_graph_stale(self):
+        disk = self.get_object('/block_devices/' + os.path.basename(self.vdevs[0]))
+        drive = self.get_interface(self.get_property_raw(disk, '.Block', 'Drive'), '.Drive')
+        disk.Format('gpt', self.no_options, dbus_interface=self.iface_prefix + '.Block')
+        self.addCleanup(self.wipe_fs, self.vdevs[0])
+
+        part = self._create_partition(disk, 1024**2, 20 * 1024**2)
+        part.Format('ext4', self.no_options, dbus_interface=self.iface_prefix + '.Block')
+        mnt_path = part.Mount(self.no_options, dbus_interface=self.iface_prefix + '.Filesystem')
+        self.addCleanup(self.try_unmount, mnt_path)
+
+        msg = r'Cannot eject drive in use: Device %s is mounted' % self._get_device_path(part)
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            drive.Eject(self.no_options)
+
+        part.Unmount(self.no_options, dbus_interface=self.iface_prefix + '.Filesystem')
+        self.wipe_fs(self._get_device_path(part))
+        part.Delete(self.no_options, dbus_interface=self.iface_prefix + '.Partition')
+        self.udev_settle()
+
+        # the removed partition must not make the drive look busy anymore
+        try:
+            drive.Eject(self.no_options)
+        except dbus.exceptions.DBusException as e:
+            self.assertNotIn('in use', str(e))
+
+        # a new partition with the same name is a descendant again
+        part = self._create_partition(disk, 30 * 1024**2, 20 * 1024**2)
+        self._assert_built_on(disk, part)
+
+    def test_device_graph_loop_parent(self):
+        disk = self.get_object('/block_devices/' + os.path.basename(self.vdevs[0]))
+        manager = self.get_interface(self.get_object('/Manager'), '.Manager')
+        disk.Format('gpt', self.no_options, dbus_interface=self.iface_prefix + '.Block')
+        self.addCleanup(self.wipe_fs, self.vdevs[0])
+
+        part = self._create_partition(disk, 1024**2, 50 * 1024**2)
+        part.Format('ext4', self.no_options, dbus_interface=self.iface_prefix + '.Block')
+        self.addCleanup(self.wipe_fs, self._get_device_path(part))
+        mnt_path = part.Mount(self.no_options, dbus_interface=self.iface_prefix + '.Filesystem')
+        self.addCleanup(self.try_unmount, mnt_path)
+
+        backing_file = os.path.join(mnt_path, 'loop_backing_file')
+        self.run_command('dd if=/dev/zero of=%s bs=1MiB count=10' % backing_file)
+        self.addCleanup(os.remove, backing_file)
+        with open(backing_file, 'r+b') as f:
+            loop_path = manager.LoopSetup(f.fileno(), self.no_options)
+        loop = self.get_object(loop_path)
+        self.addCleanup(loop.Delete, self.no_options, dbus_interface=self.iface_prefix + '.Loop')
+        self.udev_settle()
+
+        # the loop device is built on the partition holding its backing file
+        self._assert_built_on(part, loop)
+        self._assert_built_on(disk, loop)
+
+    def _format_many_stage_times(self, devices):
+        '''Runs FormatMany() and returns the last StageTimes seen on its job'''
+
+        stage_times = {}
+        errors = []
+
+        def format_many():
+            try:
+                safe_dbus.call_sync(self.iface_prefix,
+                                    self.path_prefix + '/Manager',
+                                    self.iface_prefix + '.Manager',
+                                    'FormatMany',
+                                    GLib.Variant('(a(osa{sv})a{sv})', (devices, {})))
+            except Exception as e:
+                errors.append(e)
+
+        format_thread = threading.Thread(target=format_many)
+        format_thread.start()
+        while format_thread.is_alive():
+            objects = safe_dbus.call_sync(self.iface_prefix,
+                                          self.path_prefix,
+                                          'org.freedesktop.DBus.ObjectManager',
+                                          'GetManagedObjects',
+                                          None)
+            for path, interfaces in objects[0].items():
+                job = interfaces.get(self.iface_prefix + '.Job')
+                if '/jobs/' in path and job is not None and job['Operation'] == 'format-many':
+                    stage_times = job['StageTimes']
+            time.sleep(0.1)
+        format_thread.join()
+
+        if errors:
+            raise errors[0]
+        return stage_times
+
+    def test_format_many_stage_times(self):
+        paths = [self.path_prefix + '/block_devices/' + os.path.basename(dev) for dev in self.vdevs[:2]]
+        self.addCleanup(self.wipe_fs, self.vdevs[0])
+        self.addCleanup(self.wipe_fs, self.vdevs[1])
+
+        # zeroing makes the job last long enough to be seen after the wipe
+        devices = [(paths[0], 'ext4', {'erase': GLib.Variant('s', 'zero')}),
+                   (paths[1], 'ext4', {})]
+        stage_times = self._format_many_stage_times(devices)
+
+        self.assertIn('wipe', stage_times)
+        stages = {'teardown', 'wipe', 'wipe-settle', 'dry-run', 'luks-format', 'luks-open',
+                  'erase', 'mkfs', 'settle', 'configure'}
+        for stage, usec in stage_times.items():
+            self.assertIn(stage, stages)
+            self.assertGreater(usec, 0)
+
     def test_format_parttype(self):
 
         disk = self.get_object('/block_devices/' + os.path.basename(self.vdevs[0]))
@@ -167,6 +420,127 @@ class UdisksBlockTest(udiskstestcase.UdisksTestCase):
         self.assertTrue(bool(mode & os.O_ASYNC))
         os.close(fd)
 
+    def test_benchmark(self):
+        disk = self.get_object('/block_devices/' + os.path.basename(self.vdevs[0]))
+
+        # invalid pattern
+        d = dbus.Dictionary(signature='sv')
+        d['pattern'] = 'zigzag'
+        with self.assertRaises(dbus.exceptions.DBusException):
+            disk.Benchmark(d, dbus_interface=self.iface_prefix + '.Block')
+
+        # block size not a multiple of the logical block size
+        d = dbus.Dictionary(signature='sv')
+        d['block-size'] = dbus.UInt64(1000)
+        with self.assertRaises(dbus.exceptions.DBusException):
+            disk.Benchmark(d, dbus_interface=self.iface_prefix + '.Block')
+
+        # sequential read limited by size
+        d = dbus.Dictionary(signature='sv')
+        d['size'] = dbus.UInt64(16 * 1024**2)
+        d['duration'] = dbus.UInt64(0)
+        results = disk.Benchmark(d, dbus_interface=self.iface_prefix + '.Block')
+        self.assertEqual(results['bytes'], 16 * 1024**2)
+        self.assertEqual(results['operations'], 16)
+        self.assertGreater(results['throughput'], 0)
+        self.assertLessEqual(results['latency-min'], results['latency-p50'])
+        self.assertLessEqual(results['latency-p50'], results['latency-p99'])
+        self.assertLessEqual(results['latency-p99'], results['latency-max'])
+
+        # random read limited by duration
+        d = dbus.Dictionary(signature='sv')
+        d['pattern'] = 'random'
+        d['queue-depth'] = dbus.UInt32(8)
+        d['duration'] = dbus.UInt64(500 * 1000)
+        results = disk.Benchmark(d, dbus_interface=self.iface_prefix + '.Block')
+        self.assertGreater(results['operations'], 0)
+        self.assertEqual(results['bytes'], results['operations'] * 4096)
+        self.assertGreater(results['iops'], 0)
+
+    def test_backup_restore(self):
+        disk = self.get_object('/block_devices/' + os.path.basename(self.vdevs[0]))
+        self.addCleanup(self.wipe_fs, self.vdevs[0])
+
+        # 1 MiB of data at 4 MiB, zeroes everywhere else
+        _ret, out = self.run_command('blockdev --getsize64 %s' % self.vdevs[0])
+        size = int(out)
+        ret, _out = self.run_command('dd if=/dev/zero of=%s bs=1M count=%d oflag=direct' % (self.vdevs[0], size // 1024**2))
+        self.assertEqual(ret, 0)
+        data = os.urandom(1024**2)
+        fd = os.open(self.vdevs[0], os.O_WRONLY)
+        os.lseek(fd, 4 * 1024**2, os.SEEK_SET)
+        os.write(fd, data)
+        os.fsync(fd)
+        os.close(fd)
+
+        sha256 = hashlib.sha256()
+        with open(self.vdevs[0], 'rb') as f:
+            for chunk in iter(lambda: f.read(1024**2), b''):
+                sha256.update(chunk)
+
+        image = tempfile.NamedTemporaryFile(prefix='udisks_test_image')
+        self.addCleanup(image.close)
+
+        # invalid checksum type
+        d = dbus.Dictionary(signature='sv')
+        d['checksum'] = 'crc'
+        with self.assertRaises(dbus.exceptions.DBusException):
+            disk.BackupTo(dbus.types.UnixFd(image.fileno()), d, dbus_interface=self.iface_prefix + '.Block')
+
+        # the image must be writable
+        with open(image.name, 'rb') as f:
+            with self.assertRaises(dbus.exceptions.DBusException):
+                disk.BackupTo(dbus.types.UnixFd(f.fileno()), self.no_options, dbus_interface=self.iface_prefix + '.Block')
+
+        # backup, the zeroes end up as holes
+        results = disk.BackupTo(dbus.types.UnixFd(image.fileno()), self.no_options, dbus_interface=self.iface_prefix + '.Block')
+        self.assertEqual(results['bytes'], size)
+        self.assertEqual(results['checksum'], sha256.hexdigest())
+        self.assertGreaterEqual(results['bytes-written'], 1024**2)
+        self.assertEqual(results['bytes-written'] + results['bytes-skipped'], size)
+        st = os.stat(image.name)
+        self.assertEqual(st.st_size, size)
+        self.assertLess(st.st_blocks * 512, size)
+
+        # wipe the data and restore it, verifying the result
+        fd = os.open(self.vdevs[0], os.O_WRONLY)
+        os.lseek(fd, 4 * 1024**2, os.SEEK_SET)
+        os.write(fd, b'\0' * len(data))
+        os.fsync(fd)
+        os.close(fd)
+
+        with open(image.name, 'rb') as f:
+            d = dbus.Dictionary(signature='sv')
+            d['verify'] = True
+            results = disk.RestoreFrom(dbus.types.UnixFd(f.fileno()), d, dbus_interface=self.iface_prefix + '.Block')
+        self.assertEqual(results['bytes'], size)
+        self.assertEqual(results['checksum'], sha256.hexdigest())
+
+        with open(self.vdevs[0], 'rb') as f:
+            f.seek(4 * 1024**2)
+            self.assertEqual(f.read(len(data)), data)
+
+        # skipped holes keep the old data, they can't be verified
+        with open(image.name, 'rb') as f:
+            d = dbus.Dictionary(signature='sv')
+            d['verify'] = True
+            d['skip-holes'] = True
+            with self.assertRaises(dbus.exceptions.DBusException):
+                disk.RestoreFrom(dbus.types.UnixFd(f.fileno()), d, dbus_interface=self.iface_prefix + '.Block')
+
+        # holes can't be made in an image opened for appending
+        with open(image.name, 'ab') as f:
+            with self.assertRaises(dbus.exceptions.DBusException):
+                disk.BackupTo(dbus.types.UnixFd(f.fileno()), self.no_options, dbus_interface=self.iface_prefix + '.Block')
+
+        # without checksum, the data is spliced
+        with open(image.name, 'rb') as f:
+            d = dbus.Dictionary(signature='sv')
+            d['checksum'] = 'none'
+            d['skip-holes'] = True
+            results = disk.RestoreFrom(dbus.types.UnixFd(f.fileno()), d, dbus_interface=self.iface_prefix + '.Block')
+        self.assertNotIn('checksum', results)
+
     @udiskstestcase.tag_test(udiskstestcase.TestTags.UNSAFE)
     def test_configuration_fstab(self):
 
@@ -317,6 +691,39 @@ class UdisksBlockTest(udiskstestcase.UdisksTestCase):
 
         disk.Rescan(self.no_options, dbus_interface=self.iface_prefix + '.Block')
 
+    def test_statistics(self):
+        disk = self.get_object('/block_devices/' + os.path.basename(self.vdevs[0]))
+        self.assertIsNotNone(disk)
+        self.assertHasIface(disk, self.iface_prefix + '.Block.Statistics')
+
+        interval = self.get_property(disk, '.Block.Statistics', 'Interval')
+        interval.assertGreater(0)
+
+        # not subscribed yet
+        with self.assertRaises(dbus.exceptions.DBusException):
+            disk.Unsubscribe(self.no_options, dbus_interface=self.iface_prefix + '.Block.Statistics')
+
+        disk.Subscribe(self.no_options, dbus_interface=self.iface_prefix + '.Block.Statistics')
+        # subscribing twice is fine
+        disk.Subscribe(self.no_options, dbus_interface=self.iface_prefix + '.Block.Statistics')
+
+        # read from the device for a few intervals and watch the rates go up
+        max_bps = 0
+        max_iops = 0
+        for _ in range(20):
+            self.run_command('dd if=%s of=/dev/null bs=64k count=64 iflag=direct' % self.vdevs[0])
+            max_bps = max(max_bps, self.get_property_raw(disk, '.Block.Statistics', 'ReadBytesPerSecond'))
+            max_iops = max(max_iops, self.get_property_raw(disk, '.Block.Statistics', 'ReadIOPS'))
+            if max_bps > 0 and max_iops > 0:
+                break
+            time.sleep(interval.value / 4000.0)
+        self.assertGreater(max_bps, 0)
+        self.assertGreater(max_iops, 0)
+
+        disk.Unsubscribe(self.no_options, dbus_interface=self.iface_prefix + '.Block.Statistics')
+        with self.assertRaises(dbus.exceptions.DBusException):
+            disk.Unsubscribe(self.no_options, dbus_interface=self.iface_prefix + '.Block.Statistics')
+
 
 class UdisksBlockRemovableTest(udiskstestcase.UdisksTestCase):
     '''Extra block device tests over a scsi_debug removable device'''
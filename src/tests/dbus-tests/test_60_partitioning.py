@@ -330,6 +330,78 @@ class UdisksPartitionTableTest(udiskstestcase.UdisksTestCase):
         _ret, sys_fstype = self.run_command('lsblk -d -no FSTYPE /dev/%s' % part_name)
         self.assertEqual(sys_fstype, 'xfs')
 
+    def test_create_partitions(self):
+        disk = self.get_object('/block_devices/' + os.path.basename(self.vdevs[0]))
+        self.assertIsNotNone(disk)
+
+        # create gpt partition table
+        self._create_format(disk, 'gpt')
+        self.addCleanup(self._remove_format, disk)
+
+        layout = dbus.Array([], signature='(ttssa{sv}sa{sv})')
+        for i in range(3):
+            layout.append((dbus.UInt64(1024**2 + i * 101 * 1024**2), dbus.UInt64(100 * 1024**2), '',
+                           'part%d' % i, self.no_options, 'xfs' if i == 0 else '', self.no_options))
+
+        paths = disk.CreatePartitions(layout, self.no_options, dbus_interface=self.iface_prefix + '.PartitionTable')
+        self.assertEqual(len(paths), 3)
+
+        parts = [self.bus.get_object(self.iface_prefix, path) for path in paths]
+        for part in parts:
+            self.addCleanup(self._remove_partition, part)
+        self.addCleanup(self._remove_format, parts[0])
+
+        self.udev_settle()
+        for i, part in enumerate(parts):
+            offset = self.get_property(part, '.Partition', 'Offset')
+            offset.assertEqual(1024**2 + i * 101 * 1024**2)
+
+            size = self.get_property(part, '.Partition', 'Size')
+            size.assertEqual(100 * 1024**2)
+
+            name = self.get_property(part, '.Partition', 'Name')
+            name.assertEqual('part%d' % i)
+
+        fstype = self.get_property(parts[0], '.Block', 'IdType')
+        fstype.assertEqual('xfs')
+
+        dbus_parts = self.get_property(disk, '.PartitionTable', 'Partitions')
+        dbus_parts.assertLen(3)
+
+    def test_create_partitions_invalid_layout(self):
+        disk = self.get_object('/block_devices/' + os.path.basename(self.vdevs[0]))
+        self.assertIsNotNone(disk)
+
+        self._create_format(disk, 'gpt')
+        self.addCleanup(self._remove_format, disk)
+
+        disk_size = self.get_property_raw(disk, '.Block', 'Size')
+
+        def entry(offset, size):
+            return (dbus.UInt64(offset), dbus.UInt64(size), '', '', self.no_options, '', self.no_options)
+
+        # the second partition overlaps the first one
+        layout = dbus.Array([entry(1024**2, 100 * 1024**2), entry(50 * 1024**2, 100 * 1024**2)],
+                            signature='(ttssa{sv}sa{sv})')
+        msg = 'Partition 1: overlaps with partition 0'
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            disk.CreatePartitions(layout, self.no_options, dbus_interface=self.iface_prefix + '.PartitionTable')
+
+        # the second partition does not fit on the disk
+        layout = dbus.Array([entry(1024**2, 100 * 1024**2), entry(102 * 1024**2, disk_size)],
+                            signature='(ttssa{sv}sa{sv})')
+        msg = 'Partition 1: does not fit on'
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            disk.CreatePartitions(layout, self.no_options, dbus_interface=self.iface_prefix + '.PartitionTable')
+
+        # nothing should have been written to the disk
+        self.udev_settle()
+        dbus_parts = self.get_property(disk, '.PartitionTable', 'Partitions')
+        dbus_parts.assertLen(0)
+
+        _ret, out = self.run_command('lsblk -no NAME %s' % self.vdevs[0])
+        self.assertEqual(len(out.strip().splitlines()), 1)
+
     def _have_udftools(self):
         ret, _out = self.run_command('type mkudffs')
         return ret == 0
@@ -190,6 +190,46 @@ class UdisksEncryptedTest(udiskstestcase.UdisksTestCase):
         luks_ro = self.get_property(luks_obj, '.Block', 'ReadOnly')
         luks_ro.assertTrue()
 
+    def test_unlock_many(self):
+        disks = [self.get_object('/block_devices/' + os.path.basename(dev)) for dev in self.vdevs[:2]]
+        for disk in disks:
+            self._create_luks(disk, 'test')
+            self.addCleanup(self._remove_luks, disk)
+        self.udev_settle()
+        for disk in disks:
+            disk.Lock(self.no_options, dbus_interface=self.iface_prefix + '.Encrypted')
+
+        manager = self.get_interface(self.get_object('/Manager'), '.Manager')
+
+        # one right and one wrong password
+        devices = [(disks[0].object_path, 'test', dbus.Dictionary(signature='sv')),
+                   (disks[1].object_path, 'shbdkjaf', dbus.Dictionary(signature='sv'))]
+        results = manager.UnlockMany(devices, self.no_options)
+        self.assertEqual(len(results), 2)
+        self.assertEqual(results[0][0], disks[0].object_path)
+        self.assertTrue(results[0][2], results[0][3])
+        self.assertEqual(results[1][0], disks[1].object_path)
+        self.assertEqual(results[1][1], '/')
+        self.assertFalse(results[1][2])
+        self.assertIn('Error unlocking %s' % self.vdevs[1], results[1][3])
+
+        dbus_cleartext = self.get_property(disks[0], '.Encrypted', 'CleartextDevice')
+        dbus_cleartext.assertEqual(results[0][1])
+        dbus_cleartext = self.get_property(disks[1], '.Encrypted', 'CleartextDevice')
+        dbus_cleartext.assertEqual('/')
+
+        # the first one is already unlocked, read-only applies to both
+        ro_opts = dbus.Dictionary({'read-only': dbus.Boolean(True)}, signature=dbus.Signature('sv'))
+        devices = [(disks[0].object_path, 'test', dbus.Dictionary(signature='sv')),
+                   (disks[1].object_path, 'test', dbus.Dictionary(signature='sv'))]
+        results = manager.UnlockMany(devices, ro_opts)
+        self.assertFalse(results[0][2])
+        self.assertIn('is already unlocked', results[0][3])
+        self.assertTrue(results[1][2], results[1][3])
+
+        luks_ro = self.get_property(self.get_object(results[1][1]), '.Block', 'ReadOnly')
+        luks_ro.assertTrue()
+
     @udiskstestcase.tag_test(udiskstestcase.TestTags.UNSAFE)
     def test_open_crypttab(self):
         # this test will change /etc/crypttab, we might want to revert the changes when it finishes
@@ -566,6 +606,71 @@ class UdisksEncryptedTestLUKS2(UdisksEncryptedTest):
         clear_size3 = self.get_block_size(clear_dev)
         self.assertEqual(clear_size3, clear_size)
 
+    def test_unlock_dm_flags(self):
+        disk_name = os.path.basename(self.vdevs[0])
+        disk = self.get_object('/block_devices/' + disk_name)
+
+        self._create_luks(disk, 'test')
+        self.addCleanup(self._remove_luks, disk)
+        self.udev_settle()
+
+        disk.Lock(self.no_options, dbus_interface=self.iface_prefix + '.Encrypted')
+
+        d = dbus.Dictionary(signature='sv')
+        d['allow-discards'] = True
+        d['persistent-flags'] = True
+        luks_path = disk.Unlock('test', d, dbus_interface=self.iface_prefix + '.Encrypted')
+        self.assertIsNotNone(luks_path)
+        luks = self.bus.get_object(self.iface_prefix, luks_path)
+        self.assertIsNotNone(luks)
+
+        # the flag must be set for the active mapping
+        _ret, dm_name = self.run_command('ls /sys/block/%s/holders/' % disk_name)
+        self.assertEqual(_ret, 0)
+        _ret, out = self.run_command('cryptsetup status /dev/%s' % dm_name)
+        self.assertEqual(_ret, 0)
+        self.assertIn('discards', out)
+
+        # and stored in the LUKS2 header
+        _ret, out = self.run_command('cryptsetup luksDump %s' % self.vdevs[0])
+        self.assertEqual(_ret, 0)
+        self.assertIn('allow-discards', out)
+
+    def test_reencrypt(self):
+        if _get_cryptsetup_version() < Version('2.6.0'):
+            self.skipTest('cryptsetup reencrypt --progress-json not supported')
+
+        disk_name = os.path.basename(self.vdevs[0])
+        disk = self.get_object('/block_devices/' + disk_name)
+
+        self._create_luks(disk, 'test')
+        self.addCleanup(self._remove_luks, disk)
+        self.udev_settle()
+
+        # no key
+        msg = 'org.freedesktop.UDisks2.Error.Failed: No key available.*'
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            disk.Reencrypt(self.no_options, dbus_interface=self.iface_prefix + '.Encrypted')
+
+        # online re-encryption with a different key size
+        d = dbus.Dictionary(signature='sv')
+        d['passphrase'] = 'test'
+        d['key-size'] = dbus.UInt32(256)
+        d['max-bandwidth'] = dbus.UInt64(1024**3)
+        disk.Reencrypt(d, dbus_interface=self.iface_prefix + '.Encrypted', timeout=600)
+
+        _ret, out = self.run_command('cryptsetup luksDump %s' % self.vdevs[0])
+        self.assertEqual(_ret, 0)
+        six.assertRegex(self, out, r'\sKey:\s*256 bits')
+
+        # the cleartext device is still there with its filesystem
+        _ret, dm_name = self.run_command('ls /sys/block/%s/holders/' % disk_name)
+        self.assertEqual(_ret, 0)
+        obj_name = 'dm_2d' + dm_name[3:]  # '-' is encoded as '_2d' in object paths
+        luks = self.get_object('/block_devices/' + obj_name)
+        dbus_fs = self.get_property(luks, '.Block', 'IdType')
+        dbus_fs.assertEqual('xfs')
+
     def _get_default_luks_version(self):
         manager = self.get_object('/Manager')
         default_encryption_type = self.get_property(manager, '.Manager', 'DefaultEncryptionType')
@@ -973,6 +973,64 @@ class Ext4TestCase(Ext2TestCase):
         self.assertEqual(sys_stat.st_gid, int(gid))
 
 
+    def test_trim(self):
+        if not self._can_create:
+            self.skipTest('Cannot create %s filesystem' % self._fs_name)
+
+        if not self._can_mount:
+            self.skipTest('Cannot mount %s filesystem' % self._fs_name)
+
+        dev = os.path.basename(self.vdevs[0])
+        if int(self.read_file('/sys/block/%s/queue/discard_max_bytes' % dev).strip()) == 0:
+            self.skipTest('Device %s does not support discard' % self.vdevs[0])
+
+        disk = self.get_object('/block_devices/' + dev)
+        self.assertIsNotNone(disk)
+
+        # trimming needs a mounted filesystem
+        disk.Format(self._fs_name, self.no_options, dbus_interface=self.iface_prefix + '.Block')
+        self.addCleanup(self.wipe_fs, self.vdevs[0])
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, 'if unmounted'):
+            disk.Trim(self.no_options, dbus_interface=self.iface_prefix + '.Filesystem')
+
+        mnt_path = disk.Mount(self.no_options, dbus_interface=self.iface_prefix + '.Filesystem')
+        self.addCleanup(self.try_unmount, self.vdevs[0])
+
+        # small chunks so that there is more than one FITRIM call
+        d = dbus.Dictionary(signature='sv')
+        d['chunk-size'] = dbus.UInt64(16 * 1024**2)
+        trimmed = disk.Trim(d, dbus_interface=self.iface_prefix + '.Filesystem')
+        self.assertGreater(trimmed, 0)
+
+        # chunks not a multiple of the block size are rounded up
+        d['chunk-size'] = dbus.UInt64(16 * 1024**2 + 1)
+        trimmed = disk.Trim(d, dbus_interface=self.iface_prefix + '.Filesystem')
+        self.assertGreater(trimmed, 0)
+
+        with self.assertRaises(dbus.exceptions.DBusException):
+            d['chunk-size'] = dbus.UInt64(0)
+            disk.Trim(d, dbus_interface=self.iface_prefix + '.Filesystem')
+
+        # the filesystem is among the ones trimmed by TrimAll, too large
+        # max-parallel values are clamped
+        manager = self.get_interface('/Manager', '.Manager')
+        d = dbus.Dictionary(signature='sv')
+        d['max-parallel'] = dbus.UInt32(2**32 - 1)
+        results = manager.TrimAll(d)
+        paths = [str(r[0]) for r in results]
+        self.assertIn(str(disk.object_path), paths)
+        result = results[paths.index(str(disk.object_path))]
+        self.assertTrue(result[2], result[3])
+
+        # read-only mounts are refused by Trim and skipped by TrimAll
+        ret, out = self.run_command('mount -o remount,ro %s' % mnt_path)
+        self.assertEqual(ret, 0, out)
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, 'read-only'):
+            disk.Trim(self.no_options, dbus_interface=self.iface_prefix + '.Filesystem')
+        results = manager.TrimAll(self.no_options)
+        self.assertNotIn(str(disk.object_path), [str(r[0]) for r in results])
+
+
 class XFSTestCase(UdisksFSTestCase):
     _fs_name = 'xfs'
     _can_create = True and UdisksFSTestCase.command_exists('mkfs.xfs')
@@ -92,6 +92,7 @@ class UdisksJobTest(udiskstestcase.UdisksTestCase):
         self.assertLessEqual(abs(properties['StartTime'] - start_time * 10**6), 0.5 * 10**6)
 
         self.assertTrue(properties['Cancelable'])
+        self.assertFalse(properties['Queued'])
 
         # job still exists -- erase call timed out -- try to cancel it
         if safe_dbus.check_object_available(self.iface_prefix, self.job[0],
@@ -145,3 +146,102 @@ class UdisksJobTest(udiskstestcase.UdisksTestCase):
         self.assertIsNotNone(self.exception)
         self.assertTrue(isinstance(self.exception, safe_dbus.DBusCallError))
         self.assertIn('Error erasing device: Job was canceled', str(self.exception))
+
+
+class UdisksJobSchedulerTest(udiskstestcase.UdisksTestCase):
+    '''Tests for the admission control of jobs'''
+
+    def _find_jobs(self, operation, object_path):
+        objects = safe_dbus.call_sync(self.iface_prefix,
+                                      self.path_prefix,
+                                      'org.freedesktop.DBus.ObjectManager',
+                                      'GetManagedObjects',
+                                      None)
+        jobs = []
+        for path, interfaces in objects[0].items():
+            job = interfaces.get(self.iface_prefix + '.Job')
+            if job is not None and job['Operation'] == operation and object_path in job['Objects']:
+                jobs.append((path, job))
+        return [path for path, job in sorted(jobs, key=lambda j: j[1]['StartTime'])]
+
+    def _wait_for_jobs(self, operation, object_path, count):
+        for _ in range(100):
+            jobs = self._find_jobs(operation, object_path)
+            if len(jobs) >= count:
+                return jobs
+            time.sleep(0.1)
+        self.fail('Expected %d %s jobs' % (count, operation))
+
+    def _start_benchmark(self, object_path, duration):
+        '''Starts a read benchmark of @duration seconds in another thread'''
+        errors = []
+
+        def benchmark():
+            try:
+                safe_dbus.call_sync(self.iface_prefix,
+                                    object_path,
+                                    self.iface_prefix + '.Block',
+                                    'Benchmark',
+                                    GLib.Variant('(a{sv})', ({'duration': GLib.Variant('t', duration * 10**6)},)),
+                                    timeout=120 * 1000)
+            except Exception as e:
+                errors.append(e)
+
+        thread = threading.Thread(target=benchmark)
+        thread.start()
+        self.addCleanup(thread.join)
+        return thread, errors
+
+    def _job_property(self, job_path, prop):
+        return self.get_property(self.get_object(job_path), '.Job', prop)
+
+    def test_queue_limit(self):
+        '''Jobs over max_jobs_per_drive are queued in order'''
+        obj_path = self.path_prefix + '/block_devices/' + os.path.basename(self.vdevs[0])
+        self.set_job_limits(per_drive=1)
+
+        thread_a, errors_a = self._start_benchmark(obj_path, 5)
+        job_a = self._wait_for_jobs('block-benchmark', obj_path, 1)[0]
+        _thread_b, errors_b = self._start_benchmark(obj_path, 1)
+        job_b = self._wait_for_jobs('block-benchmark', obj_path, 2)[1]
+        thread_c, errors_c = self._start_benchmark(obj_path, 1)
+        job_c = self._wait_for_jobs('block-benchmark', obj_path, 3)[2]
+
+        self.assertFalse(self.get_property_raw(self.get_object(job_a), '.Job', 'Queued'))
+        self._job_property(job_b, 'Queued').assertTrue()
+        self._job_property(job_b, 'QueuePosition').assertEqual(1)
+        self._job_property(job_c, 'Queued').assertTrue()
+        self._job_property(job_c, 'QueuePosition').assertEqual(2)
+
+        # a canceled job leaves the queue, the ones behind it move up
+        safe_dbus.call_sync(self.iface_prefix, job_b, self.iface_prefix + '.Job', 'Cancel',
+                            GLib.Variant('(a{sv})', ({},)))
+        self._job_property(job_c, 'QueuePosition').assertEqual(1)
+        self.assertTrue(thread_a.is_alive())
+
+        # the last job runs once the first one is done
+        thread_a.join()
+        self.assertEqual(errors_a, [])
+        thread_c.join()
+        self.assertEqual(errors_c, [])
+        self.assertEqual(len(errors_b), 1)
+        self.assertIn('cancel', str(errors_b[0]).lower())
+
+    def test_interactive_ahead_of_bulk(self):
+        '''Interactive jobs are not held back by queued bulk jobs'''
+        disk = self.get_object('/block_devices/' + os.path.basename(self.vdevs[0]))
+        disk.Format('ext4', self.no_options, dbus_interface=self.iface_prefix + '.Block')
+        self.addCleanup(self.wipe_fs, self.vdevs[0])
+        self.set_job_limits(per_drive=1)
+
+        thread_a, _errors_a = self._start_benchmark(disk.object_path, 5)
+        self._wait_for_jobs('block-benchmark', disk.object_path, 1)
+        _thread_b, _errors_b = self._start_benchmark(disk.object_path, 1)
+        job_b = self._wait_for_jobs('block-benchmark', disk.object_path, 2)[1]
+        self._job_property(job_b, 'Queued').assertTrue()
+
+        # mounting is not queued behind the benchmark waiting for its turn
+        disk.Mount(self.no_options, dbus_interface=self.iface_prefix + '.Filesystem')
+        self.addCleanup(self.try_unmount, self.vdevs[0])
+        self.assertTrue(thread_a.is_alive())
+        self.assertTrue(self.get_property_raw(self.get_object(job_b), '.Job', 'Queued'))
@@ -2,6 +2,7 @@ import time
 import dbus
 import os
 import shutil
+import six
 import tempfile
 import udiskstestcase
 
@@ -238,3 +239,51 @@ class UdisksManagerLoopDeviceTest(udiskstestcase.UdisksTestCase):
 
         # partitions should be scanned
         self.assertTrue(os.path.exists("/dev/%sp1" % loop_dev))
+
+    def test_60_create_direct_io(self):
+        opts = dbus.Dictionary({"direct-io": dbus.Boolean(True),
+                                "logical-block-size": dbus.UInt32(4096)},
+                               signature=dbus.Signature('sv'))
+        with open(self.LOOP_DEVICE_FILENAME, "r+b") as loop_file:
+            fd = loop_file.fileno()
+            loop_dev_obj_path = self.manager.LoopSetup(fd, opts)
+        self.assertTrue(loop_dev_obj_path)
+        path, loop_dev = loop_dev_obj_path.rsplit("/", 1)
+        self.addCleanup(self.run_command, "losetup -d /dev/%s" % loop_dev)
+
+        # should use direct I/O and the requested logical block size
+        self.assertEqual(self.read_file("/sys/block/%s/loop/dio" % loop_dev).strip(), "1")
+        self.assertEqual(self.read_file("/sys/block/%s/queue/logical_block_size" % loop_dev).strip(), "4096")
+
+        # invalid logical block size
+        opts = dbus.Dictionary({"logical-block-size": dbus.UInt32(1000)}, signature=dbus.Signature('sv'))
+        msg = r'org.freedesktop.UDisks2.Error.OptionNotPermitted: Invalid logical block size 1000'
+        with open(self.LOOP_DEVICE_FILENAME, "r+b") as loop_file:
+            with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+                self.manager.LoopSetup(loop_file.fileno(), opts)
+
+    def test_70_create_many(self):
+        shutil.copy(self.LOOP_DEVICE_FILENAME, self.LOOP_DEVICE_FILENAME + ".2")
+        self.addCleanup(os.remove, self.LOOP_DEVICE_FILENAME + ".2")
+
+        ro = dbus.Dictionary({"read-only": dbus.Boolean(True)}, signature=dbus.Signature('sv'))
+        with open(self.LOOP_DEVICE_FILENAME, "r+b") as loop_file, \
+             open(self.LOOP_DEVICE_FILENAME + ".2", "r+b") as loop_file2:
+            devices = dbus.Array([dbus.Struct((dbus.types.UnixFd(loop_file.fileno()), self.no_options)),
+                                  dbus.Struct((dbus.types.UnixFd(loop_file2.fileno()), ro))],
+                                 signature=dbus.Signature('(ha{sv})'))
+            results = self.manager.LoopSetupMany(devices, self.no_options)
+        self.assertEqual(len(results), 2)
+
+        for (loop_dev_obj_path, success, message), read_only, name in zip(results, (False, True),
+                                                                           (self.LOOP_DEVICE_FILENAME,
+                                                                            self.LOOP_DEVICE_FILENAME + ".2")):
+            self.assertTrue(success, message)
+            path, loop_dev = loop_dev_obj_path.rsplit("/", 1)
+            self.addCleanup(self.run_command, "losetup -d /dev/%s" % loop_dev)
+
+            loop_dev_obj = self.get_object(loop_dev_obj_path)
+            raw = self.get_property(loop_dev_obj, '.Loop', 'BackingFile')
+            raw.assertEqual(self.str_to_ay(os.path.join(os.getcwd(), name)))
+            ro_prop = self.get_property(loop_dev_obj, ".Block", "ReadOnly")
+            ro_prop.assertEqual(read_only)
@@ -1,7 +1,9 @@
 from __future__ import print_function
 
 import unittest
+import configparser
 import dbus
+import signal
 import subprocess
 import os
 import time
@@ -446,6 +448,48 @@ class UdisksTestCase(unittest.TestCase):
     def run_command(self, command):
         return run_command(command)
 
+    @classmethod
+    def get_udisks2_conf_path(self):
+        if os.environ['UDISKS_TESTS_ARG_SYSTEM'] == '1':
+            return '/etc/udisks2/udisks2.conf'
+        else:
+            return os.path.join(os.environ['UDISKS_TESTS_PROJDIR'], 'udisks', 'udisks2.conf')
+
+    def _reload_job_limits(self):
+        bus_iface = dbus.Interface(self.bus.get_object('org.freedesktop.DBus', '/org/freedesktop/DBus'),
+                                   'org.freedesktop.DBus')
+        os.kill(int(bus_iface.GetConnectionUnixProcessID(self.iface_prefix)), signal.SIGHUP)
+        # there is nothing to wait for, the signal is handled in the main loop
+        time.sleep(1)
+
+    def set_job_limits(self, per_drive=0, per_host=0):
+        """Sets the [jobs] limits in udisks2.conf and makes the daemon re-read
+        them, the original file is restored when the test finishes"""
+        conf_path = self.get_udisks2_conf_path()
+        try:
+            orig_contents = self.read_file(conf_path)
+        except FileNotFoundError:
+            orig_contents = None
+
+        def restore():
+            if orig_contents is not None:
+                self.write_file(conf_path, orig_contents)
+            else:
+                self.remove_file(conf_path, ignore_nonexistent=True)
+            self._reload_job_limits()
+        self.addCleanup(restore)
+
+        config = configparser.ConfigParser(interpolation=None)
+        if orig_contents is not None:
+            config.read_string(orig_contents)
+        if not config.has_section('jobs'):
+            config.add_section('jobs')
+        config.set('jobs', 'max_jobs_per_drive', str(per_drive))
+        config.set('jobs', 'max_jobs_per_host', str(per_host))
+        with open(conf_path, 'w') as f:
+            config.write(f)
+        self._reload_job_limits()
+
     @classmethod
     def module_available(cls, module):
         ret, _out = cls.run_command('modprobe %s' % module)
@@ -117,6 +117,19 @@ main (int argc, char *argv[])
       }
       break;
 
+    case 9:
+      /* progress counter overwritten with backspaces, like mke2fs does */
+      {
+        guint n;
+
+        g_print ("Writing inode tables: ");
+        for (n = 0; n <= 3; n++)
+          g_print ("%u/3\b\b\b", n);
+        g_print ("done\n");
+        ret = 0;
+      }
+      break;
+
     default:
       g_assert_not_reached ();
       break;
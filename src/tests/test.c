@@ -21,15 +21,21 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <pwd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <unistd.h>
 
+#include <stdio.h>
 #include <string.h>
+#include <glib/gstdio.h>
 
 #include <udisksdaemontypes.h>
 #include <udisksdaemon.h>
 #include <udisksspawnedjob.h>
 #include <udisksthreadedjob.h>
+#include <udisksstats.h>
+#include <udisksdriveconfigstore.h>
 
 #include "testutil.h"
 
@@ -454,6 +460,211 @@ test_spawned_job_binary_input_string (void)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static void
+on_output_line (UDisksSpawnedJob *job,
+                gint              stream,
+                const gchar      *line,
+                gpointer          user_data)
+{
+  GPtrArray *lines = user_data;
+
+  g_assert_cmpint (stream, ==, STDOUT_FILENO);
+  g_ptr_array_add (lines, g_strdup (line));
+}
+
+static void
+test_spawned_job_output_line (void)
+{
+  UDisksSpawnedJob *job;
+  GPtrArray *lines;
+  gchar *s;
+
+  lines = g_ptr_array_new_with_free_func (g_free);
+  s = g_strdup_printf (UDISKS_TEST_DIR "/udisks-test-helper 0");
+  job = udisks_spawned_job_new (s, NULL, getuid (), geteuid (), NULL, NULL);
+  g_signal_connect (job, "output-line", G_CALLBACK (on_output_line), lines);
+  udisks_spawned_job_start (job);
+  _g_assert_signal_received (job, "spawned-job-completed", G_CALLBACK (read_stdout_on_spawned_job_completed), NULL);
+  g_assert_cmpuint (lines->len, ==, 2);
+  g_assert_cmpstr (lines->pdata[0], ==, "Hello Stdout");
+  g_assert_cmpstr (lines->pdata[1], ==, "Line 2");
+  g_object_unref (job);
+  g_ptr_array_unref (lines);
+  g_free (s);
+}
+
+static void
+test_spawned_job_output_line_backspace (void)
+{
+  UDisksSpawnedJob *job;
+  GPtrArray *lines;
+  gchar *s;
+
+  lines = g_ptr_array_new_with_free_func (g_free);
+  s = g_strdup_printf (UDISKS_TEST_DIR "/udisks-test-helper 9");
+  job = udisks_spawned_job_new (s, NULL, getuid (), geteuid (), NULL, NULL);
+  g_signal_connect (job, "output-line", G_CALLBACK (on_output_line), lines);
+  udisks_spawned_job_start (job);
+  _g_assert_signal_received (job, "completed", G_CALLBACK (on_completed_expect_success), NULL);
+  g_assert_cmpuint (lines->len, ==, 5);
+  g_assert_cmpstr (lines->pdata[0], ==, "Writing inode tables: 0/3");
+  g_assert_cmpstr (lines->pdata[1], ==, "1/3");
+  g_assert_cmpstr (lines->pdata[2], ==, "2/3");
+  g_assert_cmpstr (lines->pdata[3], ==, "3/3");
+  g_assert_cmpstr (lines->pdata[4], ==, "done");
+  g_object_unref (job);
+  g_ptr_array_unref (lines);
+  g_free (s);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+output_limit_on_spawned_job_completed (UDisksSpawnedJob *job,
+                                       GError           *error,
+                                       gint              status,
+                                       GString          *standard_output,
+                                       GString          *standard_error,
+                                       gpointer          user_data)
+{
+  guint n;
+
+  g_assert_no_error (error);
+  g_assert (WIFEXITED (status));
+  g_assert (WEXITSTATUS (status) == 0);
+
+  /* only the last 50 bytes of the 200 bytes written are kept */
+  g_assert_cmpint (standard_output->len, ==, 50);
+  for (n = 0; n < 25; n++)
+    {
+      g_assert_cmpint (standard_output->str[n*2+0], ==, n + 75);
+      g_assert_cmpint (standard_output->str[n*2+1], ==, 0);
+    }
+  return FALSE;
+}
+
+static void
+test_spawned_job_output_limit (void)
+{
+  UDisksSpawnedJob *job;
+  guint limit;
+  gchar *s;
+
+  s = g_strdup_printf (UDISKS_TEST_DIR "/udisks-test-helper 6");
+  job = udisks_spawned_job_new (s, NULL, getuid (), geteuid (), NULL, NULL);
+  /* bounded by default */
+  g_object_get (job, "output-limit", &limit, NULL);
+  g_assert_cmpuint (limit, ==, 1024 * 1024);
+  udisks_spawned_job_set_output_limit (job, 50);
+  udisks_spawned_job_start (job);
+  _g_assert_signal_received (job, "spawned-job-completed", G_CALLBACK (output_limit_on_spawned_job_completed), NULL);
+  g_object_unref (job);
+  g_free (s);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+switch_credentials_on_spawned_job_completed (UDisksSpawnedJob *job,
+                                             GError           *error,
+                                             gint              status,
+                                             GString          *standard_output,
+                                             GString          *standard_error,
+                                             gpointer          user_data)
+{
+  struct passwd *pw = user_data;
+  gchar *expected;
+
+  g_assert_no_error (error);
+  g_assert (WIFEXITED (status));
+  g_assert (WEXITSTATUS (status) == 0);
+  /* real and effective uid and gid */
+  expected = g_strdup_printf ("%u\n%u\n%u\n%u\n",
+                              (guint) pw->pw_uid, (guint) pw->pw_uid,
+                              (guint) pw->pw_gid, (guint) pw->pw_gid);
+  g_assert_cmpstr (standard_output->str, ==, expected);
+  g_free (expected);
+  return FALSE;
+}
+
+/* Switching credentials goes through the clone() child instead of
+ * posix_spawn(). As root, run a program as nobody; otherwise switching
+ * to root must fail in the child and be reported.
+ */
+static void
+test_spawned_job_switch_credentials (void)
+{
+  UDisksSpawnedJob *job;
+  struct passwd *pw;
+  const gchar *command = "/bin/sh -c 'id -ru; id -u; id -rg; id -g'";
+
+  if (getuid () == 0)
+    {
+      pw = getpwnam ("nobody");
+      if (pw == NULL)
+        {
+          g_test_skip ("No nobody user");
+          return;
+        }
+      job = udisks_spawned_job_new (command, NULL, pw->pw_uid, pw->pw_uid, NULL, NULL);
+      udisks_spawned_job_start (job);
+      _g_assert_signal_received (job, "spawned-job-completed",
+                                 G_CALLBACK (switch_credentials_on_spawned_job_completed), pw);
+    }
+  else
+    {
+      job = udisks_spawned_job_new (command, NULL, 0, 0, NULL, NULL);
+      udisks_spawned_job_start (job);
+      _g_assert_signal_received (job, "completed", G_CALLBACK (on_completed_expect_failure), NULL);
+      g_assert (strstr (last_failure_message, "Failed to switch credentials for child process"));
+      g_assert (strstr (last_failure_message, "setgroups"));
+    }
+  g_object_unref (job);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gdouble
+measure_spawn_latency (guint n_jobs)
+{
+  UDisksSpawnedJob *job;
+  guint n;
+
+  g_test_timer_start ();
+  for (n = 0; n < n_jobs; n++)
+    {
+      job = udisks_spawned_job_new ("/bin/true", NULL, getuid (), geteuid (), NULL, NULL);
+      udisks_spawned_job_start (job);
+      _g_assert_signal_received (job, "completed", G_CALLBACK (on_completed_expect_success), NULL);
+      g_object_unref (job);
+    }
+  return g_test_timer_elapsed () / n_jobs;
+}
+
+/* Only run in perf mode (-m perf). The ballast emulates a daemon with a
+ * large object tree - with fork() the spawn latency grows with it.
+ */
+static void
+test_spawned_job_spawn_latency (void)
+{
+  const gsize ballast_size = 512 * 1024 * 1024;
+  gchar *ballast;
+  gdouble latency;
+
+  latency = measure_spawn_latency (500);
+  g_test_message ("spawn latency: %.1f usec per job", latency * G_USEC_PER_SEC);
+
+  ballast = g_malloc (ballast_size);
+  memset (ballast, 0xaa, ballast_size);
+  latency = measure_spawn_latency (500);
+  g_test_minimized_result (latency * G_USEC_PER_SEC,
+                           "spawn latency with %" G_GSIZE_FORMAT " MiB RSS: %.1f usec per job",
+                           ballast_size / (1024 * 1024), latency * G_USEC_PER_SEC);
+  g_free (ballast);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static gboolean
 threaded_job_successful_func (UDisksThreadedJob   *job,
                               GCancellable        *cancellable,
@@ -682,6 +893,111 @@ test_threaded_job_override_signal_handler (void)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* parses count, total and max of @name from the stats dump */
+static void
+get_stats (const gchar *name,
+           guint64     *count,
+           guint64     *total,
+           guint64     *max)
+{
+  gchar *dump;
+  gchar *needle;
+  const gchar *line;
+
+  dump = udisks_stats_dump ();
+  needle = g_strdup_printf ("\n%s ", name);
+  line = strstr (dump, needle);
+  g_assert (line != NULL);
+  g_assert_cmpint (sscanf (line + strlen (needle),
+                           "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT,
+                           count, total, max), ==, 3);
+  g_free (needle);
+  g_free (dump);
+}
+
+static void
+test_stats (void)
+{
+  guint64 count, total, max;
+  guint64 prev_total;
+
+  /* only check what doesn't depend on scheduling, the durations are lower bounds */
+  udisks_stats_end ("test", "handler", udisks_stats_begin () - 1500);
+  udisks_stats_end ("test", "handler", udisks_stats_begin () - 20);
+  get_stats ("test/handler", &count, &total, &max);
+  g_assert_cmpuint (count, ==, 2);
+  g_assert_cmpuint (total, >=, 1520);
+  g_assert_cmpuint (max, >=, 1500);
+  g_assert_cmpuint (max, <=, total);
+
+  prev_total = total;
+  udisks_stats_end ("test", "handler", udisks_stats_begin ());
+  get_stats ("test/handler", &count, &total, &max);
+  g_assert_cmpuint (count, ==, 3);
+  g_assert_cmpuint (total, >=, prev_total);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+test_drive_config_store (void)
+{
+  UDisksDriveConfigStore *store;
+  GError *error = NULL;
+  GVariant *configuration;
+  GVariantDict dict;
+  gchar *dir;
+  gchar *path;
+  gchar **ids;
+  gint32 value;
+
+  dir = g_dir_make_tmp ("udisks-test-XXXXXX", &error);
+  g_assert_no_error (error);
+  path = g_build_filename (dir, "a.conf", NULL);
+  g_assert (g_file_set_contents (path, "[ATA]\nStandbyTimeout=10\n", -1, &error));
+  g_assert_no_error (error);
+
+  store = udisks_drive_config_store_new (dir);
+
+  configuration = udisks_drive_config_store_lookup (store, "a");
+  g_assert (configuration != NULL);
+  g_assert (g_variant_lookup (configuration, "ata-pm-standby", "i", &value));
+  g_assert_cmpint (value, ==, 10);
+  g_variant_unref (configuration);
+
+  g_assert (udisks_drive_config_store_lookup (store, "b") == NULL);
+
+  g_variant_dict_init (&dict, NULL);
+  g_variant_dict_insert (&dict, "ata-pm-standby", "i", 20);
+  configuration = g_variant_ref_sink (g_variant_dict_end (&dict));
+  g_assert (udisks_drive_config_store_write (store, "b", configuration, &error));
+  g_assert_no_error (error);
+  g_variant_unref (configuration);
+
+  configuration = udisks_drive_config_store_lookup (store, "b");
+  g_assert (configuration != NULL);
+  g_assert (g_variant_lookup (configuration, "ata-pm-standby", "i", &value));
+  g_assert_cmpint (value, ==, 20);
+  g_variant_unref (configuration);
+
+  ids = udisks_drive_config_store_get_ids (store);
+  g_assert (g_strv_contains ((const gchar * const *) ids, "a"));
+  g_assert (g_strv_contains ((const gchar * const *) ids, "b"));
+  g_strfreev (ids);
+
+  g_object_unref (store);
+
+  g_unlink (path);
+  g_free (path);
+  path = g_build_filename (dir, "b.conf", NULL);
+  g_unlink (path);
+  g_free (path);
+  g_rmdir (dir);
+  g_free (dir);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 int
 main (int    argc,
       char **argv)
@@ -714,6 +1030,12 @@ main (int    argc,
   g_test_add_func ("/udisks/daemon/spawned_job/binary_output", test_spawned_job_binary_output);
   g_test_add_func ("/udisks/daemon/spawned_job/input_string", test_spawned_job_input_string);
   g_test_add_func ("/udisks/daemon/spawned_job/binary_input_string", test_spawned_job_binary_input_string);
+  g_test_add_func ("/udisks/daemon/spawned_job/output_line", test_spawned_job_output_line);
+  g_test_add_func ("/udisks/daemon/spawned_job/output_line_backspace", test_spawned_job_output_line_backspace);
+  g_test_add_func ("/udisks/daemon/spawned_job/output_limit", test_spawned_job_output_limit);
+  g_test_add_func ("/udisks/daemon/spawned_job/switch_credentials", test_spawned_job_switch_credentials);
+  if (g_test_perf ())
+    g_test_add_func ("/udisks/daemon/spawned_job/spawn_latency", test_spawned_job_spawn_latency);
   g_test_add_func ("/udisks/daemon/threaded_job/successful", test_threaded_job_successful);
   g_test_add_func ("/udisks/daemon/threaded_job/failure", test_threaded_job_failure);
   g_test_add_func ("/udisks/daemon/threaded_job/cancelled_at_start", test_threaded_job_cancelled_at_start);
@@ -723,6 +1045,8 @@ main (int    argc,
   g_test_add_func ("/udisks/daemon/threaded_job_sync/failure", test_threaded_job_sync_failure);
   g_test_add_func ("/udisks/daemon/threaded_job_sync/cancelled_at_start", test_threaded_job_sync_cancelled_at_start);
   g_test_add_func ("/udisks/daemon/threaded_job_sync/cancelled_midway", test_threaded_job_sync_cancelled_midway);
+  g_test_add_func ("/udisks/daemon/stats", test_stats);
+  g_test_add_func ("/udisks/daemon/drive_config_store", test_drive_config_store);
 
   ret = g_test_run();
 
@@ -0,0 +1,497 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#include <linux/aio_abi.h>
+
+#include "udisksbenchmark.h"
+#include "udiskslogging.h"
+
+/**
+ * SECTION:udisksbenchmark
+ * @title: Benchmarking
+ * @short_description: Helper routines for benchmarking block devices
+ *
+ * Helper routines for measuring throughput, IOPS and latency of a
+ * block device. Requests are issued with Linux native asynchronous
+ * I/O so that a configurable number of them are in flight at any
+ * time. The file descriptor is expected to be opened with
+ * <literal>O_DIRECT</literal> so the page cache is bypassed.
+ */
+
+/* upper bound for queue_depth * block_size */
+#define MAX_BUFFER_SIZE (256 * 1024 * 1024)
+
+#define MAX_QUEUE_DEPTH 256
+
+/* Latencies are recorded in a log-linear histogram: values below
+ * LATENCY_SUB_BUCKETS are exact, each further power of two is split
+ * into LATENCY_SUB_BUCKETS linear buckets.
+ */
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS (64 * LATENCY_SUB_BUCKETS)
+
+static gint
+sys_io_setup (guint          nr_events,
+              aio_context_t *ctx)
+{
+  return syscall (__NR_io_setup, nr_events, ctx);
+}
+
+static gint
+sys_io_destroy (aio_context_t ctx)
+{
+  return syscall (__NR_io_destroy, ctx);
+}
+
+static gint
+sys_io_submit (aio_context_t   ctx,
+               glong           nr,
+               struct iocb   **iocbpp)
+{
+  return syscall (__NR_io_submit, ctx, nr, iocbpp);
+}
+
+static gint
+sys_io_getevents (aio_context_t     ctx,
+                  glong             min_nr,
+                  glong             nr,
+                  struct io_event  *events,
+                  struct timespec  *timeout)
+{
+  return syscall (__NR_io_getevents, ctx, min_nr, nr, events, timeout);
+}
+
+static guint64
+get_time_nsec (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((guint64) ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static guint
+latency_to_bucket (guint64 nsec)
+{
+  guint msb = 0;
+  guint shift;
+
+  if (nsec < LATENCY_SUB_BUCKETS)
+    return nsec;
+
+  while ((nsec >> (msb + 1)) != 0)
+    msb++;
+  shift = msb - LATENCY_SUB_BITS;
+  return (shift + 1) * LATENCY_SUB_BUCKETS + ((nsec >> shift) & (LATENCY_SUB_BUCKETS - 1));
+}
+
+static guint64
+bucket_to_latency (guint bucket)
+{
+  guint shift;
+  guint64 low;
+
+  if (bucket < LATENCY_SUB_BUCKETS)
+    return bucket;
+
+  shift = bucket / LATENCY_SUB_BUCKETS - 1;
+  low = ((guint64) (LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS)) << shift;
+  /* middle of the bucket */
+  return low + ((((guint64) 1) << shift) >> 1);
+}
+
+static guint64
+get_percentile (const guint64 *histogram,
+                guint64        count,
+                gdouble        percentile,
+                guint64        min,
+                guint64        max)
+{
+  guint64 target;
+  guint64 seen = 0;
+  guint n;
+
+  target = (guint64) (percentile * count + 0.5);
+  if (target == 0)
+    target = 1;
+
+  for (n = 0; n < LATENCY_BUCKETS; n++)
+    {
+      seen += histogram[n];
+      if (seen >= target)
+        return CLAMP (bucket_to_latency (n), min, max);
+    }
+  return max;
+}
+
+/* xorshift64, write data only has to defeat compression and deduplication */
+static void
+fill_random (guchar *buf,
+             gsize   size)
+{
+  guint64 state;
+  gsize n;
+
+  state = ((guint64) g_random_int ()) << 32 | g_random_int () | 1;
+  for (n = 0; n + sizeof (guint64) <= size; n += sizeof (guint64))
+    {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      memcpy (buf + n, &state, sizeof (guint64));
+    }
+}
+
+/**
+ * udisks_benchmark_run_sync:
+ * @fd: A file descriptor for a block device opened with <literal>O_DIRECT</literal>.
+ * @params: The workload to run.
+ * @results: (out): Return location for the results.
+ * @progress_func: (allow-none): Function to report progress to or %NULL.
+ * @user_data: User data to pass to @progress_func.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Runs the workload described by @params against @fd, blocking the
+ * calling thread until either limit in @params is reached, an I/O
+ * error occurs or @cancellable is cancelled.
+ *
+ * Returns: %TRUE if @results was set, %FALSE if @error is set.
+ */
+gboolean
+udisks_benchmark_run_sync (gint                          fd,
+                           const UDisksBenchmarkParams  *params,
+                           UDisksBenchmarkResults       *results,
+                           UDisksBenchmarkProgressFunc   progress_func,
+                           gpointer                      user_data,
+                           GCancellable                 *cancellable,
+                           GError                      **error)
+{
+  gboolean ret = FALSE;
+  GError *local_error = NULL;
+  aio_context_t ctx = 0;
+  gboolean have_ctx = FALSE;
+  struct iocb *iocbs = NULL;
+  struct iocb **to_submit = NULL;
+  struct io_event *events = NULL;
+  guint64 *submit_time = NULL;
+  guint64 *histogram = NULL;
+  gpointer buffers = NULL;
+  GRand *rand = NULL;
+  guint64 device_size;
+  gint logical_block_size;
+  guint64 num_blocks;
+  guint64 next_block = 0;
+  guint64 submitted_bytes = 0;
+  guint64 latency_sum = 0;
+  guint64 latency_min = G_MAXUINT64;
+  guint64 latency_max = 0;
+  guint64 start_time;
+  guint64 end_time;
+  guint64 deadline = 0;
+  guint64 time_of_last_progress;
+  guint64 bytes_at_last_progress = 0;
+  guint queue_depth;
+  guint in_flight = 0;
+  guint n_submit = 0;
+  guint n_prepared = 0;
+  gboolean stopping = FALSE;
+  guint n;
+
+  g_return_val_if_fail (params != NULL, FALSE);
+  g_return_val_if_fail (results != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  memset (results, 0, sizeof (UDisksBenchmarkResults));
+
+  if (ioctl (fd, BLKGETSIZE64, &device_size) != 0)
+    {
+      g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error doing BLKGETSIZE64 ioctl: %m");
+      goto out;
+    }
+  if (ioctl (fd, BLKSSZGET, &logical_block_size) != 0)
+    {
+      g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error doing BLKSSZGET ioctl: %m");
+      goto out;
+    }
+
+  if (params->block_size == 0 || params->block_size % logical_block_size != 0)
+    {
+      g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Block size %" G_GSIZE_FORMAT " is not a multiple of the logical block size %d",
+                   params->block_size, logical_block_size);
+      goto out;
+    }
+  if (params->max_bytes == 0 && params->max_duration_usec <= 0)
+    {
+      g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Either a size or a duration limit must be given");
+      goto out;
+    }
+
+  num_blocks = device_size / params->block_size;
+  if (num_blocks == 0)
+    {
+      g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Device of size %" G_GUINT64_FORMAT " is smaller than the block size %" G_GSIZE_FORMAT,
+                   device_size, params->block_size);
+      goto out;
+    }
+
+  queue_depth = CLAMP (params->queue_depth, 1, MAX_QUEUE_DEPTH);
+  if ((guint64) queue_depth * params->block_size > MAX_BUFFER_SIZE)
+    {
+      g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Queue depth times block size must not exceed %d bytes",
+                   MAX_BUFFER_SIZE);
+      goto out;
+    }
+
+  if (posix_memalign (&buffers, MAX (logical_block_size, 4096), queue_depth * params->block_size) != 0)
+    {
+      buffers = NULL;
+      g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error allocating %" G_GSIZE_FORMAT " bytes of aligned memory",
+                   queue_depth * params->block_size);
+      goto out;
+    }
+  if (params->write)
+    fill_random (buffers, queue_depth * params->block_size);
+
+  if (sys_io_setup (queue_depth, &ctx) != 0)
+    {
+      g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error setting up asynchronous I/O: %m");
+      goto out;
+    }
+  have_ctx = TRUE;
+
+  iocbs = g_new0 (struct iocb, queue_depth);
+  to_submit = g_new0 (struct iocb *, queue_depth);
+  events = g_new0 (struct io_event, queue_depth);
+  submit_time = g_new0 (guint64, queue_depth);
+  histogram = g_new0 (guint64, LATENCY_BUCKETS);
+  rand = g_rand_new ();
+
+  start_time = get_time_nsec ();
+  time_of_last_progress = start_time;
+  if (params->max_duration_usec > 0)
+    deadline = start_time + params->max_duration_usec * 1000;
+
+  for (n = 0; n < queue_depth; n++)
+    to_submit[n_submit++] = &iocbs[n];
+
+  while (TRUE)
+    {
+      struct timespec timeout = { 0, 250 * 1000 * 1000 };
+      guint64 now;
+      gint rc;
+
+      /* prepare the new slots in to_submit unless a limit was reached */
+      for (n = n_prepared; n < n_submit; n++)
+        {
+          struct iocb *iocb = to_submit[n];
+          guint idx = iocb - iocbs;
+          guint64 block;
+
+          if (stopping ||
+              (params->max_bytes > 0 && submitted_bytes >= params->max_bytes) ||
+              (deadline > 0 && get_time_nsec () >= deadline))
+            {
+              stopping = TRUE;
+              n_submit = n;
+              break;
+            }
+
+          if (params->random)
+            block = (((guint64) g_rand_int (rand)) << 32 | g_rand_int (rand)) % num_blocks;
+          else
+            block = next_block++ % num_blocks;
+
+          memset (iocb, 0, sizeof (struct iocb));
+          iocb->aio_data = idx;
+          iocb->aio_lio_opcode = params->write ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+          iocb->aio_fildes = fd;
+          iocb->aio_buf = (guint64) (guintptr) ((guchar *) buffers + idx * params->block_size);
+          iocb->aio_nbytes = params->block_size;
+          iocb->aio_offset = block * params->block_size;
+          submitted_bytes += params->block_size;
+        }
+      /* slots prepared before a limit was reached are still submitted */
+      if (local_error != NULL)
+        n_submit = 0;
+
+      n = 0;
+      while (n < n_submit)
+        {
+          now = get_time_nsec ();
+          rc = sys_io_submit (ctx, n_submit - n, to_submit + n);
+          if (rc < 0)
+            {
+              if (errno == EINTR)
+                continue;
+              if (errno == EAGAIN && in_flight > 0)
+                {
+                  /* retried after reaping some requests */
+                  memmove (to_submit, to_submit + n, (n_submit - n) * sizeof (struct iocb *));
+                  break;
+                }
+              g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                           "Error submitting I/O: %m");
+              stopping = TRUE;
+              break;
+            }
+          for (; rc > 0; rc--, n++)
+            {
+              submit_time[to_submit[n] - iocbs] = now;
+              in_flight++;
+            }
+        }
+      n_submit = n < n_submit && !stopping ? n_submit - n : 0;
+      n_prepared = n_submit;
+
+      if (in_flight == 0)
+        break;
+
+      rc = sys_io_getevents (ctx, 1, queue_depth, events, &timeout);
+      if (rc < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          if (local_error == NULL)
+            g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                         "Error waiting for I/O: %m");
+          /* io_destroy() below waits for what is still in flight */
+          break;
+        }
+
+      now = get_time_nsec ();
+      for (n = 0; n < (guint) rc; n++)
+        {
+          guint idx = events[n].data;
+          gint64 res = events[n].res;
+          guint64 latency;
+
+          in_flight--;
+          if (res != (gint64) params->block_size)
+            {
+              if (local_error == NULL)
+                {
+                  if (res < 0)
+                    g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                 "Error %s %" G_GSIZE_FORMAT " bytes at offset %" G_GUINT64_FORMAT ": %s",
+                                 params->write ? "writing" : "reading",
+                                 params->block_size, (guint64) iocbs[idx].aio_offset,
+                                 g_strerror (-res));
+                  else
+                    g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                 "Short %s of %" G_GINT64_FORMAT " bytes at offset %" G_GUINT64_FORMAT,
+                                 params->write ? "write" : "read",
+                                 res, (guint64) iocbs[idx].aio_offset);
+                }
+              stopping = TRUE;
+              continue;
+            }
+
+          latency = now - submit_time[idx];
+          histogram[latency_to_bucket (latency)]++;
+          latency_sum += latency;
+          latency_min = MIN (latency_min, latency);
+          latency_max = MAX (latency_max, latency);
+          results->bytes += params->block_size;
+          results->operations++;
+
+          to_submit[n_submit++] = &iocbs[idx];
+        }
+
+      if (!stopping && g_cancellable_is_cancelled (cancellable))
+        {
+          g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_CANCELLED,
+                       "Job was canceled");
+          stopping = TRUE;
+        }
+
+      /* only report progress at most once a second */
+      if (progress_func != NULL && now - time_of_last_progress > 1000000000)
+        {
+          gdouble progress = 0.0;
+
+          if (params->max_bytes > 0)
+            progress = ((gdouble) results->bytes) / params->max_bytes;
+          if (deadline > 0)
+            progress = MAX (progress, ((gdouble) (now - start_time)) / (deadline - start_time));
+          progress_func (MIN (progress, 1.0),
+                         (results->bytes - bytes_at_last_progress) * 1000000000 / (now - time_of_last_progress),
+                         user_data);
+          time_of_last_progress = now;
+          bytes_at_last_progress = results->bytes;
+        }
+    }
+  end_time = get_time_nsec ();
+
+  if (local_error != NULL)
+    goto out;
+
+  results->elapsed_usec = (end_time - start_time) / 1000;
+  if (end_time > start_time)
+    {
+      results->throughput = ((gdouble) results->bytes) * 1e9 / (end_time - start_time);
+      results->iops = ((gdouble) results->operations) * 1e9 / (end_time - start_time);
+    }
+  if (results->operations > 0)
+    {
+      results->latency_min = latency_min;
+      results->latency_max = latency_max;
+      results->latency_mean = latency_sum / results->operations;
+      results->latency_p50 = get_percentile (histogram, results->operations, 0.50, latency_min, latency_max);
+      results->latency_p90 = get_percentile (histogram, results->operations, 0.90, latency_min, latency_max);
+      results->latency_p99 = get_percentile (histogram, results->operations, 0.99, latency_min, latency_max);
+      results->latency_p999 = get_percentile (histogram, results->operations, 0.999, latency_min, latency_max);
+    }
+
+  ret = TRUE;
+
+ out:
+  if (have_ctx)
+    sys_io_destroy (ctx);
+  if (local_error != NULL)
+    g_propagate_error (error, local_error);
+  if (rand != NULL)
+    g_rand_free (rand);
+  g_free (histogram);
+  g_free (submit_time);
+  g_free (events);
+  g_free (to_submit);
+  g_free (iocbs);
+  free (buffers);
+  return ret;
+}
@@ -0,0 +1,106 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __UDISKS_BENCHMARK_H__
+#define __UDISKS_BENCHMARK_H__
+
+#include "udisksdaemontypes.h"
+
+G_BEGIN_DECLS
+
+/**
+ * UDisksBenchmarkParams:
+ * @random: Whether to use random offsets instead of sequential ones.
+ * @write: Whether to write instead of read. Destroys data on the device.
+ * @block_size: Size of each request in bytes, a multiple of the logical block size.
+ * @queue_depth: Number of requests kept in flight.
+ * @max_bytes: Stop after transferring this many bytes or 0 for no limit.
+ * @max_duration_usec: Stop after this many microseconds or 0 for no limit.
+ *
+ * Parameters for udisks_benchmark_run_sync(). At least one of
+ * @max_bytes and @max_duration_usec must be non-zero.
+ */
+struct _UDisksBenchmarkParams
+{
+  /*< public >*/
+  gboolean random;
+  gboolean write;
+  gsize    block_size;
+  guint    queue_depth;
+  guint64  max_bytes;
+  gint64   max_duration_usec;
+};
+
+/**
+ * UDisksBenchmarkResults:
+ * @bytes: Number of bytes transferred.
+ * @operations: Number of requests completed.
+ * @elapsed_usec: Wall clock time the benchmark ran for, in microseconds.
+ * @throughput: Bytes per second.
+ * @iops: Requests per second.
+ * @latency_min: Minimum request latency in nanoseconds.
+ * @latency_mean: Mean request latency in nanoseconds.
+ * @latency_p50: Median request latency in nanoseconds.
+ * @latency_p90: 90th percentile request latency in nanoseconds.
+ * @latency_p99: 99th percentile request latency in nanoseconds.
+ * @latency_p999: 99.9th percentile request latency in nanoseconds.
+ * @latency_max: Maximum request latency in nanoseconds.
+ *
+ * Results of udisks_benchmark_run_sync(). Percentiles are taken from a
+ * log-linear histogram and are accurate to within about 6%.
+ */
+struct _UDisksBenchmarkResults
+{
+  /*< public >*/
+  guint64 bytes;
+  guint64 operations;
+  gint64  elapsed_usec;
+  gdouble throughput;
+  gdouble iops;
+  guint64 latency_min;
+  guint64 latency_mean;
+  guint64 latency_p50;
+  guint64 latency_p90;
+  guint64 latency_p99;
+  guint64 latency_p999;
+  guint64 latency_max;
+};
+
+/**
+ * UDisksBenchmarkProgressFunc:
+ * @progress: Progress between 0.0 and 1.0.
+ * @rate: Current throughput in bytes per second.
+ * @user_data: User data passed to udisks_benchmark_run_sync().
+ *
+ * Function called at most once a second while a benchmark is running.
+ */
+typedef void (*UDisksBenchmarkProgressFunc) (gdouble   progress,
+                                             guint64   rate,
+                                             gpointer  user_data);
+
+gboolean udisks_benchmark_run_sync (gint                          fd,
+                                    const UDisksBenchmarkParams  *params,
+                                    UDisksBenchmarkResults       *results,
+                                    UDisksBenchmarkProgressFunc   progress_func,
+                                    gpointer                      user_data,
+                                    GCancellable                 *cancellable,
+                                    GError                      **error);
+
+G_END_DECLS
+
+#endif /* __UDISKS_BENCHMARK_H__ */
@@ -37,6 +37,13 @@ struct _UDisksConfigManager {
 
   const gchar *encryption;
   gchar *config_dir;
+
+  guint max_jobs_per_drive;
+  guint max_jobs_per_host;
+
+  guint slow_handler_threshold;
+
+  guint statistics_interval;
 };
 
 struct _UDisksConfigManagerClass {
@@ -61,6 +68,19 @@ enum
 #define DEFAULTS_GROUP_NAME "defaults"
 #define DEFAULTS_ENCRYPTION_KEY "encryption"
 
+#define JOBS_GROUP_NAME "jobs"
+#define JOBS_MAX_PER_DRIVE_KEY "max_jobs_per_drive"
+#define JOBS_MAX_PER_HOST_KEY "max_jobs_per_host"
+
+#define DEBUG_GROUP_NAME "debug"
+#define DEBUG_SLOW_HANDLER_THRESHOLD_KEY "slow_handler_threshold"
+
+#define STATISTICS_GROUP_NAME "statistics"
+#define STATISTICS_INTERVAL_KEY "sample_interval"
+
+#define SLOW_HANDLER_THRESHOLD_DEFAULT 250
+#define STATISTICS_INTERVAL_DEFAULT 1000
+
 #define MODULES_ALL_ARG "*"
 
 static void
@@ -138,10 +158,37 @@ udisks_config_manager_set_property (GObject      *object,
     }
 }
 
+static void
+read_uint (GKeyFile    *config_file,
+           const gchar *group,
+           const gchar *key,
+           guint       *out_value)
+{
+  GError *error = NULL;
+  gint value;
+
+  if (!g_key_file_has_key (config_file, group, key, NULL))
+    return;
+
+  value = g_key_file_get_integer (config_file, group, key, &error);
+  if (error != NULL || value < 0)
+    {
+      udisks_warning ("Invalid value used for '%s': %s; defaulting to %u",
+                      key, error != NULL ? error->message : "negative number", *out_value);
+      g_clear_error (&error);
+      return;
+    }
+  *out_value = value;
+}
+
 static void
 parse_config_file (UDisksConfigManager         *manager,
                    UDisksModuleLoadPreference  *out_load_preference,
                    const gchar                **out_encryption,
+                   guint                       *out_max_jobs_per_drive,
+                   guint                       *out_max_jobs_per_host,
+                   guint                       *out_slow_handler_threshold,
+                   guint                       *out_statistics_interval,
                    GList                      **out_modules)
 {
   GKeyFile *config_file;
@@ -239,6 +286,18 @@ parse_config_file (UDisksConfigManager         *manager,
               g_free (encryption);
             }
         }
+
+      if (out_max_jobs_per_drive != NULL)
+        read_uint (config_file, JOBS_GROUP_NAME, JOBS_MAX_PER_DRIVE_KEY, out_max_jobs_per_drive);
+
+      if (out_max_jobs_per_host != NULL)
+        read_uint (config_file, JOBS_GROUP_NAME, JOBS_MAX_PER_HOST_KEY, out_max_jobs_per_host);
+
+      if (out_slow_handler_threshold != NULL)
+        read_uint (config_file, DEBUG_GROUP_NAME, DEBUG_SLOW_HANDLER_THRESHOLD_KEY, out_slow_handler_threshold);
+
+      if (out_statistics_interval != NULL)
+        read_uint (config_file, STATISTICS_GROUP_NAME, STATISTICS_INTERVAL_KEY, out_statistics_interval);
     }
   else
     {
@@ -268,7 +327,14 @@ udisks_config_manager_constructed (GObject *object)
       udisks_warning ("Error creating directory %s: %m", manager->config_dir);
     }
 
-  parse_config_file (manager, &manager->load_preference, &manager->encryption, NULL);
+  parse_config_file (manager,
+                     &manager->load_preference,
+                     &manager->encryption,
+                     &manager->max_jobs_per_drive,
+                     &manager->max_jobs_per_host,
+                     &manager->slow_handler_threshold,
+                     &manager->statistics_interval,
+                     NULL);
 
   if (G_OBJECT_CLASS (udisks_config_manager_parent_class))
     G_OBJECT_CLASS (udisks_config_manager_parent_class)->constructed (object);
@@ -360,6 +426,8 @@ udisks_config_manager_init (UDisksConfigManager *manager)
 {
   manager->load_preference = UDISKS_MODULE_LOAD_ONDEMAND;
   manager->encryption = UDISKS_ENCRYPTION_DEFAULT;
+  manager->slow_handler_threshold = SLOW_HANDLER_THRESHOLD_DEFAULT;
+  manager->statistics_interval = STATISTICS_INTERVAL_DEFAULT;
 }
 
 UDisksConfigManager *
@@ -404,7 +472,7 @@ udisks_config_manager_get_modules (UDisksConfigManager *manager)
 
   g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager), NULL);
 
-  parse_config_file (manager, NULL, NULL, &modules);
+  parse_config_file (manager, NULL, NULL, NULL, NULL, NULL, NULL, &modules);
   return modules;
 }
 
@@ -425,7 +493,7 @@ udisks_config_manager_get_modules_all (UDisksConfigManager *manager)
 
   g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager), FALSE);
 
-  parse_config_file (manager, NULL, NULL, &modules);
+  parse_config_file (manager, NULL, NULL, NULL, NULL, NULL, NULL, &modules);
 
   ret = !modules || (g_strcmp0 (modules->data, MODULES_ALL_ARG) == 0 && g_list_length (modules) == 1);
 
@@ -450,6 +518,100 @@ udisks_config_manager_get_encryption (UDisksConfigManager *manager)
   return manager->encryption;
 }
 
+/**
+ * udisks_config_manager_get_max_jobs_per_drive:
+ * @manager: A #UDisksConfigManager.
+ *
+ * Gets the maximum number of jobs allowed to run concurrently against
+ * a single drive, as set by the <literal>max_jobs_per_drive</literal>
+ * key in the <literal>[jobs]</literal> section of the udisks2.conf file.
+ *
+ * Returns: The limit or 0 if unlimited.
+ */
+guint
+udisks_config_manager_get_max_jobs_per_drive (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager), 0);
+  return manager->max_jobs_per_drive;
+}
+
+/**
+ * udisks_config_manager_get_max_jobs_per_host:
+ * @manager: A #UDisksConfigManager.
+ *
+ * Gets the maximum number of jobs allowed to run concurrently against
+ * drives behind a single host adapter, as set by the
+ * <literal>max_jobs_per_host</literal> key in the
+ * <literal>[jobs]</literal> section of the udisks2.conf file.
+ *
+ * Returns: The limit or 0 if unlimited.
+ */
+guint
+udisks_config_manager_get_max_jobs_per_host (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager), 0);
+  return manager->max_jobs_per_host;
+}
+
+/**
+ * udisks_config_manager_reload_job_limits:
+ * @manager: A #UDisksConfigManager.
+ *
+ * Re-reads the <literal>max_jobs_per_drive</literal> and
+ * <literal>max_jobs_per_host</literal> keys from the udisks2.conf file.
+ * The new limits apply to jobs admitted from now on, running jobs are
+ * not affected.
+ */
+void
+udisks_config_manager_reload_job_limits (UDisksConfigManager *manager)
+{
+  guint max_jobs_per_drive = 0;
+  guint max_jobs_per_host = 0;
+
+  g_return_if_fail (UDISKS_IS_CONFIG_MANAGER (manager));
+
+  parse_config_file (manager, NULL, NULL, &max_jobs_per_drive, &max_jobs_per_host, NULL, NULL, NULL);
+  manager->max_jobs_per_drive = max_jobs_per_drive;
+  manager->max_jobs_per_host = max_jobs_per_host;
+  udisks_notice ("Job limits reloaded: %u per drive, %u per host", max_jobs_per_drive, max_jobs_per_host);
+}
+
+/**
+ * udisks_config_manager_get_slow_handler_threshold:
+ * @manager: A #UDisksConfigManager.
+ *
+ * Gets the duration in milliseconds above which handlers running in the
+ * daemon are logged as slow, as set by the
+ * <literal>slow_handler_threshold</literal> key in the
+ * <literal>[debug]</literal> section of the udisks2.conf file.
+ *
+ * Returns: The threshold or 0 if slow handlers should not be logged.
+ */
+guint
+udisks_config_manager_get_slow_handler_threshold (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager), 0);
+  return manager->slow_handler_threshold;
+}
+
+/**
+ * udisks_config_manager_get_statistics_interval:
+ * @manager: A #UDisksConfigManager.
+ *
+ * Gets the interval in milliseconds at which I/O statistics are
+ * sampled for subscribed block devices, as set by the
+ * <literal>sample_interval</literal> key in the
+ * <literal>[statistics]</literal> section of the udisks2.conf file.
+ *
+ * Returns: The interval in milliseconds.
+ */
+guint
+udisks_config_manager_get_statistics_interval (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager), STATISTICS_INTERVAL_DEFAULT);
+  return manager->statistics_interval;
+}
+
 /**
  * udisks_config_manager_get_config_dir:
  * @manager: A #UDisksConfigManager.
@@ -61,6 +61,12 @@ UDisksModuleLoadPreference
                       udisks_config_manager_get_load_preference (UDisksConfigManager *manager);
 const gchar          *udisks_config_manager_get_encryption (UDisksConfigManager *manager);
 
+guint                 udisks_config_manager_get_max_jobs_per_drive (UDisksConfigManager *manager);
+guint                 udisks_config_manager_get_max_jobs_per_host  (UDisksConfigManager *manager);
+void                  udisks_config_manager_reload_job_limits (UDisksConfigManager *manager);
+guint                 udisks_config_manager_get_slow_handler_threshold (UDisksConfigManager *manager);
+guint                 udisks_config_manager_get_statistics_interval (UDisksConfigManager *manager);
+
 const gchar          *udisks_config_manager_get_config_dir  (UDisksConfigManager *manager);
 
 G_END_DECLS
@@ -43,6 +43,11 @@
 #include "udisksmodulemanager.h"
 #include "udisksmodule.h"
 #include "udisksconfigmanager.h"
+#include "udisksjobscheduler.h"
+#include "udisksdriveconfigstore.h"
+#include "udisksdevicegraph.h"
+#include "udisksstatisticssampler.h"
+#include "udisksstats.h"
 #include "udiskslinuxmountoptions.h"
 
 #ifdef HAVE_LIBMOUNT_UTAB
@@ -90,6 +95,14 @@ struct _UDisksDaemon
 
   UDisksConfigManager *config_manager;
 
+  UDisksJobScheduler *job_scheduler;
+
+  UDisksDriveConfigStore *drive_config_store;
+
+  UDisksDeviceGraph *device_graph;
+
+  UDisksStatisticsSampler *statistics_sampler;
+
   gboolean disable_modules;
   gboolean force_load_modules;
   gboolean uninstalled;
@@ -144,6 +157,10 @@ udisks_daemon_finalize (GObject *object)
   g_object_unref (daemon->state);
   g_free (daemon->uuid);
 
+  g_clear_object (&daemon->job_scheduler);
+  g_clear_object (&daemon->drive_config_store);
+  g_clear_object (&daemon->device_graph);
+  g_clear_object (&daemon->statistics_sampler);
   g_clear_object (&daemon->config_manager);
 
   if (G_OBJECT_CLASS (udisks_daemon_parent_class)->finalize != NULL)
@@ -417,6 +434,16 @@ udisks_daemon_constructed (GObject *object)
       daemon->module_manager = udisks_module_manager_new_uninstalled (daemon);
     }
 
+  daemon->job_scheduler = udisks_job_scheduler_new (daemon);
+
+  daemon->drive_config_store = udisks_drive_config_store_new (udisks_config_manager_get_config_dir (daemon->config_manager));
+
+  daemon->device_graph = udisks_device_graph_new ();
+
+  daemon->statistics_sampler = udisks_statistics_sampler_new (udisks_config_manager_get_statistics_interval (daemon->config_manager));
+
+  udisks_stats_init (udisks_config_manager_get_slow_handler_threshold (daemon->config_manager), NULL);
+
   daemon->mount_monitor = udisks_mount_monitor_new ();
 
   daemon->state = udisks_state_new (daemon);
@@ -778,6 +805,9 @@ on_job_completed (UDisksJob    *job,
   object = UDISKS_OBJECT_SKELETON (g_dbus_interface_get_object (G_DBUS_INTERFACE (job)));
   g_assert (object != NULL);
 
+  /* let queued jobs for the same drive run */
+  udisks_job_scheduler_release (daemon->job_scheduler, UDISKS_BASE_JOB (job));
+
   /* Unexport job */
   g_dbus_object_manager_server_unexport (daemon->object_manager,
                                          g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
@@ -838,6 +868,9 @@ common_job (UDisksDaemon    *daemon,
                           G_CALLBACK (on_job_completed),
                           job_data);
 
+  /* wait for other jobs on the same drive or host, if limited */
+  udisks_job_scheduler_admit_sync (daemon->job_scheduler, UDISKS_BASE_JOB (job), object, job_operation);
+
   return UDISKS_BASE_JOB (job);
 }
 
@@ -1162,6 +1195,72 @@ udisks_daemon_launch_spawned_job_sync (UDisksDaemon    *daemon,
   return ret;
 }
 
+static gboolean
+launch_spawned_job_sync (UDisksDaemon    *daemon,
+                         UDisksObject    *object,
+                         const gchar     *job_operation,
+                         uid_t            job_started_by_uid,
+                         GCancellable    *cancellable,
+                         uid_t            run_as_uid,
+                         uid_t            run_as_euid,
+                         GCallback        output_line_callback,
+                         gpointer         user_data,
+                         gint            *out_status,
+                         gchar          **out_message,
+                         GString         *input_string,
+                         const gchar     *command_line)
+{
+  UDisksBaseJob *job;
+  SpawnedJobSyncData data;
+
+  data.context = g_main_context_new ();
+  g_main_context_push_thread_default (data.context);
+  data.loop = g_main_loop_new (data.context, FALSE);
+  data.success = FALSE;
+  data.status = 0;
+  data.message = NULL;
+
+  job = udisks_daemon_launch_spawned_job_gstring (daemon,
+                                          object,
+                                          job_operation,
+                                          job_started_by_uid,
+                                          cancellable,
+                                          run_as_uid,
+                                          run_as_euid,
+                                          input_string,
+                                          "%s",
+                                          command_line);
+  g_signal_connect (job,
+                    "spawned-job-completed",
+                    G_CALLBACK (spawned_job_sync_on_spawned_job_completed),
+                    &data);
+  g_signal_connect_after (job,
+                          "completed",
+                          G_CALLBACK (spawned_job_sync_on_completed),
+                          &data);
+  if (output_line_callback != NULL)
+    g_signal_connect (job, "output-line", output_line_callback, user_data);
+
+  udisks_spawned_job_start (UDISKS_SPAWNED_JOB (job));
+  g_main_loop_run (data.loop);
+
+  if (out_status != NULL)
+    *out_status = data.status;
+
+  if (out_message != NULL)
+    *out_message = data.message;
+  else
+    g_free (data.message);
+
+  g_main_loop_unref (data.loop);
+  g_main_context_pop_thread_default (data.context);
+  g_main_context_unref (data.context);
+
+  /* note: the job object is freed in the ::completed handler */
+
+  return data.success;
+}
+
 /**
  * udisks_daemon_launch_spawned_job_gstring_sync:
  * @daemon: A #UDisksDaemon.
@@ -1202,61 +1301,77 @@ udisks_daemon_launch_spawned_job_gstring_sync (UDisksDaemon    *daemon,
 {
   va_list var_args;
   gchar *command_line;
-  UDisksBaseJob *job;
-  SpawnedJobSyncData data;
+  gboolean ret;
 
   g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), FALSE);
   g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), FALSE);
   g_return_val_if_fail (command_line_format != NULL, FALSE);
 
-  data.context = g_main_context_new ();
-  g_main_context_push_thread_default (data.context);
-  data.loop = g_main_loop_new (data.context, FALSE);
-  data.success = FALSE;
-  data.status = 0;
-  data.message = NULL;
-
   va_start (var_args, command_line_format);
   command_line = g_strdup_vprintf (command_line_format, var_args);
   va_end (var_args);
-  job = udisks_daemon_launch_spawned_job_gstring (daemon,
-                                          object,
-                                          job_operation,
-                                          job_started_by_uid,
-                                          cancellable,
-                                          run_as_uid,
-                                          run_as_euid,
-                                          input_string,
-                                          "%s",
-                                          command_line);
-  g_signal_connect (job,
-                    "spawned-job-completed",
-                    G_CALLBACK (spawned_job_sync_on_spawned_job_completed),
-                    &data);
-  g_signal_connect_after (job,
-                          "completed",
-                          G_CALLBACK (spawned_job_sync_on_completed),
-                          &data);
 
-  udisks_spawned_job_start (UDISKS_SPAWNED_JOB (job));
-  g_main_loop_run (data.loop);
+  ret = launch_spawned_job_sync (daemon, object, job_operation, job_started_by_uid, cancellable,
+                                 run_as_uid, run_as_euid, NULL, NULL,
+                                 out_status, out_message, input_string, command_line);
 
-  if (out_status != NULL)
-    *out_status = data.status;
+  g_free (command_line);
+  return ret;
+}
 
-  if (out_message != NULL)
-    *out_message = data.message;
-  else
-    g_free (data.message);
+/**
+ * udisks_daemon_launch_spawned_job_with_output_sync:
+ * @daemon: A #UDisksDaemon.
+ * @object: (allow-none): A #UDisksObject to add to the job or %NULL.
+ * @job_operation: The operation for the job.
+ * @job_started_by_uid: The user who started the job.
+ * @cancellable: A #GCancellable or %NULL.
+ * @output_line_callback: Handler for the #UDisksSpawnedJob::output-line signal.
+ * @user_data: User data to pass to @output_line_callback.
+ * @out_status: Return location for the @status parameter of the #UDisksSpawnedJob::spawned-job-completed signal.
+ * @out_message: Return location for the @message parameter of the #UDisksJob::completed signal.
+ * @command_line_format: printf()-style format for the command line to spawn.
+ * @...: Arguments for @command_line_format.
+ *
+ * Like udisks_daemon_launch_spawned_job_sync() for a command run as
+ * root without any input, but @output_line_callback is called for
+ * every line the command prints while it is running, e.g. to update
+ * the progress of the job.
+ *
+ * Returns: The @success parameter of the #UDisksJob::completed signal.
+ */
+gboolean
+udisks_daemon_launch_spawned_job_with_output_sync (UDisksDaemon    *daemon,
+                                                   UDisksObject    *object,
+                                                   const gchar     *job_operation,
+                                                   uid_t            job_started_by_uid,
+                                                   GCancellable    *cancellable,
+                                                   GCallback        output_line_callback,
+                                                   gpointer         user_data,
+                                                   gint            *out_status,
+                                                   gchar          **out_message,
+                                                   const gchar     *command_line_format,
+                                                   ...)
+{
+  va_list var_args;
+  gchar *command_line;
+  gboolean ret;
 
-  g_free (command_line);
-  g_main_loop_unref (data.loop);
-  g_main_context_pop_thread_default (data.context);
-  g_main_context_unref (data.context);
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), FALSE);
+  g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), FALSE);
+  g_return_val_if_fail (output_line_callback != NULL, FALSE);
+  g_return_val_if_fail (command_line_format != NULL, FALSE);
 
-  /* note: the job object is freed in the ::completed handler */
+  va_start (var_args, command_line_format);
+  command_line = g_strdup_vprintf (command_line_format, var_args);
+  va_end (var_args);
 
-  return data.success;
+  ret = launch_spawned_job_sync (daemon, object, job_operation, job_started_by_uid, cancellable,
+                                 0, 0, output_line_callback, user_data,
+                                 out_status, out_message, NULL, command_line);
+
+  g_free (command_line);
+  return ret;
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -1594,28 +1709,7 @@ UDisksObject *
 udisks_daemon_find_block (UDisksDaemon *daemon,
                           dev_t         block_device_number)
 {
-  UDisksObject *ret = NULL;
-  GList *objects, *l;
-
-  objects = g_dbus_object_manager_get_objects (G_DBUS_OBJECT_MANAGER (daemon->object_manager));
-  for (l = objects; l != NULL; l = l->next)
-    {
-      UDisksObject *object = UDISKS_OBJECT (l->data);
-      UDisksBlock *block;
-
-      block = udisks_object_peek_block (object);
-      if (block == NULL)
-        continue;
-
-      if (udisks_block_get_device_number (block) == block_device_number)
-        {
-          ret = g_object_ref (object);
-          goto out;
-        }
-    }
- out:
-  g_list_free_full (objects, g_object_unref);
-  return ret;
+  return udisks_device_graph_lookup_by_device_number (daemon->device_graph, block_device_number);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -1672,33 +1766,7 @@ UDisksObject *
 udisks_daemon_find_block_by_sysfs_path (UDisksDaemon *daemon,
                                         const gchar  *sysfs_path)
 {
-  UDisksObject *ret = NULL;
-  GList *objects, *l;
-
-  objects = g_dbus_object_manager_get_objects (G_DBUS_OBJECT_MANAGER (daemon->object_manager));
-  for (l = objects; l != NULL; l = l->next)
-    {
-      UDisksObject *object = UDISKS_OBJECT (l->data);
-      UDisksLinuxDevice *device;
-
-      if (!UDISKS_IS_LINUX_BLOCK_OBJECT (object))
-        continue;
-
-      device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (object));
-      if (device == NULL)
-        continue;
-
-      if (g_strcmp0 (g_udev_device_get_sysfs_path (device->udev_device), sysfs_path) == 0)
-        {
-          g_object_unref (device);
-          ret = g_object_ref (object);
-          goto out;
-        }
-      g_object_unref (device);
-    }
- out:
-  g_list_free_full (objects, g_object_unref);
-  return ret;
+  return udisks_device_graph_lookup (daemon->device_graph, sysfs_path);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -1764,6 +1832,66 @@ udisks_daemon_get_config_manager (UDisksDaemon *daemon)
   return daemon->config_manager;
 }
 
+/**
+ * udisks_daemon_get_job_scheduler:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Gets the job scheduler used by @daemon.
+ *
+ * Returns: A #UDisksJobScheduler. Do not free, the object is owned by @daemon.
+ */
+UDisksJobScheduler *
+udisks_daemon_get_job_scheduler (UDisksDaemon *daemon)
+{
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
+  return daemon->job_scheduler;
+}
+
+/**
+ * udisks_daemon_get_drive_config_store:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Gets the store of drive configuration files used by @daemon.
+ *
+ * Returns: A #UDisksDriveConfigStore. Do not free, the object is owned by @daemon.
+ */
+UDisksDriveConfigStore *
+udisks_daemon_get_drive_config_store (UDisksDaemon *daemon)
+{
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
+  return daemon->drive_config_store;
+}
+
+/**
+ * udisks_daemon_get_device_graph:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Gets the graph of block device dependencies maintained by @daemon.
+ *
+ * Returns: A #UDisksDeviceGraph. Do not free, the object is owned by @daemon.
+ */
+UDisksDeviceGraph *
+udisks_daemon_get_device_graph (UDisksDaemon *daemon)
+{
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
+  return daemon->device_graph;
+}
+
+/**
+ * udisks_daemon_get_statistics_sampler:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Gets the sampler refreshing the I/O statistics of block devices.
+ *
+ * Returns: A #UDisksStatisticsSampler. Do not free, the object is owned by @daemon.
+ */
+UDisksStatisticsSampler *
+udisks_daemon_get_statistics_sampler (UDisksDaemon *daemon)
+{
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
+  return daemon->statistics_sampler;
+}
+
 /**
  * udisks_daemon_get_disable_modules:
  * @daemon: A #UDisksDaemon.
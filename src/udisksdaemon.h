@@ -48,6 +48,10 @@ PolkitAuthority          *udisks_daemon_get_authority         (UDisksDaemon    *
 UDisksState              *udisks_daemon_get_state             (UDisksDaemon    *daemon);
 UDisksModuleManager      *udisks_daemon_get_module_manager    (UDisksDaemon    *daemon);
 UDisksConfigManager      *udisks_daemon_get_config_manager    (UDisksDaemon    *daemon);
+UDisksJobScheduler       *udisks_daemon_get_job_scheduler     (UDisksDaemon    *daemon);
+UDisksDriveConfigStore   *udisks_daemon_get_drive_config_store(UDisksDaemon    *daemon);
+UDisksDeviceGraph        *udisks_daemon_get_device_graph      (UDisksDaemon    *daemon);
+UDisksStatisticsSampler  *udisks_daemon_get_statistics_sampler (UDisksDaemon   *daemon);
 gboolean                  udisks_daemon_get_disable_modules   (UDisksDaemon    *daemon);
 gboolean                  udisks_daemon_get_force_load_modules(UDisksDaemon    *daemon);
 gboolean                  udisks_daemon_get_uninstalled       (UDisksDaemon    *daemon);
@@ -154,6 +158,17 @@ gboolean                  udisks_daemon_launch_spawned_job_gstring_sync (UDisksD
                                                                  GString         *input_string,
                                                                  const gchar     *command_line_format,
                                                                  ...) G_GNUC_PRINTF (11, 12);
+gboolean                  udisks_daemon_launch_spawned_job_with_output_sync (UDisksDaemon    *daemon,
+                                                                 UDisksObject    *object,
+                                                                 const gchar     *job_operation,
+                                                                 uid_t            job_started_by_uid,
+                                                                 GCancellable    *cancellable,
+                                                                 GCallback        output_line_callback,
+                                                                 gpointer         user_data,
+                                                                 gint            *out_status,
+                                                                 gchar          **out_message,
+                                                                 const gchar     *command_line_format,
+                                                                 ...) G_GNUC_PRINTF (10, 11);
 UDisksBaseJob            *udisks_daemon_launch_threaded_job   (UDisksDaemon          *daemon,
                                                                UDisksObject          *object,
                                                                const gchar           *job_operation,
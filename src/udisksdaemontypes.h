@@ -68,6 +68,33 @@ typedef struct _UDisksThreadedJob UDisksThreadedJob;
 struct _UDisksSimpleJob;
 typedef struct _UDisksSimpleJob UDisksSimpleJob;
 
+struct _UDisksJobScheduler;
+typedef struct _UDisksJobScheduler UDisksJobScheduler;
+
+struct _UDisksDriveConfigStore;
+typedef struct _UDisksDriveConfigStore UDisksDriveConfigStore;
+
+struct _UDisksDeviceGraph;
+typedef struct _UDisksDeviceGraph UDisksDeviceGraph;
+
+struct _UDisksStatisticsSampler;
+typedef struct _UDisksStatisticsSampler UDisksStatisticsSampler;
+
+/**
+ * UDisksJobPriority:
+ * @UDISKS_JOB_PRIORITY_INTERACTIVE: Short jobs a user is waiting for, e.g. mounting. Never queued.
+ * @UDISKS_JOB_PRIORITY_NORMAL: Jobs not classified otherwise.
+ * @UDISKS_JOB_PRIORITY_BULK: Long running jobs moving lots of data, e.g. erasing.
+ *
+ * Priorities used by #UDisksJobScheduler to order queued jobs.
+ */
+typedef enum
+{
+  UDISKS_JOB_PRIORITY_INTERACTIVE,
+  UDISKS_JOB_PRIORITY_NORMAL,
+  UDISKS_JOB_PRIORITY_BULK
+} UDisksJobPriority;
+
 struct _UDisksMountMonitor;
 typedef struct _UDisksMountMonitor UDisksMountMonitor;
 
@@ -86,6 +113,9 @@ typedef struct _UDisksLinuxEncrypted UDisksLinuxEncrypted;
 struct _UDisksLinuxLoop;
 typedef struct _UDisksLinuxLoop UDisksLinuxLoop;
 
+struct _UDisksLinuxBlockStatistics;
+typedef struct _UDisksLinuxBlockStatistics UDisksLinuxBlockStatistics;
+
 struct _UDisksLinuxManager;
 typedef struct _UDisksLinuxManager UDisksLinuxManager;
 
@@ -188,6 +218,18 @@ typedef struct _UDisksAtaCommandOutput UDisksAtaCommandOutput;
 struct _UDisksAtaCommandInput;
 typedef struct _UDisksAtaCommandInput UDisksAtaCommandInput;
 
+struct _UDisksBenchmarkParams;
+typedef struct _UDisksBenchmarkParams UDisksBenchmarkParams;
+
+struct _UDisksBenchmarkResults;
+typedef struct _UDisksBenchmarkResults UDisksBenchmarkResults;
+
+struct _UDisksImageCopyParams;
+typedef struct _UDisksImageCopyParams UDisksImageCopyParams;
+
+struct _UDisksImageCopyResults;
+typedef struct _UDisksImageCopyResults UDisksImageCopyResults;
+
 /**
  * UDisksAtaCommandProtocol:
  * @UDISKS_ATA_COMMAND_PROTOCOL_NONE: Non-data
@@ -1661,53 +1661,137 @@ trigger_uevent (const gchar *path, const gchar *str)
 
 typedef struct
 {
+  volatile gint ref_count;
+  GMutex lock;
   UDisksDaemon *daemon;
-  GMainLoop *main_loop;
-  guint serial;
-  gchar *uevent_path;
-  gboolean success;
-} SynthUeventData;
+  /* NULL once the batch has completed */
+  GTask *task;
+  /* serials (guint) we are still waiting for */
+  GArray *serials;
+  guint num_untagged;
+  gulong probed_handler_id;
+  GSource *timeout_source;
+  GSource *cancellable_source;
+} UeventBatch;
 
-static gboolean
-trigger_uevent_idle_cb (gpointer user_data)
+static UeventBatch *
+uevent_batch_ref (UeventBatch *batch)
+{
+  g_atomic_int_inc (&batch->ref_count);
+  return batch;
+}
+
+static void
+uevent_batch_unref (UeventBatch *batch)
+{
+  if (!g_atomic_int_dec_and_test (&batch->ref_count))
+    return;
+
+  if (batch->timeout_source != NULL)
+    g_source_unref (batch->timeout_source);
+  if (batch->cancellable_source != NULL)
+    g_source_unref (batch->cancellable_source);
+  g_array_unref (batch->serials);
+  g_mutex_clear (&batch->lock);
+  g_free (batch);
+}
+
+static void
+uevent_batch_closure_notify (gpointer  data,
+                             GClosure *closure)
+{
+  uevent_batch_unref (data);
+}
+
+/* Completes the batch unless already done. If @error is %NULL, the
+ * result is determined from the number of serials not received.
+ */
+static void
+uevent_batch_complete (UeventBatch *batch,
+                       GError      *error)
 {
-  SynthUeventData *data = user_data;
-  gchar *str;
+  GTask *task;
+  guint num_missing;
 
-  str = g_strdup_printf ("change %s UDISKSSERIAL=%u", udisks_daemon_get_uuid (data->daemon), data->serial);
+  g_mutex_lock (&batch->lock);
+  task = g_steal_pointer (&batch->task);
+  num_missing = batch->serials->len;
+  g_mutex_unlock (&batch->lock);
 
-  if (! trigger_uevent (data->uevent_path, str))
+  if (task == NULL)
     {
-      /* kernel refused our string, try simple "change" but don't wait for it */
-      trigger_uevent (data->uevent_path, "change");
-      data->success = FALSE;
-      g_main_loop_quit (data->main_loop);
+      g_clear_error (&error);
+      return;
     }
-  g_free (str);
 
-  /* remove the source */
-  return FALSE;
+  g_signal_handler_disconnect (udisks_daemon_get_linux_provider (batch->daemon), batch->probed_handler_id);
+  g_source_destroy (batch->timeout_source);
+  if (batch->cancellable_source != NULL)
+    g_source_destroy (batch->cancellable_source);
+
+  if (error == NULL && num_missing > 0)
+    error = g_error_new (UDISKS_ERROR, UDISKS_ERROR_TIMED_OUT,
+                         "Timed out waiting for %u uevent(s)", num_missing);
+  if (error == NULL && batch->num_untagged > 0)
+    error = g_error_new (UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                         "Kernel refused tagged uevent for %u device(s)", batch->num_untagged);
+
+  if (error != NULL)
+    g_task_return_error (task, error);
+  else
+    g_task_return_boolean (task, TRUE);
+  g_object_unref (task);
+}
+
+static gboolean
+uevent_batch_timeout_cb (gpointer user_data)
+{
+  uevent_batch_complete (user_data, NULL);
+  return G_SOURCE_REMOVE;
 }
 
 static gboolean
-uevent_wait_timeout_cb (gpointer user_data)
+uevent_batch_cancelled_cb (GCancellable *cancellable,
+                           gpointer      user_data)
 {
-  SynthUeventData *data = user_data;
+  uevent_batch_complete (user_data,
+                         g_error_new (G_IO_ERROR, G_IO_ERROR_CANCELLED, "Operation was cancelled"));
+  return G_SOURCE_REMOVE;
+}
 
-  data->success = FALSE;
-  g_main_loop_quit (data->main_loop);
+/* Removes @serial from the batch, returns %TRUE if it was the last one. */
+static gboolean
+uevent_batch_take_serial (UeventBatch *batch,
+                          guint        serial)
+{
+  gboolean found = FALSE;
+  gboolean last = FALSE;
+  guint n;
 
-  /* remove the source */
-  return FALSE;
+  g_mutex_lock (&batch->lock);
+  for (n = 0; n < batch->serials->len; n++)
+    {
+      if (g_array_index (batch->serials, guint, n) == serial)
+        {
+          g_array_remove_index_fast (batch->serials, n);
+          found = TRUE;
+          break;
+        }
+    }
+  last = found && batch->serials->len == 0;
+  g_mutex_unlock (&batch->lock);
+
+  return last;
 }
 
+/* runs in the main thread */
 static void
-uevent_probed_cb (UDisksLinuxProvider *provider,
-                  const gchar         *action,
-                  UDisksLinuxDevice   *device,
-                  gpointer             user_data)
+uevent_batch_probed_cb (UDisksLinuxProvider *provider,
+                        const gchar         *action,
+                        UDisksLinuxDevice   *device,
+                        gpointer             user_data)
 {
-  SynthUeventData *data = user_data;
+  UeventBatch *batch = user_data;
   const gchar *received_serial_str;
   gint64 received_serial;
   gchar *endptr;
@@ -1717,11 +1801,8 @@ uevent_probed_cb (UDisksLinuxProvider *provider,
     {
       endptr = (gchar *) received_serial_str;
       received_serial = g_ascii_strtoll (received_serial_str, &endptr, 0);
-      if (endptr != received_serial_str && received_serial == data->serial)
-        {
-          data->success = TRUE;
-          g_main_loop_quit (data->main_loop);
-        }
+      if (endptr != received_serial_str && uevent_batch_take_serial (batch, (guint) received_serial))
+        uevent_batch_complete (batch, NULL);
     }
 }
 
@@ -1825,58 +1906,225 @@ udisks_daemon_util_trigger_uevent_sync (UDisksDaemon *daemon,
                                         const gchar  *sysfs_path,
                                         guint         timeout_seconds)
 {
-  UDisksLinuxProvider *provider;
-  SynthUeventData data;
-  GMainContext *main_context;
-  GSource *idle_source;
-  GSource *timeout_source;
+  const gchar *paths[2] = { NULL, NULL };
+  GError *error = NULL;
+  gboolean ret;
 
   g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), FALSE);
   g_return_val_if_fail (device_file != NULL || sysfs_path != NULL, FALSE);
 
-  if (bd_utils_check_linux_version (4, 13, 0) < 0)
+  paths[0] = sysfs_path != NULL ? sysfs_path : device_file;
+  ret = udisks_daemon_util_trigger_uevents_sync (daemon, paths, timeout_seconds, &error);
+  if (!ret)
     {
-      udisks_daemon_util_trigger_uevent (daemon, device_file, sysfs_path);
-      return FALSE;
+      udisks_debug ("Error waiting for uevent on %s: %s", paths[0], error->message);
+      g_clear_error (&error);
     }
 
-  data.daemon = daemon;
-  data.uevent_path = resolve_uevent_path (daemon, device_file, sysfs_path);
-  if (data.uevent_path == NULL)
-    return FALSE;
-  data.serial = g_atomic_int_add (&uevent_serial, 1);
+  return ret;
+}
 
-  main_context = g_main_context_new ();
-  g_main_context_push_thread_default (main_context);
-  data.main_loop = g_main_loop_new (main_context, FALSE);
+/**
+ * udisks_daemon_util_trigger_uevents:
+ * @daemon: A #UDisksDaemon.
+ * @paths: A %NULL-terminated array of device paths in /sys or block device files (/dev/xxx).
+ * @timeout_seconds: Maximum time to wait for all the uevents (in seconds).
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @callback: Function to call when the request is satisfied.
+ * @user_data: User data to pass to @callback.
+ *
+ * Asynchronously triggers a 'change' uevent on each of @paths at once
+ * and waits until all of them have been received and processed by
+ * udisks, or until @timeout_seconds have passed.
+ *
+ * Paths starting with <filename>/sys/</filename> are taken as sysfs
+ * paths, anything else as device files which are resolved as in
+ * udisks_daemon_util_trigger_uevent().
+ *
+ * Compared to calling udisks_daemon_util_trigger_uevent_sync() for
+ * each device in turn, this lets udev and the probing thread work on
+ * all the devices while waiting, with a single deadline for the whole
+ * set.
+ *
+ * When the operation is finished, @callback will be invoked in the
+ * <link linkend="g-main-context-push-thread-default">thread-default main context</link>
+ * of the thread you are calling this method from. You can then call
+ * udisks_daemon_util_trigger_uevents_finish() to get the result.
+ */
+void
+udisks_daemon_util_trigger_uevents (UDisksDaemon        *daemon,
+                                    const gchar * const *paths,
+                                    guint                timeout_seconds,
+                                    GCancellable        *cancellable,
+                                    GAsyncReadyCallback  callback,
+                                    gpointer             user_data)
+{
+  UDisksLinuxProvider *provider;
+  UeventBatch *batch;
+  GTask *task;
+  GPtrArray *uevent_paths;
+  gboolean done;
+  guint n;
 
-  /* queue the actual trigger in the loop */
-  idle_source = g_idle_source_new ();
-  g_source_set_callback (idle_source, (GSourceFunc) trigger_uevent_idle_cb, &data, NULL);
-  g_source_attach (idle_source, main_context);
-  g_source_unref (idle_source);
+  g_return_if_fail (UDISKS_IS_DAEMON (daemon));
+  g_return_if_fail (paths != NULL);
 
-  /* add timeout as a fallback */
-  timeout_source = g_timeout_source_new_seconds (timeout_seconds);
-  g_source_set_callback (timeout_source, (GSourceFunc) uevent_wait_timeout_cb, &data, NULL);
-  g_source_attach (timeout_source, main_context);
-  g_source_unref (timeout_source);
+  task = g_task_new (daemon, cancellable, callback, user_data);
+  g_task_set_source_tag (task, udisks_daemon_util_trigger_uevents);
 
-  /* catch incoming uevents */
+  uevent_paths = g_ptr_array_new_with_free_func (g_free);
+  for (n = 0; paths[n] != NULL; n++)
+    {
+      if (g_str_has_prefix (paths[n], "/sys/"))
+        g_ptr_array_add (uevent_paths, resolve_uevent_path (daemon, NULL, paths[n]));
+      else
+        g_ptr_array_add (uevent_paths, resolve_uevent_path (daemon, paths[n], NULL));
+    }
+
+  if (bd_utils_check_linux_version (4, 13, 0) < 0)
+    {
+      for (n = 0; n < uevent_paths->len; n++)
+        trigger_uevent (uevent_paths->pdata[n], "change");
+      g_task_return_new_error (task, UDISKS_ERROR, UDISKS_ERROR_NOT_SUPPORTED,
+                               "Waiting for uevents requires Linux 4.13 or newer");
+      goto out;
+    }
+
+  batch = g_new0 (UeventBatch, 1);
+  batch->ref_count = 1;
+  g_mutex_init (&batch->lock);
+  batch->daemon = daemon;
+  batch->task = g_object_ref (task);
+  batch->serials = g_array_sized_new (FALSE, FALSE, sizeof (guint), uevent_paths->len);
+  for (n = 0; n < uevent_paths->len; n++)
+    {
+      guint serial = g_atomic_int_add (&uevent_serial, 1);
+      g_array_append_val (batch->serials, serial);
+    }
+  /* the task owns the initial reference */
+  g_task_set_task_data (task, batch, (GDestroyNotify) uevent_batch_unref);
+
+  batch->timeout_source = g_timeout_source_new_seconds (timeout_seconds);
+  g_source_set_callback (batch->timeout_source, uevent_batch_timeout_cb,
+                         uevent_batch_ref (batch), (GDestroyNotify) uevent_batch_unref);
+  g_source_attach (batch->timeout_source, g_task_get_context (task));
+
+  if (cancellable != NULL)
+    {
+      batch->cancellable_source = g_cancellable_source_new (cancellable);
+      g_source_set_callback (batch->cancellable_source, (GSourceFunc) uevent_batch_cancelled_cb,
+                             uevent_batch_ref (batch), (GDestroyNotify) uevent_batch_unref);
+      g_source_attach (batch->cancellable_source, g_task_get_context (task));
+    }
+
+  /* catch incoming uevents, the signal is emitted in the main thread */
   provider = udisks_daemon_get_linux_provider (daemon);
-  g_signal_connect (provider, "uevent-probed", G_CALLBACK (uevent_probed_cb), &data);
+  batch->probed_handler_id = g_signal_connect_data (provider, "uevent-probed",
+                                                    G_CALLBACK (uevent_batch_probed_cb),
+                                                    uevent_batch_ref (batch),
+                                                    uevent_batch_closure_notify,
+                                                    0);
+
+  /* only now that everything is in place, fire all the uevents */
+  done = FALSE;
+  for (n = 0; n < uevent_paths->len; n++)
+    {
+      gchar *str;
 
-  data.success = FALSE;
-  g_main_loop_run (data.main_loop);
+      str = g_strdup_printf ("change %s UDISKSSERIAL=%u",
+                             udisks_daemon_get_uuid (daemon),
+                             g_array_index (batch->serials, guint, n));
+      if (! trigger_uevent (uevent_paths->pdata[n], str))
+        {
+          guint serial = g_array_index (batch->serials, guint, n);
+
+          /* kernel refused our string, try simple "change" but don't wait for it */
+          trigger_uevent (uevent_paths->pdata[n], "change");
+          g_mutex_lock (&batch->lock);
+          batch->num_untagged++;
+          g_mutex_unlock (&batch->lock);
+          if (uevent_batch_take_serial (batch, serial))
+            done = TRUE;
+        }
+      g_free (str);
+    }
 
-  g_signal_handlers_disconnect_by_func (provider, uevent_probed_cb, &data);
-  g_main_context_pop_thread_default (main_context);
+  if (done || uevent_paths->len == 0)
+    uevent_batch_complete (batch, NULL);
+
+ out:
+  g_ptr_array_unref (uevent_paths);
+  g_object_unref (task);
+}
 
-  g_main_loop_unref (data.main_loop);
+/**
+ * udisks_daemon_util_trigger_uevents_finish:
+ * @daemon: A #UDisksDaemon.
+ * @res: A #GAsyncResult obtained from the #GAsyncReadyCallback passed to udisks_daemon_util_trigger_uevents().
+ * @error: Return location for error or %NULL.
+ *
+ * Finishes an operation started with udisks_daemon_util_trigger_uevents().
+ *
+ * Returns: %TRUE if all the uevents have been received, %FALSE if @error is set.
+ */
+gboolean
+udisks_daemon_util_trigger_uevents_finish (UDisksDaemon  *daemon,
+                                           GAsyncResult  *res,
+                                           GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, daemon), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+static void
+trigger_uevents_sync_cb (GObject      *source_object,
+                         GAsyncResult *res,
+                         gpointer      user_data)
+{
+  GAsyncResult **out_res = user_data;
+
+  *out_res = g_object_ref (res);
+}
+
+/**
+ * udisks_daemon_util_trigger_uevents_sync:
+ * @daemon: A #UDisksDaemon.
+ * @paths: A %NULL-terminated array of device paths in /sys or block device files (/dev/xxx).
+ * @timeout_seconds: Maximum time to wait for all the uevents (in seconds).
+ * @error: Return location for error or %NULL.
+ *
+ * Synchronous version of udisks_daemon_util_trigger_uevents(). Must not
+ * be called from the main thread.
+ *
+ * Returns: %TRUE if all the uevents have been received, %FALSE if @error is set.
+ */
+gboolean
+udisks_daemon_util_trigger_uevents_sync (UDisksDaemon         *daemon,
+                                         const gchar * const  *paths,
+                                         guint                 timeout_seconds,
+                                         GError              **error)
+{
+  GMainContext *main_context;
+  GAsyncResult *res = NULL;
+  gboolean ret;
+
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), FALSE);
+
+  main_context = g_main_context_new ();
+  g_main_context_push_thread_default (main_context);
+
+  udisks_daemon_util_trigger_uevents (daemon, paths, timeout_seconds, NULL, trigger_uevents_sync_cb, &res);
+  while (res == NULL)
+    g_main_context_iteration (main_context, TRUE);
+
+  g_main_context_pop_thread_default (main_context);
   g_main_context_unref (main_context);
-  g_free (data.uevent_path);
 
-  return data.success;
+  ret = udisks_daemon_util_trigger_uevents_finish (daemon, res, error);
+  g_object_unref (res);
+
+  return ret;
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -60,6 +60,22 @@ gboolean udisks_daemon_util_trigger_uevent_sync (UDisksDaemon *daemon,
                                                  const gchar  *sysfs_path,
                                                  guint         timeout_seconds);
 
+void udisks_daemon_util_trigger_uevents (UDisksDaemon        *daemon,
+                                         const gchar * const *paths,
+                                         guint                timeout_seconds,
+                                         GCancellable        *cancellable,
+                                         GAsyncReadyCallback  callback,
+                                         gpointer             user_data);
+
+gboolean udisks_daemon_util_trigger_uevents_finish (UDisksDaemon  *daemon,
+                                                    GAsyncResult  *res,
+                                                    GError       **error);
+
+gboolean udisks_daemon_util_trigger_uevents_sync (UDisksDaemon         *daemon,
+                                                  const gchar * const  *paths,
+                                                  guint                 timeout_seconds,
+                                                  GError              **error);
+
 gchar *udisks_daemon_util_resolve_link (const gchar *path,
                                         const gchar *name);
 
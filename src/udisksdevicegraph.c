@@ -0,0 +1,467 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib/gi18n-lib.h>
+
+#include "udisksdevicegraph.h"
+#include "udisksdaemonutil.h"
+#include "udiskslinuxblockobject.h"
+#include "udiskslinuxdevice.h"
+#include "udiskslogging.h"
+
+/**
+ * SECTION:udisksdevicegraph
+ * @title: UDisksDeviceGraph
+ * @short_description: Index of block device dependencies
+ *
+ * This type keeps track of which block devices are built on top of
+ * which others: partitions on their disk, device-mapper devices (such
+ * as dm-crypt cleartext devices and LVM logical volumes) and MD RAID
+ * arrays on their slaves and loop devices on the block device holding
+ * their backing file.
+ *
+ * The graph is updated incrementally by #UDisksLinuxProvider when
+ * uevents for block devices are processed. It also indexes the
+ * #UDisksLinuxBlockObject instances by sysfs path and device number
+ * so that looking up a device or walking the devices stacked on it
+ * takes time proportional to the result rather than to the number of
+ * objects exported by the daemon.
+ *
+ * All functions may be called from any thread.
+ */
+
+typedef struct _UDisksDeviceGraphClass UDisksDeviceGraphClass;
+
+/**
+ * UDisksDeviceGraph:
+ *
+ * The #UDisksDeviceGraph structure contains only private data and should
+ * only be accessed using the provided API.
+ */
+struct _UDisksDeviceGraph
+{
+  GObject parent_instance;
+
+  /* protects everything below */
+  GMutex lock;
+
+  /* sysfs path -> GraphNode*, owns the nodes */
+  GHashTable *nodes;
+  /* device number -> GraphNode*, only nodes with an object */
+  GHashTable *nodes_by_device_number;
+};
+
+struct _UDisksDeviceGraphClass
+{
+  GObjectClass parent_class;
+};
+
+typedef struct
+{
+  gchar *sysfs_path;
+  /* not referenced, cleared by udisks_device_graph_remove() before the object
+   * is released by the provider; NULL for devices only known as a parent */
+  UDisksLinuxBlockObject *object;
+  gint64 device_number;
+  /* sysfs paths of the devices this one is built on */
+  GPtrArray *parents;
+  /* set of sysfs paths of the devices built on this one */
+  GHashTable *children;
+} GraphNode;
+
+G_DEFINE_TYPE (UDisksDeviceGraph, udisks_device_graph, G_TYPE_OBJECT);
+
+static void
+graph_node_free (GraphNode *node)
+{
+  g_free (node->sysfs_path);
+  g_ptr_array_unref (node->parents);
+  g_hash_table_unref (node->children);
+  g_free (node);
+}
+
+static void
+udisks_device_graph_init (UDisksDeviceGraph *graph)
+{
+  g_mutex_init (&graph->lock);
+  graph->nodes = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) graph_node_free);
+  graph->nodes_by_device_number = g_hash_table_new (g_int64_hash, g_int64_equal);
+}
+
+static void
+udisks_device_graph_finalize (GObject *object)
+{
+  UDisksDeviceGraph *graph = UDISKS_DEVICE_GRAPH (object);
+
+  g_hash_table_unref (graph->nodes_by_device_number);
+  g_hash_table_unref (graph->nodes);
+  g_mutex_clear (&graph->lock);
+
+  G_OBJECT_CLASS (udisks_device_graph_parent_class)->finalize (object);
+}
+
+static void
+udisks_device_graph_class_init (UDisksDeviceGraphClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = udisks_device_graph_finalize;
+}
+
+/**
+ * udisks_device_graph_new:
+ *
+ * Creates a new, empty #UDisksDeviceGraph.
+ *
+ * Returns: A #UDisksDeviceGraph. Free with g_object_unref().
+ */
+UDisksDeviceGraph *
+udisks_device_graph_new (void)
+{
+  return UDISKS_DEVICE_GRAPH (g_object_new (UDISKS_TYPE_DEVICE_GRAPH, NULL));
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* called with lock held */
+static GraphNode *
+ensure_node (UDisksDeviceGraph *graph,
+             const gchar       *sysfs_path)
+{
+  GraphNode *node;
+
+  node = g_hash_table_lookup (graph->nodes, sysfs_path);
+  if (node == NULL)
+    {
+      node = g_new0 (GraphNode, 1);
+      node->sysfs_path = g_strdup (sysfs_path);
+      node->parents = g_ptr_array_new_with_free_func (g_free);
+      node->children = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+      g_hash_table_insert (graph->nodes, node->sysfs_path, node);
+    }
+  return node;
+}
+
+/* called with lock held, frees @node if nothing refers to it anymore */
+static void
+maybe_free_node (UDisksDeviceGraph *graph,
+                 GraphNode         *node)
+{
+  if (node->object == NULL && node->parents->len == 0 && g_hash_table_size (node->children) == 0)
+    g_hash_table_remove (graph->nodes, node->sysfs_path);
+}
+
+/* called with lock held */
+static void
+unindex_device_number (UDisksDeviceGraph *graph,
+                       GraphNode         *node)
+{
+  if (g_hash_table_lookup (graph->nodes_by_device_number, &node->device_number) == node)
+    g_hash_table_remove (graph->nodes_by_device_number, &node->device_number);
+}
+
+/* called with lock held */
+static void
+unlink_parents (UDisksDeviceGraph *graph,
+                GraphNode         *node)
+{
+  guint n;
+
+  for (n = 0; n < node->parents->len; n++)
+    {
+      GraphNode *parent = g_hash_table_lookup (graph->nodes, node->parents->pdata[n]);
+      if (parent != NULL)
+        {
+          g_hash_table_remove (parent->children, node->sysfs_path);
+          maybe_free_node (graph, parent);
+        }
+    }
+  g_ptr_array_set_size (node->parents, 0);
+}
+
+/* Gets the device number of the block device holding the backing file of
+ * the loop device @device, 0 if none
+ */
+static dev_t
+get_loop_backing_device_number (UDisksLinuxDevice *device)
+{
+  const gchar *backing_file;
+  struct stat statbuf;
+
+  if (!g_str_has_prefix (g_udev_device_get_name (device->udev_device), "loop"))
+    return 0;
+
+  backing_file = g_udev_device_get_sysfs_attr (device->udev_device, "loop/backing_file");
+  if (backing_file == NULL || stat (backing_file, &statbuf) != 0)
+    return 0;
+
+  return statbuf.st_dev;
+}
+
+/**
+ * udisks_device_graph_update:
+ * @graph: A #UDisksDeviceGraph.
+ * @object: The #UDisksLinuxBlockObject for @device.
+ * @device: A #UDisksLinuxDevice for a block device that was added or changed.
+ *
+ * Adds @object to @graph or updates the devices it is built on.
+ */
+void
+udisks_device_graph_update (UDisksDeviceGraph      *graph,
+                            UDisksLinuxBlockObject *object,
+                            UDisksLinuxDevice      *device)
+{
+  const gchar *sysfs_path;
+  gchar **slaves;
+  gchar *partition_parent = NULL;
+  dev_t backing_device_number;
+  GraphNode *node;
+  guint n;
+
+  g_return_if_fail (UDISKS_IS_DEVICE_GRAPH (graph));
+  g_return_if_fail (UDISKS_IS_LINUX_BLOCK_OBJECT (object));
+
+  sysfs_path = g_udev_device_get_sysfs_path (device->udev_device);
+
+  /* resolve the parents before taking the lock, this needs sysfs */
+  if (g_strcmp0 (g_udev_device_get_devtype (device->udev_device), "partition") == 0)
+    partition_parent = g_path_get_dirname (sysfs_path);
+  slaves = udisks_daemon_util_resolve_links (sysfs_path, "slaves");
+  backing_device_number = get_loop_backing_device_number (device);
+
+  g_mutex_lock (&graph->lock);
+
+  node = ensure_node (graph, sysfs_path);
+  if (node->object != NULL)
+    unindex_device_number (graph, node);
+  node->object = object;
+  node->device_number = g_udev_device_get_device_number (device->udev_device);
+  /* the key points into the node, so if another node still holds this
+   * device number (e.g. a stale one not removed yet) replace the key too
+   */
+  g_hash_table_replace (graph->nodes_by_device_number, &node->device_number, node);
+
+  unlink_parents (graph, node);
+  if (partition_parent != NULL)
+    g_ptr_array_add (node->parents, g_strdup (partition_parent));
+  for (n = 0; slaves != NULL && slaves[n] != NULL; n++)
+    g_ptr_array_add (node->parents, g_strdup (slaves[n]));
+  if (backing_device_number != 0)
+    {
+      gint64 key = backing_device_number;
+      GraphNode *backing = g_hash_table_lookup (graph->nodes_by_device_number, &key);
+      if (backing != NULL && backing != node)
+        g_ptr_array_add (node->parents, g_strdup (backing->sysfs_path));
+    }
+  for (n = 0; n < node->parents->len; n++)
+    {
+      GraphNode *parent = ensure_node (graph, node->parents->pdata[n]);
+      g_hash_table_add (parent->children, g_strdup (sysfs_path));
+    }
+
+  g_mutex_unlock (&graph->lock);
+
+  g_strfreev (slaves);
+  g_free (partition_parent);
+}
+
+/**
+ * udisks_device_graph_remove:
+ * @graph: A #UDisksDeviceGraph.
+ * @sysfs_path: The sysfs path of a block device that was removed.
+ *
+ * Removes the block device with @sysfs_path from @graph. This must be
+ * called before its #UDisksLinuxBlockObject is released.
+ */
+void
+udisks_device_graph_remove (UDisksDeviceGraph *graph,
+                            const gchar       *sysfs_path)
+{
+  GraphNode *node;
+
+  g_return_if_fail (UDISKS_IS_DEVICE_GRAPH (graph));
+
+  g_mutex_lock (&graph->lock);
+
+  node = g_hash_table_lookup (graph->nodes, sysfs_path);
+  if (node != NULL && node->object != NULL)
+    {
+      unindex_device_number (graph, node);
+      node->object = NULL;
+      unlink_parents (graph, node);
+      /* kept while devices built on it still refer to it */
+      maybe_free_node (graph, node);
+    }
+
+  g_mutex_unlock (&graph->lock);
+}
+
+/**
+ * udisks_device_graph_lookup:
+ * @graph: A #UDisksDeviceGraph.
+ * @sysfs_path: A sysfs path.
+ *
+ * Finds the block object for the device at @sysfs_path.
+ *
+ * Returns: (transfer full): A #UDisksObject or %NULL if not found. Free with g_object_unref().
+ */
+UDisksObject *
+udisks_device_graph_lookup (UDisksDeviceGraph *graph,
+                            const gchar       *sysfs_path)
+{
+  UDisksObject *ret = NULL;
+  GraphNode *node;
+
+  g_return_val_if_fail (UDISKS_IS_DEVICE_GRAPH (graph), NULL);
+
+  g_mutex_lock (&graph->lock);
+  node = g_hash_table_lookup (graph->nodes, sysfs_path);
+  if (node != NULL && node->object != NULL)
+    ret = g_object_ref (UDISKS_OBJECT (node->object));
+  g_mutex_unlock (&graph->lock);
+
+  return ret;
+}
+
+/**
+ * udisks_device_graph_lookup_by_device_number:
+ * @graph: A #UDisksDeviceGraph.
+ * @device_number: A #dev_t.
+ *
+ * Finds the block object for the device with @device_number.
+ *
+ * Returns: (transfer full): A #UDisksObject or %NULL if not found. Free with g_object_unref().
+ */
+UDisksObject *
+udisks_device_graph_lookup_by_device_number (UDisksDeviceGraph *graph,
+                                             dev_t              device_number)
+{
+  UDisksObject *ret = NULL;
+  GraphNode *node;
+  gint64 key = device_number;
+
+  g_return_val_if_fail (UDISKS_IS_DEVICE_GRAPH (graph), NULL);
+
+  g_mutex_lock (&graph->lock);
+  node = g_hash_table_lookup (graph->nodes_by_device_number, &key);
+  if (node != NULL)
+    ret = g_object_ref (UDISKS_OBJECT (node->object));
+  g_mutex_unlock (&graph->lock);
+
+  return ret;
+}
+
+/**
+ * udisks_device_graph_get_children:
+ * @graph: A #UDisksDeviceGraph.
+ * @sysfs_path: A sysfs path.
+ *
+ * Gets the block objects for the devices directly built on the device
+ * at @sysfs_path, e.g. its partitions or its cleartext device.
+ *
+ * Returns: (transfer full) (element-type UDisksObject): A list of
+ *   #UDisksObject instances. Free with g_list_free_full() and g_object_unref().
+ */
+GList *
+udisks_device_graph_get_children (UDisksDeviceGraph *graph,
+                                  const gchar       *sysfs_path)
+{
+  GList *ret = NULL;
+  GraphNode *node;
+  GHashTableIter iter;
+  const gchar *child_path;
+
+  g_return_val_if_fail (UDISKS_IS_DEVICE_GRAPH (graph), NULL);
+
+  g_mutex_lock (&graph->lock);
+  node = g_hash_table_lookup (graph->nodes, sysfs_path);
+  if (node != NULL)
+    {
+      g_hash_table_iter_init (&iter, node->children);
+      while (g_hash_table_iter_next (&iter, (gpointer *) &child_path, NULL))
+        {
+          GraphNode *child = g_hash_table_lookup (graph->nodes, child_path);
+          if (child != NULL && child->object != NULL)
+            ret = g_list_prepend (ret, g_object_ref (child->object));
+        }
+    }
+  g_mutex_unlock (&graph->lock);
+
+  return ret;
+}
+
+/**
+ * udisks_device_graph_get_descendants:
+ * @graph: A #UDisksDeviceGraph.
+ * @sysfs_path: A sysfs path.
+ *
+ * Gets the block objects for all the devices built, directly or
+ * indirectly, on the device at @sysfs_path. Each device is listed after
+ * the device it is built on.
+ *
+ * Returns: (transfer full) (element-type UDisksObject): A list of
+ *   #UDisksObject instances. Free with g_list_free_full() and g_object_unref().
+ */
+GList *
+udisks_device_graph_get_descendants (UDisksDeviceGraph *graph,
+                                     const gchar       *sysfs_path)
+{
+  GList *ret = NULL;
+  GQueue queue = G_QUEUE_INIT;
+  GHashTable *visited;
+  GraphNode *node;
+
+  g_return_val_if_fail (UDISKS_IS_DEVICE_GRAPH (graph), NULL);
+
+  visited = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  g_mutex_lock (&graph->lock);
+  node = g_hash_table_lookup (graph->nodes, sysfs_path);
+  if (node != NULL)
+    {
+      g_hash_table_add (visited, node);
+      g_queue_push_tail (&queue, node);
+    }
+  while ((node = g_queue_pop_head (&queue)) != NULL)
+    {
+      GHashTableIter iter;
+      const gchar *child_path;
+
+      g_hash_table_iter_init (&iter, node->children);
+      while (g_hash_table_iter_next (&iter, (gpointer *) &child_path, NULL))
+        {
+          GraphNode *child = g_hash_table_lookup (graph->nodes, child_path);
+          if (child == NULL || g_hash_table_contains (visited, child))
+            continue;
+          g_hash_table_add (visited, child);
+          g_queue_push_tail (&queue, child);
+          if (child->object != NULL)
+            ret = g_list_prepend (ret, g_object_ref (child->object));
+        }
+    }
+  g_mutex_unlock (&graph->lock);
+
+  g_hash_table_destroy (visited);
+  return g_list_reverse (ret);
+}
@@ -0,0 +1,49 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __UDISKS_DEVICE_GRAPH_H__
+#define __UDISKS_DEVICE_GRAPH_H__
+
+#include "udisksdaemontypes.h"
+#include <sys/types.h>
+
+G_BEGIN_DECLS
+
+#define UDISKS_TYPE_DEVICE_GRAPH         (udisks_device_graph_get_type ())
+#define UDISKS_DEVICE_GRAPH(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), UDISKS_TYPE_DEVICE_GRAPH, UDisksDeviceGraph))
+#define UDISKS_IS_DEVICE_GRAPH(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), UDISKS_TYPE_DEVICE_GRAPH))
+
+GType               udisks_device_graph_get_type                   (void) G_GNUC_CONST;
+UDisksDeviceGraph  *udisks_device_graph_new                        (void);
+void                udisks_device_graph_update                     (UDisksDeviceGraph       *graph,
+                                                                    UDisksLinuxBlockObject  *object,
+                                                                    UDisksLinuxDevice       *device);
+void                udisks_device_graph_remove                     (UDisksDeviceGraph       *graph,
+                                                                    const gchar             *sysfs_path);
+UDisksObject       *udisks_device_graph_lookup                     (UDisksDeviceGraph       *graph,
+                                                                    const gchar             *sysfs_path);
+UDisksObject       *udisks_device_graph_lookup_by_device_number    (UDisksDeviceGraph       *graph,
+                                                                    dev_t                    device_number);
+GList              *udisks_device_graph_get_children               (UDisksDeviceGraph       *graph,
+                                                                    const gchar             *sysfs_path);
+GList              *udisks_device_graph_get_descendants            (UDisksDeviceGraph       *graph,
+                                                                    const gchar             *sysfs_path);
+
+G_END_DECLS
+
+#endif /* __UDISKS_DEVICE_GRAPH_H__ */
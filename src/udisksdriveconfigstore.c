@@ -0,0 +1,792 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib/gi18n-lib.h>
+
+#include "udisksdriveconfigstore.h"
+#include "udisksdaemonutil.h"
+#include "udiskslogging.h"
+
+/**
+ * SECTION:udisksdriveconfigstore
+ * @title: UDisksDriveConfigStore
+ * @short_description: Cache of drive configuration files
+ *
+ * This type provides access to the per-drive configuration files,
+ * <filename>/etc/udisks2/<replaceable>ID</replaceable>.conf</filename>,
+ * see udisks(8) for their format.
+ *
+ * The configuration directory is scanned once and then monitored for
+ * changes, so looking up a drive without a configuration file doesn't
+ * touch the disk and each file is parsed only once until it changes.
+ * The #UDisksDriveConfigStore::changed signal is emitted only when the
+ * parsed configuration of a drive actually changed.
+ *
+ * If the directory can't be monitored, every lookup reads the file.
+ */
+
+typedef struct _UDisksDriveConfigStoreClass UDisksDriveConfigStoreClass;
+
+/**
+ * UDisksDriveConfigStore:
+ *
+ * The #UDisksDriveConfigStore structure contains only private data and
+ * should only be accessed using the provided API.
+ */
+struct _UDisksDriveConfigStore
+{
+  GObject parent_instance;
+
+  gchar *config_dir;
+
+  /* where ::changed is emitted */
+  GMainContext *context;
+  GFileMonitor *file_monitor;
+
+  /* protects entries */
+  GMutex lock;
+  /* id -> parsed configuration or NULL if not parsed yet, only ids with a file are present */
+  GHashTable *entries;
+};
+
+struct _UDisksDriveConfigStoreClass
+{
+  GObjectClass parent_class;
+
+  void (*changed) (UDisksDriveConfigStore *store,
+                   const gchar            *id);
+};
+
+enum
+{
+  PROP_0,
+  PROP_CONFIG_DIR
+};
+
+enum
+{
+  CHANGED_SIGNAL,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = { 0 };
+
+typedef struct {
+  const gchar *asv_key;
+  const gchar *group;
+  const gchar *key;
+  const GVariantType *type;
+} VariantKeyfileMapping;
+
+static const VariantKeyfileMapping drive_configuration_mapping[] = {
+  {"ata-pm-standby",             "ATA",   "StandbyTimeout",       G_VARIANT_TYPE_INT32},
+  {"ata-apm-level",              "ATA",   "APMLevel",             G_VARIANT_TYPE_INT32},
+  {"ata-aam-level",              "ATA",   "AAMLevel",             G_VARIANT_TYPE_INT32},
+  {"ata-write-cache-enabled",    "ATA",   "WriteCacheEnabled",    G_VARIANT_TYPE_BOOLEAN},
+  {"ata-read-lookahead-enabled", "ATA",   "ReadLookaheadEnabled", G_VARIANT_TYPE_BOOLEAN},
+  {"queue-scheduler",            "Queue", "Scheduler",            G_VARIANT_TYPE_STRING},
+  {"queue-read-ahead-kb",        "Queue", "ReadAheadKB",          G_VARIANT_TYPE_UINT32},
+  {"queue-nr-requests",          "Queue", "NrRequests",           G_VARIANT_TYPE_UINT32},
+  {"queue-rq-affinity",          "Queue", "RqAffinity",           G_VARIANT_TYPE_UINT32},
+  {"queue-write-cache",          "Queue", "WriteCache",           G_VARIANT_TYPE_STRING},
+  {"queue-max-sectors-kb",       "Queue", "MaxSectorsKB",         G_VARIANT_TYPE_UINT32},
+};
+
+G_DEFINE_TYPE (UDisksDriveConfigStore, udisks_drive_config_store, G_TYPE_OBJECT);
+
+static void on_file_monitor_changed (GFileMonitor      *monitor,
+                                     GFile             *file,
+                                     GFile             *other_file,
+                                     GFileMonitorEvent  event_type,
+                                     gpointer           user_data);
+
+static void
+variant_unref0 (gpointer value)
+{
+  if (value != NULL)
+    g_variant_unref (value);
+}
+
+static void
+udisks_drive_config_store_init (UDisksDriveConfigStore *store)
+{
+  g_mutex_init (&store->lock);
+  store->entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, variant_unref0);
+  store->context = g_main_context_ref_thread_default ();
+}
+
+static void
+udisks_drive_config_store_finalize (GObject *object)
+{
+  UDisksDriveConfigStore *store = UDISKS_DRIVE_CONFIG_STORE (object);
+
+  g_clear_object (&store->file_monitor);
+  g_main_context_unref (store->context);
+  g_hash_table_unref (store->entries);
+  g_mutex_clear (&store->lock);
+  g_free (store->config_dir);
+
+  G_OBJECT_CLASS (udisks_drive_config_store_parent_class)->finalize (object);
+}
+
+static void
+udisks_drive_config_store_set_property (GObject      *object,
+                                        guint         prop_id,
+                                        const GValue *value,
+                                        GParamSpec   *pspec)
+{
+  UDisksDriveConfigStore *store = UDISKS_DRIVE_CONFIG_STORE (object);
+
+  switch (prop_id)
+    {
+    case PROP_CONFIG_DIR:
+      g_assert (store->config_dir == NULL);
+      store->config_dir = g_value_dup_string (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+udisks_drive_config_store_get_property (GObject    *object,
+                                        guint       prop_id,
+                                        GValue     *value,
+                                        GParamSpec *pspec)
+{
+  UDisksDriveConfigStore *store = UDISKS_DRIVE_CONFIG_STORE (object);
+
+  switch (prop_id)
+    {
+    case PROP_CONFIG_DIR:
+      g_value_set_string (value, store->config_dir);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gchar *
+dup_id_from_config_name (const gchar *conf_filename)
+{
+  if (g_str_has_suffix (conf_filename, ".conf") && strlen (conf_filename) > 5)
+    return g_strndup (conf_filename, strlen (conf_filename) - 5);
+  return NULL;
+}
+
+static gchar *
+get_path_for_id (UDisksDriveConfigStore *store,
+                 const gchar            *id)
+{
+  gchar *id_config_file;
+  gchar *path;
+
+  id_config_file = g_strdup_printf ("%s.conf", id);
+  path = g_build_filename (store->config_dir, id_config_file, NULL);
+  g_free (id_config_file);
+
+  return path;
+}
+
+/* returns a floating reference or NULL if there's no usable file, sets @out_exists */
+static GVariant *
+load_configuration (const gchar *path,
+                    gboolean    *out_exists)
+{
+  GKeyFile *key_file;
+  GError *error = NULL;
+  GVariant *ret = NULL;
+  GVariantBuilder builder;
+  guint n;
+
+  *out_exists = TRUE;
+
+  key_file = g_key_file_new ();
+  if (!g_key_file_load_from_file (key_file,
+                                  path,
+                                  G_KEY_FILE_NONE,
+                                  &error))
+    {
+      if (g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        {
+          *out_exists = FALSE;
+        }
+      else
+        {
+          udisks_critical ("Error loading drive config file: %s (%s, %d)",
+                           error->message, g_quark_to_string (error->domain), error->code);
+        }
+      g_clear_error (&error);
+      goto out;
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  for (n = 0; n < G_N_ELEMENTS (drive_configuration_mapping); n++)
+    {
+      const VariantKeyfileMapping *mapping = &drive_configuration_mapping[n];
+
+      if (!g_key_file_has_key (key_file, mapping->group, mapping->key, NULL))
+        continue;
+
+      if (g_variant_type_equal (mapping->type, G_VARIANT_TYPE_INT32))
+        {
+          gint32 int_value = g_key_file_get_integer (key_file, mapping->group, mapping->key, &error);
+          if (error != NULL)
+            {
+              udisks_critical ("Error parsing int32 key %s in group %s in drive config file %s: %s (%s, %d)",
+                               mapping->key, mapping->group, path,
+                               error->message, g_quark_to_string (error->domain), error->code);
+              g_clear_error (&error);
+            }
+          else
+            {
+              g_variant_builder_add (&builder, "{sv}", mapping->asv_key, g_variant_new_int32 (int_value));
+            }
+        }
+      else if (g_variant_type_equal (mapping->type, G_VARIANT_TYPE_BOOLEAN))
+        {
+          gboolean bool_value = g_key_file_get_boolean (key_file, mapping->group, mapping->key, &error);
+          if (error != NULL)
+            {
+              udisks_critical ("Error parsing boolean key %s in group %s in drive config file %s: %s (%s, %d)",
+                               mapping->key, mapping->group, path,
+                               error->message, g_quark_to_string (error->domain), error->code);
+              g_clear_error (&error);
+            }
+          else
+            {
+              g_variant_builder_add (&builder, "{sv}", mapping->asv_key, g_variant_new_boolean (bool_value));
+            }
+        }
+      else if (g_variant_type_equal (mapping->type, G_VARIANT_TYPE_UINT32))
+        {
+          guint64 uint_value = g_key_file_get_uint64 (key_file, mapping->group, mapping->key, &error);
+          if (error == NULL && uint_value > G_MAXUINT32)
+            g_set_error (&error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE, "Value out of range");
+          if (error != NULL)
+            {
+              udisks_critical ("Error parsing uint32 key %s in group %s in drive config file %s: %s (%s, %d)",
+                               mapping->key, mapping->group, path,
+                               error->message, g_quark_to_string (error->domain), error->code);
+              g_clear_error (&error);
+            }
+          else
+            {
+              g_variant_builder_add (&builder, "{sv}", mapping->asv_key, g_variant_new_uint32 (uint_value));
+            }
+        }
+      else if (g_variant_type_equal (mapping->type, G_VARIANT_TYPE_STRING))
+        {
+          gchar *str_value = g_key_file_get_string (key_file, mapping->group, mapping->key, &error);
+          if (error != NULL)
+            {
+              udisks_critical ("Error parsing string key %s in group %s in drive config file %s: %s (%s, %d)",
+                               mapping->key, mapping->group, path,
+                               error->message, g_quark_to_string (error->domain), error->code);
+              g_clear_error (&error);
+            }
+          else
+            {
+              g_variant_builder_add (&builder, "{sv}", mapping->asv_key, g_variant_new_take_string (str_value));
+            }
+        }
+      else
+        {
+          g_assert_not_reached ();
+        }
+    }
+
+  ret = g_variant_builder_end (&builder);
+
+ out:
+  g_key_file_free (key_file);
+  return ret;
+}
+
+/* must be called with the lock held */
+static void
+scan_config_dir (UDisksDriveConfigStore *store)
+{
+  GError *error = NULL;
+  const gchar *filename;
+  GDir *dir;
+
+  dir = g_dir_open (store->config_dir, 0, &error);
+  if (dir == NULL)
+    {
+      udisks_warning ("Error reading directory %s: %s (%s, %d)",
+                      store->config_dir,
+                      error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+      return;
+    }
+
+  while ((filename = g_dir_read_name (dir)) != NULL)
+    {
+      gchar *id = dup_id_from_config_name (filename);
+      if (id != NULL && !g_hash_table_contains (store->entries, id))
+        {
+          udisks_debug ("Found config file %s", filename);
+          g_hash_table_insert (store->entries, id, NULL);
+        }
+      else
+        {
+          g_free (id);
+        }
+    }
+
+  g_dir_close (dir);
+}
+
+static void
+udisks_drive_config_store_constructed (GObject *object)
+{
+  UDisksDriveConfigStore *store = UDISKS_DRIVE_CONFIG_STORE (object);
+  GError *error = NULL;
+  GFile *file;
+
+  g_mutex_lock (&store->lock);
+  scan_config_dir (store);
+  g_mutex_unlock (&store->lock);
+
+  file = g_file_new_for_path (store->config_dir);
+  store->file_monitor = g_file_monitor_directory (file,
+                                                  G_FILE_MONITOR_NONE,
+                                                  NULL,
+                                                  &error);
+  if (store->file_monitor != NULL)
+    {
+      g_signal_connect (store->file_monitor,
+                        "changed",
+                        G_CALLBACK (on_file_monitor_changed),
+                        store);
+    }
+  else
+    {
+      udisks_warning ("Error monitoring directory %s: %s (%s, %d)",
+                      store->config_dir,
+                      error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+    }
+  g_object_unref (file);
+
+  if (G_OBJECT_CLASS (udisks_drive_config_store_parent_class)->constructed != NULL)
+    G_OBJECT_CLASS (udisks_drive_config_store_parent_class)->constructed (object);
+}
+
+static void
+udisks_drive_config_store_class_init (UDisksDriveConfigStoreClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize     = udisks_drive_config_store_finalize;
+  gobject_class->constructed  = udisks_drive_config_store_constructed;
+  gobject_class->set_property = udisks_drive_config_store_set_property;
+  gobject_class->get_property = udisks_drive_config_store_get_property;
+
+  /**
+   * UDisksDriveConfigStore:config-dir:
+   *
+   * The directory containing the drive configuration files.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_CONFIG_DIR,
+                                   g_param_spec_string ("config-dir",
+                                                        "Configuration directory",
+                                                        "The directory containing the drive configuration files",
+                                                        NULL,
+                                                        G_PARAM_READABLE |
+                                                        G_PARAM_WRITABLE |
+                                                        G_PARAM_CONSTRUCT_ONLY |
+                                                        G_PARAM_STATIC_STRINGS));
+
+  /**
+   * UDisksDriveConfigStore::changed
+   * @store: A #UDisksDriveConfigStore.
+   * @id: The id of the drive whose configuration changed.
+   *
+   * Emitted when the configuration file of the drive with @id was
+   * created, removed or modified in a way that changes the
+   * configuration returned by udisks_drive_config_store_lookup().
+   *
+   * This signal is emitted in the
+   * <link linkend="g-main-context-push-thread-default">thread-default main loop</link>
+   * that @store was created in.
+   */
+  signals[CHANGED_SIGNAL] = g_signal_new ("changed",
+                                          G_OBJECT_CLASS_TYPE (klass),
+                                          G_SIGNAL_RUN_LAST,
+                                          G_STRUCT_OFFSET (UDisksDriveConfigStoreClass, changed),
+                                          NULL,
+                                          NULL,
+                                          g_cclosure_marshal_VOID__STRING,
+                                          G_TYPE_NONE,
+                                          1,
+                                          G_TYPE_STRING);
+}
+
+/**
+ * udisks_drive_config_store_new:
+ * @config_dir: The directory containing the drive configuration files.
+ *
+ * Creates a new #UDisksDriveConfigStore object and starts monitoring
+ * @config_dir.
+ *
+ * Returns: A #UDisksDriveConfigStore that should be freed with g_object_unref().
+ */
+UDisksDriveConfigStore *
+udisks_drive_config_store_new (const gchar *config_dir)
+{
+  g_return_val_if_fail (config_dir != NULL, NULL);
+  return UDISKS_DRIVE_CONFIG_STORE (g_object_new (UDISKS_TYPE_DRIVE_CONFIG_STORE,
+                                                  "config-dir", config_dir,
+                                                  NULL));
+}
+
+/**
+ * udisks_drive_config_store_get_config_dir:
+ * @store: A #UDisksDriveConfigStore.
+ *
+ * Gets the directory containing the drive configuration files.
+ *
+ * Returns: A string owned by @store.
+ */
+const gchar *
+udisks_drive_config_store_get_config_dir (UDisksDriveConfigStore *store)
+{
+  g_return_val_if_fail (UDISKS_IS_DRIVE_CONFIG_STORE (store), NULL);
+  return store->config_dir;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  UDisksDriveConfigStore *store;
+  gchar *id;
+} EmitChangedData;
+
+static gboolean
+emit_changed_cb (gpointer user_data)
+{
+  EmitChangedData *data = user_data;
+
+  udisks_debug ("Configuration of drive with id %s changed", data->id);
+  g_signal_emit (data->store, signals[CHANGED_SIGNAL], 0, data->id);
+
+  g_object_unref (data->store);
+  g_free (data->id);
+  g_free (data);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* re-reads the file for @id and emits ::changed if the configuration differs, may be called from any thread */
+static void
+reload_entry (UDisksDriveConfigStore *store,
+              const gchar            *id)
+{
+  GVariant *old_value = NULL;
+  GVariant *new_value;
+  gboolean had_entry;
+  gboolean exists;
+  gboolean changed;
+  gchar *path;
+
+  path = get_path_for_id (store, id);
+
+  g_mutex_lock (&store->lock);
+  had_entry = g_hash_table_lookup_extended (store->entries, id, NULL, (gpointer *) &old_value);
+  if (old_value != NULL)
+    g_variant_ref (old_value);
+
+  new_value = load_configuration (path, &exists);
+  if (new_value != NULL)
+    g_variant_ref_sink (new_value);
+
+  if (exists)
+    g_hash_table_replace (store->entries, g_strdup (id), new_value != NULL ? g_variant_ref (new_value) : NULL);
+  else
+    g_hash_table_remove (store->entries, id);
+  g_mutex_unlock (&store->lock);
+
+  /* An entry that was never parsed wasn't used by any drive yet, but be
+   * conservative and report it, drives compare with their current
+   * configuration anyway.
+   */
+  if (!had_entry && !exists)
+    changed = FALSE;
+  else if (old_value != NULL && new_value != NULL)
+    changed = !g_variant_equal (old_value, new_value);
+  else
+    changed = TRUE;
+
+  if (changed)
+    {
+      EmitChangedData *data;
+
+      data = g_new0 (EmitChangedData, 1);
+      data->store = g_object_ref (store);
+      data->id = g_strdup (id);
+      g_main_context_invoke (store->context, emit_changed_cb, data);
+    }
+
+  if (old_value != NULL)
+    g_variant_unref (old_value);
+  if (new_value != NULL)
+    g_variant_unref (new_value);
+  g_free (path);
+}
+
+static void
+on_file_monitor_changed (GFileMonitor      *monitor,
+                         GFile             *file,
+                         GFile             *other_file,
+                         GFileMonitorEvent  event_type,
+                         gpointer           user_data)
+{
+  UDisksDriveConfigStore *store = UDISKS_DRIVE_CONFIG_STORE (user_data);
+
+  if (event_type == G_FILE_MONITOR_EVENT_CREATED ||
+      event_type == G_FILE_MONITOR_EVENT_DELETED ||
+      event_type == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+    {
+      gchar *filename = g_file_get_basename (file);
+      gchar *id = dup_id_from_config_name (filename);
+      if (id != NULL)
+        reload_entry (store, id);
+      g_free (id);
+      g_free (filename);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_drive_config_store_lookup:
+ * @store: A #UDisksDriveConfigStore.
+ * @id: (allow-none): The drive id, see the #UDisksDrive:id property.
+ *
+ * Gets the configuration of the drive with @id, in the format used
+ * for the #UDisksDrive:configuration property.
+ *
+ * This function is thread-safe.
+ *
+ * Returns: (transfer full): A #GVariant of type <literal>a{sv}</literal>
+ *   or %NULL if there's no configuration file for @id. Free with
+ *   g_variant_unref().
+ */
+GVariant *
+udisks_drive_config_store_lookup (UDisksDriveConfigStore *store,
+                                  const gchar            *id)
+{
+  GVariant *ret = NULL;
+  gboolean exists;
+  gchar *path;
+
+  g_return_val_if_fail (UDISKS_IS_DRIVE_CONFIG_STORE (store), NULL);
+
+  if (id == NULL || strlen (id) == 0)
+    return NULL;
+
+  g_mutex_lock (&store->lock);
+  if (store->file_monitor != NULL)
+    {
+      /* no file, no need to look */
+      if (!g_hash_table_lookup_extended (store->entries, id, NULL, (gpointer *) &ret))
+        goto out;
+      if (ret != NULL)
+        {
+          g_variant_ref (ret);
+          goto out;
+        }
+    }
+
+  path = get_path_for_id (store, id);
+  ret = load_configuration (path, &exists);
+  g_free (path);
+  if (ret != NULL)
+    {
+      g_variant_ref_sink (ret);
+      if (store->file_monitor != NULL)
+        g_hash_table_replace (store->entries, g_strdup (id), g_variant_ref (ret));
+    }
+
+ out:
+  g_mutex_unlock (&store->lock);
+  return ret;
+}
+
+/**
+ * udisks_drive_config_store_get_ids:
+ * @store: A #UDisksDriveConfigStore.
+ *
+ * Gets the ids of all drives with a configuration file.
+ *
+ * Returns: (transfer full): A %NULL-terminated array of ids. Free with g_strfreev().
+ */
+gchar **
+udisks_drive_config_store_get_ids (UDisksDriveConfigStore *store)
+{
+  GPtrArray *ids;
+  GHashTableIter iter;
+  gpointer key;
+
+  g_return_val_if_fail (UDISKS_IS_DRIVE_CONFIG_STORE (store), NULL);
+
+  ids = g_ptr_array_new ();
+
+  g_mutex_lock (&store->lock);
+  /* without a monitor the index may be stale */
+  if (store->file_monitor == NULL)
+    {
+      g_hash_table_remove_all (store->entries);
+      scan_config_dir (store);
+    }
+  g_hash_table_iter_init (&iter, store->entries);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    g_ptr_array_add (ids, g_strdup (key));
+  g_mutex_unlock (&store->lock);
+
+  g_ptr_array_add (ids, NULL);
+  return (gchar **) g_ptr_array_free (ids, FALSE);
+}
+
+/**
+ * udisks_drive_config_store_write:
+ * @store: A #UDisksDriveConfigStore.
+ * @id: The drive id.
+ * @configuration: The configuration to write, a #GVariant of type <literal>a{sv}</literal>.
+ * @error: Return location for error or %NULL.
+ *
+ * Writes @configuration to the configuration file of the drive with
+ * @id, keeping any comments and unknown keys already in the file. The
+ * cached configuration is updated right away and
+ * #UDisksDriveConfigStore::changed is emitted if it changed.
+ *
+ * This function is thread-safe.
+ *
+ * Returns: %TRUE if the file was written, %FALSE if @error is set.
+ */
+gboolean
+udisks_drive_config_store_write (UDisksDriveConfigStore  *store,
+                                 const gchar             *id,
+                                 GVariant                *configuration,
+                                 GError                 **error)
+{
+  GKeyFile *key_file;
+  GError *local_error = NULL;
+  gboolean ret = FALSE;
+  gchar *path;
+  gchar *data = NULL;
+  gsize data_len;
+  guint n;
+
+  g_return_val_if_fail (UDISKS_IS_DRIVE_CONFIG_STORE (store), FALSE);
+  g_return_val_if_fail (id != NULL, FALSE);
+  g_return_val_if_fail (g_variant_is_of_type (configuration, G_VARIANT_TYPE_VARDICT), FALSE);
+
+  path = get_path_for_id (store, id);
+
+  key_file = g_key_file_new ();
+  if (!g_key_file_load_from_file (key_file,
+                                  path,
+                                  G_KEY_FILE_KEEP_COMMENTS | G_KEY_FILE_KEEP_TRANSLATIONS,
+                                  &local_error))
+    {
+      if (!g_error_matches (local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        {
+          g_propagate_error (error, local_error);
+          goto out;
+        }
+      /* not a problem, just create a new file */
+      g_key_file_set_comment (key_file,
+                              NULL, /* group_name */
+                              NULL, /* key */
+                              " See udisks(8) for the format of this file.",
+                              NULL);
+      g_clear_error (&local_error);
+    }
+
+  for (n = 0; n < G_N_ELEMENTS (drive_configuration_mapping); n++)
+    {
+      const VariantKeyfileMapping *mapping = &drive_configuration_mapping[n];
+      GVariant *value = NULL;
+
+      value = g_variant_lookup_value (configuration, mapping->asv_key, mapping->type);
+      if (value == NULL)
+        {
+          g_key_file_remove_key (key_file, mapping->group, mapping->key, NULL);
+        }
+      else
+        {
+          if (g_variant_type_equal (mapping->type, G_VARIANT_TYPE_INT32))
+            {
+              g_key_file_set_integer (key_file, mapping->group, mapping->key, g_variant_get_int32 (value));
+            }
+          else if (g_variant_type_equal (mapping->type, G_VARIANT_TYPE_BOOLEAN))
+            {
+              g_key_file_set_boolean (key_file, mapping->group, mapping->key, g_variant_get_boolean (value));
+            }
+          else if (g_variant_type_equal (mapping->type, G_VARIANT_TYPE_UINT32))
+            {
+              g_key_file_set_uint64 (key_file, mapping->group, mapping->key, g_variant_get_uint32 (value));
+            }
+          else if (g_variant_type_equal (mapping->type, G_VARIANT_TYPE_STRING))
+            {
+              g_key_file_set_string (key_file, mapping->group, mapping->key, g_variant_get_string (value, NULL));
+            }
+          else
+            {
+              g_assert_not_reached ();
+            }
+          g_variant_unref (value);
+        }
+    }
+
+  data = g_key_file_to_data (key_file, &data_len, NULL);
+
+  if (!udisks_daemon_util_file_set_contents (path,
+                                             data,
+                                             data_len,
+                                             0600, /* mode to use if non-existent */
+                                             error))
+    goto out;
+
+  /* don't wait for the file monitor, it will find nothing changed */
+  reload_entry (store, id);
+
+  ret = TRUE;
+
+ out:
+  g_free (data);
+  g_free (path);
+  g_key_file_free (key_file);
+  return ret;
+}
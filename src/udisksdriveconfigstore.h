@@ -0,0 +1,43 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __UDISKS_DRIVE_CONFIG_STORE_H__
+#define __UDISKS_DRIVE_CONFIG_STORE_H__
+
+#include "udisksdaemontypes.h"
+
+G_BEGIN_DECLS
+
+#define UDISKS_TYPE_DRIVE_CONFIG_STORE         (udisks_drive_config_store_get_type ())
+#define UDISKS_DRIVE_CONFIG_STORE(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), UDISKS_TYPE_DRIVE_CONFIG_STORE, UDisksDriveConfigStore))
+#define UDISKS_IS_DRIVE_CONFIG_STORE(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), UDISKS_TYPE_DRIVE_CONFIG_STORE))
+
+GType                    udisks_drive_config_store_get_type       (void) G_GNUC_CONST;
+UDisksDriveConfigStore  *udisks_drive_config_store_new            (const gchar             *config_dir);
+const gchar             *udisks_drive_config_store_get_config_dir (UDisksDriveConfigStore  *store);
+GVariant                *udisks_drive_config_store_lookup         (UDisksDriveConfigStore  *store,
+                                                                   const gchar             *id);
+gchar                  **udisks_drive_config_store_get_ids        (UDisksDriveConfigStore  *store);
+gboolean                 udisks_drive_config_store_write          (UDisksDriveConfigStore  *store,
+                                                                   const gchar             *id,
+                                                                   GVariant                *configuration,
+                                                                   GError                 **error);
+
+G_END_DECLS
+
+#endif /* __UDISKS_DRIVE_CONFIG_STORE_H__ */
@@ -0,0 +1,715 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#define _GNU_SOURCE /* for splice(), SEEK_DATA and SEEK_HOLE */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+#include "udisksimagecopy.h"
+#include "udiskslogging.h"
+
+/**
+ * SECTION:udisksimagecopy
+ * @title: Image Copying
+ * @short_description: Helper routines for backing up and restoring block devices
+ *
+ * Helper routines for copying a block device to a sparse image file
+ * and back, used by the Block.BackupTo() and Block.RestoreFrom() D-Bus
+ * methods.
+ *
+ * Backups read the device in large chunks and leave the zeroed parts
+ * of it as holes in the image. Restores find the data in the image
+ * with <literal>SEEK_DATA</literal> and <literal>SEEK_HOLE</literal>
+ * and zero the device where the image has holes with the
+ * <literal>BLKZEROOUT</literal> ioctl, which devices supporting it can
+ * do without transferring any data. Data that doesn't need to be
+ * looked at, because neither a checksum nor zero detection is wanted,
+ * is moved with splice() through a pipe so it isn't copied to and from
+ * user space. The data is dropped from the page cache as it is copied,
+ * copying a large device doesn't push everything else out of memory.
+ */
+
+#define CHUNK_SIZE (4 * 1024 * 1024)
+
+/* granularity of the holes written to the image */
+#define HOLE_SIZE 4096
+
+typedef struct
+{
+  const UDisksImageCopyParams *params;
+  UDisksImageCopyResults      *results;
+  GChecksum                   *checksum;
+  guchar                      *buffer;
+  guchar                      *zeroes;
+  gint                         pipe_fds[2];
+  gboolean                     can_splice;
+  guint64                      bytes_done;
+  guint64                      bytes_total;
+  gint64                       time_of_last_progress;
+  UDisksImageCopyProgressFunc  progress_func;
+  gpointer                     user_data;
+  GCancellable                *cancellable;
+} ImageCopy;
+
+static void
+image_copy_init (ImageCopy                    *copy,
+                 const UDisksImageCopyParams  *params,
+                 UDisksImageCopyResults       *results,
+                 UDisksImageCopyProgressFunc   progress_func,
+                 gpointer                      user_data,
+                 GCancellable                 *cancellable)
+{
+  memset (copy, 0, sizeof (ImageCopy));
+  memset (results, 0, sizeof (UDisksImageCopyResults));
+  copy->params = params;
+  copy->results = results;
+  copy->progress_func = progress_func;
+  copy->user_data = user_data;
+  copy->cancellable = cancellable;
+  copy->pipe_fds[0] = copy->pipe_fds[1] = -1;
+  copy->time_of_last_progress = g_get_monotonic_time ();
+  if (params->checksum)
+    copy->checksum = g_checksum_new (params->checksum_type);
+  copy->buffer = g_malloc (CHUNK_SIZE);
+  copy->zeroes = g_malloc0 (CHUNK_SIZE);
+
+  /* without a checksum, data that isn't checked for zeroes can be spliced */
+  copy->can_splice = !params->checksum && pipe2 (copy->pipe_fds, O_CLOEXEC) == 0;
+  if (copy->can_splice)
+    fcntl (copy->pipe_fds[1], F_SETPIPE_SZ, CHUNK_SIZE);
+}
+
+static void
+image_copy_clear (ImageCopy *copy)
+{
+  if (copy->checksum != NULL)
+    g_checksum_free (copy->checksum);
+  g_free (copy->buffer);
+  g_free (copy->zeroes);
+  if (copy->pipe_fds[0] != -1)
+    close (copy->pipe_fds[0]);
+  if (copy->pipe_fds[1] != -1)
+    close (copy->pipe_fds[1]);
+}
+
+static gboolean
+image_copy_check_cancelled (ImageCopy  *copy,
+                            GError    **error)
+{
+  if (g_cancellable_is_cancelled (copy->cancellable))
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_CANCELLED,
+                   "Job was canceled");
+      return TRUE;
+    }
+  return FALSE;
+}
+
+static void
+image_copy_progress (ImageCopy *copy,
+                     guint64    bytes)
+{
+  gint64 now;
+
+  copy->bytes_done += bytes;
+
+  /* only report at most once a second */
+  now = g_get_monotonic_time ();
+  if (copy->progress_func != NULL && now - copy->time_of_last_progress > G_USEC_PER_SEC)
+    {
+      copy->progress_func (copy->bytes_done, copy->bytes_total, copy->user_data);
+      copy->time_of_last_progress = now;
+    }
+}
+
+/* Feeds @len bytes of zeroes to the checksum, for holes */
+static void
+image_copy_checksum_zeroes (ImageCopy *copy,
+                            guint64    len)
+{
+  while (copy->checksum != NULL && len > 0)
+    {
+      gsize n = MIN (len, CHUNK_SIZE);
+      g_checksum_update (copy->checksum, copy->zeroes, n);
+      len -= n;
+    }
+}
+
+static gboolean
+is_zeroes (const guchar *buf,
+           gsize         len)
+{
+  return len == 0 || (buf[0] == 0 && memcmp (buf, buf + 1, len - 1) == 0);
+}
+
+static gboolean
+read_full (gint      fd,
+           guchar   *buf,
+           gsize     len,
+           guint64   offset,
+           GError  **error)
+{
+  while (len > 0)
+    {
+      ssize_t num_read = pread (fd, buf, len, offset);
+      if (num_read < 0 && errno == EINTR)
+        continue;
+      if (num_read <= 0)
+        {
+          if (num_read == 0)
+            errno = EIO;
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Error reading %" G_GSIZE_FORMAT " bytes at offset %" G_GUINT64_FORMAT ": %m",
+                       len, offset);
+          return FALSE;
+        }
+      buf += num_read;
+      len -= num_read;
+      offset += num_read;
+    }
+  return TRUE;
+}
+
+static gboolean
+write_full (gint           fd,
+            const guchar  *buf,
+            gsize          len,
+            guint64        offset,
+            GError       **error)
+{
+  while (len > 0)
+    {
+      ssize_t num_written = pwrite (fd, buf, len, offset);
+      if (num_written < 0 && errno == EINTR)
+        continue;
+      if (num_written <= 0)
+        {
+          if (num_written == 0)
+            errno = EIO;
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Error writing %" G_GSIZE_FORMAT " bytes at offset %" G_GUINT64_FORMAT ": %m",
+                       len, offset);
+          return FALSE;
+        }
+      buf += num_written;
+      len -= num_written;
+      offset += num_written;
+    }
+  return TRUE;
+}
+
+/* Moves @len bytes at @offset from @src_fd to @dst_fd through the pipe.
+ * Returns FALSE with errno set to EINVAL if either side can't be
+ * spliced, before anything was moved.
+ */
+static gboolean
+splice_full (ImageCopy  *copy,
+             gint        src_fd,
+             gint        dst_fd,
+             gsize       len,
+             guint64     offset,
+             GError    **error)
+{
+  loff_t in_offset = offset;
+  loff_t out_offset = offset;
+
+  while (len > 0)
+    {
+      ssize_t in_pipe;
+
+      in_pipe = splice (src_fd, &in_offset, copy->pipe_fds[1], NULL, len, SPLICE_F_MOVE);
+      if (in_pipe < 0 && errno == EINTR)
+        continue;
+      if (in_pipe <= 0)
+        {
+          if (in_pipe == 0)
+            errno = EIO;
+          if (errno == EINVAL && (guint64) in_offset == offset)
+            return FALSE;
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Error reading %" G_GSIZE_FORMAT " bytes at offset %" G_GUINT64_FORMAT ": %m",
+                       len, (guint64) in_offset);
+          return FALSE;
+        }
+      len -= in_pipe;
+
+      while (in_pipe > 0)
+        {
+          ssize_t out_pipe;
+
+          out_pipe = splice (copy->pipe_fds[0], NULL, dst_fd, &out_offset, in_pipe, SPLICE_F_MOVE);
+          if (out_pipe < 0 && errno == EINTR)
+            continue;
+          if (out_pipe <= 0)
+            {
+              if (out_pipe == 0)
+                errno = EIO;
+              g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                           "Error writing %" G_GSIZE_FORMAT " bytes at offset %" G_GUINT64_FORMAT ": %m",
+                           (gsize) in_pipe, (guint64) out_offset);
+              return FALSE;
+            }
+          in_pipe -= out_pipe;
+        }
+    }
+  return TRUE;
+}
+
+/* Copies @len bytes at @offset, with splice() if possible */
+static gboolean
+copy_range (ImageCopy  *copy,
+            gint        src_fd,
+            gint        dst_fd,
+            gsize       len,
+            guint64     offset,
+            GError    **error)
+{
+  GError *local_error = NULL;
+
+  if (copy->can_splice)
+    {
+      if (splice_full (copy, src_fd, dst_fd, len, offset, &local_error))
+        return TRUE;
+      if (local_error != NULL)
+        {
+          g_propagate_error (error, local_error);
+          return FALSE;
+        }
+      udisks_debug ("Cannot splice, falling back to copying through a buffer");
+      copy->can_splice = FALSE;
+    }
+
+  if (!read_full (src_fd, copy->buffer, len, offset, error))
+    return FALSE;
+  if (copy->checksum != NULL)
+    g_checksum_update (copy->checksum, copy->buffer, len);
+  return write_full (dst_fd, copy->buffer, len, offset, error);
+}
+
+/* Zeroes @len bytes of the device at @offset, offloaded to the device if possible */
+static gboolean
+zero_range (ImageCopy  *copy,
+            gint        fd,
+            guint64     len,
+            guint64     offset,
+            GError    **error)
+{
+  guint64 range[2];
+  guint64 aligned_len;
+
+  /* BLKZEROOUT needs 512-byte alignment, the rest is written */
+  aligned_len = offset % 512 == 0 ? len - len % 512 : 0;
+  if (aligned_len > 0)
+    {
+      range[0] = offset;
+      range[1] = aligned_len;
+      if (ioctl (fd, BLKZEROOUT, range) == 0)
+        {
+          offset += aligned_len;
+          len -= aligned_len;
+        }
+    }
+
+  while (len > 0)
+    {
+      gsize n = MIN (len, CHUNK_SIZE);
+      if (!write_full (fd, copy->zeroes, n, offset, error))
+        return FALSE;
+      offset += n;
+      len -= n;
+    }
+  return TRUE;
+}
+
+static gboolean
+get_size (gint      fd,
+          guint64  *out_size,
+          GError  **error)
+{
+  struct stat statbuf;
+
+  if (fstat (fd, &statbuf) != 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error getting the size of the device: %m");
+      return FALSE;
+    }
+  if (S_ISREG (statbuf.st_mode))
+    {
+      *out_size = statbuf.st_size;
+      return TRUE;
+    }
+  if (ioctl (fd, BLKGETSIZE64, out_size) != 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error doing BLKGETSIZE64 ioctl: %m");
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/* Writes the non-zero parts of the chunk in the buffer to @image_fd */
+static gboolean
+write_sparse (ImageCopy  *copy,
+              gint        image_fd,
+              gsize       len,
+              guint64     offset,
+              GError    **error)
+{
+  gsize pos = 0;
+
+  while (pos < len)
+    {
+      gsize start;
+
+      /* skip the zeroed blocks */
+      while (pos < len && is_zeroes (copy->buffer + pos, MIN (HOLE_SIZE, len - pos)))
+        {
+          copy->results->bytes_skipped += MIN (HOLE_SIZE, len - pos);
+          pos += MIN (HOLE_SIZE, len - pos);
+        }
+      if (pos >= len)
+        break;
+
+      /* and write the others in one go */
+      start = pos;
+      while (pos < len && !is_zeroes (copy->buffer + pos, MIN (HOLE_SIZE, len - pos)))
+        pos += MIN (HOLE_SIZE, len - pos);
+      if (!write_full (image_fd, copy->buffer + start, pos - start, offset + start, error))
+        return FALSE;
+      copy->results->bytes_written += pos - start;
+    }
+  return TRUE;
+}
+
+static gboolean
+verify_device (ImageCopy  *copy,
+               gint        device_fd,
+               guint64     size,
+               GError    **error)
+{
+  GChecksum *checksum;
+  guint64 offset;
+  gboolean ret = FALSE;
+
+  /* make sure the data comes from the device rather than the page cache */
+  posix_fadvise (device_fd, 0, size, POSIX_FADV_DONTNEED);
+
+  checksum = g_checksum_new (copy->params->checksum_type);
+  for (offset = 0; offset < size; offset += CHUNK_SIZE)
+    {
+      gsize len = MIN (size - offset, CHUNK_SIZE);
+
+      if (image_copy_check_cancelled (copy, error))
+        goto out;
+      if (!read_full (device_fd, copy->buffer, len, offset, error))
+        goto out;
+      g_checksum_update (checksum, copy->buffer, len);
+      posix_fadvise (device_fd, offset, len, POSIX_FADV_DONTNEED);
+      image_copy_progress (copy, len);
+    }
+
+  if (g_strcmp0 (g_checksum_get_string (checksum), copy->results->checksum) != 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Verification failed: the checksum of the device is %s, expected %s",
+                   g_checksum_get_string (checksum), copy->results->checksum);
+      goto out;
+    }
+  ret = TRUE;
+
+ out:
+  g_checksum_free (checksum);
+  return ret;
+}
+
+/**
+ * udisks_image_copy_backup_sync:
+ * @device_fd: A file descriptor for the block device to back up, opened for reading.
+ * @image_fd: A file descriptor for a regular file, opened for writing.
+ * @params: How to copy.
+ * @results: (out): Return location for the results.
+ * @progress_func: (allow-none): Function to report progress to or %NULL.
+ * @user_data: User data to pass to @progress_func.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Copies the whole device to the image, replacing what the image
+ * contained. If @params requests a sparse image, the zeroed parts of
+ * the device are left as holes in the image.
+ *
+ * Returns: %TRUE if @results was set, %FALSE if @error is set. Free the
+ * checksum in @results with g_free().
+ */
+gboolean
+udisks_image_copy_backup_sync (gint                          device_fd,
+                               gint                          image_fd,
+                               const UDisksImageCopyParams  *params,
+                               UDisksImageCopyResults       *results,
+                               UDisksImageCopyProgressFunc   progress_func,
+                               gpointer                      user_data,
+                               GCancellable                 *cancellable,
+                               GError                      **error)
+{
+  ImageCopy copy;
+  guint64 size;
+  guint64 offset;
+  gint64 start_time;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (params != NULL, FALSE);
+  g_return_val_if_fail (results != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  image_copy_init (&copy, params, results, progress_func, user_data, cancellable);
+  /* zero detection needs the data */
+  if (params->sparse)
+    copy.can_splice = FALSE;
+  start_time = g_get_monotonic_time ();
+
+  if (!get_size (device_fd, &size, error))
+    goto out;
+  copy.bytes_total = size;
+
+  /* start with an image that is one big hole */
+  if (ftruncate (image_fd, 0) != 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error truncating the image: %m");
+      goto out;
+    }
+  posix_fadvise (device_fd, 0, size, POSIX_FADV_SEQUENTIAL);
+
+  for (offset = 0; offset < size; offset += CHUNK_SIZE)
+    {
+      gsize len = MIN (size - offset, CHUNK_SIZE);
+
+      if (image_copy_check_cancelled (&copy, error))
+        goto out;
+
+      if (params->sparse)
+        {
+          if (!read_full (device_fd, copy.buffer, len, offset, error))
+            goto out;
+          if (copy.checksum != NULL)
+            g_checksum_update (copy.checksum, copy.buffer, len);
+          if (!write_sparse (&copy, image_fd, len, offset, error))
+            goto out;
+        }
+      else
+        {
+          if (!copy_range (&copy, device_fd, image_fd, len, offset, error))
+            goto out;
+          results->bytes_written += len;
+        }
+
+      posix_fadvise (device_fd, offset, len, POSIX_FADV_DONTNEED);
+      posix_fadvise (image_fd, offset, len, POSIX_FADV_DONTNEED);
+      image_copy_progress (&copy, len);
+    }
+
+  /* the size of the image covers trailing holes too */
+  if (ftruncate (image_fd, size) != 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error setting the size of the image: %m");
+      goto out;
+    }
+  if (fsync (image_fd) != 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error syncing the image: %m");
+      goto out;
+    }
+
+  results->bytes = size;
+  if (copy.checksum != NULL)
+    results->checksum = g_strdup (g_checksum_get_string (copy.checksum));
+  results->elapsed_usec = g_get_monotonic_time () - start_time;
+  ret = TRUE;
+
+ out:
+  image_copy_clear (&copy);
+  return ret;
+}
+
+/**
+ * udisks_image_copy_restore_sync:
+ * @image_fd: A file descriptor for a regular file, opened for reading.
+ * @device_fd: A file descriptor for the block device to restore to, opened for reading and writing.
+ * @params: How to copy.
+ * @results: (out): Return location for the results.
+ * @progress_func: (allow-none): Function to report progress to or %NULL.
+ * @user_data: User data to pass to @progress_func.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Copies the image to the start of the device. The image must not be
+ * larger than the device. Holes in the image, and chunks of data that
+ * are all zeroes, are zeroed on the device with
+ * <literal>BLKZEROOUT</literal> unless @params requests to skip them.
+ *
+ * If @params requests verification, the device is read back once the
+ * image has been copied and its checksum is compared with the one of
+ * the image.
+ *
+ * Returns: %TRUE if @results was set, %FALSE if @error is set. Free the
+ * checksum in @results with g_free().
+ */
+gboolean
+udisks_image_copy_restore_sync (gint                          image_fd,
+                                gint                          device_fd,
+                                const UDisksImageCopyParams  *params,
+                                UDisksImageCopyResults       *results,
+                                UDisksImageCopyProgressFunc   progress_func,
+                                gpointer                      user_data,
+                                GCancellable                 *cancellable,
+                                GError                      **error)
+{
+  ImageCopy copy;
+  guint64 size;
+  guint64 device_size;
+  guint64 offset = 0;
+  guint64 extent_end = 0;
+  gboolean in_data = FALSE;
+  gint64 start_time;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (params != NULL, FALSE);
+  g_return_val_if_fail (results != NULL, FALSE);
+  g_return_val_if_fail (!params->verify || params->checksum, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  image_copy_init (&copy, params, results, progress_func, user_data, cancellable);
+  start_time = g_get_monotonic_time ();
+
+  if (!get_size (image_fd, &size, error) || !get_size (device_fd, &device_size, error))
+    goto out;
+  if (size > device_size)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "The image of %" G_GUINT64_FORMAT " bytes is larger than the device of %" G_GUINT64_FORMAT " bytes",
+                   size, device_size);
+      goto out;
+    }
+  copy.bytes_total = params->verify ? 2 * size : size;
+  posix_fadvise (image_fd, 0, size, POSIX_FADV_SEQUENTIAL);
+
+  while (offset < size)
+    {
+      gsize len;
+
+      if (image_copy_check_cancelled (&copy, error))
+        goto out;
+
+      /* find out whether the next extent of the image is data or a hole */
+      if (offset >= extent_end)
+        {
+          off_t data;
+
+          data = lseek (image_fd, offset, SEEK_DATA);
+          if (data < 0 && errno == ENXIO)
+            data = size;
+          else if (data < 0)
+            data = offset;   /* SEEK_DATA not supported, everything is data */
+
+          if ((guint64) data > offset)
+            {
+              in_data = FALSE;
+              extent_end = MIN ((guint64) data, size);
+            }
+          else
+            {
+              off_t hole = lseek (image_fd, offset, SEEK_HOLE);
+              in_data = TRUE;
+              extent_end = hole < 0 ? size : MIN ((guint64) hole, size);
+            }
+        }
+      len = MIN (extent_end - offset, CHUNK_SIZE);
+
+      if (!in_data)
+        {
+          image_copy_checksum_zeroes (&copy, len);
+          if (!params->skip_holes && !zero_range (&copy, device_fd, len, offset, error))
+            goto out;
+          results->bytes_skipped += len;
+        }
+      else if (copy.can_splice)
+        {
+          if (!copy_range (&copy, image_fd, device_fd, len, offset, error))
+            goto out;
+          results->bytes_written += len;
+        }
+      else
+        {
+          if (!read_full (image_fd, copy.buffer, len, offset, error))
+            goto out;
+          if (copy.checksum != NULL)
+            g_checksum_update (copy.checksum, copy.buffer, len);
+          if (is_zeroes (copy.buffer, len))
+            {
+              if (!zero_range (&copy, device_fd, len, offset, error))
+                goto out;
+              results->bytes_skipped += len;
+            }
+          else
+            {
+              if (!write_full (device_fd, copy.buffer, len, offset, error))
+                goto out;
+              results->bytes_written += len;
+            }
+        }
+
+      posix_fadvise (image_fd, offset, len, POSIX_FADV_DONTNEED);
+      image_copy_progress (&copy, len);
+      offset += len;
+    }
+
+  if (fsync (device_fd) != 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error syncing the device: %m");
+      goto out;
+    }
+
+  results->bytes = size;
+  if (copy.checksum != NULL)
+    results->checksum = g_strdup (g_checksum_get_string (copy.checksum));
+
+  if (params->verify && !verify_device (&copy, device_fd, size, error))
+    goto out;
+
+  results->elapsed_usec = g_get_monotonic_time () - start_time;
+  ret = TRUE;
+
+ out:
+  if (!ret)
+    g_clear_pointer (&results->checksum, g_free);
+  image_copy_clear (&copy);
+  return ret;
+}
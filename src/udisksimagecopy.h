@@ -0,0 +1,99 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __UDISKS_IMAGE_COPY_H__
+#define __UDISKS_IMAGE_COPY_H__
+
+#include "udisksdaemontypes.h"
+
+G_BEGIN_DECLS
+
+/**
+ * UDisksImageCopyParams:
+ * @checksum: Whether to compute a checksum of the copied data.
+ * @checksum_type: The type of checksum to compute if @checksum is %TRUE.
+ * @sparse: For backups, whether to leave zeroed regions of the device as holes in the image.
+ * @skip_holes: For restores, whether to leave the device untouched where the image has holes instead of zeroing it.
+ * @verify: For restores, whether to read the device back and compare its checksum. Requires @checksum.
+ *
+ * Parameters for udisks_image_copy_backup_sync() and
+ * udisks_image_copy_restore_sync().
+ */
+struct _UDisksImageCopyParams
+{
+  /*< public >*/
+  gboolean      checksum;
+  GChecksumType checksum_type;
+  gboolean      sparse;
+  gboolean      skip_holes;
+  gboolean      verify;
+};
+
+/**
+ * UDisksImageCopyResults:
+ * @bytes: Size of the copied data in bytes, including holes.
+ * @bytes_written: Number of bytes of data actually written.
+ * @bytes_skipped: Number of bytes not written because they were holes or zeroes.
+ * @elapsed_usec: Wall clock time the copy took, in microseconds.
+ * @checksum: Hexadecimal checksum of the data, including holes, or %NULL. Free with g_free().
+ *
+ * Results of udisks_image_copy_backup_sync() and udisks_image_copy_restore_sync().
+ */
+struct _UDisksImageCopyResults
+{
+  /*< public >*/
+  guint64  bytes;
+  guint64  bytes_written;
+  guint64  bytes_skipped;
+  gint64   elapsed_usec;
+  gchar   *checksum;
+};
+
+/**
+ * UDisksImageCopyProgressFunc:
+ * @bytes_done: Number of bytes processed so far.
+ * @bytes_total: Number of bytes to process, including the verification pass.
+ * @user_data: User data passed to udisks_image_copy_backup_sync() or udisks_image_copy_restore_sync().
+ *
+ * Function called at most once a second while copying.
+ */
+typedef void (*UDisksImageCopyProgressFunc) (guint64   bytes_done,
+                                             guint64   bytes_total,
+                                             gpointer  user_data);
+
+gboolean udisks_image_copy_backup_sync  (gint                          device_fd,
+                                         gint                          image_fd,
+                                         const UDisksImageCopyParams  *params,
+                                         UDisksImageCopyResults       *results,
+                                         UDisksImageCopyProgressFunc   progress_func,
+                                         gpointer                      user_data,
+                                         GCancellable                 *cancellable,
+                                         GError                      **error);
+
+gboolean udisks_image_copy_restore_sync (gint                          image_fd,
+                                         gint                          device_fd,
+                                         const UDisksImageCopyParams  *params,
+                                         UDisksImageCopyResults       *results,
+                                         UDisksImageCopyProgressFunc   progress_func,
+                                         gpointer                      user_data,
+                                         GCancellable                 *cancellable,
+                                         GError                      **error);
+
+G_END_DECLS
+
+#endif /* __UDISKS_IMAGE_COPY_H__ */
@@ -0,0 +1,786 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+
+#include <glib/gi18n-lib.h>
+
+#include "udisksdaemon.h"
+#include "udisksjobscheduler.h"
+#include "udisksbasejob.h"
+#include "udisksconfigmanager.h"
+#include "udiskslogging.h"
+#include "udiskslinuxblockobject.h"
+#include "udiskslinuxdriveobject.h"
+#include "udiskslinuxdevice.h"
+
+/**
+ * SECTION:udisksjobscheduler
+ * @title: UDisksJobScheduler
+ * @short_description: Admission control for jobs
+ *
+ * This type limits the number of jobs running concurrently against a
+ * single drive and against all drives connected to the same host
+ * adapter, as configured by the <literal>max_jobs_per_drive</literal>
+ * and <literal>max_jobs_per_host</literal> keys in the
+ * <literal>[jobs]</literal> section of
+ * <filename>udisks2.conf</filename>.
+ *
+ * Jobs over the limit are held back in udisks_job_scheduler_admit_sync()
+ * until a running job on the same drive or host completes. While
+ * waiting, the #UDisksJob:queued and #UDisksJob:queue-position
+ * properties are set so clients can show the job as queued. Waiting
+ * jobs are admitted in order of #UDisksJobPriority and, within the same
+ * priority, in the order they were submitted.
+ *
+ * Jobs of interactive priority (e.g. mounting or unlocking) are never
+ * held back, neither are jobs launched from the main thread or jobs
+ * launched by a thread already running a job on the same drive.
+ *
+ * Some operations are limited on their own, whatever the configured
+ * limits are: at most one <literal>filesystem-trim</literal> job runs
+ * on a drive at a time, as concurrent FITRIM calls on one device only
+ * compete for it.
+ *
+ * Method handlers that launch jobs while holding the cleanup lock of a
+ * block object wait for their turn with
+ * udisks_job_scheduler_reserve_sync() before taking the lock instead,
+ * so queued work never sits on a lock that cleanup or other jobs need.
+ */
+
+typedef struct _UDisksJobSchedulerClass UDisksJobSchedulerClass;
+
+/**
+ * UDisksJobScheduler:
+ *
+ * The #UDisksJobScheduler structure contains only private data and should
+ * only be accessed using the provided API.
+ */
+struct _UDisksJobScheduler
+{
+  GObject parent_instance;
+
+  UDisksDaemon *daemon;
+
+  /* protects everything below */
+  GMutex lock;
+  GCond cond;
+
+  /* UDisksBaseJob* (or JobEntry* for reservations) -> JobEntry*, owns the entries */
+  GHashTable *entries;
+  /* JobEntry*, sorted by priority and submission order */
+  GList *pending;
+  /* key -> number of running jobs */
+  GHashTable *running_per_drive;
+  GHashTable *running_per_host;
+  /* operation key -> number of running jobs */
+  GHashTable *running_per_operation;
+
+  guint64 seq;
+};
+
+struct _UDisksJobSchedulerClass
+{
+  GObjectClass parent_class;
+};
+
+typedef struct
+{
+  /* not referenced, the entry is removed in udisks_job_scheduler_release();
+   * NULL for reservations */
+  UDisksBaseJob *job;
+  gchar *drive_key;
+  gchar *host_key;
+  /* "<operation> <drive key>" for operations with a limit of their own */
+  gchar *operation_key;
+  guint max_per_operation;
+  UDisksJobPriority priority;
+  guint64 seq;
+  GThread *thread;
+  gboolean running;
+} JobEntry;
+
+enum
+{
+  PROP_0,
+  PROP_DAEMON
+};
+
+G_DEFINE_TYPE (UDisksJobScheduler, udisks_job_scheduler, G_TYPE_OBJECT);
+
+static void
+job_entry_free (JobEntry *entry)
+{
+  g_free (entry->drive_key);
+  g_free (entry->host_key);
+  g_free (entry->operation_key);
+  g_free (entry);
+}
+
+static void
+udisks_job_scheduler_init (UDisksJobScheduler *scheduler)
+{
+  g_mutex_init (&scheduler->lock);
+  g_cond_init (&scheduler->cond);
+  scheduler->entries = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) job_entry_free);
+  scheduler->running_per_drive = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  scheduler->running_per_host = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  scheduler->running_per_operation = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+}
+
+static void
+udisks_job_scheduler_finalize (GObject *object)
+{
+  UDisksJobScheduler *scheduler = UDISKS_JOB_SCHEDULER (object);
+
+  g_list_free (scheduler->pending);
+  g_hash_table_unref (scheduler->entries);
+  g_hash_table_unref (scheduler->running_per_drive);
+  g_hash_table_unref (scheduler->running_per_host);
+  g_hash_table_unref (scheduler->running_per_operation);
+  g_cond_clear (&scheduler->cond);
+  g_mutex_clear (&scheduler->lock);
+
+  G_OBJECT_CLASS (udisks_job_scheduler_parent_class)->finalize (object);
+}
+
+static void
+udisks_job_scheduler_get_property (GObject    *object,
+                                   guint       prop_id,
+                                   GValue     *value,
+                                   GParamSpec *pspec)
+{
+  UDisksJobScheduler *scheduler = UDISKS_JOB_SCHEDULER (object);
+
+  switch (prop_id)
+    {
+    case PROP_DAEMON:
+      g_value_set_object (value, udisks_job_scheduler_get_daemon (scheduler));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+udisks_job_scheduler_set_property (GObject      *object,
+                                   guint         prop_id,
+                                   const GValue *value,
+                                   GParamSpec   *pspec)
+{
+  UDisksJobScheduler *scheduler = UDISKS_JOB_SCHEDULER (object);
+
+  switch (prop_id)
+    {
+    case PROP_DAEMON:
+      g_assert (scheduler->daemon == NULL);
+      /* we don't take a reference to the daemon */
+      scheduler->daemon = g_value_get_object (value);
+      g_assert (scheduler->daemon != NULL);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+udisks_job_scheduler_class_init (UDisksJobSchedulerClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = udisks_job_scheduler_finalize;
+  gobject_class->set_property = udisks_job_scheduler_set_property;
+  gobject_class->get_property = udisks_job_scheduler_get_property;
+
+  /**
+   * UDisksJobScheduler:daemon:
+   *
+   * The #UDisksDaemon object.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_DAEMON,
+                                   g_param_spec_object ("daemon",
+                                                        "Daemon",
+                                                        "The daemon object",
+                                                        UDISKS_TYPE_DAEMON,
+                                                        G_PARAM_READABLE |
+                                                        G_PARAM_WRITABLE |
+                                                        G_PARAM_CONSTRUCT_ONLY |
+                                                        G_PARAM_STATIC_STRINGS));
+}
+
+/**
+ * udisks_job_scheduler_new:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Creates a new #UDisksJobScheduler object.
+ *
+ * Returns: A #UDisksJobScheduler that should be freed with g_object_unref().
+ */
+UDisksJobScheduler *
+udisks_job_scheduler_new (UDisksDaemon *daemon)
+{
+  return UDISKS_JOB_SCHEDULER (g_object_new (UDISKS_TYPE_JOB_SCHEDULER,
+                                             "daemon", daemon,
+                                             NULL));
+}
+
+/**
+ * udisks_job_scheduler_get_daemon:
+ * @scheduler: A #UDisksJobScheduler.
+ *
+ * Gets the daemon used by @scheduler.
+ *
+ * Returns: A #UDisksDaemon. Do not free, the object is owned by @scheduler.
+ */
+UDisksDaemon *
+udisks_job_scheduler_get_daemon (UDisksJobScheduler *scheduler)
+{
+  g_return_val_if_fail (UDISKS_IS_JOB_SCHEDULER (scheduler), NULL);
+  return scheduler->daemon;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static const gchar *interactive_operations[] = {
+  "filesystem-mount",
+  "filesystem-unmount",
+  "encrypted-unlock",
+  "encrypted-lock",
+  "swapspace-start",
+  "swapspace-stop",
+  "drive-eject",
+  "loop-setup",
+  "cleanup",
+  "md-raid-start",
+  "md-raid-stop",
+  NULL
+};
+
+static const gchar *bulk_operations[] = {
+  "format-erase",
+  "format-mkfs",
+  "block-benchmark",
+  "block-backup",
+  "block-restore",
+  "ata-secure-erase",
+  "ata-enhanced-secure-erase",
+  "ata-smart-selftest",
+  "filesystem-resize",
+  "filesystem-check",
+  "filesystem-repair",
+  "filesystem-trim",
+  "filesystem-trim-all",
+  "encrypted-resize",
+  "encrypted-reencrypt",
+  "mdraid-create",
+  "md-raid-add-device",
+  "pv-format-erase",
+  "lvm-lvol-resize",
+  NULL
+};
+
+/* Operations limited per drive regardless of max_jobs_per_drive */
+static const struct
+{
+  const gchar *job_operation;
+  guint        max_per_drive;
+} operation_limits[] = {
+  { "filesystem-trim", 1 },
+};
+
+static guint
+get_max_per_drive_for_operation (const gchar *job_operation)
+{
+  guint n;
+
+  for (n = 0; n < G_N_ELEMENTS (operation_limits); n++)
+    if (g_strcmp0 (operation_limits[n].job_operation, job_operation) == 0)
+      return operation_limits[n].max_per_drive;
+  return 0;
+}
+
+/**
+ * udisks_job_scheduler_get_priority_for_operation:
+ * @job_operation: A job operation, e.g. <literal>format-mkfs</literal>.
+ *
+ * Gets the priority jobs for @job_operation are scheduled with.
+ *
+ * Returns: A #UDisksJobPriority.
+ */
+UDisksJobPriority
+udisks_job_scheduler_get_priority_for_operation (const gchar *job_operation)
+{
+  if (job_operation == NULL)
+    return UDISKS_JOB_PRIORITY_NORMAL;
+  if (g_strv_contains (interactive_operations, job_operation))
+    return UDISKS_JOB_PRIORITY_INTERACTIVE;
+  if (g_strv_contains (bulk_operations, job_operation))
+    return UDISKS_JOB_PRIORITY_BULK;
+  return UDISKS_JOB_PRIORITY_NORMAL;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Returns the prefix of @sysfs_path identifying the host adapter the
+ * device is connected to, e.g. ".../host2" for SCSI/ATA devices or
+ * ".../nvme/nvme0" for NVMe devices, or %NULL if not known.
+ */
+static gchar *
+host_key_from_sysfs_path (const gchar *sysfs_path)
+{
+  gchar **parts;
+  gchar *ret = NULL;
+  guint n;
+
+  parts = g_strsplit (sysfs_path, "/", -1);
+  for (n = 0; parts[n] != NULL; n++)
+    {
+      if (g_str_has_prefix (parts[n], "host") && g_ascii_isdigit (parts[n][4]))
+        {
+          g_free (parts[n + 1]);
+          parts[n + 1] = NULL;
+          ret = g_strjoinv ("/", parts);
+          break;
+        }
+      if (g_strcmp0 (parts[n], "nvme") == 0 && parts[n + 1] != NULL && g_str_has_prefix (parts[n + 1], "nvme"))
+        {
+          g_free (parts[n + 2]);
+          parts[n + 2] = NULL;
+          ret = g_strjoinv ("/", parts);
+          break;
+        }
+    }
+  g_strfreev (parts);
+  return ret;
+}
+
+/* Follows Block:Drive and Block:CryptoBackingDevice to find the object
+ * representing the hardware @object lives on.
+ *
+ * Returns: (transfer full): A #UDisksObject.
+ */
+static UDisksObject *
+resolve_hardware_object (UDisksDaemon *daemon,
+                         UDisksObject *object)
+{
+  UDisksObject *ret = g_object_ref (object);
+  guint depth;
+
+  for (depth = 0; depth < 8; depth++)
+    {
+      UDisksBlock *block;
+      UDisksObject *next = NULL;
+      const gchar *path;
+
+      block = udisks_object_peek_block (ret);
+      if (block == NULL)
+        break;
+
+      path = udisks_block_get_drive (block);
+      if (g_strcmp0 (path, "/") != 0)
+        next = udisks_daemon_find_object (daemon, path);
+
+      if (next == NULL)
+        {
+          path = udisks_block_get_crypto_backing_device (block);
+          if (g_strcmp0 (path, "/") != 0)
+            next = udisks_daemon_find_object (daemon, path);
+        }
+
+      if (next == NULL)
+        break;
+
+      g_object_unref (ret);
+      ret = next;
+    }
+
+  return ret;
+}
+
+static void
+compute_keys (UDisksJobScheduler  *scheduler,
+              UDisksObject        *object,
+              gchar              **out_drive_key,
+              gchar              **out_host_key)
+{
+  UDisksObject *hw_object;
+  UDisksLinuxDevice *device = NULL;
+
+  hw_object = resolve_hardware_object (scheduler->daemon, object);
+  *out_drive_key = g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (hw_object)));
+
+  if (UDISKS_IS_LINUX_DRIVE_OBJECT (hw_object))
+    device = udisks_linux_drive_object_get_device (UDISKS_LINUX_DRIVE_OBJECT (hw_object), FALSE);
+  else if (UDISKS_IS_LINUX_BLOCK_OBJECT (hw_object))
+    device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (hw_object));
+
+  *out_host_key = NULL;
+  if (device != NULL)
+    {
+      *out_host_key = host_key_from_sysfs_path (g_udev_device_get_sysfs_path (device->udev_device));
+      g_object_unref (device);
+    }
+
+  g_object_unref (hw_object);
+}
+
+static gint
+job_entry_compare (gconstpointer a,
+                   gconstpointer b)
+{
+  const JobEntry *ea = a;
+  const JobEntry *eb = b;
+
+  if (ea->priority != eb->priority)
+    return ea->priority < eb->priority ? -1 : 1;
+  return ea->seq < eb->seq ? -1 : (ea->seq > eb->seq ? 1 : 0);
+}
+
+static guint
+get_running (GHashTable  *counts,
+             const gchar *key)
+{
+  return key != NULL ? GPOINTER_TO_UINT (g_hash_table_lookup (counts, key)) : 0;
+}
+
+static void
+adjust_running (GHashTable  *counts,
+                const gchar *key,
+                gint         delta)
+{
+  guint count;
+
+  if (key == NULL)
+    return;
+
+  count = get_running (counts, key) + delta;
+  if (count == 0)
+    g_hash_table_remove (counts, key);
+  else
+    g_hash_table_replace (counts, g_strdup (key), GUINT_TO_POINTER (count));
+}
+
+/* must be called with lock held */
+static gboolean
+can_run (UDisksJobScheduler *scheduler,
+         JobEntry           *entry,
+         guint               max_per_drive,
+         guint               max_per_host)
+{
+  GList *l;
+
+  /* don't overtake queued jobs for the same drive or host */
+  for (l = scheduler->pending; l != NULL && l->data != entry; l = l->next)
+    {
+      JobEntry *other = l->data;
+      if (g_strcmp0 (other->drive_key, entry->drive_key) == 0)
+        return FALSE;
+      if (entry->host_key != NULL && g_strcmp0 (other->host_key, entry->host_key) == 0)
+        return FALSE;
+    }
+
+  if (max_per_drive > 0 && get_running (scheduler->running_per_drive, entry->drive_key) >= max_per_drive)
+    return FALSE;
+  if (max_per_host > 0 && get_running (scheduler->running_per_host, entry->host_key) >= max_per_host)
+    return FALSE;
+  if (entry->max_per_operation > 0 &&
+      get_running (scheduler->running_per_operation, entry->operation_key) >= entry->max_per_operation)
+    return FALSE;
+
+  return TRUE;
+}
+
+/* must be called with lock held */
+static void
+update_queue_positions (UDisksJobScheduler *scheduler)
+{
+  GHashTable *positions;
+  GList *l;
+
+  positions = g_hash_table_new (g_str_hash, g_str_equal);
+  for (l = scheduler->pending; l != NULL; l = l->next)
+    {
+      JobEntry *entry = l->data;
+      guint position;
+
+      position = GPOINTER_TO_UINT (g_hash_table_lookup (positions, entry->drive_key)) + 1;
+      g_hash_table_insert (positions, entry->drive_key, GUINT_TO_POINTER (position));
+      if (entry->job != NULL)
+        udisks_job_set_queue_position (UDISKS_JOB (entry->job), position);
+    }
+  g_hash_table_unref (positions);
+}
+
+/* must be called with lock held */
+static gboolean
+is_nested (UDisksJobScheduler *scheduler,
+           JobEntry           *entry)
+{
+  GHashTableIter iter;
+  JobEntry *other;
+
+  g_hash_table_iter_init (&iter, scheduler->entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &other))
+    {
+      if (other->running && other->thread == entry->thread &&
+          g_strcmp0 (other->drive_key, entry->drive_key) == 0)
+        return TRUE;
+    }
+  return FALSE;
+}
+
+static void
+on_cancelled (GCancellable *cancellable,
+              gpointer      user_data)
+{
+  UDisksJobScheduler *scheduler = UDISKS_JOB_SCHEDULER (user_data);
+
+  g_mutex_lock (&scheduler->lock);
+  g_cond_broadcast (&scheduler->cond);
+  g_mutex_unlock (&scheduler->lock);
+}
+
+/* Returns the entry if @key is now accounted for, NULL if it is not
+ * subject to admission control.
+ */
+static JobEntry *
+admit (UDisksJobScheduler *scheduler,
+       gpointer            key,
+       UDisksBaseJob      *job,
+       UDisksObject       *object,
+       const gchar        *job_operation,
+       GCancellable       *cancellable)
+{
+  UDisksConfigManager *config_manager;
+  JobEntry *entry;
+  guint max_per_drive;
+  guint max_per_host;
+  guint max_per_operation;
+  gulong cancelled_id = 0;
+
+  config_manager = udisks_daemon_get_config_manager (scheduler->daemon);
+  max_per_drive = udisks_config_manager_get_max_jobs_per_drive (config_manager);
+  max_per_host = udisks_config_manager_get_max_jobs_per_host (config_manager);
+  max_per_operation = get_max_per_drive_for_operation (job_operation);
+
+  if ((max_per_drive == 0 && max_per_host == 0 && max_per_operation == 0) || object == NULL)
+    return NULL;
+
+  entry = g_new0 (JobEntry, 1);
+  entry->job = job;
+  entry->priority = udisks_job_scheduler_get_priority_for_operation (job_operation);
+  entry->thread = g_thread_self ();
+  compute_keys (scheduler, object, &entry->drive_key, &entry->host_key);
+  if (max_per_operation > 0)
+    {
+      entry->operation_key = g_strdup_printf ("%s %s", job_operation, entry->drive_key);
+      entry->max_per_operation = max_per_operation;
+    }
+
+  /* Never hold back interactive jobs or jobs launched from the main
+   * thread - the latter would block the whole daemon.
+   */
+  if (entry->priority == UDISKS_JOB_PRIORITY_INTERACTIVE ||
+      g_main_context_is_owner (g_main_context_default ()))
+    {
+      job_entry_free (entry);
+      return NULL;
+    }
+
+  if (key == NULL)
+    key = entry;
+
+  if (cancellable != NULL)
+    cancelled_id = g_cancellable_connect (cancellable, G_CALLBACK (on_cancelled), scheduler, NULL);
+
+  g_mutex_lock (&scheduler->lock);
+  entry->seq = scheduler->seq++;
+  g_hash_table_insert (scheduler->entries, key, entry);
+
+  /* A job launched while running another job (or holding a reservation)
+   * on the same drive must not wait for it.
+   */
+  if (!is_nested (scheduler, entry))
+    {
+      scheduler->pending = g_list_insert_sorted (scheduler->pending, entry, job_entry_compare);
+      if (!can_run (scheduler, entry, max_per_drive, max_per_host))
+        {
+          udisks_debug ("Queuing %s %p (%s) for %s",
+                        job != NULL ? "job" : "reservation", key, job_operation, entry->drive_key);
+          if (job != NULL)
+            udisks_job_set_queued (UDISKS_JOB (job), TRUE);
+          update_queue_positions (scheduler);
+          while (!can_run (scheduler, entry, max_per_drive, max_per_host) &&
+                 !g_cancellable_is_cancelled (cancellable))
+            g_cond_wait (&scheduler->cond, &scheduler->lock);
+          if (job != NULL)
+            {
+              udisks_job_set_queued (UDISKS_JOB (job), FALSE);
+              udisks_job_set_queue_position (UDISKS_JOB (job), 0);
+            }
+        }
+      scheduler->pending = g_list_remove (scheduler->pending, entry);
+      update_queue_positions (scheduler);
+    }
+
+  entry->running = TRUE;
+  adjust_running (scheduler->running_per_drive, entry->drive_key, 1);
+  adjust_running (scheduler->running_per_host, entry->host_key, 1);
+  adjust_running (scheduler->running_per_operation, entry->operation_key, 1);
+  /* jobs behind us may now be first in line for another drive */
+  g_cond_broadcast (&scheduler->cond);
+  g_mutex_unlock (&scheduler->lock);
+
+  if (cancelled_id != 0)
+    g_cancellable_disconnect (cancellable, cancelled_id);
+
+  return entry;
+}
+
+/* must be called with lock held */
+static void
+release_entry (UDisksJobScheduler *scheduler,
+               JobEntry           *entry,
+               gpointer            key)
+{
+  if (entry->running)
+    {
+      adjust_running (scheduler->running_per_drive, entry->drive_key, -1);
+      adjust_running (scheduler->running_per_host, entry->host_key, -1);
+      adjust_running (scheduler->running_per_operation, entry->operation_key, -1);
+    }
+  else
+    {
+      scheduler->pending = g_list_remove (scheduler->pending, entry);
+      update_queue_positions (scheduler);
+    }
+  g_hash_table_remove (scheduler->entries, key);
+  g_cond_broadcast (&scheduler->cond);
+}
+
+/**
+ * udisks_job_scheduler_admit_sync:
+ * @scheduler: A #UDisksJobScheduler.
+ * @job: The job to admit.
+ * @object: (allow-none): The #UDisksObject @job operates on or %NULL.
+ * @job_operation: The operation for the job.
+ *
+ * Blocks the calling thread until @job may run according to the
+ * configured limits. If @job is cancelled while waiting, it is
+ * admitted immediately so it can complete as cancelled.
+ *
+ * This is called when a job is created, so callers that hold locks
+ * other jobs may need (e.g. the cleanup lock of a block object) while
+ * launching a job of non-interactive priority should take a
+ * reservation with udisks_job_scheduler_reserve_sync() before taking
+ * those locks.
+ *
+ * Every admitted job must be passed to udisks_job_scheduler_release()
+ * once it completes.
+ */
+void
+udisks_job_scheduler_admit_sync (UDisksJobScheduler *scheduler,
+                                 UDisksBaseJob      *job,
+                                 UDisksObject       *object,
+                                 const gchar        *job_operation)
+{
+  g_return_if_fail (UDISKS_IS_JOB_SCHEDULER (scheduler));
+  g_return_if_fail (UDISKS_IS_BASE_JOB (job));
+
+  admit (scheduler, job, job, object, job_operation, udisks_base_job_get_cancellable (job));
+}
+
+/**
+ * udisks_job_scheduler_release:
+ * @scheduler: A #UDisksJobScheduler.
+ * @job: A job previously passed to udisks_job_scheduler_admit_sync().
+ *
+ * Releases the slot held by @job, letting queued jobs run. Does
+ * nothing if @job was never subject to admission control.
+ */
+void
+udisks_job_scheduler_release (UDisksJobScheduler *scheduler,
+                              UDisksBaseJob      *job)
+{
+  JobEntry *entry;
+
+  g_return_if_fail (UDISKS_IS_JOB_SCHEDULER (scheduler));
+
+  g_mutex_lock (&scheduler->lock);
+  entry = g_hash_table_lookup (scheduler->entries, job);
+  if (entry != NULL)
+    release_entry (scheduler, entry, job);
+  g_mutex_unlock (&scheduler->lock);
+}
+
+/**
+ * udisks_job_scheduler_reserve_sync:
+ * @scheduler: A #UDisksJobScheduler.
+ * @object: (allow-none): The #UDisksObject the caller is going to launch jobs for or %NULL.
+ * @job_operation: The operation of the jobs the caller is going to launch.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ *
+ * Like udisks_job_scheduler_admit_sync() but takes a slot for the
+ * calling thread before any job exists. Jobs the calling thread then
+ * launches for the same drive are never held back.
+ *
+ * Method handlers use this to wait for their turn before taking the
+ * cleanup lock of @object, so that a queued job never blocks while
+ * holding it.
+ *
+ * Returns: (nullable): An opaque reservation to pass to
+ * udisks_job_scheduler_release_reservation() or %NULL if the caller is
+ * not subject to admission control.
+ */
+gpointer
+udisks_job_scheduler_reserve_sync (UDisksJobScheduler *scheduler,
+                                   UDisksObject       *object,
+                                   const gchar        *job_operation,
+                                   GCancellable       *cancellable)
+{
+  g_return_val_if_fail (UDISKS_IS_JOB_SCHEDULER (scheduler), NULL);
+
+  return admit (scheduler, NULL, NULL, object, job_operation, cancellable);
+}
+
+/**
+ * udisks_job_scheduler_release_reservation:
+ * @scheduler: A #UDisksJobScheduler.
+ * @reservation: (allow-none): A reservation from udisks_job_scheduler_reserve_sync() or %NULL.
+ *
+ * Releases @reservation, letting queued jobs run.
+ */
+void
+udisks_job_scheduler_release_reservation (UDisksJobScheduler *scheduler,
+                                          gpointer            reservation)
+{
+  g_return_if_fail (UDISKS_IS_JOB_SCHEDULER (scheduler));
+
+  if (reservation == NULL)
+    return;
+
+  g_mutex_lock (&scheduler->lock);
+  release_entry (scheduler, reservation, reservation);
+  g_mutex_unlock (&scheduler->lock);
+}
@@ -0,0 +1,50 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __UDISKS_JOB_SCHEDULER_H__
+#define __UDISKS_JOB_SCHEDULER_H__
+
+#include "udisksdaemontypes.h"
+
+G_BEGIN_DECLS
+
+#define UDISKS_TYPE_JOB_SCHEDULER         (udisks_job_scheduler_get_type ())
+#define UDISKS_JOB_SCHEDULER(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), UDISKS_TYPE_JOB_SCHEDULER, UDisksJobScheduler))
+#define UDISKS_IS_JOB_SCHEDULER(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), UDISKS_TYPE_JOB_SCHEDULER))
+
+GType                udisks_job_scheduler_get_type     (void) G_GNUC_CONST;
+UDisksJobScheduler  *udisks_job_scheduler_new          (UDisksDaemon        *daemon);
+UDisksDaemon        *udisks_job_scheduler_get_daemon   (UDisksJobScheduler  *scheduler);
+void                 udisks_job_scheduler_admit_sync   (UDisksJobScheduler  *scheduler,
+                                                        UDisksBaseJob       *job,
+                                                        UDisksObject        *object,
+                                                        const gchar         *job_operation);
+void                 udisks_job_scheduler_release      (UDisksJobScheduler  *scheduler,
+                                                        UDisksBaseJob       *job);
+gpointer             udisks_job_scheduler_reserve_sync (UDisksJobScheduler  *scheduler,
+                                                        UDisksObject        *object,
+                                                        const gchar         *job_operation,
+                                                        GCancellable        *cancellable);
+void                 udisks_job_scheduler_release_reservation (UDisksJobScheduler *scheduler,
+                                                               gpointer            reservation);
+
+UDisksJobPriority    udisks_job_scheduler_get_priority_for_operation (const gchar *job_operation);
+
+G_END_DECLS
+
+#endif /* __UDISKS_JOB_SCHEDULER_H__ */
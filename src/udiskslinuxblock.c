@@ -30,7 +30,9 @@
 #include <pwd.h>
 #include <grp.h>
 #include <string.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <errno.h>
 #include <mntent.h>
 
@@ -60,6 +62,8 @@
 #include "udiskscrypttabentry.h"
 #include "udisksdaemonutil.h"
 #include "udisksbasejob.h"
+#include "udisksbenchmark.h"
+#include "udisksimagecopy.h"
 #include "udiskssimplejob.h"
 #include "udiskslinuxdriveata.h"
 #include "udiskslinuxmdraidobject.h"
@@ -69,6 +73,8 @@
 #include "udiskslinuxencryptedhelpers.h"
 #include "udiskslinuxpartitiontable.h"
 #include "udiskslinuxfilesystemhelpers.h"
+#include "udisksdevicegraph.h"
+#include "udisksjobscheduler.h"
 
 #ifdef HAVE_LIBMOUNT_UTAB
 #include "udisksutabmonitor.h"
@@ -187,42 +193,6 @@ get_sysfs_attr (GUdevDevice *device,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-static UDisksLinuxBlockObject *
-find_block_device_by_sysfs_path (GDBusObjectManagerServer *object_manager,
-                                 const gchar              *sysfs_path)
-{
-  UDisksLinuxBlockObject *ret;
-  GList *objects;
-  GList *l;
-
-  ret = NULL;
-
-  objects = g_dbus_object_manager_get_objects (G_DBUS_OBJECT_MANAGER (object_manager));
-  for (l = objects; l != NULL; l = l->next)
-    {
-      GDBusObjectSkeleton *object = G_DBUS_OBJECT_SKELETON (l->data);
-      UDisksLinuxDevice *device;
-
-      if (!UDISKS_IS_LINUX_BLOCK_OBJECT (object))
-        continue;
-
-      device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (object));
-      if (g_strcmp0 (sysfs_path, g_udev_device_get_sysfs_path (device->udev_device)) == 0)
-        {
-          ret = g_object_ref (UDISKS_LINUX_BLOCK_OBJECT (object));
-          g_object_unref (device);
-          goto out;
-        }
-      g_object_unref (device);
-    }
-
- out:
-  g_list_free_full (objects, g_object_unref);
-  return ret;
-}
-
-/* ---------------------------------------------------------------------------------------------------- */
-
 static gchar *
 find_drive (GDBusObjectManagerServer  *object_manager,
             GUdevDevice               *block_device,
@@ -1011,8 +981,8 @@ udisks_linux_block_update (UDisksLinuxBlock       *block,
 
           while (slave_sysfs_path)
             {
-              UDisksLinuxBlockObject *slave_object;
-              slave_object = find_block_device_by_sysfs_path (object_manager, slave_sysfs_path);
+              UDisksObject *slave_object;
+              slave_object = udisks_daemon_find_block_by_sysfs_path (daemon, slave_sysfs_path);
               if (slave_object != NULL)
                 {
                   UDisksEncrypted *enc;
@@ -2573,21 +2543,25 @@ get_cleartext_block (UDisksDaemon  *daemon,
   UDisksBlock *ret = NULL;
   GDBusObject *object;
   const gchar *object_path;
-  GList *objects = NULL;
+  UDisksLinuxDevice *device;
+  GList *children = NULL;
   GList *l;
 
   object = g_dbus_interface_get_object (G_DBUS_INTERFACE (block));
-  if (object == NULL)
+  if (object == NULL || !UDISKS_IS_LINUX_BLOCK_OBJECT (object))
     goto out;
 
+  /* the cleartext device is built on @block */
   object_path = g_dbus_object_get_object_path (object);
-  objects = udisks_daemon_get_objects (daemon);
-  for (l = objects; l != NULL; l = l->next)
+  device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (object));
+  children = udisks_device_graph_get_children (udisks_daemon_get_device_graph (daemon),
+                                               g_udev_device_get_sysfs_path (device->udev_device));
+  g_object_unref (device);
+  for (l = children; l != NULL; l = l->next)
     {
-      UDisksObject *iter_object = UDISKS_OBJECT (l->data);
       UDisksBlock *iter_block;
 
-      iter_block = udisks_object_peek_block (iter_object);
+      iter_block = udisks_object_peek_block (UDISKS_OBJECT (l->data));
       if (iter_block == NULL)
         continue;
 
@@ -2599,7 +2573,7 @@ get_cleartext_block (UDisksDaemon  *daemon,
     }
 
  out:
-  g_list_free_full (objects, g_object_unref);
+  g_list_free_full (children, g_object_unref);
   return ret;
 }
 
@@ -2829,6 +2803,8 @@ trigger_uevent_on_nested_partitions (UDisksDaemon           *daemon,
   const gchar *sysfs_path;
   GList *list;
   GList *l;
+  GPtrArray *paths;
+  GError *error = NULL;
 
   block_device = udisks_linux_block_object_get_device (object);
   if (block_device == NULL)
@@ -2846,6 +2822,7 @@ trigger_uevent_on_nested_partitions (UDisksDaemon           *daemon,
 
   g_udev_enumerator_add_match_sysfs_attr (gudev_enumerator, "partition", "1");
 
+  paths = g_ptr_array_new ();
   list = g_udev_enumerator_execute (gudev_enumerator);
   for (l = list; l; l = g_list_next (l))
     {
@@ -2855,10 +2832,21 @@ trigger_uevent_on_nested_partitions (UDisksDaemon           *daemon,
       if (parent)
         {
           if (g_strcmp0 (g_udev_device_get_sysfs_path (parent), sysfs_path) == 0)
-            udisks_daemon_util_trigger_uevent_sync (daemon, NULL, g_udev_device_get_sysfs_path (l->data), UDISKS_DEFAULT_WAIT_TIMEOUT);
+            g_ptr_array_add (paths, (gpointer) g_udev_device_get_sysfs_path (l->data));
           g_object_unref (parent);
         }
     }
+  g_ptr_array_add (paths, NULL);
+
+  /* trigger all partitions at once and wait for them together */
+  if (paths->len > 1 &&
+      !udisks_daemon_util_trigger_uevents_sync (daemon, (const gchar * const *) paths->pdata,
+                                                UDISKS_DEFAULT_WAIT_TIMEOUT, &error))
+    {
+      udisks_debug ("Error waiting for uevents on partitions of %s: %s", sysfs_path, error->message);
+      g_clear_error (&error);
+    }
+  g_ptr_array_free (paths, TRUE);
   g_list_free_full (list, g_object_unref);
 
   g_object_unref (gudev_enumerator);
@@ -2868,14 +2856,11 @@ trigger_uevent_on_nested_partitions (UDisksDaemon           *daemon,
 /* ---------------------------------------------------------------------------------------------------- */
 
 static void
-handle_format_failure (GDBusMethodInvocation *invocation,
-                       GError *error)
+format_failure (GError **error,
+                GError  *local_error)
 {
-  udisks_warning ("%s", error->message);
-  if (invocation != NULL)
-    g_dbus_method_invocation_take_error (invocation, error);
-  else
-    g_clear_error (&error);
+  udisks_warning ("%s", local_error->message);
+  g_propagate_error (error, local_error);
 }
 
 static gboolean
@@ -2936,13 +2921,221 @@ build_command (const gchar *template,
   return command;
 }
 
-void
-udisks_linux_block_handle_format (UDisksBlock             *block,
-                                  GDBusMethodInvocation   *invocation,
-                                  const gchar             *type,
-                                  GVariant                *options,
-                                  void                   (*complete)(gpointer user_data),
-                                  gpointer                 complete_user_data)
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Stages of formatting a device, see Manager.FormatMany() */
+typedef enum
+{
+  FORMAT_STAGE_TEARDOWN,
+  FORMAT_STAGE_WIPE,
+  FORMAT_STAGE_WIPE_SETTLE,
+  FORMAT_STAGE_DRY_RUN,
+  FORMAT_STAGE_LUKS_FORMAT,
+  FORMAT_STAGE_LUKS_OPEN,
+  FORMAT_STAGE_ERASE,
+  FORMAT_STAGE_MKFS,
+  FORMAT_STAGE_SETTLE,
+  FORMAT_STAGE_CONFIGURE,
+  FORMAT_STAGE_N
+} FormatStage;
+
+static const gchar *format_stage_names[FORMAT_STAGE_N] =
+{
+  "teardown",
+  "wipe",
+  "wipe-settle",
+  "dry-run",
+  "luks-format",
+  "luks-open",
+  "erase",
+  "mkfs",
+  "settle",
+  "configure",
+};
+
+/* State shared by the devices formatted in one Manager.FormatMany() call */
+typedef struct
+{
+  UDisksDaemon          *daemon;
+  GDBusMethodInvocation *invocation;
+  UDisksBaseJob         *job;
+  GMutex                 lock;
+  GCond                  cond;
+  /* devices that haven't reached the final settle yet */
+  guint                  num_unsettled;
+  GPtrArray             *settle_paths;
+  gboolean               settled;
+  /* wall time of each stage, from its first start to its last end on any device */
+  gint64                 stage_start[FORMAT_STAGE_N];
+  gint64                 stage_end[FORMAT_STAGE_N];
+} FormatMany;
+
+/* Records that @stage, started at @start, has finished on one of the
+ * devices and updates the StageTimes property of the job. */
+static void
+format_many_stage_done (FormatMany  *many,
+                        FormatStage  stage,
+                        gint64       start)
+{
+  GVariantBuilder builder;
+  gint64 end;
+  guint n;
+
+  if (many == NULL)
+    return;
+
+  end = g_get_monotonic_time ();
+
+  g_mutex_lock (&many->lock);
+  if (many->stage_end[stage] == 0 || start < many->stage_start[stage])
+    many->stage_start[stage] = start;
+  many->stage_end[stage] = MAX (many->stage_end[stage], end);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+  for (n = 0; n < FORMAT_STAGE_N; n++)
+    {
+      if (many->stage_end[n] != 0)
+        g_variant_builder_add (&builder, "{st}",
+                               format_stage_names[n],
+                               (guint64) (many->stage_end[n] - many->stage_start[n]));
+    }
+  udisks_job_set_stage_times (UDISKS_JOB (many->job), g_variant_builder_end (&builder));
+  g_mutex_unlock (&many->lock);
+}
+
+/* Called by each device when it is ready for the final settle, with
+ * @sysfs_path set to %NULL if it failed before getting there. The last
+ * device to arrive triggers the uevents for all the devices at once,
+ * the others wait for it to finish.
+ */
+static void
+format_many_settle (FormatMany  *many,
+                    const gchar *sysfs_path)
+{
+  GError *error = NULL;
+
+  g_mutex_lock (&many->lock);
+  if (sysfs_path != NULL)
+    g_ptr_array_add (many->settle_paths, g_strdup (sysfs_path));
+  many->num_unsettled--;
+  if (many->num_unsettled == 0)
+    {
+      g_ptr_array_add (many->settle_paths, NULL);
+      g_mutex_unlock (&many->lock);
+
+      if (many->settle_paths->len > 1 &&
+          !udisks_daemon_util_trigger_uevents_sync (many->daemon,
+                                                    (const gchar * const *) many->settle_paths->pdata,
+                                                    UDISKS_DEFAULT_WAIT_TIMEOUT,
+                                                    &error))
+        {
+          udisks_warning ("Error settling formatted devices: %s", error->message);
+          g_clear_error (&error);
+        }
+
+      g_mutex_lock (&many->lock);
+      many->settled = TRUE;
+      g_cond_broadcast (&many->cond);
+    }
+  while (!many->settled)
+    g_cond_wait (&many->cond, &many->lock);
+  g_mutex_unlock (&many->lock);
+}
+
+static void
+format_get_authorization (UDisksDaemon  *daemon,
+                          UDisksObject  *object,
+                          UDisksBlock   *block,
+                          const gchar   *erase_type,
+                          uid_t          caller_uid,
+                          const gchar  **out_action_id,
+                          const gchar  **out_message)
+{
+  if (g_strcmp0 (erase_type, "ata-secure-erase") == 0 ||
+      g_strcmp0 (erase_type, "ata-secure-erase-enhanced") == 0)
+    {
+      /* Translators: Shown in authentication dialog when the user
+       * requests erasing a hard disk using the SECURE ERASE UNIT
+       * command.
+       *
+       * Do not translate $(drive), it's a placeholder and
+       * will be replaced by the name of the drive/device in question
+       */
+      *out_message = N_("Authentication is required to perform a secure erase of $(drive)");
+      *out_action_id = "org.freedesktop.udisks2.ata-secure-erase";
+    }
+  else
+    {
+      /* Translators: Shown in authentication dialog when formatting a
+       * device. This includes both creating a filesystem or partition
+       * table.
+       *
+       * Do not translate $(drive), it's a placeholder and will
+       * be replaced by the name of the drive/device in question
+       */
+      *out_message = N_("Authentication is required to format $(drive)");
+      *out_action_id = "org.freedesktop.udisks2.modify-device";
+      if (!udisks_daemon_util_setup_by_user (daemon, object, caller_uid))
+        {
+          if (udisks_block_get_hint_system (block))
+            {
+              *out_action_id = "org.freedesktop.udisks2.modify-device-system";
+            }
+          else if (!udisks_daemon_util_on_user_seat (daemon, object, caller_uid))
+            {
+              *out_action_id = "org.freedesktop.udisks2.modify-device-other-seat";
+            }
+        }
+    }
+}
+
+/* mkfs programs like mke2fs count the blocks or groups done in each of
+ * their longer stages, e.g. "Discarding device blocks:  1024/262144",
+ * and back up over the counter to update it. Report the progress of the
+ * stage currently running.
+ */
+static void
+on_mkfs_output_line (UDisksSpawnedJob *job,
+                     gint              stream,
+                     const gchar      *line,
+                     gpointer          user_data)
+{
+  const gchar *counter;
+  guint64 done;
+  guint64 total;
+  gint len = 0;
+
+  if (stream != STDOUT_FILENO)
+    return;
+
+  counter = strrchr (line, ' ');
+  counter = counter != NULL ? counter + 1 : line;
+  if (sscanf (counter, "%" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT "%n", &done, &total, &len) != 2 ||
+      counter[len] != '\0' || total == 0 || done > total)
+    return;
+
+  if (!udisks_job_get_progress_valid (UDISKS_JOB (job)))
+    udisks_job_set_progress_valid (UDISKS_JOB (job), TRUE);
+  udisks_job_set_progress (UDISKS_JOB (job), (gdouble) done / total);
+}
+
+/* Formats @block. If @many is not %NULL, the caller has already checked
+ * authorization for the device, the final settle is done together with
+ * the other devices and the time spent in each stage is recorded.
+ *
+ * @complete is called right before returning %TRUE, or as soon as the
+ * device has been wiped if the no-block option is set. In the latter
+ * case errors happening afterwards are only logged.
+ */
+static gboolean
+format_block_sync (UDisksBlock             *block,
+                   GDBusMethodInvocation   *invocation,
+                   const gchar             *type,
+                   GVariant                *options,
+                   FormatMany              *many,
+                   void                   (*complete)(gpointer user_data),
+                   gpointer                 complete_user_data,
+                   GError                 **error)
 {
   FormatWaitData *wait_data = NULL;
   UDisksObject *object;
@@ -2953,7 +3146,7 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
   UDisksLinuxDevice *udev_cleartext_device = NULL;
   UDisksBlock *block_to_mkfs = NULL;
   UDisksObject *object_to_mkfs = NULL;
-  UDisksDaemon *daemon;
+  UDisksDaemon *daemon = NULL;
   UDisksState *state = NULL;
   UDisksConfigManager *config_manager = NULL;
   const gchar *action_id;
@@ -2962,7 +3155,7 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
   const gchar *command_options = NULL;
   gchar *command = NULL;
   gchar *error_message;
-  GError *error;
+  GError *local_error = NULL;
   int status;
   uid_t caller_uid;
   gid_t caller_gid;
@@ -2983,14 +3176,14 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
   gboolean no_discard_flag = FALSE;
   BDPartTableType part_table_type = BD_PART_TABLE_UNDEF;
   UDisksObject *filesystem_object;
+  gboolean settle_pending = (many != NULL);
+  gint64 stage_start;
+  gpointer reservation = NULL;
+  gboolean ret = FALSE;
 
-  error = NULL;
-  object = udisks_daemon_util_dup_object (block, &error);
+  object = udisks_daemon_util_dup_object (block, error);
   if (object == NULL)
-    {
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
-    }
+    goto out;
 
   daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
   state = udisks_daemon_get_state (daemon);
@@ -2998,6 +3191,9 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
   command = NULL;
   error_message = NULL;
 
+  /* wait for our turn on the drive before taking the cleanup lock */
+  reservation = udisks_job_scheduler_reserve_sync (udisks_daemon_get_job_scheduler (daemon),
+                                                   object, "format-mkfs", NULL);
   udisks_linux_block_object_lock_for_cleanup (UDISKS_LINUX_BLOCK_OBJECT (object));
   udisks_state_check_block (state, udisks_linux_block_object_get_device_number (UDISKS_LINUX_BLOCK_OBJECT (object)));
 
@@ -3023,10 +3219,10 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
        */
       if (udisks_partition_get_offset (partition) == 0)
         {
-          g_dbus_method_invocation_return_error (invocation,
-                                                 UDISKS_ERROR,
-                                                 UDISKS_ERROR_NOT_SUPPORTED,
-                                                 "This partition cannot be modified because it contains a partition table; please reinitialize layout of the whole device.");
+          g_set_error (error,
+                       UDISKS_ERROR,
+                       UDISKS_ERROR_NOT_SUPPORTED,
+                       "This partition cannot be modified because it contains a partition table; please reinitialize layout of the whole device.");
           goto out;
         }
 
@@ -3048,54 +3244,11 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
                                                         encrypt_passphrase != NULL ? "crypto_LUKS" : type);
     }
 
-  if (!udisks_daemon_util_get_caller_uid_sync (daemon, invocation, NULL /* GCancellable */, &caller_uid, &error))
-    {
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
-    }
-
-  if (!udisks_daemon_util_get_user_info (caller_uid, &caller_gid, NULL /* user name */, &error))
-    {
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
-    }
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon, invocation, NULL /* GCancellable */, &caller_uid, error))
+    goto out;
 
-  if (g_strcmp0 (erase_type, "ata-secure-erase") == 0 ||
-      g_strcmp0 (erase_type, "ata-secure-erase-enhanced") == 0)
-    {
-      /* Translators: Shown in authentication dialog when the user
-       * requests erasing a hard disk using the SECURE ERASE UNIT
-       * command.
-       *
-       * Do not translate $(drive), it's a placeholder and
-       * will be replaced by the name of the drive/device in question
-       */
-      message = N_("Authentication is required to perform a secure erase of $(drive)");
-      action_id = "org.freedesktop.udisks2.ata-secure-erase";
-    }
-  else
-    {
-      /* Translators: Shown in authentication dialog when formatting a
-       * device. This includes both creating a filesystem or partition
-       * table.
-       *
-       * Do not translate $(drive), it's a placeholder and will
-       * be replaced by the name of the drive/device in question
-       */
-      message = N_("Authentication is required to format $(drive)");
-      action_id = "org.freedesktop.udisks2.modify-device";
-      if (!udisks_daemon_util_setup_by_user (daemon, object, caller_uid))
-        {
-          if (udisks_block_get_hint_system (block))
-            {
-              action_id = "org.freedesktop.udisks2.modify-device-system";
-            }
-          else if (!udisks_daemon_util_on_user_seat (daemon, object, caller_uid))
-            {
-              action_id = "org.freedesktop.udisks2.modify-device-other-seat";
-            }
-        }
-    }
+  if (!udisks_daemon_util_get_user_info (caller_uid, &caller_gid, NULL /* user name */, error))
+    goto out;
 
   /* TODO: Consider just accepting any @type and just running "mkfs -t <type>".
    *       There are some obvious security implications by doing this, though
@@ -3103,7 +3256,7 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
   fs_info = get_fs_info (type);
   if (fs_info == NULL || fs_info->command_create_fs == NULL)
     {
-      g_dbus_method_invocation_return_error (invocation,
+      g_set_error (error,
                    UDISKS_ERROR,
                    UDISKS_ERROR_NOT_SUPPORTED,
                    "Creation of file system type %s is not supported",
@@ -3111,64 +3264,72 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
       goto out;
     }
 
-  if (!udisks_daemon_util_check_authorization_sync (daemon,
-                                                    object,
-                                                    action_id,
-                                                    options,
-                                                    message,
-                                                    invocation))
-    goto out;
+  if (many == NULL)
+    {
+      format_get_authorization (daemon, object, block, erase_type, caller_uid, &action_id, &message);
+      if (!udisks_daemon_util_check_authorization_sync_with_error (daemon,
+                                                                   object,
+                                                                   action_id,
+                                                                   options,
+                                                                   message,
+                                                                   invocation,
+                                                                   error))
+        goto out;
 
-  if ((config_items != NULL || teardown_flag) &&
-      !udisks_daemon_util_check_authorization_sync (daemon,
-                                                    NULL,
-                                                    "org.freedesktop.udisks2.modify-system-configuration",
-                                                    options,
-                                                    N_("Authentication is required to modify the system configuration"),
-                                                    invocation))
-    goto out;
+      if ((config_items != NULL || teardown_flag) &&
+          !udisks_daemon_util_check_authorization_sync_with_error (daemon,
+                                                                   NULL,
+                                                                   "org.freedesktop.udisks2.modify-system-configuration",
+                                                                   options,
+                                                                   N_("Authentication is required to modify the system configuration"),
+                                                                   invocation,
+                                                                   error))
+        goto out;
+    }
 
   was_partitioned = (udisks_object_peek_partition_table (object) != NULL);
 
   if (teardown_flag)
     {
-      if (!udisks_linux_block_teardown (block, invocation, options, &error))
-        {
-          g_dbus_method_invocation_take_error (invocation, error);
-          goto out;
-        }
+      stage_start = g_get_monotonic_time ();
+      if (!udisks_linux_block_teardown (block, invocation, options, error))
+        goto out;
+      format_many_stage_done (many, FORMAT_STAGE_TEARDOWN, stage_start);
     }
 
   device_name = udisks_block_dup_device (block);
 
   /* First wipe the device... */
+  stage_start = g_get_monotonic_time ();
 #ifdef HAVE_LIBBLOCKDEV3
-  if (! bd_fs_wipe (device_name, TRUE, FALSE, &error))
+  if (! bd_fs_wipe (device_name, TRUE, FALSE, &local_error))
 #else
-  if (! bd_fs_wipe_force (device_name, TRUE, FALSE, &error))
+  if (! bd_fs_wipe_force (device_name, TRUE, FALSE, &local_error))
 #endif
     {
-      if (g_error_matches (error, BD_FS_ERROR, BD_FS_ERROR_NOFS))
+      if (g_error_matches (local_error, BD_FS_ERROR, BD_FS_ERROR_NOFS))
         /* no signature to remove, ignore */
-        g_clear_error (&error);
+        g_clear_error (&local_error);
       else
         {
-          g_dbus_method_invocation_return_error (invocation,
-                                                 UDISKS_ERROR,
-                                                 UDISKS_ERROR_FAILED,
-                                                 "Error wiping device: %s",
-                                                 error->message);
-          g_clear_error (&error);
+          g_set_error (error,
+                       UDISKS_ERROR,
+                       UDISKS_ERROR_FAILED,
+                       "Error wiping device: %s",
+                       local_error->message);
+          g_clear_error (&local_error);
           goto out;
         }
     }
+  format_many_stage_done (many, FORMAT_STAGE_WIPE, stage_start);
 
   /* ...then wait until this change has taken effect */
+  stage_start = g_get_monotonic_time ();
   if (was_partitioned &&
-      !udisks_linux_block_object_reread_partition_table (UDISKS_LINUX_BLOCK_OBJECT (object), &error))
+      !udisks_linux_block_object_reread_partition_table (UDISKS_LINUX_BLOCK_OBJECT (object), &local_error))
     {
-      udisks_warning ("%s", error->message);
-      g_clear_error (&error);
+      udisks_warning ("%s", local_error->message);
+      g_clear_error (&local_error);
     }
   udisks_linux_block_object_trigger_uevent_sync (UDISKS_LINUX_BLOCK_OBJECT (object),
                                                  UDISKS_DEFAULT_WAIT_TIMEOUT);
@@ -3180,14 +3341,14 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
                                                           wait_data,
                                                           NULL,
                                                           UDISKS_DEFAULT_WAIT_TIMEOUT,
-                                                          &error);
+                                                          error);
   if (filesystem_object == NULL)
     {
-      g_prefix_error (&error, "Error synchronizing after initial wipe: ");
-      g_dbus_method_invocation_take_error (invocation, error);
+      g_prefix_error (error, "Error synchronizing after initial wipe: ");
       goto out;
     }
   g_object_unref (filesystem_object);
+  format_many_stage_done (many, FORMAT_STAGE_WIPE_SETTLE, stage_start);
 
   if (no_discard_flag && fs_info->option_no_discard)
     command_options = fs_info->option_no_discard;
@@ -3198,10 +3359,12 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
   if (dry_run_first && fs_info->command_validate_create_fs)
     {
       const gchar *device = udisks_block_get_device (block);
-      command = build_command (fs_info->command_validate_create_fs, device, label, command_options, &error);
+
+      stage_start = g_get_monotonic_time ();
+      command = build_command (fs_info->command_validate_create_fs, device, label, command_options, &local_error);
       if (command == NULL)
         {
-          handle_format_failure (invocation, error);
+          format_failure (error, local_error);
           goto out;
         }
 
@@ -3216,17 +3379,18 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
                                                   NULL, /* input_string */
                                                   "%s", command))
         {
-          g_dbus_method_invocation_return_error (invocation,
-                                                 UDISKS_ERROR,
-                                                 UDISKS_ERROR_FAILED,
-                                                 "Error creating file system: %s",
-                                                 error_message);
+          g_set_error (error,
+                       UDISKS_ERROR,
+                       UDISKS_ERROR_FAILED,
+                       "Error creating file system: %s",
+                       error_message);
           g_free (error_message);
           goto out;
         }
 
       g_free (error_message);
-      g_free (command);
+      g_clear_pointer (&command, g_free);
+      format_many_stage_done (many, FORMAT_STAGE_DRY_RUN, stage_start);
     }
 
   /* And now create the desired filesystem */
@@ -3247,6 +3411,7 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
       udisks_linux_block_encrypted_lock (block);
 
       /* Create it */
+      stage_start = g_get_monotonic_time ();
       if (!udisks_daemon_launch_threaded_job_sync (daemon,
                                                    object,
                                                    "format-mkfs",
@@ -3255,11 +3420,11 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
                                                    &data,
                                                    NULL, /* user_data_free_func */
                                                    NULL, /* cancellable */
-                                                   &error))
+                                                   &local_error))
         {
-          handle_format_failure (invocation, g_error_new (UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                 "Error creating LUKS device: %s", error->message));
-          g_clear_error (&error);
+          format_failure (error, g_error_new (UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                          "Error creating LUKS device: %s", local_error->message));
+          g_clear_error (&local_error);
           udisks_linux_block_encrypted_unlock (block);
           goto out;
         }
@@ -3271,21 +3436,23 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
                                                              wait_data,
                                                              NULL,
                                                              UDISKS_DEFAULT_WAIT_TIMEOUT,
-                                                             &error);
+                                                             &local_error);
       if (luks_uuid_object == NULL)
         {
-          g_prefix_error (&error, "Error waiting for LUKS UUID: ");
-          handle_format_failure (invocation, error);
+          g_prefix_error (&local_error, "Error waiting for LUKS UUID: ");
+          format_failure (error, local_error);
           goto out;
         }
       g_object_unref (luks_uuid_object);
+      format_many_stage_done (many, FORMAT_STAGE_LUKS_FORMAT, stage_start);
 
       /* Open it */
-      mapped_name = make_block_luksname (block, &error);
+      stage_start = g_get_monotonic_time ();
+      mapped_name = make_block_luksname (block, &local_error);
       if (!mapped_name)
         {
-          g_prefix_error (&error, "Failed to get LUKS UUID: ");
-          handle_format_failure (invocation, error);
+          g_prefix_error (&local_error, "Failed to get LUKS UUID: ");
+          format_failure (error, local_error);
           goto out;
         }
 
@@ -3300,11 +3467,11 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
                                                    &data,
                                                    NULL, /* user_data_free_func */
                                                    NULL, /* cancellable */
-                                                   &error))
+                                                   &local_error))
         {
-          handle_format_failure (invocation, g_error_new (UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                 "Error opening LUKS device: %s", error->message));
-          g_clear_error (&error);
+          format_failure (error, g_error_new (UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                          "Error opening LUKS device: %s", local_error->message));
+          g_clear_error (&local_error);
           udisks_linux_block_encrypted_unlock (block);
           goto out;
         }
@@ -3317,18 +3484,18 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
                                                              wait_data,
                                                              NULL,
                                                              UDISKS_DEFAULT_WAIT_TIMEOUT,
-                                                             &error);
+                                                             &local_error);
       if (cleartext_object == NULL)
         {
-          g_prefix_error (&error, "Error waiting for LUKS cleartext device: ");
-          handle_format_failure (invocation, error);
+          g_prefix_error (&local_error, "Error waiting for LUKS cleartext device: ");
+          format_failure (error, local_error);
           goto out;
         }
       cleartext_block = udisks_object_get_block (cleartext_object);
       if (cleartext_block == NULL)
         {
-          handle_format_failure (invocation, g_error_new (UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                 "LUKS cleartext device does not have block interface"));
+          format_failure (error, g_error_new (UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                          "LUKS cleartext device does not have block interface"));
           goto out;
         }
 
@@ -3339,6 +3506,7 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
                                             udisks_block_get_device_number (block),
                                             g_udev_device_get_sysfs_attr (udev_cleartext_device->udev_device, "dm/uuid"),
                                             caller_uid);
+      format_many_stage_done (many, FORMAT_STAGE_LUKS_OPEN, stage_start);
 
       object_to_mkfs = cleartext_object;
       block_to_mkfs = cleartext_block;
@@ -3350,22 +3518,24 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
     }
 
   /* complete early, if requested */
-  if (no_block)
+  if (no_block && complete != NULL)
     {
       complete (complete_user_data);
-      invocation = NULL;
+      complete = NULL;
     }
 
   /* Erase the device, if requested
    */
   if (erase_type != NULL)
     {
-      if (!erase_device (block_to_mkfs, object_to_mkfs, daemon, caller_uid, erase_type, &error))
+      stage_start = g_get_monotonic_time ();
+      if (!erase_device (block_to_mkfs, object_to_mkfs, daemon, caller_uid, erase_type, &local_error))
         {
-          g_prefix_error (&error, "Error erasing device: ");
-          handle_format_failure (invocation, error);
+          g_prefix_error (&local_error, "Error erasing device: ");
+          format_failure (error, local_error);
           goto out;
         }
+      format_many_stage_done (many, FORMAT_STAGE_ERASE, stage_start);
     }
 
   /* Set label, if needed */
@@ -3374,8 +3544,8 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
       /* TODO: return an error if label is too long */
       if (strstr (fs_info->command_create_fs, "$LABEL") == NULL)
         {
-          handle_format_failure (invocation, g_error_new (UDISKS_ERROR, UDISKS_ERROR_NOT_SUPPORTED,
-                                 "File system type %s does not support labels", type));
+          format_failure (error, g_error_new (UDISKS_ERROR, UDISKS_ERROR_NOT_SUPPORTED,
+                          "File system type %s does not support labels", type));
           goto out;
         }
     }
@@ -3385,30 +3555,30 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
   else if (g_strcmp0 (type, "gpt") == 0)
     part_table_type = BD_PART_TABLE_GPT;
 
+  stage_start = g_get_monotonic_time ();
   if (part_table_type == BD_PART_TABLE_UNDEF)
     {
       /* Build and run mkfs shell command */
       const gchar *device = udisks_block_get_device (block_to_mkfs);
-      command = build_command (fs_info->command_create_fs, device, label, command_options, &error);
+      command = build_command (fs_info->command_create_fs, device, label, command_options, &local_error);
       if (command == NULL)
         {
-          handle_format_failure (invocation, error);
+          format_failure (error, local_error);
           goto out;
         }
 
-      if (!udisks_daemon_launch_spawned_job_sync (daemon,
-                                                  object_to_mkfs,
-                                                  "format-mkfs", caller_uid,
-                                                  NULL, /* cancellable */
-                                                  0,    /* uid_t run_as_uid */
-                                                  0,    /* uid_t run_as_euid */
-                                                  &status,
-                                                  &error_message,
-                                                  NULL, /* input_string */
-                                                  "%s", command))
+      if (!udisks_daemon_launch_spawned_job_with_output_sync (daemon,
+                                                              object_to_mkfs,
+                                                              "format-mkfs", caller_uid,
+                                                              NULL, /* cancellable */
+                                                              G_CALLBACK (on_mkfs_output_line),
+                                                              NULL, /* user_data */
+                                                              &status,
+                                                              &error_message,
+                                                              "%s", command))
         {
-          handle_format_failure (invocation, g_error_new (UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                 "Error creating file system: %s", error_message));
+          format_failure (error, g_error_new (UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                          "Error creating file system: %s", error_message));
           g_free (error_message);
           goto out;
         }
@@ -3417,9 +3587,9 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
   else
     {
       /* Create the partition table. */
-      if (! bd_part_create_table (device_name, part_table_type, TRUE, &error))
+      if (! bd_part_create_table (device_name, part_table_type, TRUE, &local_error))
         {
-          handle_format_failure (invocation, error);
+          format_failure (error, local_error);
           goto out;
         }
     }
@@ -3433,26 +3603,49 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
                                                      partition_type,
                                                      caller_uid,
                                                      NULL, /* cancellable */
-                                                     &error))
+                                                     &local_error))
             {
-              g_prefix_error (&error, "Error setting partition type after formatting: ");
-              handle_format_failure (invocation, error);
+              g_prefix_error (&local_error, "Error setting partition type after formatting: ");
+              format_failure (error, local_error);
               goto out;
             }
         }
     }
+  format_many_stage_done (many, FORMAT_STAGE_MKFS, stage_start);
 
   /* The mkfs program may not generate all the uevents we need - so explicitly
    * trigger an event here
    */
+  stage_start = g_get_monotonic_time ();
   if (udisks_linux_fsinfo_creates_protective_parttable (type) &&
-      !udisks_linux_block_object_reread_partition_table (UDISKS_LINUX_BLOCK_OBJECT (object), &error))
+      !udisks_linux_block_object_reread_partition_table (UDISKS_LINUX_BLOCK_OBJECT (object), &local_error))
     {
-      udisks_warning ("%s", error->message);
-      g_clear_error (&error);
+      udisks_warning ("%s", local_error->message);
+      g_clear_error (&local_error);
+    }
+  if (many != NULL)
+    {
+      UDisksLinuxDevice *device;
+
+      /* Trigger the uevents for all the devices at once. The other
+       * devices may still be waiting for a job slot or for the cleanup
+       * lock, so give up both while waiting for them.
+       */
+      device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (object_to_mkfs));
+      if (reservation != NULL)
+        udisks_job_scheduler_release_reservation (udisks_daemon_get_job_scheduler (daemon), reservation);
+      reservation = NULL;
+      udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (object));
+      format_many_settle (many, g_udev_device_get_sysfs_path (device->udev_device));
+      udisks_linux_block_object_lock_for_cleanup (UDISKS_LINUX_BLOCK_OBJECT (object));
+      settle_pending = FALSE;
+      g_object_unref (device);
+    }
+  else
+    {
+      udisks_linux_block_object_trigger_uevent_sync (UDISKS_LINUX_BLOCK_OBJECT (object_to_mkfs),
+                                                     UDISKS_DEFAULT_WAIT_TIMEOUT);
     }
-  udisks_linux_block_object_trigger_uevent_sync (UDISKS_LINUX_BLOCK_OBJECT (object_to_mkfs),
-                                                 UDISKS_DEFAULT_WAIT_TIMEOUT);
 
   /* In case a protective partition table was potentially created, trigger uevents
    * on all nested partitions. */
@@ -3468,26 +3661,29 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
                                                           wait_data,
                                                           NULL,
                                                           UDISKS_DEFAULT_WAIT_TIMEOUT,
-                                                          &error);
+                                                          &local_error);
   if (filesystem_object == NULL)
     {
-      g_prefix_error (&error,
+      g_prefix_error (&local_error,
                       "Error synchronizing after formatting with type `%s': ",
                       type);
-      handle_format_failure (invocation, error);
+      format_failure (error, local_error);
       goto out;
     }
   g_object_unref (filesystem_object);
+  format_many_stage_done (many, FORMAT_STAGE_SETTLE, stage_start);
+
+  stage_start = g_get_monotonic_time ();
 
   /* Change ownership, if requested and supported */
   if (take_ownership && fs_info->supports_owners)
     {
       if (!take_filesystem_ownership (udisks_block_get_device (block_to_mkfs),
-                                      type, caller_uid, caller_gid, FALSE, &error))
+                                      type, caller_uid, caller_gid, FALSE, &local_error))
         {
-          g_prefix_error (&error,
+          g_prefix_error (&local_error,
                           "Failed to take ownership of newly created filesystem: ");
-          handle_format_failure (invocation, error);
+          format_failure (error, local_error);
           goto out;
         }
     }
@@ -3504,17 +3700,19 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
         {
           if (strcmp (item_type, "fstab") == 0)
             {
-              if (!add_remove_fstab_entry (block_to_mkfs, NULL, details, &error))
+              if (!add_remove_fstab_entry (block_to_mkfs, NULL, details, &local_error))
                 {
-                  handle_format_failure (invocation, error);
+                  format_failure (error, local_error);
+                  g_variant_unref (details);
                   goto out;
                 }
             }
           else if (strcmp (item_type, "crypttab") == 0)
             {
-              if (!add_remove_crypttab_entry (block, NULL, details, &error))
+              if (!add_remove_crypttab_entry (block, NULL, details, &local_error))
                 {
-                  handle_format_failure (invocation, error);
+                  format_failure (error, local_error);
+                  g_variant_unref (details);
                   goto out;
                 }
             }
@@ -3522,13 +3720,20 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
         }
       update_configuration (UDISKS_LINUX_BLOCK (block), daemon);
     }
+  format_many_stage_done (many, FORMAT_STAGE_CONFIGURE, stage_start);
 
-  if (invocation != NULL)
+  if (complete != NULL)
     complete (complete_user_data);
 
+  ret = TRUE;
+
  out:
   if (object != NULL)
     udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (object));
+  if (reservation != NULL)
+    udisks_job_scheduler_release_reservation (udisks_daemon_get_job_scheduler (daemon), reservation);
+  if (settle_pending)
+    format_many_settle (many, NULL);
   if (state != NULL)
     udisks_state_check (state);
   g_free (device_name);
@@ -3546,21 +3751,336 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
   g_clear_object (&partition_table);
   g_clear_object (&partition);
   g_clear_object (&object);
+  return ret;
 }
 
-struct FormatCompleteData {
-  UDisksBlock *block;
-  GDBusMethodInvocation *invocation;
+struct FormatCompletion {
+  void   (*complete)(gpointer user_data);
+  gpointer complete_user_data;
+  gboolean completed;
 };
 
 static void
-handle_format_complete (gpointer user_data)
+format_completion_complete (gpointer user_data)
 {
-  struct FormatCompleteData *data = user_data;
-  udisks_block_complete_format (data->block, data->invocation);
+  struct FormatCompletion *data = user_data;
+  data->complete (data->complete_user_data);
+  data->completed = TRUE;
 }
 
-static gboolean
+void
+udisks_linux_block_handle_format (UDisksBlock             *block,
+                                  GDBusMethodInvocation   *invocation,
+                                  const gchar             *type,
+                                  GVariant                *options,
+                                  void                   (*complete)(gpointer user_data),
+                                  gpointer                 complete_user_data)
+{
+  struct FormatCompletion data;
+  GError *error = NULL;
+
+  data.complete = complete;
+  data.complete_user_data = complete_user_data;
+  data.completed = FALSE;
+  if (!format_block_sync (block, invocation, type, options, NULL,
+                          format_completion_complete, &data, &error))
+    {
+      /* with no-block the method may have returned already */
+      if (data.completed)
+        g_clear_error (&error);
+      else
+        g_dbus_method_invocation_take_error (invocation, error);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  FormatMany   *many;
+  UDisksObject *object;
+  UDisksBlock  *block;
+  gchar        *type;
+  GVariant     *options;
+  GError       *error;
+} FormatManyDevice;
+
+static void
+format_many_device_free (FormatManyDevice *device)
+{
+  g_clear_object (&device->object);
+  g_clear_object (&device->block);
+  g_free (device->type);
+  if (device->options != NULL)
+    g_variant_unref (device->options);
+  g_clear_error (&device->error);
+  g_free (device);
+}
+
+static gpointer
+format_many_thread_func (gpointer user_data)
+{
+  FormatManyDevice *device = user_data;
+
+  format_block_sync (device->block,
+                     device->many->invocation,
+                     device->type,
+                     device->options,
+                     device->many,
+                     NULL, NULL, /* complete */
+                     &device->error);
+  return NULL;
+}
+
+/* Returns @options with the entries of @device_options added or replaced */
+static GVariant *
+format_many_merge_options (GVariant *options,
+                           GVariant *device_options)
+{
+  GVariantDict dict;
+  GVariantIter iter;
+  const gchar *key;
+  GVariant *value;
+
+  g_variant_dict_init (&dict, options);
+  g_variant_iter_init (&iter, device_options);
+  while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+    {
+      g_variant_dict_insert_value (&dict, key, value);
+      g_variant_unref (value);
+    }
+  return g_variant_ref_sink (g_variant_dict_end (&dict));
+}
+
+/**
+ * udisks_linux_block_format_many_sync:
+ * @daemon: A #UDisksDaemon.
+ * @invocation: The #GDBusMethodInvocation of the Manager.FormatMany() call.
+ * @devices: A #GVariant of type <literal>a(osa{sv})</literal> with the devices to format.
+ * @options: Options used for authorization and as defaults for the options of each device.
+ * @error: Return location for error or %NULL.
+ *
+ * Formats @devices in parallel, see the Manager.FormatMany() D-Bus
+ * method. The uevents for all the devices are triggered and waited for
+ * together at the end and the time spent in each stage is exposed
+ * in the #UDisksJob:stage-times property of the
+ * <literal>format-many</literal> job.
+ *
+ * Must not be called from the main thread.
+ *
+ * Returns: (transfer full): A #GVariant of type <literal>a(obs)</literal>
+ * with the result for each device or %NULL if @error is set. Failing to
+ * format a device doesn't set @error.
+ */
+GVariant *
+udisks_linux_block_format_many_sync (UDisksDaemon           *daemon,
+                                     GDBusMethodInvocation  *invocation,
+                                     GVariant               *devices,
+                                     GVariant               *options,
+                                     GError                **error)
+{
+  FormatMany many = { 0 };
+  GPtrArray *format_devices;
+  GPtrArray *threads = NULL;
+  GVariantBuilder builder;
+  GVariantIter iter;
+  const gchar *object_path;
+  const gchar *type;
+  GVariant *device_options;
+  gboolean need_configuration_auth = FALSE;
+  uid_t caller_uid;
+  guint num_failed = 0;
+  GVariant *ret = NULL;
+  guint n, m;
+
+  g_mutex_init (&many.lock);
+  g_cond_init (&many.cond);
+  format_devices = g_ptr_array_new_with_free_func ((GDestroyNotify) format_many_device_free);
+
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon, invocation, NULL /* GCancellable */, &caller_uid, error))
+    goto out;
+
+  g_variant_iter_init (&iter, devices);
+  while (g_variant_iter_next (&iter, "(&o&s@a{sv})", &object_path, &type, &device_options))
+    {
+      FormatManyDevice *device;
+
+      device = g_new0 (FormatManyDevice, 1);
+      device->many = &many;
+      device->object = udisks_daemon_find_object (daemon, object_path);
+      device->block = device->object != NULL ? udisks_object_get_block (device->object) : NULL;
+      device->type = g_strdup (type);
+      device->options = format_many_merge_options (options, device_options);
+      g_variant_unref (device_options);
+      g_ptr_array_add (format_devices, device);
+
+      if (device->block == NULL)
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Object %s is not a block device", object_path);
+          goto out;
+        }
+      for (m = 0; m + 1 < format_devices->len; m++)
+        {
+          if (((FormatManyDevice *) format_devices->pdata[m])->object == device->object)
+            {
+              g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                           "Device %s is given more than once", object_path);
+              goto out;
+            }
+        }
+    }
+
+  /* Formatting a device also destroys whatever is built on it, e.g. the
+   * partitions of a disk or a dm-crypt or MD RAID device on top of it.
+   */
+  for (n = 0; n < format_devices->len; n++)
+    {
+      FormatManyDevice *device = format_devices->pdata[n];
+      UDisksLinuxDevice *linux_device;
+      GList *descendants;
+      GList *l;
+
+      linux_device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (device->object));
+      descendants = udisks_device_graph_get_descendants (udisks_daemon_get_device_graph (daemon),
+                                                         g_udev_device_get_sysfs_path (linux_device->udev_device));
+      g_object_unref (linux_device);
+      for (l = descendants; l != NULL; l = l->next)
+        {
+          for (m = 0; m < format_devices->len; m++)
+            {
+              FormatManyDevice *other = format_devices->pdata[m];
+
+              if (other->object == l->data)
+                {
+                  g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                               "Device %s is built on %s, they can't be formatted at the same time",
+                               udisks_block_get_device (other->block),
+                               udisks_block_get_device (device->block));
+                  g_list_free_full (descendants, g_object_unref);
+                  goto out;
+                }
+            }
+        }
+      g_list_free_full (descendants, g_object_unref);
+    }
+
+  /* Check authorization for all the devices up front, from this thread,
+   * so that the user is asked at most once per device and not by several
+   * threads at the same time.
+   */
+  for (n = 0; n < format_devices->len; n++)
+    {
+      FormatManyDevice *device = format_devices->pdata[n];
+      const gchar *action_id;
+      const gchar *message;
+      const gchar *erase_type = NULL;
+      gboolean teardown_flag = FALSE;
+      GVariant *config_items;
+
+      g_variant_lookup (device->options, "erase", "&s", &erase_type);
+      format_get_authorization (daemon, device->object, device->block, erase_type, caller_uid, &action_id, &message);
+      if (!udisks_daemon_util_check_authorization_sync_with_error (daemon,
+                                                                   device->object,
+                                                                   action_id,
+                                                                   device->options,
+                                                                   message,
+                                                                   invocation,
+                                                                   error))
+        goto out;
+
+      g_variant_lookup (device->options, "tear-down", "b", &teardown_flag);
+      config_items = g_variant_lookup_value (device->options, "config-items", NULL);
+      if (teardown_flag || config_items != NULL)
+        need_configuration_auth = TRUE;
+      if (config_items != NULL)
+        g_variant_unref (config_items);
+    }
+
+  if (need_configuration_auth &&
+      !udisks_daemon_util_check_authorization_sync_with_error (daemon,
+                                                               NULL,
+                                                               "org.freedesktop.udisks2.modify-system-configuration",
+                                                               options,
+                                                               N_("Authentication is required to modify the system configuration"),
+                                                               invocation,
+                                                               error))
+    goto out;
+
+  many.daemon = daemon;
+  many.invocation = invocation;
+  many.num_unsettled = format_devices->len;
+  many.settle_paths = g_ptr_array_new_with_free_func (g_free);
+  many.job = udisks_daemon_launch_simple_job (daemon, NULL, "format-many", caller_uid, NULL);
+  udisks_job_set_stage_times (UDISKS_JOB (many.job), g_variant_new_array (G_VARIANT_TYPE ("{st}"), NULL, 0));
+  for (n = 0; n < format_devices->len; n++)
+    udisks_base_job_add_object (many.job, ((FormatManyDevice *) format_devices->pdata[n])->object);
+
+  /* Use a thread per device rather than a bounded pool: the devices wait
+   * for each other before the final settle. How many mkfs jobs actually
+   * run at the same time is up to the job scheduler.
+   */
+  threads = g_ptr_array_new ();
+  for (n = 0; n < format_devices->len; n++)
+    g_ptr_array_add (threads, g_thread_new ("format-many", format_many_thread_func, format_devices->pdata[n]));
+  for (n = 0; n < threads->len; n++)
+    g_thread_join (threads->pdata[n]);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(obs)"));
+  for (n = 0; n < format_devices->len; n++)
+    {
+      FormatManyDevice *device = format_devices->pdata[n];
+      const gchar *device_object_path = g_dbus_object_get_object_path (G_DBUS_OBJECT (device->object));
+
+      if (device->error != NULL)
+        {
+          udisks_warning ("Error formatting %s: %s", device_object_path, device->error->message);
+          num_failed++;
+        }
+      g_variant_builder_add (&builder, "(obs)",
+                             device_object_path,
+                             device->error == NULL,
+                             device->error != NULL ? device->error->message : "");
+    }
+  ret = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  if (num_failed == 0)
+    {
+      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (many.job), TRUE, "");
+    }
+  else
+    {
+      gchar *job_message = g_strdup_printf ("Failed to format %u of %u devices", num_failed, format_devices->len);
+      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (many.job), FALSE, job_message);
+      g_free (job_message);
+    }
+
+ out:
+  if (threads != NULL)
+    g_ptr_array_unref (threads);
+  g_ptr_array_unref (format_devices);
+  if (many.settle_paths != NULL)
+    g_ptr_array_unref (many.settle_paths);
+  g_cond_clear (&many.cond);
+  g_mutex_clear (&many.lock);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+struct FormatCompleteData {
+  UDisksBlock *block;
+  GDBusMethodInvocation *invocation;
+};
+
+static void
+handle_format_complete (gpointer user_data)
+{
+  struct FormatCompleteData *data = user_data;
+  udisks_block_complete_format (data->block, data->invocation);
+}
+
+static gboolean
 handle_format (UDisksBlock           *block,
                GDBusMethodInvocation *invocation,
                const gchar           *type,
@@ -3761,19 +4281,23 @@ handle_open_for_restore (UDisksBlock           *block,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-static gboolean
-handle_open_for_benchmark (UDisksBlock           *block,
-                           GDBusMethodInvocation *invocation,
-                           GUnixFDList           *fd_list,
-                           GVariant              *options)
+/* Checks authorization and opens the device for benchmarking.
+ *
+ * Returns: A file descriptor or -1 if an error has been returned on
+ * @invocation. The object for @block is returned in @out_object.
+ */
+static gint
+open_for_benchmark (UDisksBlock           *block,
+                    GDBusMethodInvocation *invocation,
+                    GVariant              *options,
+                    gboolean               writable,
+                    UDisksObject         **out_object)
 {
   UDisksObject *object;
   UDisksDaemon *daemon;
   UDisksState *state = NULL;
   const gchar *action_id;
   const gchar *device;
-  GUnixFDList *out_fd_list = NULL;
-  gboolean opt_writable = FALSE;
   GError *error = NULL;
   gint fd = -1;
   const gchar *open_mode = NULL;
@@ -3810,10 +4334,8 @@ handle_open_for_benchmark (UDisksBlock           *block,
                                                     invocation))
     goto out;
 
-  g_variant_lookup (options, "writable", "b", &opt_writable);
-
   open_flags = O_DIRECT | O_SYNC | O_CLOEXEC;
-  if (opt_writable)
+  if (writable)
     {
       open_flags |= O_EXCL;
       open_mode = "rw";
@@ -3830,21 +4352,496 @@ handle_open_for_benchmark (UDisksBlock           *block,
       goto out;
     }
 
-  out_fd_list = g_unix_fd_list_new_from_array (&fd, 1);
-  udisks_block_complete_open_for_benchmark (block, invocation, out_fd_list, g_variant_new_handle (0));
-
  out:
   if (object != NULL)
     udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (object));
   if (state != NULL)
     udisks_state_check (state);
+  if (fd != -1 && out_object != NULL)
+    *out_object = g_steal_pointer (&object);
+  g_clear_object (&object);
+  return fd;
+}
+
+static gboolean
+handle_open_for_benchmark (UDisksBlock           *block,
+                           GDBusMethodInvocation *invocation,
+                           GUnixFDList           *fd_list,
+                           GVariant              *options)
+{
+  GUnixFDList *out_fd_list = NULL;
+  gboolean opt_writable = FALSE;
+  gint fd;
+
+  g_variant_lookup (options, "writable", "b", &opt_writable);
+
+  fd = open_for_benchmark (block, invocation, options, opt_writable, NULL);
+  if (fd == -1)
+    goto out;
+
+  out_fd_list = g_unix_fd_list_new_from_array (&fd, 1);
+  udisks_block_complete_open_for_benchmark (block, invocation, out_fd_list, g_variant_new_handle (0));
+
+ out:
   g_clear_object (&out_fd_list);
+  return TRUE; /* returning true means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+on_benchmark_progress (gdouble  progress,
+                       guint64  rate,
+                       gpointer user_data)
+{
+  UDisksJob *job = UDISKS_JOB (user_data);
+
+  udisks_job_set_progress (job, progress);
+  udisks_job_set_rate (job, rate);
+}
+
+static gboolean
+handle_benchmark (UDisksBlock           *block,
+                  GDBusMethodInvocation *invocation,
+                  GVariant              *options)
+{
+  UDisksObject *object = NULL;
+  UDisksDaemon *daemon;
+  UDisksBaseJob *job;
+  UDisksBenchmarkParams params = { 0 };
+  UDisksBenchmarkResults results;
+  GVariantBuilder builder;
+  const gchar *opt_pattern = "sequential";
+  gboolean opt_write = FALSE;
+  guint64 opt_block_size = 0;
+  guint32 opt_queue_depth = 32;
+  guint64 opt_duration = 10 * G_USEC_PER_SEC;
+  guint64 opt_size = 0;
+  uid_t caller_uid;
+  GError *error = NULL;
+  gint fd = -1;
+
+  g_variant_lookup (options, "pattern", "&s", &opt_pattern);
+  g_variant_lookup (options, "write", "b", &opt_write);
+  g_variant_lookup (options, "block-size", "t", &opt_block_size);
+  g_variant_lookup (options, "queue-depth", "u", &opt_queue_depth);
+  g_variant_lookup (options, "duration", "t", &opt_duration);
+  g_variant_lookup (options, "size", "t", &opt_size);
+
+  if (g_strcmp0 (opt_pattern, "sequential") != 0 && g_strcmp0 (opt_pattern, "random") != 0)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "Unknown benchmark pattern `%s'", opt_pattern);
+      goto out;
+    }
+
+  params.random = g_strcmp0 (opt_pattern, "random") == 0;
+  params.write = opt_write;
+  params.block_size = opt_block_size;
+  if (params.block_size == 0)
+    params.block_size = params.random ? 4096 : 1024 * 1024;
+  params.queue_depth = opt_queue_depth;
+  params.max_bytes = opt_size;
+  params.max_duration_usec = opt_duration;
+
+  /* writing with O_EXCL, as OpenForBenchmark() with the writable option */
+  fd = open_for_benchmark (block, invocation, options, opt_write, &object);
+  if (fd == -1)
+    goto out;
+
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
+
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon, invocation, NULL /* GCancellable */, &caller_uid, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  job = udisks_daemon_launch_simple_job (daemon, object, "block-benchmark", caller_uid, NULL);
+  udisks_base_job_set_auto_estimate (job, TRUE);
+  udisks_job_set_progress_valid (UDISKS_JOB (job), TRUE);
+  if (params.max_bytes > 0)
+    udisks_job_set_bytes (UDISKS_JOB (job), params.max_bytes);
+
+  if (!udisks_benchmark_run_sync (fd, &params, &results,
+                                  on_benchmark_progress, job,
+                                  udisks_base_job_get_cancellable (job),
+                                  &error))
+    {
+      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+  udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), TRUE, "");
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "bytes", g_variant_new_uint64 (results.bytes));
+  g_variant_builder_add (&builder, "{sv}", "operations", g_variant_new_uint64 (results.operations));
+  g_variant_builder_add (&builder, "{sv}", "elapsed", g_variant_new_uint64 (results.elapsed_usec));
+  g_variant_builder_add (&builder, "{sv}", "throughput", g_variant_new_double (results.throughput));
+  g_variant_builder_add (&builder, "{sv}", "iops", g_variant_new_double (results.iops));
+  g_variant_builder_add (&builder, "{sv}", "latency-min", g_variant_new_uint64 (results.latency_min));
+  g_variant_builder_add (&builder, "{sv}", "latency-mean", g_variant_new_uint64 (results.latency_mean));
+  g_variant_builder_add (&builder, "{sv}", "latency-p50", g_variant_new_uint64 (results.latency_p50));
+  g_variant_builder_add (&builder, "{sv}", "latency-p90", g_variant_new_uint64 (results.latency_p90));
+  g_variant_builder_add (&builder, "{sv}", "latency-p99", g_variant_new_uint64 (results.latency_p99));
+  g_variant_builder_add (&builder, "{sv}", "latency-p999", g_variant_new_uint64 (results.latency_p999));
+  g_variant_builder_add (&builder, "{sv}", "latency-max", g_variant_new_uint64 (results.latency_max));
+
+  udisks_block_complete_benchmark (block, invocation, g_variant_builder_end (&builder));
+
+ out:
+  if (fd != -1)
+    close (fd);
   g_clear_object (&object);
   return TRUE; /* returning true means that we handled the method invocation */
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Checks authorization and opens the device and gets the image file from
+ * @fd_list for BackupTo() and RestoreFrom(). @object is the object for
+ * @block.
+ *
+ * Returns: %TRUE if both were opened, %FALSE if an error has been
+ * returned on @invocation.
+ */
+static gboolean
+open_for_image_copy (UDisksBlock           *block,
+                     UDisksObject          *object,
+                     GDBusMethodInvocation *invocation,
+                     GUnixFDList           *fd_list,
+                     GVariant              *fd_index,
+                     GVariant              *options,
+                     gboolean               restore,
+                     gint                  *out_device_fd,
+                     gint                  *out_image_fd)
+{
+  UDisksDaemon *daemon;
+  UDisksState *state = NULL;
+  const gchar *action_id;
+  const gchar *message;
+  struct stat statbuf;
+  GError *error = NULL;
+  gint device_fd = -1;
+  gint image_fd = -1;
+  gint fd_num;
+  gint accmode;
+  gboolean ret = FALSE;
+
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
+  state = udisks_daemon_get_state (daemon);
+
+  udisks_linux_block_object_lock_for_cleanup (UDISKS_LINUX_BLOCK_OBJECT (object));
+  udisks_state_check_block (state, udisks_linux_block_object_get_device_number (UDISKS_LINUX_BLOCK_OBJECT (object)));
+
+  action_id = "org.freedesktop.udisks2.open-device";
+  if (udisks_block_get_hint_system (block))
+    action_id = "org.freedesktop.udisks2.open-device-system";
+
+  if (restore)
+    /* Translators: Shown in authentication dialog when restoring
+     * from a disk image file.
+     *
+     * Do not translate $(drive), it's a placeholder and will
+     * be replaced by the name of the drive/device in question
+     */
+    message = N_("Authentication is required to open $(drive) for writing");
+  else
+    /* Translators: Shown in authentication dialog when creating a
+     * disk image file.
+     *
+     * Do not translate $(drive), it's a placeholder and will
+     * be replaced by the name of the drive/device in question
+     */
+    message = N_("Authentication is required to open $(drive) for reading");
+
+  if (!udisks_daemon_util_check_authorization_sync (daemon,
+                                                    object,
+                                                    action_id,
+                                                    options,
+                                                    message,
+                                                    invocation))
+    goto out;
+
+  fd_num = g_variant_get_handle (fd_index);
+  if (fd_list == NULL || fd_num >= g_unix_fd_list_get_length (fd_list))
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "Expected to use fd at index %d, but message has only %d fds",
+                                             fd_num,
+                                             fd_list == NULL ? 0 : g_unix_fd_list_get_length (fd_list));
+      goto out;
+    }
+  image_fd = g_unix_fd_list_get (fd_list, fd_num, &error);
+  if (image_fd == -1)
+    {
+      g_prefix_error (&error, "Error getting file descriptor %d from message: ", fd_num);
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  /* holes need a regular file, the image can't be a pipe or a device */
+  accmode = fcntl (image_fd, F_GETFL) & O_ACCMODE;
+  if (fstat (image_fd, &statbuf) != 0 || !S_ISREG (statbuf.st_mode))
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "The image must be a regular file");
+      goto out;
+    }
+  if ((restore && accmode == O_WRONLY) || (!restore && accmode == O_RDONLY))
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "The image must be opened for %s",
+                                             restore ? "reading" : "writing");
+      goto out;
+    }
+  /* holes are made by seeking, which O_APPEND would defeat */
+  if (!restore && (fcntl (image_fd, F_GETFL) & O_APPEND) != 0)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "The image must not be opened for appending");
+      goto out;
+    }
+
+  /* read back when restoring for verification */
+  device_fd = open_device (udisks_block_get_device (block),
+                           restore ? "rw" : "r",
+                           O_CLOEXEC | O_EXCL,
+                           &error);
+  if (device_fd == -1)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  ret = TRUE;
+
+ out:
+  udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (object));
+  if (state != NULL)
+    udisks_state_check (state);
+  if (ret)
+    {
+      *out_device_fd = device_fd;
+      *out_image_fd = image_fd;
+    }
+  else
+    {
+      if (device_fd != -1)
+        close (device_fd);
+      if (image_fd != -1)
+        close (image_fd);
+    }
+  return ret;
+}
+
+static gboolean
+lookup_image_copy_params (GVariant               *options,
+                          UDisksImageCopyParams  *params,
+                          GError                **error)
+{
+  const gchar *opt_checksum = "sha256";
+
+  params->sparse = TRUE;
+  g_variant_lookup (options, "checksum", "&s", &opt_checksum);
+  g_variant_lookup (options, "sparse", "b", &params->sparse);
+  g_variant_lookup (options, "skip-holes", "b", &params->skip_holes);
+  g_variant_lookup (options, "verify", "b", &params->verify);
+
+  params->checksum = TRUE;
+  if (g_strcmp0 (opt_checksum, "none") == 0)
+    params->checksum = FALSE;
+  else if (g_strcmp0 (opt_checksum, "md5") == 0)
+    params->checksum_type = G_CHECKSUM_MD5;
+  else if (g_strcmp0 (opt_checksum, "sha1") == 0)
+    params->checksum_type = G_CHECKSUM_SHA1;
+  else if (g_strcmp0 (opt_checksum, "sha256") == 0)
+    params->checksum_type = G_CHECKSUM_SHA256;
+  else if (g_strcmp0 (opt_checksum, "sha512") == 0)
+    params->checksum_type = G_CHECKSUM_SHA512;
+  else
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Unknown checksum type `%s'", opt_checksum);
+      return FALSE;
+    }
+
+  if (params->verify && !params->checksum)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Verification needs a checksum");
+      return FALSE;
+    }
+  /* the skipped ranges keep whatever the device had there, which
+   * doesn't match the checksum of the image */
+  if (params->verify && params->skip_holes)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                   "Verification can't be combined with skipping holes");
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static GVariant *
+image_copy_results_to_variant (const UDisksImageCopyResults *results)
+{
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "bytes", g_variant_new_uint64 (results->bytes));
+  g_variant_builder_add (&builder, "{sv}", "bytes-written", g_variant_new_uint64 (results->bytes_written));
+  g_variant_builder_add (&builder, "{sv}", "bytes-skipped", g_variant_new_uint64 (results->bytes_skipped));
+  g_variant_builder_add (&builder, "{sv}", "elapsed", g_variant_new_uint64 (results->elapsed_usec));
+  if (results->checksum != NULL)
+    g_variant_builder_add (&builder, "{sv}", "checksum", g_variant_new_string (results->checksum));
+  return g_variant_builder_end (&builder);
+}
+
+static void
+on_image_copy_progress (guint64  bytes_done,
+                        guint64  bytes_total,
+                        gpointer user_data)
+{
+  UDisksJob *job = UDISKS_JOB (user_data);
+
+  udisks_job_set_bytes (job, bytes_total);
+  if (bytes_total > 0)
+    udisks_job_set_progress (job, ((gdouble) bytes_done) / bytes_total);
+}
+
+static gboolean
+handle_image_copy (UDisksBlock           *block,
+                   GDBusMethodInvocation *invocation,
+                   GUnixFDList           *fd_list,
+                   GVariant              *fd_index,
+                   GVariant              *options,
+                   gboolean               restore)
+{
+  UDisksObject *object = NULL;
+  UDisksDaemon *daemon = NULL;
+  UDisksBaseJob *job;
+  gpointer reservation = NULL;
+  UDisksImageCopyParams params = { 0 };
+  UDisksImageCopyResults results = { 0 };
+  UDisksLinuxDevice *device = NULL;
+  uid_t caller_uid;
+  GError *error = NULL;
+  gint device_fd = -1;
+  gint image_fd = -1;
+  gboolean success;
+
+  if (!lookup_image_copy_params (options, &params, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  object = udisks_daemon_util_dup_object (block, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
+
+  /* wait for our turn on the drive before taking the cleanup lock */
+  reservation = udisks_job_scheduler_reserve_sync (udisks_daemon_get_job_scheduler (daemon),
+                                                   object, restore ? "block-restore" : "block-backup", NULL);
+
+  if (!open_for_image_copy (block, object, invocation, fd_list, fd_index, options, restore,
+                            &device_fd, &image_fd))
+    goto out;
+
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon, invocation, NULL /* GCancellable */, &caller_uid, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  job = udisks_daemon_launch_simple_job (daemon, object, restore ? "block-restore" : "block-backup", caller_uid, NULL);
+  udisks_base_job_set_auto_estimate (job, TRUE);
+  udisks_job_set_progress_valid (UDISKS_JOB (job), TRUE);
+
+  if (restore)
+    success = udisks_image_copy_restore_sync (image_fd, device_fd, &params, &results,
+                                              on_image_copy_progress, job,
+                                              udisks_base_job_get_cancellable (job),
+                                              &error);
+  else
+    success = udisks_image_copy_backup_sync (device_fd, image_fd, &params, &results,
+                                             on_image_copy_progress, job,
+                                             udisks_base_job_get_cancellable (job),
+                                             &error);
+
+  /* the device has to be closed for the partition table to be re-read */
+  close (device_fd);
+  device_fd = -1;
+  if (restore)
+    {
+      GError *rescan_error = NULL;
+
+      device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (object));
+      if (g_strcmp0 (g_udev_device_get_devtype (device->udev_device), "disk") == 0 &&
+          !udisks_linux_block_object_reread_partition_table (UDISKS_LINUX_BLOCK_OBJECT (object), &rescan_error))
+        {
+          udisks_warning ("%s", rescan_error->message);
+          g_clear_error (&rescan_error);
+        }
+      udisks_linux_block_object_trigger_uevent_sync (UDISKS_LINUX_BLOCK_OBJECT (object),
+                                                     UDISKS_DEFAULT_WAIT_TIMEOUT);
+    }
+
+  if (!success)
+    {
+      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+  udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), TRUE, "");
+
+  if (restore)
+    udisks_block_complete_restore_from (block, invocation, NULL, image_copy_results_to_variant (&results));
+  else
+    udisks_block_complete_backup_to (block, invocation, NULL, image_copy_results_to_variant (&results));
+
+ out:
+  if (device_fd != -1)
+    close (device_fd);
+  if (image_fd != -1)
+    close (image_fd);
+  if (reservation != NULL)
+    udisks_job_scheduler_release_reservation (udisks_daemon_get_job_scheduler (daemon), reservation);
+  g_free (results.checksum);
+  g_clear_object (&device);
+  g_clear_object (&object);
+  return TRUE; /* returning true means that we handled the method invocation */
+}
+
+static gboolean
+handle_backup_to (UDisksBlock           *block,
+                  GDBusMethodInvocation *invocation,
+                  GUnixFDList           *fd_list,
+                  GVariant              *fd_index,
+                  GVariant              *options)
+{
+  return handle_image_copy (block, invocation, fd_list, fd_index, options, FALSE);
+}
+
+static gboolean
+handle_restore_from (UDisksBlock           *block,
+                     GDBusMethodInvocation *invocation,
+                     GUnixFDList           *fd_list,
+                     GVariant              *fd_index,
+                     GVariant              *options)
+{
+  return handle_image_copy (block, invocation, fd_list, fd_index, options, TRUE);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static gboolean
 handle_open_device (UDisksBlock           *block,
                     GDBusMethodInvocation *invocation,
@@ -3989,6 +4986,9 @@ block_iface_init (UDisksBlockIface *iface)
   iface->handle_open_for_backup           = handle_open_for_backup;
   iface->handle_open_for_restore          = handle_open_for_restore;
   iface->handle_open_for_benchmark        = handle_open_for_benchmark;
+  iface->handle_benchmark                 = handle_benchmark;
+  iface->handle_backup_to                 = handle_backup_to;
+  iface->handle_restore_from              = handle_restore_from;
   iface->handle_open_device               = handle_open_device;
   iface->handle_rescan                    = handle_rescan;
 }
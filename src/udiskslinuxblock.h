@@ -41,6 +41,12 @@ void         udisks_linux_block_handle_format (UDisksBlock            *block,
                                                void                  (*complete)(gpointer user_data),
                                                gpointer                complete_user_data);
 
+GVariant    *udisks_linux_block_format_many_sync (UDisksDaemon           *daemon,
+                                                  GDBusMethodInvocation  *invocation,
+                                                  GVariant               *devices,
+                                                  GVariant               *options,
+                                                  GError                **error);
+
 gboolean     udisks_linux_block_matches_id (UDisksLinuxBlock *block,
                                             const gchar      *device_path);
 
@@ -53,6 +53,7 @@
 #include "udiskslinuxencrypted.h"
 #include "udiskslinuxswapspace.h"
 #include "udiskslinuxloop.h"
+#include "udiskslinuxblockstatistics.h"
 #include "udiskslinuxprovider.h"
 #include "udiskscrypttabmonitor.h"
 #include "udiskscrypttabentry.h"
@@ -60,6 +61,7 @@
 #include "udisksmodulemanager.h"
 #include "udisksmodule.h"
 #include "udisksmoduleobject.h"
+#include "udisksstats.h"
 
 /**
  * SECTION:udiskslinuxblockobject
@@ -97,7 +99,11 @@ struct _UDisksLinuxBlockObject
   UDisksSwapspace *iface_swapspace;
   UDisksEncrypted *iface_encrypted;
   UDisksLoop *iface_loop;
+  UDisksBlockStatistics *iface_block_statistics;
   GHashTable *module_ifaces;
+
+  /* udev properties and sysfs attributes at the time of the last uevent, see take_snapshot() */
+  GHashTable *snapshot;
 };
 
 struct _UDisksLinuxBlockObjectClass
@@ -132,6 +138,8 @@ udisks_linux_block_object_finalize (GObject *_object)
 
   g_object_unref (object->device);
   g_mutex_clear (&object->device_mutex);
+  if (object->snapshot != NULL)
+    g_hash_table_unref (object->snapshot);
 
   g_mutex_clear (&object->cleanup_mutex);
 
@@ -149,6 +157,8 @@ udisks_linux_block_object_finalize (GObject *_object)
     g_object_unref (object->iface_encrypted);
   if (object->iface_loop != NULL)
     g_object_unref (object->iface_loop);
+  if (object->iface_block_statistics != NULL)
+    g_object_unref (object->iface_block_statistics);
   if (object->module_ifaces != NULL)
     g_hash_table_destroy (object->module_ifaces);
 
@@ -429,6 +439,7 @@ update_iface (UDisksObject                     *object,
 {
   gboolean has;
   gboolean add;
+  gint64 begin_time;
   GDBusInterface **interface_pointer = _interface_pointer;
 
   g_return_if_fail (object != NULL);
@@ -439,6 +450,7 @@ update_iface (UDisksObject                     *object,
   g_return_if_fail (interface_pointer != NULL);
   g_return_if_fail (*interface_pointer == NULL || G_IS_DBUS_INTERFACE (*interface_pointer));
 
+  begin_time = udisks_stats_begin ();
   add = FALSE;
   has = has_func (object);
   if (*interface_pointer == NULL)
@@ -470,6 +482,8 @@ update_iface (UDisksObject                     *object,
         g_dbus_object_skeleton_add_interface (G_DBUS_OBJECT_SKELETON (object),
                                               G_DBUS_INTERFACE_SKELETON (*interface_pointer));
     }
+
+  udisks_stats_end ("block-iface", g_type_name (skeleton_type), begin_time);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -844,6 +858,204 @@ loop_update (UDisksObject   *object,
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
+/* org.freedesktop.UDisks2.Block.Statistics */
+
+static gboolean
+block_statistics_check (UDisksObject *object)
+{
+  UDisksLinuxBlockObject *block_object = UDISKS_LINUX_BLOCK_OBJECT (object);
+
+  return g_udev_device_has_sysfs_attr (block_object->device->udev_device, "stat");
+}
+
+static void
+block_statistics_connect (UDisksObject *object)
+{
+}
+
+static gboolean
+block_statistics_update (UDisksObject   *object,
+                         const gchar    *uevent_action,
+                         GDBusInterface *_iface)
+{
+  udisks_linux_block_statistics_update (UDISKS_LINUX_BLOCK_STATISTICS (_iface), UDISKS_LINUX_BLOCK_OBJECT (object));
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Inputs the interfaces depend on, used to only update the interfaces
+ * affected by a uevent. See take_snapshot() and compute_changes().
+ */
+typedef enum
+{
+  BLOCK_INPUT_NONE            = 0,
+  BLOCK_INPUT_UDEV_ID_FS      = (1 << 0), /* ID_FS_* udev properties */
+  BLOCK_INPUT_UDEV_PART_TABLE = (1 << 1), /* ID_PART_TABLE_* udev properties */
+  BLOCK_INPUT_UDEV_PART_ENTRY = (1 << 2), /* ID_PART_ENTRY_* udev properties */
+  BLOCK_INPUT_UDEV_DM         = (1 << 3), /* DM_* udev properties */
+  BLOCK_INPUT_UDEV_OTHER      = (1 << 4), /* any other udev property */
+  BLOCK_INPUT_SYSFS           = (1 << 5), /* generic sysfs attributes such as the size */
+  BLOCK_INPUT_SYSFS_LOOP      = (1 << 6), /* loop/ sysfs attributes */
+  BLOCK_INPUT_TOPOLOGY        = (1 << 7), /* partitions, holders and slaves */
+  BLOCK_INPUT_ALL             = 0xff
+} BlockInput;
+
+#define BLOCK_INPUTS_BLOCK            BLOCK_INPUT_ALL
+#define BLOCK_INPUTS_FILESYSTEM       (BLOCK_INPUT_UDEV_ID_FS | BLOCK_INPUT_SYSFS | BLOCK_INPUT_TOPOLOGY)
+#define BLOCK_INPUTS_SWAPSPACE        (BLOCK_INPUT_UDEV_ID_FS)
+#define BLOCK_INPUTS_ENCRYPTED        (BLOCK_INPUT_UDEV_ID_FS | BLOCK_INPUT_UDEV_DM | BLOCK_INPUT_UDEV_OTHER | BLOCK_INPUT_TOPOLOGY)
+#define BLOCK_INPUTS_LOOP             (BLOCK_INPUT_SYSFS | BLOCK_INPUT_SYSFS_LOOP)
+#define BLOCK_INPUTS_PARTITION_TABLE  (BLOCK_INPUT_UDEV_ID_FS | BLOCK_INPUT_UDEV_PART_TABLE | BLOCK_INPUT_TOPOLOGY)
+#define BLOCK_INPUTS_PARTITION        (BLOCK_INPUT_UDEV_PART_ENTRY | BLOCK_INPUT_SYSFS)
+#define BLOCK_INPUTS_STATISTICS       (BLOCK_INPUT_SYSFS)
+
+static const gchar *snapshot_sysfs_attrs[] =
+{
+  "size", "ro", "removable", "start", "partition", "dm/name", "dm/uuid",
+  "loop/backing_file", "loop/offset", "loop/sizelimit", "loop/autoclear", "loop/partscan",
+  NULL
+};
+
+/* properties that differ for every uevent without the device changing */
+static gboolean
+is_volatile_property (const gchar *key)
+{
+  return g_strcmp0 (key, "ACTION") == 0 ||
+         g_strcmp0 (key, "SEQNUM") == 0 ||
+         g_str_has_prefix (key, "SYNTH_");
+}
+
+static gint
+compare_names (gconstpointer a,
+               gconstpointer b)
+{
+  return g_strcmp0 (*(const gchar **) a, *(const gchar **) b);
+}
+
+/* returns the sorted entries of @sysfs_path/@subdir starting with @prefix, separated by spaces */
+static gchar *
+list_sysfs_dir (const gchar *sysfs_path,
+                const gchar *subdir,
+                const gchar *prefix)
+{
+  GPtrArray *names;
+  GDir *dir;
+  const gchar *name;
+  gchar *path;
+  gchar *ret;
+
+  names = g_ptr_array_new_with_free_func (g_free);
+  path = g_build_filename (sysfs_path, subdir, NULL);
+  dir = g_dir_open (path, 0 /* flags */, NULL /* GError */);
+  g_free (path);
+  if (dir != NULL)
+    {
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          if (prefix == NULL || g_str_has_prefix (name, prefix))
+            g_ptr_array_add (names, g_strdup (name));
+        }
+      g_dir_close (dir);
+    }
+  g_ptr_array_sort (names, compare_names);
+  g_ptr_array_add (names, NULL);
+  ret = g_strjoinv (" ", (gchar **) names->pdata);
+  g_ptr_array_unref (names);
+
+  return ret;
+}
+
+/* Records everything compute_changes() compares, keys are prefixed by
+ * "P:" for udev properties, "S:" for sysfs attributes and "T:" for
+ * the topology.
+ */
+static GHashTable *
+take_snapshot (UDisksLinuxDevice *device)
+{
+  GHashTable *snapshot;
+  const gchar * const *keys;
+  const gchar *sysfs_path;
+  guint n;
+
+  snapshot = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  keys = g_udev_device_get_property_keys (device->udev_device);
+  for (n = 0; keys != NULL && keys[n] != NULL; n++)
+    {
+      if (is_volatile_property (keys[n]))
+        continue;
+      g_hash_table_insert (snapshot,
+                           g_strconcat ("P:", keys[n], NULL),
+                           g_strdup (g_udev_device_get_property (device->udev_device, keys[n])));
+    }
+
+  for (n = 0; snapshot_sysfs_attrs[n] != NULL; n++)
+    {
+      gchar *value;
+
+      /* not using g_udev_device_get_sysfs_attr() as that caches the values */
+      value = udisks_linux_device_read_sysfs_attr (device, snapshot_sysfs_attrs[n], NULL);
+      if (value != NULL)
+        g_hash_table_insert (snapshot, g_strconcat ("S:", snapshot_sysfs_attrs[n], NULL), value);
+    }
+
+  sysfs_path = g_udev_device_get_sysfs_path (device->udev_device);
+  if (g_strcmp0 (g_udev_device_get_devtype (device->udev_device), "disk") == 0)
+    g_hash_table_insert (snapshot, g_strdup ("T:partitions"),
+                         list_sysfs_dir (sysfs_path, NULL, g_udev_device_get_name (device->udev_device)));
+  g_hash_table_insert (snapshot, g_strdup ("T:holders"), list_sysfs_dir (sysfs_path, "holders", NULL));
+  g_hash_table_insert (snapshot, g_strdup ("T:slaves"), list_sysfs_dir (sysfs_path, "slaves", NULL));
+
+  return snapshot;
+}
+
+static BlockInput
+classify_snapshot_key (const gchar *key)
+{
+  if (g_str_has_prefix (key, "P:ID_FS_"))
+    return BLOCK_INPUT_UDEV_ID_FS;
+  if (g_str_has_prefix (key, "P:ID_PART_TABLE_"))
+    return BLOCK_INPUT_UDEV_PART_TABLE;
+  if (g_str_has_prefix (key, "P:ID_PART_ENTRY_"))
+    return BLOCK_INPUT_UDEV_PART_ENTRY;
+  if (g_str_has_prefix (key, "P:DM_"))
+    return BLOCK_INPUT_UDEV_DM;
+  if (g_str_has_prefix (key, "P:"))
+    return BLOCK_INPUT_UDEV_OTHER;
+  if (g_str_has_prefix (key, "S:loop/"))
+    return BLOCK_INPUT_SYSFS_LOOP;
+  if (g_str_has_prefix (key, "S:"))
+    return BLOCK_INPUT_SYSFS;
+  return BLOCK_INPUT_TOPOLOGY;
+}
+
+static BlockInput
+compute_changes (GHashTable *old_snapshot,
+                 GHashTable *new_snapshot)
+{
+  BlockInput changes = BLOCK_INPUT_NONE;
+  GHashTableIter iter;
+  const gchar *key;
+  const gchar *value;
+
+  g_hash_table_iter_init (&iter, new_snapshot);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &key, (gpointer *) &value))
+    {
+      if (g_strcmp0 (g_hash_table_lookup (old_snapshot, key), value) != 0)
+        changes |= classify_snapshot_key (key);
+    }
+
+  /* removed keys */
+  g_hash_table_iter_init (&iter, old_snapshot);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &key, NULL))
+    {
+      if (!g_hash_table_contains (new_snapshot, key))
+        changes |= classify_snapshot_key (key);
+    }
+
+  return changes;
+}
 
 /**
  * udisks_linux_block_object_uevent:
@@ -852,6 +1064,12 @@ loop_update (UDisksObject   *object,
  * @device: A new #UDisksLinuxDevice device object or %NULL if the device hasn't changed.
  *
  * Updates all information on interfaces on @object as a result of incoming uevent processing.
+ *
+ * For <literal>change</literal> uevents coming from the kernel, only the
+ * interfaces depending on udev properties or sysfs attributes that actually
+ * changed are updated. Everything is refreshed when @device is %NULL, i.e. when
+ * something else than the device changed, and for synthetic uevents such as the
+ * ones triggered by udisks_linux_block_object_trigger_uevent() or Block.Rescan().
  */
 void
 udisks_linux_block_object_uevent (UDisksLinuxBlockObject *object,
@@ -861,12 +1079,24 @@ udisks_linux_block_object_uevent (UDisksLinuxBlockObject *object,
   UDisksModuleManager *module_manager;
   GList *modules;
   GList *l;
+  BlockInput changes = BLOCK_INPUT_ALL;
 
   g_return_if_fail (UDISKS_IS_LINUX_BLOCK_OBJECT (object));
   g_return_if_fail (device == NULL || UDISKS_IS_LINUX_DEVICE (device));
 
   if (device != NULL)
     {
+      GHashTable *snapshot;
+
+      snapshot = take_snapshot (device);
+      if (object->snapshot != NULL &&
+          g_strcmp0 (action, "change") == 0 &&
+          !g_udev_device_has_property (device->udev_device, "SYNTH_UUID"))
+        changes = compute_changes (object->snapshot, snapshot);
+      if (object->snapshot != NULL)
+        g_hash_table_unref (object->snapshot);
+      object->snapshot = snapshot;
+
       g_mutex_lock (&object->device_mutex);
       g_object_unref (object->device);
       object->device = g_object_ref (device);
@@ -874,23 +1104,37 @@ udisks_linux_block_object_uevent (UDisksLinuxBlockObject *object,
       g_object_notify (G_OBJECT (object), "device");
     }
 
-  update_iface (UDISKS_OBJECT (object), action, block_device_check, block_device_connect, block_device_update,
-                UDISKS_TYPE_LINUX_BLOCK, &object->iface_block_device);
+  if (changes == BLOCK_INPUT_NONE)
+    udisks_debug ("Nothing changed for %s, skipping interface updates",
+                  g_udev_device_get_sysfs_path (object->device->udev_device));
+
+  if (changes & BLOCK_INPUTS_BLOCK)
+    update_iface (UDISKS_OBJECT (object), action, block_device_check, block_device_connect, block_device_update,
+                  UDISKS_TYPE_LINUX_BLOCK, &object->iface_block_device);
   g_warn_if_fail (object->iface_block_device != NULL);
-  update_iface (UDISKS_OBJECT (object), action, contains_filesystem, filesystem_connect, filesystem_update,
-                UDISKS_TYPE_LINUX_FILESYSTEM, &object->iface_filesystem);
-  update_iface (UDISKS_OBJECT (object), action, swapspace_check, swapspace_connect, swapspace_update,
-                UDISKS_TYPE_LINUX_SWAPSPACE, &object->iface_swapspace);
-  update_iface (UDISKS_OBJECT (object), action, encrypted_check, encrypted_connect, encrypted_update,
-                UDISKS_TYPE_LINUX_ENCRYPTED, &object->iface_encrypted);
-  update_iface (UDISKS_OBJECT (object), action, loop_check, loop_connect, loop_update,
-                UDISKS_TYPE_LINUX_LOOP, &object->iface_loop);
-  update_iface (UDISKS_OBJECT (object), action, partition_table_check, partition_table_connect, partition_table_update,
-                UDISKS_TYPE_LINUX_PARTITION_TABLE, &object->iface_partition_table);
-  update_iface (UDISKS_OBJECT (object), action, partition_check, partition_connect, partition_update,
-                UDISKS_TYPE_LINUX_PARTITION, &object->iface_partition);
-
-  /* Attach interfaces from modules */
+  if (changes & BLOCK_INPUTS_FILESYSTEM)
+    update_iface (UDISKS_OBJECT (object), action, contains_filesystem, filesystem_connect, filesystem_update,
+                  UDISKS_TYPE_LINUX_FILESYSTEM, &object->iface_filesystem);
+  if (changes & BLOCK_INPUTS_SWAPSPACE)
+    update_iface (UDISKS_OBJECT (object), action, swapspace_check, swapspace_connect, swapspace_update,
+                  UDISKS_TYPE_LINUX_SWAPSPACE, &object->iface_swapspace);
+  if (changes & BLOCK_INPUTS_ENCRYPTED)
+    update_iface (UDISKS_OBJECT (object), action, encrypted_check, encrypted_connect, encrypted_update,
+                  UDISKS_TYPE_LINUX_ENCRYPTED, &object->iface_encrypted);
+  if (changes & BLOCK_INPUTS_LOOP)
+    update_iface (UDISKS_OBJECT (object), action, loop_check, loop_connect, loop_update,
+                  UDISKS_TYPE_LINUX_LOOP, &object->iface_loop);
+  if (changes & BLOCK_INPUTS_PARTITION_TABLE)
+    update_iface (UDISKS_OBJECT (object), action, partition_table_check, partition_table_connect, partition_table_update,
+                  UDISKS_TYPE_LINUX_PARTITION_TABLE, &object->iface_partition_table);
+  if (changes & BLOCK_INPUTS_PARTITION)
+    update_iface (UDISKS_OBJECT (object), action, partition_check, partition_connect, partition_update,
+                  UDISKS_TYPE_LINUX_PARTITION, &object->iface_partition);
+  if (changes & BLOCK_INPUTS_STATISTICS)
+    update_iface (UDISKS_OBJECT (object), action, block_statistics_check, block_statistics_connect, block_statistics_update,
+                  UDISKS_TYPE_LINUX_BLOCK_STATISTICS, &object->iface_block_statistics);
+
+  /* Attach interfaces from modules, these don't declare their inputs so always update them */
   module_manager = udisks_daemon_get_module_manager (object->daemon);
   modules = udisks_module_manager_get_modules (module_manager);
   for (l = modules; l; l = g_list_next (l))
@@ -903,7 +1147,9 @@ udisks_linux_block_object_uevent (UDisksLinuxBlockObject *object,
         {
           GDBusInterfaceSkeleton *interface;
           gboolean keep = TRUE;
+          gint64 begin_time;
 
+          begin_time = udisks_stats_begin ();
           interface = g_hash_table_lookup (object->module_ifaces, GSIZE_TO_POINTER (*types));
           if (interface != NULL)
             {
@@ -930,6 +1176,7 @@ udisks_linux_block_object_uevent (UDisksLinuxBlockObject *object,
                   g_warn_if_fail (g_hash_table_replace (object->module_ifaces, GSIZE_TO_POINTER (*types), interface));
                 }
             }
+          udisks_stats_end ("block-iface", g_type_name (*types), begin_time);
         }
     }
   g_list_free_full (modules, g_object_unref);
@@ -0,0 +1,261 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include "udiskslogging.h"
+#include "udiskslinuxblockstatistics.h"
+#include "udiskslinuxblockobject.h"
+#include "udiskslinuxdevice.h"
+#include "udisksstatisticssampler.h"
+#include "udisksdaemon.h"
+
+/**
+ * SECTION:udiskslinuxblockstatistics
+ * @title: UDisksLinuxBlockStatistics
+ * @short_description: Linux implementation of #UDisksBlockStatistics
+ *
+ * This type provides an implementation of the #UDisksBlockStatistics
+ * interface on Linux. It keeps track of the subscribed clients and
+ * registers the device with the daemon's #UDisksStatisticsSampler
+ * while there is at least one of them.
+ *
+ * Unlike most other interfaces, method invocations are handled in the
+ * main thread. They are cheap and this way the subscribers and the
+ * sampler are only ever touched from a single thread.
+ */
+
+typedef struct _UDisksLinuxBlockStatisticsClass   UDisksLinuxBlockStatisticsClass;
+
+/**
+ * UDisksLinuxBlockStatistics:
+ *
+ * The #UDisksLinuxBlockStatistics structure contains only private data and should
+ * only be accessed using the provided API.
+ */
+struct _UDisksLinuxBlockStatistics
+{
+  UDisksBlockStatisticsSkeleton parent_instance;
+
+  /* not referenced, owned by the daemon which outlives us */
+  UDisksStatisticsSampler *sampler;
+  gchar *sysfs_path;
+
+  /* unique bus name -> watcher id */
+  GHashTable *subscribers;
+};
+
+struct _UDisksLinuxBlockStatisticsClass
+{
+  UDisksBlockStatisticsSkeletonClass parent_class;
+};
+
+static void block_statistics_iface_init (UDisksBlockStatisticsIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (UDisksLinuxBlockStatistics, udisks_linux_block_statistics, UDISKS_TYPE_BLOCK_STATISTICS_SKELETON,
+                         G_IMPLEMENT_INTERFACE (UDISKS_TYPE_BLOCK_STATISTICS, block_statistics_iface_init));
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+unwatch_subscriber (gpointer data)
+{
+  g_bus_unwatch_name (GPOINTER_TO_UINT (data));
+}
+
+static void
+udisks_linux_block_statistics_finalize (GObject *object)
+{
+  UDisksLinuxBlockStatistics *statistics = UDISKS_LINUX_BLOCK_STATISTICS (object);
+
+  if (statistics->sampler != NULL)
+    udisks_statistics_sampler_remove (statistics->sampler, UDISKS_BLOCK_STATISTICS (statistics));
+  g_hash_table_unref (statistics->subscribers);
+  g_free (statistics->sysfs_path);
+
+  if (G_OBJECT_CLASS (udisks_linux_block_statistics_parent_class)->finalize != NULL)
+    G_OBJECT_CLASS (udisks_linux_block_statistics_parent_class)->finalize (object);
+}
+
+static void
+udisks_linux_block_statistics_init (UDisksLinuxBlockStatistics *statistics)
+{
+  statistics->subscribers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, unwatch_subscriber);
+}
+
+static void
+udisks_linux_block_statistics_class_init (UDisksLinuxBlockStatisticsClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = udisks_linux_block_statistics_finalize;
+}
+
+/**
+ * udisks_linux_block_statistics_new:
+ *
+ * Creates a new #UDisksLinuxBlockStatistics instance.
+ *
+ * Returns: A new #UDisksLinuxBlockStatistics. Free with g_object_unref().
+ */
+UDisksBlockStatistics *
+udisks_linux_block_statistics_new (void)
+{
+  return UDISKS_BLOCK_STATISTICS (g_object_new (UDISKS_TYPE_LINUX_BLOCK_STATISTICS,
+                                                NULL));
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_linux_block_statistics_update:
+ * @statistics: A #UDisksLinuxBlockStatistics.
+ * @object: The enclosing #UDisksLinuxBlockObject instance.
+ *
+ * Updates the interface.
+ */
+void
+udisks_linux_block_statistics_update (UDisksLinuxBlockStatistics *statistics,
+                                      UDisksLinuxBlockObject     *object)
+{
+  UDisksDaemon *daemon;
+  UDisksLinuxDevice *device;
+
+  daemon = udisks_linux_block_object_get_daemon (object);
+  device = udisks_linux_block_object_get_device (object);
+
+  statistics->sampler = udisks_daemon_get_statistics_sampler (daemon);
+  g_free (statistics->sysfs_path);
+  statistics->sysfs_path = g_strdup (g_udev_device_get_sysfs_path (device->udev_device));
+
+  udisks_block_statistics_set_interval (UDISKS_BLOCK_STATISTICS (statistics),
+                                        udisks_statistics_sampler_get_interval (statistics->sampler));
+
+  g_dbus_interface_skeleton_flush (G_DBUS_INTERFACE_SKELETON (statistics));
+  g_object_unref (device);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+remove_subscriber (UDisksLinuxBlockStatistics *statistics,
+                   const gchar                *name)
+{
+  if (!g_hash_table_remove (statistics->subscribers, name))
+    return;
+
+  if (g_hash_table_size (statistics->subscribers) == 0)
+    udisks_statistics_sampler_remove (statistics->sampler, UDISKS_BLOCK_STATISTICS (statistics));
+}
+
+static void
+on_subscriber_vanished (GDBusConnection *connection,
+                        const gchar     *name,
+                        gpointer         user_data)
+{
+  UDisksLinuxBlockStatistics *statistics = UDISKS_LINUX_BLOCK_STATISTICS (user_data);
+
+  udisks_debug ("Statistics subscriber %s of %s vanished", name, statistics->sysfs_path);
+  remove_subscriber (statistics, name);
+}
+
+/* runs in the main thread */
+static gboolean
+handle_subscribe (UDisksBlockStatistics *_statistics,
+                  GDBusMethodInvocation *invocation,
+                  GVariant              *options)
+{
+  UDisksLinuxBlockStatistics *statistics = UDISKS_LINUX_BLOCK_STATISTICS (_statistics);
+  const gchar *sender;
+  guint watcher_id;
+  GError *error = NULL;
+
+  sender = g_dbus_method_invocation_get_sender (invocation);
+
+  if (statistics->sampler == NULL || statistics->sysfs_path == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             UDISKS_ERROR,
+                                             UDISKS_ERROR_FAILED,
+                                             "The statistics of the device are not available yet");
+      goto out;
+    }
+
+  if (sender == NULL || g_hash_table_contains (statistics->subscribers, sender))
+    goto done;
+
+  if (g_hash_table_size (statistics->subscribers) == 0 &&
+      !udisks_statistics_sampler_add (statistics->sampler, _statistics, statistics->sysfs_path, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  watcher_id = g_bus_watch_name_on_connection (g_dbus_method_invocation_get_connection (invocation),
+                                               sender,
+                                               G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                               NULL, /* name_appeared_handler */
+                                               on_subscriber_vanished,
+                                               statistics,
+                                               NULL); /* user_data_free_func */
+  g_hash_table_insert (statistics->subscribers, g_strdup (sender), GUINT_TO_POINTER (watcher_id));
+
+ done:
+  udisks_block_statistics_complete_subscribe (_statistics, invocation);
+
+ out:
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+/* runs in the main thread */
+static gboolean
+handle_unsubscribe (UDisksBlockStatistics *_statistics,
+                    GDBusMethodInvocation *invocation,
+                    GVariant              *options)
+{
+  UDisksLinuxBlockStatistics *statistics = UDISKS_LINUX_BLOCK_STATISTICS (_statistics);
+  const gchar *sender;
+
+  sender = g_dbus_method_invocation_get_sender (invocation);
+
+  if (sender == NULL || !g_hash_table_contains (statistics->subscribers, sender))
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             UDISKS_ERROR,
+                                             UDISKS_ERROR_FAILED,
+                                             "Not subscribed to the statistics of the device");
+      goto out;
+    }
+
+  remove_subscriber (statistics, sender);
+  udisks_block_statistics_complete_unsubscribe (_statistics, invocation);
+
+ out:
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+block_statistics_iface_init (UDisksBlockStatisticsIface *iface)
+{
+  iface->handle_subscribe = handle_subscribe;
+  iface->handle_unsubscribe = handle_unsubscribe;
+}
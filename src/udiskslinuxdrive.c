@@ -26,6 +26,7 @@
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <inttypes.h>
 #include <errno.h>
 #include <linux/bsg.h>
@@ -50,7 +51,7 @@
 #include "udisksdaemon.h"
 #include "udisksdaemonutil.h"
 #include "udiskslinuxdevice.h"
-#include "udisksconfigmanager.h"
+#include "udisksdriveconfigstore.h"
 
 /**
  * SECTION:udiskslinuxdrive
@@ -211,139 +212,27 @@ out:
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-typedef struct {
-  const gchar *asv_key;
-  const gchar *group;
-  const gchar *key;
-  const GVariantType *type;
-} VariantKeyfileMapping;
-
-static const VariantKeyfileMapping drive_configuration_mapping[5] = {
-  {"ata-pm-standby",             "ATA", "StandbyTimeout",       G_VARIANT_TYPE_INT32},
-  {"ata-apm-level",              "ATA", "APMLevel",             G_VARIANT_TYPE_INT32},
-  {"ata-aam-level",              "ATA", "AAMLevel",             G_VARIANT_TYPE_INT32},
-  {"ata-write-cache-enabled",    "ATA", "WriteCacheEnabled",    G_VARIANT_TYPE_BOOLEAN},
-  {"ata-read-lookahead-enabled", "ATA", "ReadLookaheadEnabled", G_VARIANT_TYPE_BOOLEAN},
-};
-
-/* ---------------------------------------------------------------------------------------------------- */
-
-static gchar *
-configuration_get_path (UDisksLinuxDrive *drive,
-                        UDisksDaemon     *daemon)
-{
-  UDisksConfigManager *config_manager;
-  const gchar *id;
-  gchar *id_config_file;
-  gchar *path;
-
-  config_manager = udisks_daemon_get_config_manager (daemon);
-
-  id = udisks_drive_get_id (UDISKS_DRIVE (drive));
-  if (id == NULL || strlen (id) == 0)
-    return NULL;
-
-  id_config_file = g_strdup_printf ("%s.conf", id);
-  path = g_build_filename (udisks_config_manager_get_config_dir (config_manager),
-                           id_config_file,
-                           NULL);
-  g_free (id_config_file);
-
-  return path;
-}
-
 /* returns TRUE if configuration changed */
 static gboolean
 update_configuration (UDisksLinuxDrive       *drive,
                       UDisksLinuxDriveObject *object)
 {
   UDisksDaemon *daemon;
-  GKeyFile *key_file = NULL;
   gboolean ret = FALSE;
-  gchar *path = NULL;
-  GError *error = NULL;
-  GVariant *value = NULL;
-  GVariantBuilder builder;
+  GVariant *value;
   GVariant *old_value;
-  guint n;
 
   daemon = udisks_linux_drive_object_get_daemon (object);
 
-  path = configuration_get_path (drive, daemon);
-  if (path == NULL)
-    goto out;
-
-  key_file = g_key_file_new ();
-  if (!g_key_file_load_from_file (key_file,
-                                  path,
-                                  G_KEY_FILE_NONE,
-                                  &error))
-    {
-      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
-        {
-          udisks_critical ("Error loading drive config file: %s (%s, %d)",
-                        error->message, g_quark_to_string (error->domain), error->code);
-        }
-      g_clear_error (&error);
-      goto out;
-    }
-
-  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
-  for (n = 0; n < G_N_ELEMENTS (drive_configuration_mapping); n++)
-    {
-      const VariantKeyfileMapping *mapping = &drive_configuration_mapping[n];
-
-      if (!g_key_file_has_key (key_file, mapping->group, mapping->key, NULL))
-        continue;
-
-      if (g_variant_type_equal (mapping->type, G_VARIANT_TYPE_INT32))
-        {
-          gint32 int_value = g_key_file_get_integer (key_file, mapping->group, mapping->key, &error);
-          if (error != NULL)
-            {
-              udisks_critical ("Error parsing int32 key %s in group %s in drive config file %s: %s (%s, %d)",
-                            mapping->key, mapping->group, path,
-                            error->message, g_quark_to_string (error->domain), error->code);
-              g_clear_error (&error);
-            }
-          else
-            {
-              g_variant_builder_add (&builder, "{sv}", mapping->asv_key, g_variant_new_int32 (int_value));
-            }
-        }
-      else if (g_variant_type_equal (mapping->type, G_VARIANT_TYPE_BOOLEAN))
-        {
-          gboolean bool_value = g_key_file_get_boolean (key_file, mapping->group, mapping->key, &error);
-          if (error != NULL)
-            {
-              udisks_critical ("Error parsing boolean key %s in group %s in drive config file %s: %s (%s, %d)",
-                            mapping->key, mapping->group, path,
-                            error->message, g_quark_to_string (error->domain), error->code);
-              g_clear_error (&error);
-            }
-          else
-            {
-              g_variant_builder_add (&builder, "{sv}", mapping->asv_key, g_variant_new_boolean (bool_value));
-            }
-        }
-      else
-        {
-          g_assert_not_reached ();
-        }
-    }
-
-  value = g_variant_ref_sink (g_variant_builder_end (&builder));
-
- out:
-  g_free (path);
+  /* served from the cache, doesn't touch the disk unless the file changed */
+  value = udisks_drive_config_store_lookup (udisks_daemon_get_drive_config_store (daemon),
+                                            udisks_drive_get_id (UDISKS_DRIVE (drive)));
 
   old_value = udisks_drive_get_configuration (UDISKS_DRIVE (drive));
   if (!_g_variant_equal0 (old_value, value))
     ret = TRUE;
   udisks_drive_set_configuration (UDISKS_DRIVE (drive), value);
 
-  if (key_file != NULL)
-    g_key_file_free (key_file);
   if (value != NULL)
     g_variant_unref (value);
 
@@ -1092,12 +981,8 @@ handle_set_configuration (UDisksDrive           *_drive,
   UDisksLinuxDriveObject *object;
   const gchar *action_id;
   const gchar *message;
-  GKeyFile *key_file = NULL;
+  const gchar *id;
   GError *error = NULL;
-  gchar *path = NULL;
-  gchar *data = NULL;
-  gsize data_len;
-  guint n;
 
   object = udisks_daemon_util_dup_object (drive, &error);
   if (object == NULL)
@@ -1126,85 +1011,467 @@ handle_set_configuration (UDisksDrive           *_drive,
                                                     invocation))
     goto out;
 
-  path = configuration_get_path (drive, daemon);
-  if (path == NULL)
+  id = udisks_drive_get_id (UDISKS_DRIVE (drive));
+  if (id == NULL || strlen (id) == 0)
     {
       g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
                                              "Drive has no persistent unique id");
       goto out;
     }
 
-  key_file = g_key_file_new ();
-  if (!g_key_file_load_from_file (key_file,
-                                  path,
-                                  G_KEY_FILE_KEEP_COMMENTS | G_KEY_FILE_KEEP_TRANSLATIONS,
-                                  &error))
+  if (!udisks_drive_config_store_write (udisks_daemon_get_drive_config_store (daemon),
+                                        id,
+                                        configuration,
+                                        &error))
     {
-      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  udisks_drive_complete_set_configuration (UDISKS_DRIVE (drive), invocation);
+
+ out:
+  g_clear_object (&object);
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Block queue attributes that can be set through the drive configuration, in
+ * the order they are applied. The scheduler goes first since switching it
+ * resets nr_requests.
+ */
+static const struct
+{
+  const gchar *key;
+  const gchar *attr;
+  const GVariantType *type;
+} queue_attributes[] =
+{
+  {"queue-scheduler",      "scheduler",      G_VARIANT_TYPE_STRING},
+  {"queue-read-ahead-kb",  "read_ahead_kb",  G_VARIANT_TYPE_UINT32},
+  {"queue-nr-requests",    "nr_requests",    G_VARIANT_TYPE_UINT32},
+  {"queue-rq-affinity",    "rq_affinity",    G_VARIANT_TYPE_UINT32},
+  {"queue-write-cache",    "write_cache",    G_VARIANT_TYPE_STRING},
+  {"queue-max-sectors-kb", "max_sectors_kb", G_VARIANT_TYPE_UINT32},
+};
+
+/* Returns the current value of the queue attribute @attr of the block device
+ * at @sysfs_path or %NULL. For the scheduler this is the active one, i.e. the
+ * one in brackets.
+ */
+static gchar *
+read_queue_attribute (const gchar *sysfs_path,
+                      const gchar *attr)
+{
+  gchar *path;
+  gchar *contents = NULL;
+  gchar *begin;
+  gchar *end;
+  gchar *ret = NULL;
+
+  path = g_build_filename (sysfs_path, "queue", attr, NULL);
+  if (!g_file_get_contents (path, &contents, NULL, NULL))
+    goto out;
+
+  g_strstrip (contents);
+  begin = strchr (contents, '[');
+  end = begin != NULL ? strchr (begin, ']') : NULL;
+  if (end != NULL)
+    ret = g_strndup (begin + 1, end - begin - 1);
+  else
+    ret = g_strdup (contents);
+
+ out:
+  g_free (contents);
+  g_free (path);
+  return ret;
+}
+
+static gboolean
+write_queue_attribute (const gchar  *sysfs_path,
+                       const gchar  *attr,
+                       const gchar  *value,
+                       GError      **error)
+{
+  gchar *path;
+  gint fd;
+  gboolean ret = FALSE;
+
+  path = g_build_filename (sysfs_path, "queue", attr, NULL);
+  fd = open (path, O_WRONLY | O_CLOEXEC);
+  if (fd == -1 || write (fd, value, strlen (value)) != (ssize_t) strlen (value))
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error writing '%s' to %s: %m", value, path);
+      goto out;
+    }
+
+  ret = TRUE;
+
+ out:
+  if (fd != -1)
+    close (fd);
+  g_free (path);
+  return ret;
+}
+
+/* Checks @configuration only contains known queue settings with sane values
+ * for @device, which may be %NULL if the drive has no block device.
+ */
+static gboolean
+validate_queue_configuration (GVariant           *configuration,
+                              UDisksLinuxDevice  *device,
+                              GError            **error)
+{
+  const gchar *sysfs_path = NULL;
+  GVariantIter iter;
+  const gchar *key;
+  GVariant *value = NULL;
+  gboolean ret = FALSE;
+
+  if (device != NULL)
+    sysfs_path = g_udev_device_get_sysfs_path (device->udev_device);
+
+  g_variant_iter_init (&iter, configuration);
+  while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+    {
+      guint n;
+
+      for (n = 0; n < G_N_ELEMENTS (queue_attributes); n++)
         {
-          g_dbus_method_invocation_take_error (invocation, error);
+          if (g_strcmp0 (queue_attributes[n].key, key) == 0)
+            break;
+        }
+
+      if (n == G_N_ELEMENTS (queue_attributes))
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                       "Unknown queue setting '%s'", key);
           goto out;
         }
-      /* not a problem, just create a new file */
-      g_key_file_set_comment (key_file,
-                              NULL, /* group_name */
-                              NULL, /* key */
-                              " See udisks(8) for the format of this file.",
-                              NULL);
-      g_clear_error (&error);
-    }
 
-  for (n = 0; n < G_N_ELEMENTS (drive_configuration_mapping); n++)
-    {
-      const VariantKeyfileMapping *mapping = &drive_configuration_mapping[n];
-      GVariant *value = NULL;
+      if (!g_variant_is_of_type (value, queue_attributes[n].type))
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                       "Value for queue setting '%s' must be of type '%.*s'",
+                       key,
+                       (gint) g_variant_type_get_string_length (queue_attributes[n].type),
+                       g_variant_type_peek_string (queue_attributes[n].type));
+          goto out;
+        }
 
-      value = g_variant_lookup_value (configuration, mapping->asv_key, mapping->type);
-      if (value == NULL)
+      if (g_strcmp0 (key, "queue-scheduler") == 0 && sysfs_path != NULL)
         {
-          g_key_file_remove_key (key_file, mapping->group, mapping->key, NULL);
+          gchar *path;
+          gchar *contents = NULL;
+          gchar **schedulers;
+          gboolean found = FALSE;
+          guint m;
+
+          path = g_build_filename (sysfs_path, "queue", "scheduler", NULL);
+          if (g_file_get_contents (path, &contents, NULL, NULL))
+            {
+              g_strstrip (g_strdelimit (g_strdelimit (contents, "[", ' '), "]", ' '));
+              schedulers = g_strsplit_set (contents, " ", -1);
+              for (m = 0; schedulers[m] != NULL; m++)
+                {
+                  if (g_strcmp0 (schedulers[m], g_variant_get_string (value, NULL)) == 0)
+                    found = TRUE;
+                }
+              g_strfreev (schedulers);
+            }
+          g_free (contents);
+          g_free (path);
+          if (!found)
+            {
+              g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_NOT_SUPPORTED,
+                           "I/O scheduler '%s' is not available for the drive",
+                           g_variant_get_string (value, NULL));
+              goto out;
+            }
         }
-      else
+      else if (g_strcmp0 (key, "queue-write-cache") == 0)
         {
-          if (g_variant_type_equal (mapping->type, G_VARIANT_TYPE_INT32))
+          if (g_strcmp0 (g_variant_get_string (value, NULL), "write back") != 0 &&
+              g_strcmp0 (g_variant_get_string (value, NULL), "write through") != 0)
             {
-              g_key_file_set_integer (key_file, mapping->group, mapping->key, g_variant_get_int32 (value));
+              g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                           "Value for queue setting '%s' must be 'write back' or 'write through'", key);
+              goto out;
             }
-          else if (g_variant_type_equal (mapping->type, G_VARIANT_TYPE_BOOLEAN))
+        }
+      else if (g_strcmp0 (key, "queue-rq-affinity") == 0)
+        {
+          if (g_variant_get_uint32 (value) > 2)
             {
-              g_key_file_set_boolean (key_file, mapping->group, mapping->key, g_variant_get_boolean (value));
+              g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                           "Value for queue setting '%s' must be 0, 1 or 2", key);
+              goto out;
             }
-          else
+        }
+      else if (g_strcmp0 (key, "queue-nr-requests") == 0 ||
+               g_strcmp0 (key, "queue-max-sectors-kb") == 0)
+        {
+          if (g_variant_get_uint32 (value) == 0)
             {
-              g_assert_not_reached ();
+              g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                           "Value for queue setting '%s' must be positive", key);
+              goto out;
+            }
+          if (g_strcmp0 (key, "queue-max-sectors-kb") == 0 && sysfs_path != NULL)
+            {
+              gchar *max_hw = read_queue_attribute (sysfs_path, "max_hw_sectors_kb");
+              if (max_hw != NULL && g_variant_get_uint32 (value) > g_ascii_strtoull (max_hw, NULL, 10))
+                {
+                  g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                               "Value for queue setting '%s' exceeds the hardware limit of %s", key, max_hw);
+                  g_free (max_hw);
+                  goto out;
+                }
+              g_free (max_hw);
             }
         }
+
+      g_variant_unref (value);
+      value = NULL;
     }
 
-  data = g_key_file_to_data (key_file, &data_len, NULL);
+  ret = TRUE;
 
-  if (!udisks_daemon_util_file_set_contents (path,
-                                             data,
-                                             data_len,
-                                             0600, /* mode to use if non-existent */
-                                             &error))
+ out:
+  if (value != NULL)
+    g_variant_unref (value);
+  return ret;
+}
+
+static gboolean
+handle_set_queue_configuration (UDisksDrive           *_drive,
+                                GDBusMethodInvocation *invocation,
+                                GVariant              *configuration,
+                                GVariant              *options)
+{
+  UDisksLinuxDrive *drive = UDISKS_LINUX_DRIVE (_drive);
+  UDisksDaemon *daemon;
+  UDisksLinuxDriveObject *object;
+  UDisksLinuxDevice *device = NULL;
+  GVariant *old_configuration = NULL;
+  GVariant *new_configuration = NULL;
+  GVariantBuilder builder;
+  GVariantIter iter;
+  const gchar *key;
+  GVariant *value;
+  const gchar *id;
+  GError *error = NULL;
+
+  object = udisks_daemon_util_dup_object (drive, &error);
+  if (object == NULL)
     {
       g_dbus_method_invocation_take_error (invocation, error);
       goto out;
     }
 
+  daemon = udisks_linux_drive_object_get_daemon (object);
 
-  udisks_drive_complete_set_configuration (UDISKS_DRIVE (drive), invocation);
+  /* Check that the user is actually authorized */
+  if (!udisks_daemon_util_check_authorization_sync (daemon,
+                                                    UDISKS_OBJECT (object),
+                                                    "org.freedesktop.udisks2.modify-drive-settings",
+                                                    options,
+                                                    /* Translators: Shown in authentication dialog when the user
+                                                     * changes settings for a drive.
+                                                     *
+                                                     * Do not translate $(drive), it's a placeholder and will be
+                                                     * replaced by the name of the drive/device in question
+                                                     */
+                                                    N_("Authentication is required to configure settings for $(drive)"),
+                                                    invocation))
+    goto out;
+
+  id = udisks_drive_get_id (UDISKS_DRIVE (drive));
+  if (id == NULL || strlen (id) == 0)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "Drive has no persistent unique id");
+      goto out;
+    }
+
+  device = udisks_linux_drive_object_get_device (object, TRUE /* get_hw */);
+  if (!validate_queue_configuration (configuration, device, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  /* replace the queue settings, keep everything else */
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  old_configuration = udisks_drive_dup_configuration (UDISKS_DRIVE (drive));
+  if (old_configuration != NULL)
+    {
+      g_variant_iter_init (&iter, old_configuration);
+      while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+        {
+          if (!g_str_has_prefix (key, "queue-"))
+            g_variant_builder_add (&builder, "{sv}", key, value);
+          g_variant_unref (value);
+        }
+    }
+  g_variant_iter_init (&iter, configuration);
+  while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+    {
+      g_variant_builder_add (&builder, "{sv}", key, value);
+      g_variant_unref (value);
+    }
+  new_configuration = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  /* the store notifies the provider which applies the configuration */
+  if (!udisks_drive_config_store_write (udisks_daemon_get_drive_config_store (daemon),
+                                        id,
+                                        new_configuration,
+                                        &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  udisks_drive_complete_set_queue_configuration (UDISKS_DRIVE (drive), invocation);
 
  out:
-  g_free (data);
-  g_free (path);
+  if (new_configuration != NULL)
+    g_variant_unref (new_configuration);
+  if (old_configuration != NULL)
+    g_variant_unref (old_configuration);
+  g_clear_object (&device);
   g_clear_object (&object);
-  if (key_file != NULL)
-    g_key_file_free (key_file);
   return TRUE; /* returning TRUE means that we handled the method invocation */
 }
 
+typedef struct
+{
+  gchar *id;
+  GPtrArray *sysfs_paths;
+  gchar *values[G_N_ELEMENTS (queue_attributes)];
+} ApplyQueueConfData;
+
+static void
+apply_queue_conf_data_free (ApplyQueueConfData *data)
+{
+  guint n;
+
+  for (n = 0; n < G_N_ELEMENTS (queue_attributes); n++)
+    g_free (data->values[n]);
+  g_ptr_array_unref (data->sysfs_paths);
+  g_free (data->id);
+  g_free (data);
+}
+
+static void
+apply_queue_configuration_thread_func (GTask        *task,
+                                       gpointer      source_object,
+                                       gpointer      task_data,
+                                       GCancellable *cancellable)
+{
+  ApplyQueueConfData *data = task_data;
+  GError *error = NULL;
+  guint n;
+  guint m;
+
+  for (m = 0; m < data->sysfs_paths->len; m++)
+    {
+      const gchar *sysfs_path = g_ptr_array_index (data->sysfs_paths, m);
+
+      for (n = 0; n < G_N_ELEMENTS (queue_attributes); n++)
+        {
+          gchar *current;
+
+          if (data->values[n] == NULL)
+            continue;
+
+          /* switching the scheduler drains the queue, don't do it needlessly */
+          current = read_queue_attribute (sysfs_path, queue_attributes[n].attr);
+          if (g_strcmp0 (current, data->values[n]) == 0)
+            {
+              g_free (current);
+              continue;
+            }
+          g_free (current);
+
+          if (!write_queue_attribute (sysfs_path, queue_attributes[n].attr, data->values[n], &error))
+            {
+              udisks_critical ("Error applying queue configuration to %s [%s]: %s (%s, %d)",
+                               sysfs_path, data->id,
+                               error->message, g_quark_to_string (error->domain), error->code);
+              g_clear_error (&error);
+            }
+          else
+            {
+              udisks_notice ("Set queue %s to '%s' on %s [%s]",
+                             queue_attributes[n].attr, data->values[n], sysfs_path, data->id);
+            }
+        }
+    }
+}
+
+/**
+ * udisks_linux_drive_apply_queue_configuration:
+ * @drive: A #UDisksLinuxDrive.
+ * @devices: (element-type UDisksLinuxDevice): The block devices of the drive.
+ * @configuration: The configuration to apply.
+ *
+ * Spawns a thread to apply the block queue settings in @configuration,
+ * if any, to all of @devices. Does not wait for the thread to terminate.
+ */
+void
+udisks_linux_drive_apply_queue_configuration (UDisksLinuxDrive *drive,
+                                              GList            *devices,
+                                              GVariant         *configuration)
+{
+  ApplyQueueConfData *data;
+  gboolean has_conf = FALSE;
+  GTask *task;
+  GList *l;
+  guint n;
+
+  g_return_if_fail (UDISKS_IS_LINUX_DRIVE (drive));
+
+  data = g_new0 (ApplyQueueConfData, 1);
+  data->id = g_strdup (udisks_drive_get_id (UDISKS_DRIVE (drive)));
+  data->sysfs_paths = g_ptr_array_new_with_free_func (g_free);
+  for (l = devices; l != NULL; l = l->next)
+    {
+      UDisksLinuxDevice *device = UDISKS_LINUX_DEVICE (l->data);
+      g_ptr_array_add (data->sysfs_paths, g_strdup (g_udev_device_get_sysfs_path (device->udev_device)));
+    }
+
+  for (n = 0; n < G_N_ELEMENTS (queue_attributes); n++)
+    {
+      GVariant *value;
+
+      value = g_variant_lookup_value (configuration, queue_attributes[n].key, queue_attributes[n].type);
+      if (value == NULL)
+        continue;
+      if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
+        data->values[n] = g_variant_dup_string (value, NULL);
+      else
+        data->values[n] = g_strdup_printf ("%u", g_variant_get_uint32 (value));
+      g_variant_unref (value);
+      has_conf = TRUE;
+    }
+
+  /* don't do anything if none of the configuration is set */
+  if (!has_conf || data->sysfs_paths->len == 0)
+    {
+      apply_queue_conf_data_free (data);
+      return;
+    }
+
+  /* switching the scheduler waits for in-flight I/O so run it in a thread */
+  task = g_task_new (drive, NULL, NULL, NULL);
+  g_task_set_task_data (task, data, (GDestroyNotify) apply_queue_conf_data_free);
+  g_task_run_in_thread (task, apply_queue_configuration_thread_func);
+  g_object_unref (task);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 /* TODO: move to udisksscsi.[ch] similar what we do for ATA with udisksata.[ch] */
@@ -1619,5 +1886,6 @@ drive_iface_init (UDisksDriveIface *iface)
 {
   iface->handle_eject = handle_eject;
   iface->handle_set_configuration = handle_set_configuration;
+  iface->handle_set_queue_configuration = handle_set_queue_configuration;
   iface->handle_power_off = handle_power_off;
 }
@@ -33,6 +33,9 @@ GType        udisks_linux_drive_get_type (void) G_GNUC_CONST;
 UDisksDrive *udisks_linux_drive_new      (void);
 gboolean     udisks_linux_drive_update   (UDisksLinuxDrive       *drive,
                                           UDisksLinuxDriveObject *object);
+void         udisks_linux_drive_apply_queue_configuration (UDisksLinuxDrive *drive,
+                                                           GList            *devices,
+                                                           GVariant         *configuration);
 
 G_END_DECLS
 
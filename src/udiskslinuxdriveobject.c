@@ -34,6 +34,7 @@
 #include "udiskslinuxdriveata.h"
 #include "udiskslinuxblockobject.h"
 #include "udiskslinuxdevice.h"
+#include "udisksdevicegraph.h"
 #include "udisksmodulemanager.h"
 #include "udisksmodule.h"
 #include "udisksmoduleobject.h"
@@ -620,6 +621,7 @@ drive_ata_update (UDisksObject   *object,
 /* ---------------------------------------------------------------------------------------------------- */
 
 static void apply_configuration (UDisksLinuxDriveObject *object);
+static void apply_queue_configuration (UDisksLinuxDriveObject *object);
 
 static GList *
 find_link_for_sysfs_path (UDisksLinuxDriveObject *object,
@@ -750,10 +752,35 @@ udisks_linux_drive_object_uevent (UDisksLinuxDriveObject *object,
 
   if (conf_changed)
     apply_configuration (object);
+  else if (g_strcmp0 (action, "add") == 0 && device != NULL)
+    {
+      /* a new path of a multipath drive starts with the default queue
+       * settings, the ATA settings live on the drive and are still in place
+       */
+      apply_queue_configuration (object);
+    }
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static void
+apply_queue_configuration (UDisksLinuxDriveObject *object)
+{
+  GVariant *configuration;
+
+  if (object->iface_drive == NULL)
+    return;
+
+  configuration = udisks_drive_dup_configuration (object->iface_drive);
+  if (configuration == NULL)
+    return;
+
+  udisks_linux_drive_apply_queue_configuration (UDISKS_LINUX_DRIVE (object->iface_drive),
+                                                object->devices,
+                                                configuration);
+  g_variant_unref (configuration);
+}
+
 static void
 apply_configuration (UDisksLinuxDriveObject *object)
 {
@@ -767,6 +794,10 @@ apply_configuration (UDisksLinuxDriveObject *object)
   if (configuration == NULL)
     goto out;
 
+  udisks_linux_drive_apply_queue_configuration (UDISKS_LINUX_DRIVE (object->iface_drive),
+                                                object->devices,
+                                                configuration);
+
   device = udisks_linux_drive_object_get_device (object, TRUE /* get_hw */);
   if (device == NULL)
     goto out;
@@ -1047,15 +1078,23 @@ udisks_linux_drive_object_housekeeping (UDisksLinuxDriveObject  *object,
 }
 
 static gboolean
-is_block_unlocked (GList *objects, const gchar *crypto_object_path)
+is_block_unlocked (UDisksDeviceGraph *graph,
+                   UDisksObject      *object)
 {
   gboolean ret = FALSE;
+  UDisksLinuxDevice *device;
+  const gchar *crypto_object_path;
+  GList *children;
   GList *l;
-  for (l = objects; l != NULL; l = l->next)
+
+  /* only the devices built on @object can be its cleartext device */
+  crypto_object_path = g_dbus_object_get_object_path (G_DBUS_OBJECT (object));
+  device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (object));
+  children = udisks_device_graph_get_children (graph, g_udev_device_get_sysfs_path (device->udev_device));
+  for (l = children; l != NULL; l = l->next)
     {
-      UDisksObject *object = UDISKS_OBJECT (l->data);
       UDisksBlock *block;
-      block = udisks_object_peek_block (object);
+      block = udisks_object_peek_block (UDISKS_OBJECT (l->data));
       if (block != NULL)
         {
           if (g_strcmp0 (udisks_block_get_crypto_backing_device (block), crypto_object_path) == 0)
@@ -1066,6 +1105,8 @@ is_block_unlocked (GList *objects, const gchar *crypto_object_path)
         }
     }
  out:
+  g_list_free_full (children, g_object_unref);
+  g_object_unref (device);
   return ret;
 }
 
@@ -1085,35 +1126,44 @@ udisks_linux_drive_object_is_not_in_use (UDisksLinuxDriveObject  *object,
                                          GCancellable            *cancellable,
                                          GError                 **error)
 {
-  GDBusObjectManagerServer *object_manager;
+  UDisksDeviceGraph *graph;
   const gchar *drive_object_path;
   gboolean ret = TRUE;
+  GList *devices = NULL;
   GList *objects = NULL;
-  GList *l;
+  GList *d, *l;
 
   g_return_val_if_fail (UDISKS_IS_LINUX_DRIVE_OBJECT (object), FALSE);
   g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
   drive_object_path = g_dbus_object_get_object_path (G_DBUS_OBJECT (object));
+  graph = udisks_daemon_get_device_graph (object->daemon);
 
-  object_manager = udisks_daemon_get_object_manager (object->daemon);
-  objects = g_dbus_object_manager_get_objects (G_DBUS_OBJECT_MANAGER (object_manager));
+  /* Collect the whole disk block devices of the drive and everything built on them */
+  devices = udisks_linux_drive_object_get_devices (object);
+  for (d = devices; d != NULL; d = d->next)
+    {
+      const gchar *sysfs_path = g_udev_device_get_sysfs_path (UDISKS_LINUX_DEVICE (d->data)->udev_device);
+      UDisksObject *whole_disk_object;
+
+      whole_disk_object = udisks_device_graph_lookup (graph, sysfs_path);
+      if (whole_disk_object != NULL)
+        objects = g_list_prepend (objects, whole_disk_object);
+      objects = g_list_concat (objects, udisks_device_graph_get_descendants (graph, sysfs_path));
+    }
 
   /* Visit all block devices related to the drive... */
   for (l = objects; l != NULL; l = l->next)
     {
-      GDBusObjectSkeleton *iter_object = G_DBUS_OBJECT_SKELETON (l->data);
+      UDisksObject *iter_object = UDISKS_OBJECT (l->data);
       UDisksBlock *block;
       UDisksFilesystem *filesystem;
 
-      if (!UDISKS_IS_LINUX_BLOCK_OBJECT (iter_object))
-        continue;
-
-      block = udisks_object_peek_block (UDISKS_OBJECT (iter_object));
-      filesystem = udisks_object_peek_filesystem (UDISKS_OBJECT (iter_object));
+      block = udisks_object_peek_block (iter_object);
+      filesystem = udisks_object_peek_filesystem (iter_object);
 
-      if (g_strcmp0 (udisks_block_get_drive (block), drive_object_path) != 0)
+      if (block == NULL || g_strcmp0 (udisks_block_get_drive (block), drive_object_path) != 0)
         continue;
 
       /* bail if block device is mounted */
@@ -1132,7 +1182,7 @@ udisks_linux_drive_object_is_not_in_use (UDisksLinuxDriveObject  *object,
         }
 
       /* bail if block device is unlocked (LUKS) */
-      if (is_block_unlocked (objects, g_dbus_object_get_object_path (G_DBUS_OBJECT (iter_object))))
+      if (is_block_unlocked (graph, iter_object))
         {
           g_set_error (error,
                        UDISKS_ERROR,
@@ -1146,6 +1196,7 @@ udisks_linux_drive_object_is_not_in_use (UDisksLinuxDriveObject  *object,
 
  out:
   g_list_free_full (objects, g_object_unref);
+  g_list_free_full (devices, g_object_unref);
   return ret;
 }
 
@@ -22,6 +22,8 @@
 #include <glib/gi18n-lib.h>
 
 #include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <pwd.h>
 #include <grp.h>
 #include <string.h>
@@ -45,6 +47,7 @@
 #include "udiskscrypttabmonitor.h"
 #include "udisksspawnedjob.h"
 #include "udiskssimplejob.h"
+#include "udisksjobscheduler.h"
 
 #define MAX_TCRYPT_KEYFILES 256
 
@@ -324,23 +327,59 @@ has_option (const gchar *options,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-/* runs in thread dedicated to handling @invocation */
-static gboolean
-handle_unlock (UDisksEncrypted        *encrypted,
-               GDBusMethodInvocation  *invocation,
-               const gchar            *passphrase,
-               GVariant               *options)
+/* Everything needed to unlock one device, see unlock_request_new() */
+typedef struct
 {
-  UDisksObject *object = NULL;
-  UDisksBlock *block;
+  UDisksEncrypted   *encrypted;
+  UDisksObject      *object;
+  UDisksBlock       *block;
+  UDisksState       *state;
+  uid_t              caller_uid;
+  gboolean           is_luks;
+  gboolean           is_bitlk;
+  gchar             *name;
+  gchar             *device;
+  GString           *passphrase;
+  GVariant          *keyfiles_variant;
+  const gchar       *keyfiles[MAX_TCRYPT_KEYFILES];
+  guint32            pim;
+  gboolean           hidden;
+  gboolean           system;
+  gboolean           read_only;
+  guint              dm_flags;
+  gboolean           persistent_flags;
+} UnlockRequest;
+
+static void
+unlock_request_free (UnlockRequest *request)
+{
+  if (request->object != NULL)
+    udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (request->object));
+  if (request->state != NULL)
+    udisks_state_check (request->state);
+  g_free (request->name);
+  g_free (request->device);
+  udisks_string_wipe_and_free (request->passphrase);
+  if (request->keyfiles_variant != NULL)
+    g_variant_unref (request->keyfiles_variant);
+  g_clear_object (&request->object);
+  g_free (request);
+}
+
+/* Checks that @encrypted can be unlocked by the caller and picks the key
+ * and the name to use. The cleanup lock of the device is held until the
+ * returned request is freed, which must happen in the same thread.
+ */
+static UnlockRequest *
+unlock_request_new (UDisksEncrypted        *encrypted,
+                    GDBusMethodInvocation  *invocation,
+                    const gchar            *passphrase,
+                    GVariant               *options,
+                    GError                **error)
+{
+  UnlockRequest *request;
   UDisksDaemon *daemon;
-  UDisksState *state = NULL;
-  gchar *name = NULL;
   UDisksObject *cleartext_object = NULL;
-  UDisksBlock *cleartext_block;
-  UDisksLinuxDevice *cleartext_device = NULL;
-  GError *error = NULL;
-  uid_t caller_uid;
   const gchar *action_id;
   const gchar *message;
   gboolean is_in_crypttab = FALSE;
@@ -348,58 +387,45 @@ handle_unlock (UDisksEncrypted        *encrypted,
   gchar *crypttab_passphrase = NULL;
   gsize crypttab_passphrase_len = 0;
   gchar *crypttab_options = NULL;
-  gchar *device = NULL;
-  gchar *old_hint_encryption_type = NULL;
-  gboolean read_only = FALSE;
-  gboolean is_hidden = FALSE;
-  gboolean is_system = FALSE;
-  guint32 pim = 0;
-  GString *effective_passphrase = NULL;
-  GVariant *keyfiles_variant = NULL;
-  const gchar *keyfiles[MAX_TCRYPT_KEYFILES] = {};
-  CryptoJobData data;
-  gboolean is_luks;
-  gboolean is_bitlk;
   gboolean handle_as_tcrypt;
-  void *open_func;
   const gchar *uuid = NULL;
+  gboolean ret = FALSE;
 
-  object = udisks_daemon_util_dup_object (encrypted, &error);
-  if (object == NULL)
-    {
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
-    }
+  request = g_new0 (UnlockRequest, 1);
+  request->encrypted = encrypted;
+  request->object = udisks_daemon_util_dup_object (encrypted, error);
+  if (request->object == NULL)
+    goto out;
 
-  block = udisks_object_peek_block (object);
-  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
-  state = udisks_daemon_get_state (daemon);
-  is_luks = udisks_linux_block_is_luks (block);
-  is_bitlk = udisks_linux_block_is_bitlk (block);
-  handle_as_tcrypt = udisks_linux_block_is_tcrypt (block) || udisks_linux_block_is_unknown_crypto (block);
+  request->block = udisks_object_peek_block (request->object);
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (request->object));
+  request->state = udisks_daemon_get_state (daemon);
+  request->is_luks = udisks_linux_block_is_luks (request->block);
+  request->is_bitlk = udisks_linux_block_is_bitlk (request->block);
+  handle_as_tcrypt = udisks_linux_block_is_tcrypt (request->block) || udisks_linux_block_is_unknown_crypto (request->block);
 
-  udisks_linux_block_object_lock_for_cleanup (UDISKS_LINUX_BLOCK_OBJECT (object));
-  udisks_state_check_block (state, udisks_linux_block_object_get_device_number (UDISKS_LINUX_BLOCK_OBJECT (object)));
+  udisks_linux_block_object_lock_for_cleanup (UDISKS_LINUX_BLOCK_OBJECT (request->object));
+  udisks_state_check_block (request->state, udisks_linux_block_object_get_device_number (UDISKS_LINUX_BLOCK_OBJECT (request->object)));
 
   /* get TCRYPT options */
   if (handle_as_tcrypt)
     {
-      g_variant_lookup (options, "hidden", "b", &is_hidden);
-      g_variant_lookup (options, "system", "b", &is_system);
-      g_variant_lookup (options, "pim", "u", &pim);
+      g_variant_lookup (options, "hidden", "b", &request->hidden);
+      g_variant_lookup (options, "system", "b", &request->system);
+      g_variant_lookup (options, "pim", "u", &request->pim);
 
       /* get keyfiles */
-      keyfiles_variant = g_variant_lookup_value(options, "keyfiles", G_VARIANT_TYPE_ARRAY);
-      if (keyfiles_variant)
+      request->keyfiles_variant = g_variant_lookup_value(options, "keyfiles", G_VARIANT_TYPE_ARRAY);
+      if (request->keyfiles_variant)
         {
           GVariantIter iter;
           const gchar *path;
           uint i = 0;
 
-          g_variant_iter_init (&iter, keyfiles_variant);
+          g_variant_iter_init (&iter, request->keyfiles_variant);
           while (g_variant_iter_next (&iter, "&s", &path) && i < MAX_TCRYPT_KEYFILES)
             {
-              keyfiles[i] = path;
+              request->keyfiles[i] = path;
               i++;
             }
         }
@@ -411,20 +437,20 @@ handle_unlock (UDisksEncrypted        *encrypted,
    */
 
   /* Fail if the device is not a LUKS or possible TCRYPT device */
-  if (!(is_luks || is_bitlk || handle_as_tcrypt))
+  if (!(request->is_luks || request->is_bitlk || handle_as_tcrypt))
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Device %s does not appear to be a LUKS, BITLK or TCRYPT device",
-                                             udisks_block_get_device (block));
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Device %s does not appear to be a LUKS, BITLK or TCRYPT device",
+                   udisks_block_get_device (request->block));
       goto out;
     }
 
   /* Fail if device is already unlocked */
   cleartext_object = udisks_daemon_wait_for_object_sync (daemon,
                                                          wait_for_cleartext_object,
-                                                         g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (object))),
+                                                         g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (request->object))),
                                                          g_free,
                                                          0, /* timeout_seconds */
                                                          NULL); /* error */
@@ -432,55 +458,48 @@ handle_unlock (UDisksEncrypted        *encrypted,
     {
       UDisksBlock *unlocked_block;
       unlocked_block = udisks_object_peek_block (cleartext_object);
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Device %s is already unlocked as %s",
-                                             udisks_block_get_device (block),
-                                             udisks_block_get_device (unlocked_block));
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Device %s is already unlocked as %s",
+                   udisks_block_get_device (request->block),
+                   udisks_block_get_device (unlocked_block));
       goto out;
     }
 
   /* we need the uid of the caller for the unlocked-crypto-dev file */
-  if (!udisks_daemon_util_get_caller_uid_sync (daemon, invocation, NULL /* GCancellable */, &caller_uid, &error))
-    {
-      g_dbus_method_invocation_return_gerror (invocation, error);
-      g_clear_error (&error);
-      goto out;
-    }
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon, invocation, NULL /* GCancellable */, &request->caller_uid, error))
+    goto out;
 
   /* check if in crypttab file */
-  if (!check_crypttab (block,
+  if (!check_crypttab (request->block,
                        TRUE,
                        &is_in_crypttab,
                        &crypttab_name,
                        &crypttab_passphrase,
                        &crypttab_passphrase_len,
                        &crypttab_options,
-                       &error))
-    {
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
-    }
+                       error))
+    goto out;
 
   /* fallback mechanism: keyfile_contents (for LUKS) -> passphrase -> crypttab_passphrase -> TCRYPT keyfiles -> error (no key) */
-  if (is_luks && udisks_variant_lookup_binary (options, "keyfile_contents", &effective_passphrase))
+  if (request->is_luks && udisks_variant_lookup_binary (options, "keyfile_contents", &request->passphrase))
     {
-      /* effective_passphrase was set to keyfile_contents, nothing more to do here */
+      /* passphrase was set to keyfile_contents, nothing more to do here */
     }
   else if (passphrase && (strlen (passphrase) > 0))
-    effective_passphrase = g_string_new (passphrase);
+    request->passphrase = g_string_new (passphrase);
   else if (is_in_crypttab && crypttab_passphrase != NULL && crypttab_passphrase_len > 0)
-    effective_passphrase = g_string_new_len (crypttab_passphrase, crypttab_passphrase_len);
-  else if (keyfiles[0] != NULL)
-    effective_passphrase = g_string_new (NULL);
+    request->passphrase = g_string_new_len (crypttab_passphrase, crypttab_passphrase_len);
+  else if (request->keyfiles[0] != NULL)
+    request->passphrase = g_string_new (NULL);
   else
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "No key available to unlock device %s",
-                                             udisks_block_get_device (block));
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "No key available to unlock device %s",
+                   udisks_block_get_device (request->block));
       goto out;
     }
 
@@ -494,118 +513,264 @@ handle_unlock (UDisksEncrypted        *encrypted,
    * will be replaced by the name of the drive/device in question
    */
   message = N_("Authentication is required to unlock the encrypted device $(drive)");
-  if (!udisks_daemon_util_setup_by_user (daemon, object, caller_uid))
+  if (!udisks_daemon_util_setup_by_user (daemon, request->object, request->caller_uid))
     {
       if (is_in_crypttab && has_option (crypttab_options, "x-udisks-auth"))
         {
           action_id = "org.freedesktop.udisks2.encrypted-unlock-crypttab";
         }
-      else if (udisks_block_get_hint_system (block))
+      else if (udisks_block_get_hint_system (request->block))
         {
           action_id = "org.freedesktop.udisks2.encrypted-unlock-system";
         }
-      else if (!udisks_daemon_util_on_user_seat (daemon, object, caller_uid))
+      else if (!udisks_daemon_util_on_user_seat (daemon, request->object, request->caller_uid))
         {
           action_id = "org.freedesktop.udisks2.encrypted-unlock-other-seat";
         }
     }
 
-  if (!udisks_daemon_util_check_authorization_sync (daemon,
-                                                    object,
-                                                    action_id,
-                                                    options,
-                                                    message,
-                                                    invocation))
+  if (!udisks_daemon_util_check_authorization_sync_with_error (daemon,
+                                                               request->object,
+                                                               action_id,
+                                                               options,
+                                                               message,
+                                                               invocation,
+                                                               error))
     goto out;
 
   /* calculate the name to use */
   if (is_in_crypttab && crypttab_name != NULL)
-    name = g_strdup (crypttab_name);
+    request->name = g_strdup (crypttab_name);
   else {
-    if (is_luks)
-      name = g_strdup_printf ("luks-%s", udisks_block_get_id_uuid (block));
-    else if (is_bitlk)
+    if (request->is_luks)
+      request->name = g_strdup_printf ("luks-%s", udisks_block_get_id_uuid (request->block));
+    else if (request->is_bitlk)
       {
-        uuid = udisks_block_get_id_uuid (block);
+        uuid = udisks_block_get_id_uuid (request->block);
         if (uuid && g_strcmp0 (uuid, "") != 0)
-          name = g_strdup_printf ("bitlk-%s", uuid);
+          request->name = g_strdup_printf ("bitlk-%s", uuid);
         else
-          name = g_strdup_printf ("bitlk-%" G_GUINT64_FORMAT, udisks_block_get_device_number (block));
+          request->name = g_strdup_printf ("bitlk-%" G_GUINT64_FORMAT, udisks_block_get_device_number (request->block));
       }
     else
       /* TCRYPT devices don't have a UUID, so we use the device number instead */
-      name = g_strdup_printf ("tcrypt-%" G_GUINT64_FORMAT, udisks_block_get_device_number (block));
+      request->name = g_strdup_printf ("tcrypt-%" G_GUINT64_FORMAT, udisks_block_get_device_number (request->block));
   }
 
+  request->device = udisks_block_dup_device (request->block);
+
+  /* unlock as read-only if specified in @options or if the device itself is read-only */
+  g_variant_lookup (options, "read-only", "b", &request->read_only);
+  if (udisks_block_get_read_only (request->block))
+    request->read_only = TRUE;
+
+  /* dm-crypt flags from @options and the crypttab entry, if any */
+  request->dm_flags = crypto_dm_flags_from_options (options);
+  if (request->dm_flags != 0 && !request->is_luks)
+    {
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_NOT_SUPPORTED,
+                   "dm-crypt flags are only supported for LUKS devices");
+      goto out;
+    }
+  if (is_in_crypttab)
+    {
+      /* crypttab entries are shared with systemd-cryptsetup, don't fail
+       * the unlock just because we can't apply them */
+      if (request->is_luks)
+        request->dm_flags |= crypto_dm_flags_from_crypttab_options (crypttab_options);
+      else if (crypto_dm_flags_from_crypttab_options (crypttab_options) != 0)
+        udisks_debug ("Ignoring dm-crypt flags from the crypttab entry of %s, they are only supported for LUKS devices",
+                      udisks_block_get_device (request->block));
+    }
+
+  /* only LUKS2 can store the flags in its header */
+  g_variant_lookup (options, "persistent-flags", "b", &request->persistent_flags);
+  if (g_strcmp0 (udisks_block_get_id_version (request->block), "2") != 0)
+    request->persistent_flags = FALSE;
+
+  ret = TRUE;
+
+ out:
+  g_free (crypttab_name);
+  g_free (crypttab_passphrase);
+  g_free (crypttab_options);
+  g_clear_object (&cleartext_object);
+  if (!ret)
+    {
+      unlock_request_free (request);
+      request = NULL;
+    }
+  return request;
+}
+
+/* Opens the device of @request, may be called from any thread */
+static gboolean
+unlock_request_open (UnlockRequest  *request,
+                     GError        **error)
+{
+  UDisksDaemon *daemon;
+  gchar *old_hint_encryption_type;
+  CryptoJobData data;
+  void *open_func;
+  gchar *command = NULL;
+  gchar *error_message = NULL;
+  GError *local_error = NULL;
+  gboolean ret = FALSE;
+
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (request->object));
+
   /* save old encryption type to be able to restore it */
-  old_hint_encryption_type = udisks_encrypted_dup_hint_encryption_type (encrypted);
+  old_hint_encryption_type = udisks_encrypted_dup_hint_encryption_type (request->encrypted);
 
   /* Set hint_encryption type. We have to do this before the
    * actual unlock, in order to have this set before the device
    * update triggered by the unlock. */
-  if (is_luks)
-    udisks_encrypted_set_hint_encryption_type (encrypted, "LUKS");
-  else if (is_bitlk)
-    udisks_encrypted_set_hint_encryption_type (encrypted, "BITLK");
+  if (request->is_luks)
+    udisks_encrypted_set_hint_encryption_type (request->encrypted, "LUKS");
+  else if (request->is_bitlk)
+    udisks_encrypted_set_hint_encryption_type (request->encrypted, "BITLK");
   else
-    udisks_encrypted_set_hint_encryption_type (encrypted, "TCRYPT");
-
-  device = udisks_block_dup_device (block);
-
-  /* unlock as read-only if specified in @options or if the device itself is read-only */
-  g_variant_lookup (options, "read-only", "b", &read_only);
-  if (udisks_block_get_read_only (block))
-    read_only = TRUE;
-
-  data.device = device;
-  data.map_name = name;
-  data.passphrase = effective_passphrase;
-  data.keyfiles = keyfiles;
-  data.pim = pim;
-  data.hidden = is_hidden;
-  data.system = is_system;
-  data.read_only = read_only;
-
-  if (is_luks)
+    udisks_encrypted_set_hint_encryption_type (request->encrypted, "TCRYPT");
+
+  data.device = request->device;
+  data.map_name = request->name;
+  data.passphrase = request->passphrase;
+  data.keyfiles = request->keyfiles;
+  data.pim = request->pim;
+  data.hidden = request->hidden;
+  data.system = request->system;
+  data.read_only = request->read_only;
+  data.dm_flags = request->dm_flags;
+  data.persistent_flags = request->persistent_flags;
+
+  if (request->is_luks)
     open_func = luks_open_job_func;
-  else if (is_bitlk)
+  else if (request->is_bitlk)
     open_func = bitlk_open_job_func;
   else
     open_func = tcrypt_open_job_func;
 
-  udisks_linux_block_encrypted_lock (block);
-  if (!udisks_daemon_launch_threaded_job_sync (daemon,
-                                               object,
-                                               "encrypted-unlock",
-                                               caller_uid,
-                                               open_func,
-                                               &data,
-                                               NULL, /* user_data_free_func */
-                                               NULL, /* cancellable */
-                                               &error))
+  udisks_linux_block_encrypted_lock (request->block);
+  if (data.dm_flags != 0)
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Error unlocking %s: %s",
-                                             udisks_block_get_device (block),
-                                             error->message);
-      g_clear_error (&error);
+      /* libblockdev can't pass activation flags, use cryptsetup directly */
+      command = crypto_build_luks_open_command (&data);
+      if (!udisks_daemon_launch_spawned_job_gstring_sync (daemon,
+                                                          request->object,
+                                                          "encrypted-unlock",
+                                                          request->caller_uid,
+                                                          NULL, /* cancellable */
+                                                          0,    /* uid_t run_as_uid */
+                                                          0,    /* uid_t run_as_euid */
+                                                          NULL, /* gint *out_status */
+                                                          &error_message,
+                                                          request->passphrase,
+                                                          "%s", command))
+        {
+          local_error = g_error_new_literal (UDISKS_ERROR, UDISKS_ERROR_FAILED, error_message);
+        }
+    }
+  else
+    {
+      udisks_daemon_launch_threaded_job_sync (daemon,
+                                              request->object,
+                                              "encrypted-unlock",
+                                              request->caller_uid,
+                                              open_func,
+                                              &data,
+                                              NULL, /* user_data_free_func */
+                                              NULL, /* cancellable */
+                                              &local_error);
+    }
+
+  if (local_error != NULL)
+    {
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Error unlocking %s: %s",
+                   udisks_block_get_device (request->block),
+                   local_error->message);
+      g_clear_error (&local_error);
 
       /* Restore the old encryption type if the unlock failed, because
        * in this case we don't know for sure if we used the correct
        * encryption type. */
-      udisks_encrypted_set_hint_encryption_type (encrypted, old_hint_encryption_type);
-      udisks_linux_block_encrypted_unlock (block);
+      udisks_encrypted_set_hint_encryption_type (request->encrypted, old_hint_encryption_type);
+      udisks_linux_block_encrypted_unlock (request->block);
       goto out;
     }
 
-  udisks_linux_block_encrypted_unlock (block);
+  udisks_linux_block_encrypted_unlock (request->block);
+  ret = TRUE;
+
+ out:
+  g_free (command);
+  g_free (error_message);
+  g_free (old_hint_encryption_type);
+  return ret;
+}
+
+/* Records that @request has been unlocked as @cleartext_object */
+static void
+unlock_request_finish (UnlockRequest *request,
+                       UDisksObject  *cleartext_object)
+{
+  UDisksBlock *cleartext_block;
+  UDisksLinuxDevice *cleartext_device;
+
+  cleartext_block = udisks_object_peek_block (cleartext_object);
+
+  udisks_notice ("Unlocked device %s as %s",
+                 udisks_block_get_device (request->block),
+                 udisks_block_get_device (cleartext_block));
+
+  cleartext_device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (cleartext_object));
+
+  /* update the unlocked-crypto-dev file */
+  udisks_state_add_unlocked_crypto_dev (request->state,
+                                        udisks_block_get_device_number (cleartext_block),
+                                        udisks_block_get_device_number (request->block),
+                                        g_udev_device_get_sysfs_attr (cleartext_device->udev_device, "dm/uuid"),
+                                        request->caller_uid);
+  g_object_unref (cleartext_device);
+
+  /* ensure property changes are sent before the method return */
+  g_dbus_interface_skeleton_flush (G_DBUS_INTERFACE_SKELETON (request->encrypted));
+}
+
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_unlock (UDisksEncrypted        *encrypted,
+               GDBusMethodInvocation  *invocation,
+               const gchar            *passphrase,
+               GVariant               *options)
+{
+  UnlockRequest *request;
+  UDisksDaemon *daemon;
+  UDisksObject *cleartext_object = NULL;
+  GError *error = NULL;
+
+  request = unlock_request_new (encrypted, invocation, passphrase, options, &error);
+  if (request == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  if (!unlock_request_open (request, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
 
   /* Determine the resulting cleartext object */
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (request->object));
   cleartext_object = udisks_daemon_wait_for_object_sync (daemon,
                                                          wait_for_cleartext_object,
-                                                         g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (object))),
+                                                         g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (request->object))),
                                                          g_free,
                                                          UDISKS_DEFAULT_WAIT_TIMEOUT,
                                                          &error);
@@ -613,55 +778,470 @@ handle_unlock (UDisksEncrypted        *encrypted,
     {
       g_prefix_error (&error,
                       "Error waiting for cleartext object after unlocking '%s': ",
-                      udisks_block_get_device (block));
+                      udisks_block_get_device (request->block));
       g_dbus_method_invocation_take_error (invocation, error);
       goto out;
     }
-  cleartext_block = udisks_object_peek_block (cleartext_object);
 
-  udisks_notice ("Unlocked device %s as %s",
-                 udisks_block_get_device (block),
-                 udisks_block_get_device (cleartext_block));
-
-  cleartext_device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (cleartext_object));
-
-  /* update the unlocked-crypto-dev file */
-  udisks_state_add_unlocked_crypto_dev (state,
-                                        udisks_block_get_device_number (cleartext_block),
-                                        udisks_block_get_device_number (block),
-                                        g_udev_device_get_sysfs_attr (cleartext_device->udev_device, "dm/uuid"),
-                                        caller_uid);
-
-  /* ensure property changes are sent before the method return */
-  g_dbus_interface_skeleton_flush (G_DBUS_INTERFACE_SKELETON (encrypted));
+  unlock_request_finish (request, cleartext_object);
 
   udisks_encrypted_complete_unlock (encrypted,
                                     invocation,
                                     g_dbus_object_get_object_path (G_DBUS_OBJECT (cleartext_object)));
 
  out:
-  if (object != NULL)
-    udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (object));
-  if (state != NULL)
-    udisks_state_check (state);
-  g_free (device);
-  g_free (crypttab_name);
-  g_free (crypttab_passphrase);
-  g_free (crypttab_options);
-  g_free (name);
-  g_free (old_hint_encryption_type);
-  if (keyfiles_variant)
-    g_variant_unref (keyfiles_variant);
-  g_clear_object (&cleartext_device);
   g_clear_object (&cleartext_object);
-  g_clear_object (&object);
-  udisks_string_wipe_and_free (effective_passphrase);
+  if (request != NULL)
+    unlock_request_free (request);
 
   return TRUE; /* returning TRUE means that we handled the method invocation */
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Key derivation with LUKS2 and Argon2 needs up to a gigabyte of memory
+ * and several CPUs for every device. UnlockMany() reads the cost of each
+ * device's most expensive keyslot from the LUKS2 header and only unlocks
+ * as many devices at the same time as the memory and CPUs allow.
+ */
+
+#define LUKS2_DEFAULT_KDF_MEMORY (G_GUINT64_CONSTANT (1048576) * 1024)
+#define LUKS2_DEFAULT_KDF_CPUS   4
+#define LUKS2_MAX_HDR_SIZE       (4 * 1024 * 1024)
+
+/* Returns the largest value of the "@key": <number> pairs in @json */
+static guint64
+json_max_number (const gchar *json,
+                 const gchar *key)
+{
+  gchar *needle;
+  const gchar *p;
+  guint64 ret = 0;
+
+  needle = g_strdup_printf ("\"%s\":", key);
+  for (p = strstr (json, needle); p != NULL; p = strstr (p, needle))
+    {
+      p += strlen (needle);
+      while (g_ascii_isspace (*p))
+        p++;
+      ret = MAX (ret, g_ascii_strtoull (p, NULL, 10));
+    }
+  g_free (needle);
+  return ret;
+}
+
+static void
+get_kdf_cost (UnlockRequest *request,
+              guint64       *out_memory,
+              guint         *out_cpus)
+{
+  guchar hdr[4096];
+  gchar *json = NULL;
+  guint64 hdr_size = 0;
+  gint fd = -1;
+  guint n;
+
+  /* PBKDF2 as used by LUKS1, BITLK and TCRYPT needs neither */
+  *out_memory = 0;
+  *out_cpus = 1;
+  if (!request->is_luks)
+    return;
+
+  *out_memory = LUKS2_DEFAULT_KDF_MEMORY;
+  *out_cpus = LUKS2_DEFAULT_KDF_CPUS;
+
+  fd = open (request->device, O_RDONLY | O_CLOEXEC);
+  if (fd < 0 || pread (fd, hdr, sizeof (hdr), 0) != sizeof (hdr))
+    goto out;
+
+  /* magic, big-endian version and header size, see the LUKS2 on-disk format */
+  if (memcmp (hdr, "LUKS\xba\xbe", 6) != 0)
+    goto out;
+  if (hdr[6] != 0 || hdr[7] != 2)
+    {
+      *out_memory = 0;
+      *out_cpus = 1;
+      goto out;
+    }
+  for (n = 0; n < 8; n++)
+    hdr_size = (hdr_size << 8) | hdr[8 + n];
+  if (hdr_size <= sizeof (hdr) || hdr_size > LUKS2_MAX_HDR_SIZE)
+    goto out;
+
+  json = g_malloc0 (hdr_size - sizeof (hdr) + 1);
+  if (pread (fd, json, hdr_size - sizeof (hdr), sizeof (hdr)) != (ssize_t) (hdr_size - sizeof (hdr)))
+    goto out;
+
+  /* argon2 memory cost is in KiB, PBKDF2 keyslots have neither key */
+  *out_memory = json_max_number (json, "memory") * 1024;
+  *out_cpus = MAX (json_max_number (json, "cpus"), 1);
+
+ out:
+  if (fd >= 0)
+    close (fd);
+  g_free (json);
+}
+
+/* Returns the memory available for new allocations in bytes, see proc(5) */
+static guint64
+get_available_memory (void)
+{
+  gchar *contents = NULL;
+  const gchar *p;
+  guint64 ret = 0;
+
+  if (g_file_get_contents ("/proc/meminfo", &contents, NULL, NULL))
+    {
+      p = strstr (contents, "MemAvailable:");
+      if (p != NULL)
+        ret = g_ascii_strtoull (p + strlen ("MemAvailable:"), NULL, 10) * 1024;
+      g_free (contents);
+    }
+  if (ret == 0)
+    ret = (guint64) sysconf (_SC_AVPHYS_PAGES) * sysconf (_SC_PAGESIZE);
+
+  return ret;
+}
+
+typedef struct
+{
+  GMutex   lock;
+  GCond    cond;
+  guint64  memory_budget;
+  guint64  memory_in_use;
+  guint    num_cpus;
+  guint    cpus_in_use;
+  guint    num_running;
+} UnlockManyLimits;
+
+/* Waits until there is enough memory and CPUs to unlock another device.
+ * A device is always let through when nothing else is running, even if
+ * it needs more than the budget.
+ */
+static void
+unlock_many_limits_acquire (UnlockManyLimits *limits,
+                            guint64           memory,
+                            guint             cpus)
+{
+  g_mutex_lock (&limits->lock);
+  while (limits->num_running > 0 &&
+         (limits->memory_in_use + memory > limits->memory_budget ||
+          limits->cpus_in_use + cpus > limits->num_cpus))
+    g_cond_wait (&limits->cond, &limits->lock);
+  limits->memory_in_use += memory;
+  limits->cpus_in_use += cpus;
+  limits->num_running++;
+  g_mutex_unlock (&limits->lock);
+}
+
+static void
+unlock_many_limits_release (UnlockManyLimits *limits,
+                            guint64           memory,
+                            guint             cpus)
+{
+  g_mutex_lock (&limits->lock);
+  limits->memory_in_use -= memory;
+  limits->cpus_in_use -= cpus;
+  limits->num_running--;
+  g_cond_broadcast (&limits->cond);
+  g_mutex_unlock (&limits->lock);
+}
+
+typedef struct
+{
+  UnlockRequest    *request;
+  UDisksObject     *cleartext_object;
+  GError           *error;
+} UnlockManyDevice;
+
+static void
+unlock_many_device_free (UnlockManyDevice *device)
+{
+  if (device->request != NULL)
+    unlock_request_free (device->request);
+  g_clear_object (&device->cleartext_object);
+  g_clear_error (&device->error);
+  g_free (device);
+}
+
+static void
+unlock_many_worker (gpointer data,
+                    gpointer user_data)
+{
+  UnlockManyDevice *device = data;
+  UnlockManyLimits *limits = user_data;
+  guint64 memory;
+  guint cpus;
+
+  get_kdf_cost (device->request, &memory, &cpus);
+  unlock_many_limits_acquire (limits, memory, cpus);
+  unlock_request_open (device->request, &device->error);
+  unlock_many_limits_release (limits, memory, cpus);
+}
+
+/* like wait_for_cleartext_object() but for all the opened devices at once */
+static UDisksObject **
+wait_for_cleartext_objects (UDisksDaemon *daemon,
+                            gpointer      user_data)
+{
+  GPtrArray *opened = user_data;
+  GHashTable *cleartext_objects;
+  UDisksObject **ret;
+  GList *objects, *l;
+  guint n;
+
+  /* crypto backing device object path -> cleartext object */
+  cleartext_objects = g_hash_table_new (g_str_hash, g_str_equal);
+  objects = udisks_daemon_get_objects (daemon);
+  for (l = objects; l != NULL; l = l->next)
+    {
+      UDisksBlock *block = udisks_object_peek_block (UDISKS_OBJECT (l->data));
+
+      if (block != NULL && g_strcmp0 (udisks_block_get_crypto_backing_device (block), "/") != 0)
+        g_hash_table_insert (cleartext_objects, (gpointer) udisks_block_get_crypto_backing_device (block), l->data);
+    }
+
+  ret = g_new0 (UDisksObject *, opened->len + 1);
+  for (n = 0; n < opened->len; n++)
+    {
+      UnlockManyDevice *device = opened->pdata[n];
+      UDisksObject *cleartext_object;
+
+      cleartext_object = g_hash_table_lookup (cleartext_objects,
+                                              g_dbus_object_get_object_path (G_DBUS_OBJECT (device->request->object)));
+      if (cleartext_object == NULL)
+        break;
+      ret[n] = g_object_ref (cleartext_object);
+    }
+  if (n < opened->len)
+    {
+      for (n = 0; ret[n] != NULL; n++)
+        g_object_unref (ret[n]);
+      g_clear_pointer (&ret, g_free);
+    }
+
+  g_hash_table_destroy (cleartext_objects);
+  g_list_free_full (objects, g_object_unref);
+  return ret;
+}
+
+/**
+ * udisks_linux_encrypted_unlock_many_sync:
+ * @daemon: A #UDisksDaemon.
+ * @invocation: The #GDBusMethodInvocation of the Manager.UnlockMany() call.
+ * @devices: A #GVariant of type <literal>a(osa{sv})</literal> with the devices to unlock.
+ * @options: Options used for authorization and as defaults for the options of each device.
+ * @error: Return location for error or %NULL.
+ *
+ * Unlocks @devices in parallel, see the Manager.UnlockMany() D-Bus
+ * method. The number of devices unlocked at the same time is limited
+ * by the memory and CPUs their key derivation functions need. The
+ * cleartext devices of all the devices are waited for together.
+ *
+ * Must not be called from the main thread.
+ *
+ * Returns: (transfer full): A #GVariant of type <literal>a(oobs)</literal>
+ * with the result for each device or %NULL if @error is set. Failing to
+ * unlock a device doesn't set @error.
+ */
+GVariant *
+udisks_linux_encrypted_unlock_many_sync (UDisksDaemon           *daemon,
+                                         GDBusMethodInvocation  *invocation,
+                                         GVariant               *devices,
+                                         GVariant               *options,
+                                         GError                **error)
+{
+  UnlockManyLimits limits;
+  GPtrArray *unlock_devices;
+  GPtrArray *opened;
+  GThreadPool *pool;
+  UDisksObject **cleartext_objects = NULL;
+  GVariantBuilder builder;
+  GVariantIter iter;
+  const gchar *object_path;
+  const gchar *passphrase;
+  GVariant *device_options;
+  GError *wait_error = NULL;
+  GVariant *ret = NULL;
+  guint n, m;
+
+  memset (&limits, '\0', sizeof (limits));
+  g_mutex_init (&limits.lock);
+  g_cond_init (&limits.cond);
+  limits.memory_budget = get_available_memory () / 2;
+  limits.num_cpus = g_get_num_processors ();
+
+  unlock_devices = g_ptr_array_new_with_free_func ((GDestroyNotify) unlock_many_device_free);
+  opened = g_ptr_array_new ();
+
+  /* Check every device and the authorization for it up front, from this
+   * thread, so that the user is not asked by several threads at once.
+   */
+  g_variant_iter_init (&iter, devices);
+  while (g_variant_iter_next (&iter, "(&o&s@a{sv})", &object_path, &passphrase, &device_options))
+    {
+      UnlockManyDevice *device;
+      UDisksObject *object;
+      UDisksEncrypted *encrypted = NULL;
+      GVariantDict dict;
+      GVariantIter option_iter;
+      GVariant *merged_options;
+      const gchar *key;
+      GVariant *value;
+
+      device = g_new0 (UnlockManyDevice, 1);
+      g_ptr_array_add (unlock_devices, device);
+
+      g_variant_dict_init (&dict, options);
+      g_variant_iter_init (&option_iter, device_options);
+      while (g_variant_iter_next (&option_iter, "{&sv}", &key, &value))
+        {
+          g_variant_dict_insert_value (&dict, key, value);
+          g_variant_unref (value);
+        }
+      merged_options = g_variant_ref_sink (g_variant_dict_end (&dict));
+      g_variant_unref (device_options);
+
+      object = udisks_daemon_find_object (daemon, object_path);
+      if (object != NULL)
+        encrypted = udisks_object_get_encrypted (object);
+      if (encrypted == NULL)
+        {
+          g_set_error (&device->error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Object %s is not an encrypted device", object_path);
+        }
+      else
+        {
+          for (m = 0; m + 1 < unlock_devices->len; m++)
+            {
+              UnlockManyDevice *other = unlock_devices->pdata[m];
+              if (other->request != NULL && other->request->encrypted == encrypted)
+                {
+                  g_set_error (&device->error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                               "Device %s is given more than once", object_path);
+                  break;
+                }
+            }
+          if (device->error == NULL)
+            device->request = unlock_request_new (encrypted, invocation, passphrase, merged_options, &device->error);
+        }
+
+      g_variant_unref (merged_options);
+      g_clear_object (&encrypted);
+      g_clear_object (&object);
+
+      /* not being authorized fails the whole call, as with Unlock() */
+      if (g_error_matches (device->error, UDISKS_ERROR, UDISKS_ERROR_NOT_AUTHORIZED) ||
+          g_error_matches (device->error, UDISKS_ERROR, UDISKS_ERROR_NOT_AUTHORIZED_CAN_OBTAIN) ||
+          g_error_matches (device->error, UDISKS_ERROR, UDISKS_ERROR_NOT_AUTHORIZED_DISMISSED))
+        {
+          g_propagate_error (error, device->error);
+          device->error = NULL;
+          goto out;
+        }
+    }
+
+  /* The pool only needs as many threads as there are CPUs, the limits
+   * decide how many devices are actually unlocked at the same time.
+   */
+  for (n = 0; n < unlock_devices->len; n++)
+    {
+      UnlockManyDevice *device = unlock_devices->pdata[n];
+      if (device->request != NULL)
+        g_ptr_array_add (opened, device);
+    }
+  if (opened->len > 0)
+    {
+      pool = g_thread_pool_new (unlock_many_worker,
+                                &limits,
+                                MIN (opened->len, limits.num_cpus),
+                                FALSE,
+                                error);
+      if (pool == NULL)
+        goto out;
+      for (n = 0; n < opened->len; n++)
+        g_thread_pool_push (pool, opened->pdata[n], NULL);
+
+      /* wait for all the devices to be opened */
+      g_thread_pool_free (pool, FALSE, TRUE);
+    }
+
+  /* Wait for the cleartext devices of all the opened devices at once */
+  g_ptr_array_set_size (opened, 0);
+  for (n = 0; n < unlock_devices->len; n++)
+    {
+      UnlockManyDevice *device = unlock_devices->pdata[n];
+      if (device->request != NULL && device->error == NULL)
+        g_ptr_array_add (opened, device);
+    }
+  if (opened->len > 0)
+    {
+      cleartext_objects = udisks_daemon_wait_for_objects_sync (daemon,
+                                                               wait_for_cleartext_objects,
+                                                               opened,
+                                                               NULL,
+                                                               UDISKS_DEFAULT_WAIT_TIMEOUT,
+                                                               &wait_error);
+    }
+  for (n = 0; n < opened->len; n++)
+    {
+      UnlockManyDevice *device = opened->pdata[n];
+
+      if (cleartext_objects != NULL)
+        {
+          device->cleartext_object = cleartext_objects[n];
+        }
+      else
+        {
+          /* pick up those that did show up */
+          device->cleartext_object = udisks_daemon_wait_for_object_sync (daemon,
+                                                                         wait_for_cleartext_object,
+                                                                         g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (device->request->object))),
+                                                                         g_free,
+                                                                         0, /* timeout_seconds */
+                                                                         NULL); /* error */
+          if (device->cleartext_object == NULL)
+            {
+              device->error = g_error_copy (wait_error);
+              g_prefix_error (&device->error,
+                              "Error waiting for cleartext object after unlocking '%s': ",
+                              udisks_block_get_device (device->request->block));
+              continue;
+            }
+        }
+      unlock_request_finish (device->request, device->cleartext_object);
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(oobs)"));
+  g_variant_iter_init (&iter, devices);
+  n = 0;
+  while (g_variant_iter_next (&iter, "(&o&s@a{sv})", &object_path, &passphrase, &device_options))
+    {
+      UnlockManyDevice *device = unlock_devices->pdata[n++];
+
+      g_variant_unref (device_options);
+      if (device->error != NULL)
+        udisks_warning ("Error unlocking %s: %s", object_path, device->error->message);
+      g_variant_builder_add (&builder, "(oobs)",
+                             object_path,
+                             device->error == NULL ? g_dbus_object_get_object_path (G_DBUS_OBJECT (device->cleartext_object)) : "/",
+                             device->error == NULL,
+                             device->error != NULL ? device->error->message : "");
+    }
+  ret = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+ out:
+  g_ptr_array_unref (opened);
+  g_ptr_array_unref (unlock_devices);
+  g_free (cleartext_objects);
+  g_clear_error (&wait_error);
+  g_cond_clear (&limits.cond);
+  g_mutex_clear (&limits.lock);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 gboolean
 udisks_linux_encrypted_lock (UDisksLinuxEncrypted   *encrypted,
                              GDBusMethodInvocation  *invocation,
@@ -899,6 +1479,7 @@ handle_change_passphrase (UDisksEncrypted        *encrypted,
   UDisksObject *object = NULL;
   UDisksBlock *block;
   UDisksDaemon *daemon;
+  gpointer reservation = NULL;
   UDisksState *state = NULL;
   uid_t caller_uid;
   const gchar *action_id;
@@ -917,6 +1498,9 @@ handle_change_passphrase (UDisksEncrypted        *encrypted,
   daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
   state = udisks_daemon_get_state (daemon);
 
+  /* wait for our turn on the drive before taking the cleanup lock */
+  reservation = udisks_job_scheduler_reserve_sync (udisks_daemon_get_job_scheduler (daemon),
+                                                   object, "encrypted-modify", NULL);
   udisks_linux_block_object_lock_for_cleanup (UDISKS_LINUX_BLOCK_OBJECT (object));
   udisks_state_check_block (state, udisks_linux_block_object_get_device_number (UDISKS_LINUX_BLOCK_OBJECT (object)));
 
@@ -1005,6 +1589,8 @@ handle_change_passphrase (UDisksEncrypted        *encrypted,
  out:
   if (object != NULL)
     udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (object));
+  if (reservation != NULL)
+    udisks_job_scheduler_release_reservation (udisks_daemon_get_job_scheduler (daemon), reservation);
   if (state != NULL)
     udisks_state_check (state);
   g_free (device);
@@ -1029,6 +1615,7 @@ handle_resize (UDisksEncrypted       *encrypted,
   UDisksObject *cleartext_object = NULL;
   UDisksBlock *cleartext_block;
   UDisksDaemon *daemon;
+  gpointer reservation = NULL;
   UDisksState *state = NULL;
   uid_t caller_uid;
   const gchar *action_id = NULL;
@@ -1048,6 +1635,9 @@ handle_resize (UDisksEncrypted       *encrypted,
   daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
   state = udisks_daemon_get_state (daemon);
 
+  /* wait for our turn on the drive before taking the cleanup lock */
+  reservation = udisks_job_scheduler_reserve_sync (udisks_daemon_get_job_scheduler (daemon),
+                                                   object, "encrypted-resize", NULL);
   udisks_linux_block_object_lock_for_cleanup (UDISKS_LINUX_BLOCK_OBJECT (object));
   udisks_state_check_block (state, udisks_linux_block_object_get_device_number (UDISKS_LINUX_BLOCK_OBJECT (object)));
 
@@ -1164,6 +1754,8 @@ handle_resize (UDisksEncrypted       *encrypted,
  out:
   if (object != NULL)
     udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (object));
+  if (reservation != NULL)
+    udisks_job_scheduler_release_reservation (udisks_daemon_get_job_scheduler (daemon), reservation);
   if (state != NULL)
     udisks_state_check (state);
   g_clear_object (&cleartext_object);
@@ -1175,6 +1767,160 @@ handle_resize (UDisksEncrypted       *encrypted,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* runs in thread dedicated to handling method call */
+static gboolean
+handle_reencrypt (UDisksEncrypted       *encrypted,
+                  GDBusMethodInvocation *invocation,
+                  GVariant              *options)
+{
+  UDisksObject *object = NULL;
+  UDisksBlock *block;
+  UDisksDaemon *daemon;
+  gpointer reservation = NULL;
+  UDisksState *state = NULL;
+  uid_t caller_uid;
+  const gchar *action_id = NULL;
+  const gchar *message = NULL;
+  GError *error = NULL;
+  gchar *device = NULL;
+  CryptoJobData data = { NULL, NULL, NULL, NULL, NULL, 0, 0, FALSE, FALSE, FALSE, NULL };
+
+  object = udisks_daemon_util_dup_object (encrypted, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  block = udisks_object_peek_block (object);
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
+  state = udisks_daemon_get_state (daemon);
+
+  /* wait for our turn on the drive before taking the cleanup lock */
+  reservation = udisks_job_scheduler_reserve_sync (udisks_daemon_get_job_scheduler (daemon),
+                                                   object, "encrypted-reencrypt", NULL);
+  udisks_linux_block_object_lock_for_cleanup (UDISKS_LINUX_BLOCK_OBJECT (object));
+  udisks_state_check_block (state, udisks_linux_block_object_get_device_number (UDISKS_LINUX_BLOCK_OBJECT (object)));
+
+  /* Only LUKS2 supports (online) re-encryption */
+  if (!udisks_linux_block_is_luks (block))
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             UDISKS_ERROR,
+                                             UDISKS_ERROR_FAILED,
+                                             "Device %s does not appear to be a LUKS device",
+                                             udisks_block_get_device (block));
+      goto out;
+    }
+  if (g_strcmp0 (udisks_block_get_id_version (block), "2") != 0)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             UDISKS_ERROR,
+                                             UDISKS_ERROR_NOT_SUPPORTED,
+                                             "Re-encryption is only supported for LUKS2 devices");
+      goto out;
+    }
+
+  if (udisks_variant_lookup_binary (options, "keyfile_contents", &data.passphrase))
+    ;
+  else if (udisks_variant_lookup_binary (options, "passphrase", &data.passphrase))
+    ;
+  else
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             UDISKS_ERROR,
+                                             UDISKS_ERROR_FAILED,
+                                             "No key available to re-encrypt device %s",
+                                             udisks_block_get_device (block));
+      goto out;
+    }
+
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon, invocation, NULL /* GCancellable */, &caller_uid, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  action_id = "org.freedesktop.udisks2.modify-device";
+  /* Translators: Shown in authentication dialog when the user
+   * requests re-encrypting an encrypted block device.
+   *
+   * Do not translate $(drive), it's a placeholder and
+   * will be replaced by the name of the drive/device in question
+   */
+  message = N_("Authentication is required to re-encrypt the encrypted device $(drive)");
+  if (! udisks_daemon_util_setup_by_user (daemon, object, caller_uid))
+    {
+      if (udisks_block_get_hint_system (block))
+        {
+          action_id = "org.freedesktop.udisks2.modify-device-system";
+        }
+      else if (! udisks_daemon_util_on_user_seat (daemon, UDISKS_OBJECT (object), caller_uid))
+        {
+          action_id = "org.freedesktop.udisks2.modify-device-other-seat";
+        }
+    }
+
+  if (! udisks_daemon_util_check_authorization_sync (daemon,
+                                                     object,
+                                                     action_id,
+                                                     options,
+                                                     message,
+                                                     invocation))
+    goto out;
+
+  device = udisks_block_dup_device (block);
+  data.device = device;
+  g_variant_lookup (options, "cipher", "&s", &data.cipher);
+  g_variant_lookup (options, "key-size", "u", &data.key_size);
+  g_variant_lookup (options, "max-bandwidth", "t", &data.max_bandwidth);
+
+  /* The encrypted lock is not held here, the run may take hours and
+   * would block updating the object on uevents meanwhile. cryptsetup
+   * takes the LUKS2 metadata lock itself for every header update. */
+  if (!udisks_daemon_launch_threaded_job_sync (daemon,
+                                               object,
+                                               "encrypted-reencrypt",
+                                               caller_uid,
+                                               luks_reencrypt_job_func,
+                                               &data,
+                                               NULL, /* user_data_free_func */
+                                               NULL, /* cancellable */
+                                               &error))
+    {
+      if (g_error_matches (error, UDISKS_ERROR, UDISKS_ERROR_CANCELLED))
+        g_dbus_method_invocation_return_gerror (invocation, error);
+      else
+        g_dbus_method_invocation_return_error (invocation,
+                                               UDISKS_ERROR,
+                                               UDISKS_ERROR_FAILED,
+                                               "Error re-encrypting device %s: %s",
+                                               udisks_block_get_device (block),
+                                               error->message);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  udisks_notice ("Re-encrypted device %s", udisks_block_get_device (block));
+  udisks_encrypted_complete_reencrypt (encrypted, invocation);
+
+ out:
+  if (object != NULL)
+    udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (object));
+  if (reservation != NULL)
+    udisks_job_scheduler_release_reservation (udisks_daemon_get_job_scheduler (daemon), reservation);
+  if (state != NULL)
+    udisks_state_check (state);
+  g_free (device);
+  udisks_string_wipe_and_free (data.passphrase);
+  g_clear_object (&object);
+
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static void
 encrypted_iface_init (UDisksEncryptedIface *iface)
 {
@@ -1182,4 +1928,5 @@ encrypted_iface_init (UDisksEncryptedIface *iface)
   iface->handle_lock                = handle_lock;
   iface->handle_change_passphrase   = handle_change_passphrase;
   iface->handle_resize              = handle_resize;
+  iface->handle_reencrypt           = handle_reencrypt;
 }
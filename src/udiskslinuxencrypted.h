@@ -39,6 +39,12 @@ gboolean         udisks_linux_encrypted_lock     (UDisksLinuxEncrypted   *encryp
                                                   GVariant               *options,
                                                   GError                **error);
 
+GVariant        *udisks_linux_encrypted_unlock_many_sync (UDisksDaemon           *daemon,
+                                                          GDBusMethodInvocation  *invocation,
+                                                          GVariant               *devices,
+                                                          GVariant               *options,
+                                                          GError                **error);
+
 G_END_DECLS
 
 #endif /* __UDISKS_LINUX_ENCRYPTED_H__ */
@@ -20,12 +20,124 @@
  *
  */
 
+#include <signal.h>
+#include <string.h>
+
 #include <glib.h>
+#include <gio/gio.h>
 #include <blockdev/crypto.h>
 
 #include "udisksthreadedjob.h"
+#include "udiskslogging.h"
 #include "udiskslinuxencryptedhelpers.h"
 
+/* The flags with their Unlock() option, crypttab(5) option and cryptsetup(8) argument */
+static const struct
+{
+  CryptoDMFlags  flag;
+  const gchar   *option;
+  const gchar   *crypttab_option;
+  const gchar   *cryptsetup_arg;
+} dm_flags_table[] =
+{
+  {CRYPTO_DM_FLAG_ALLOW_DISCARDS,         "allow-discards",         "discard",                "--allow-discards"},
+  {CRYPTO_DM_FLAG_SAME_CPU_CRYPT,         "same-cpu-crypt",         "same-cpu-crypt",         "--perf-same_cpu_crypt"},
+  {CRYPTO_DM_FLAG_SUBMIT_FROM_CRYPT_CPUS, "submit-from-crypt-cpus", "submit-from-crypt-cpus", "--perf-submit_from_crypt_cpus"},
+  {CRYPTO_DM_FLAG_NO_READ_WORKQUEUE,      "no-read-workqueue",      "no-read-workqueue",      "--perf-no_read_workqueue"},
+  {CRYPTO_DM_FLAG_NO_WRITE_WORKQUEUE,     "no-write-workqueue",     "no-write-workqueue",     "--perf-no_write_workqueue"},
+};
+
+/**
+ * crypto_dm_flags_from_options:
+ * @options: Options of an Unlock() call.
+ *
+ * Returns: The #CryptoDMFlags set to %TRUE in @options.
+ */
+guint
+crypto_dm_flags_from_options (GVariant *options)
+{
+  guint ret = 0;
+  guint n;
+
+  for (n = 0; n < G_N_ELEMENTS (dm_flags_table); n++)
+    {
+      gboolean value = FALSE;
+      if (g_variant_lookup (options, dm_flags_table[n].option, "b", &value) && value)
+        ret |= dm_flags_table[n].flag;
+    }
+
+  return ret;
+}
+
+/**
+ * crypto_dm_flags_from_crypttab_options:
+ * @options: The comma-separated options of a crypttab entry.
+ *
+ * Returns: The #CryptoDMFlags present in @options.
+ */
+guint
+crypto_dm_flags_from_crypttab_options (const gchar *options)
+{
+  gchar **tokens;
+  guint ret = 0;
+  guint n, m;
+
+  if (options == NULL)
+    return 0;
+
+  tokens = g_strsplit (options, ",", -1);
+  for (n = 0; tokens[n] != NULL; n++)
+    {
+      for (m = 0; m < G_N_ELEMENTS (dm_flags_table); m++)
+        {
+          if (g_strcmp0 (tokens[n], dm_flags_table[m].crypttab_option) == 0)
+            ret |= dm_flags_table[m].flag;
+        }
+    }
+  g_strfreev (tokens);
+
+  return ret;
+}
+
+/**
+ * crypto_build_luks_open_command:
+ * @data: A #CryptoJobData.
+ *
+ * Builds a cryptsetup(8) command line opening the LUKS device described
+ * by @data with its dm-crypt flags. The passphrase is read from stdin.
+ * libblockdev cannot pass activation flags, so this is used instead of
+ * luks_open_job_func() when any are set.
+ *
+ * Returns: (transfer full): The command line, free with g_free().
+ */
+gchar *
+crypto_build_luks_open_command (const CryptoJobData *data)
+{
+  GString *command;
+  gchar *quoted;
+  guint n;
+
+  command = g_string_new ("cryptsetup open --type luks --key-file=-");
+  if (data->read_only)
+    g_string_append (command, " --readonly");
+  for (n = 0; n < G_N_ELEMENTS (dm_flags_table); n++)
+    {
+      if (data->dm_flags & dm_flags_table[n].flag)
+        g_string_append_printf (command, " %s", dm_flags_table[n].cryptsetup_arg);
+    }
+  if (data->persistent_flags)
+    g_string_append (command, " --persistent");
+
+  quoted = g_shell_quote (data->device);
+  g_string_append_printf (command, " %s", quoted);
+  g_free (quoted);
+  quoted = g_shell_quote (data->map_name);
+  g_string_append_printf (command, " %s", quoted);
+  g_free (quoted);
+
+  return g_string_free (command, FALSE);
+}
+
 gboolean luks_format_job_func (UDisksThreadedJob  *job,
                       GCancellable       *cancellable,
                       gpointer            user_data,
@@ -88,6 +200,254 @@ gboolean luks_change_key_job_func (UDisksThreadedJob  *job,
                                          error);
 }
 
+/* Returns the value of the "@key":"<number>" pair in a cryptsetup --progress-json line */
+static guint64
+progress_json_get (const gchar *line,
+                   const gchar *key)
+{
+  gchar *needle;
+  const gchar *p;
+
+  needle = g_strdup_printf ("\"%s\":\"", key);
+  p = strstr (line, needle);
+  if (p != NULL)
+    p += strlen (needle);
+  g_free (needle);
+
+  return p != NULL ? g_ascii_strtoull (p, NULL, 10) : 0;
+}
+
+/* Sleeps for @usec or until @cancellable is cancelled */
+static void
+sleep_cancellable (GCancellable *cancellable,
+                   gint64        usec)
+{
+  gint64 end;
+
+  end = g_get_monotonic_time () + usec;
+  while (!g_cancellable_is_cancelled (cancellable) && g_get_monotonic_time () < end)
+    g_usleep (MIN (end - g_get_monotonic_time (), G_USEC_PER_SEC / 10));
+}
+
+/**
+ * luks_reencrypt_job_func:
+ *
+ * Re-encrypts a LUKS2 device with a new volume key using cryptsetup(8),
+ * online if the device is unlocked.
+ *
+ * Progress is taken from the byte counts cryptsetup reports once a
+ * second. If @data->max_bandwidth is set, the hotzone is limited to
+ * about a second worth of data and cryptsetup is interrupted as soon as
+ * it gets ahead of the cap. It then finishes the current hotzone and
+ * leaves a checkpoint in the LUKS2 header, after which the job waits
+ * until the average rate drops below the cap and resumes from the
+ * checkpoint with a new cryptsetup run. The device is never left
+ * suspended or with the metadata locked while waiting.
+ *
+ * Cancelling @cancellable interrupts cryptsetup the same way. Running
+ * the job again resumes from the checkpoint.
+ */
+gboolean luks_reencrypt_job_func (UDisksThreadedJob  *job,
+                                  GCancellable       *cancellable,
+                                  gpointer            user_data,
+                                  GError            **error)
+{
+  CryptoJobData *data = (CryptoJobData*) user_data;
+  GPtrArray *argv;
+  GSubprocess *process = NULL;
+  GDataInputStream *output = NULL;
+  GString *messages;
+  gchar *line;
+  gchar *key_size = NULL;
+  gchar *hotzone_size = NULL;
+  guint64 initial_bytes = G_MAXUINT64;
+  guint64 done = 0;
+  guint64 size = 0;
+  gint64 start_time;
+  gboolean resume = FALSE;
+  gboolean ret = FALSE;
+
+  if (data->max_bandwidth > 0)
+    {
+      /* about a second worth of data, in whole 4 KiB sectors */
+      hotzone_size = g_strdup_printf ("--hotzone-size=%" G_GUINT64_FORMAT,
+                                      MAX (data->max_bandwidth & ~((guint64) 4095), 1024 * 1024));
+    }
+
+  messages = g_string_new (NULL);
+  argv = g_ptr_array_new ();
+
+  udisks_job_set_progress_valid (UDISKS_JOB (job), TRUE);
+  udisks_job_set_progress (UDISKS_JOB (job), 0.0);
+
+  start_time = g_get_monotonic_time ();
+  for (;;)
+    {
+      gboolean interrupted = FALSE;
+      gint64 elapsed, due;
+
+      g_ptr_array_set_size (argv, 0);
+      g_ptr_array_add (argv, "cryptsetup");
+      g_ptr_array_add (argv, "reencrypt");
+      g_ptr_array_add (argv, "--batch-mode");
+      g_ptr_array_add (argv, "--key-file=-");
+      g_ptr_array_add (argv, "--progress-json");
+      g_ptr_array_add (argv, "--progress-frequency=1");
+      if (resume)
+        {
+          g_ptr_array_add (argv, "--resume-only");
+        }
+      else
+        {
+          if (data->cipher != NULL)
+            {
+              g_ptr_array_add (argv, "--cipher");
+              g_ptr_array_add (argv, (gpointer) data->cipher);
+            }
+          if (data->key_size > 0)
+            {
+              key_size = g_strdup_printf ("--key-size=%u", data->key_size);
+              g_ptr_array_add (argv, key_size);
+            }
+        }
+      if (hotzone_size != NULL)
+        g_ptr_array_add (argv, hotzone_size);
+      g_ptr_array_add (argv, (gpointer) data->device);
+      g_ptr_array_add (argv, NULL);
+
+      g_string_truncate (messages, 0);
+      process = g_subprocess_newv ((const gchar * const *) argv->pdata,
+                                   G_SUBPROCESS_FLAGS_STDIN_PIPE |
+                                   G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+                                   G_SUBPROCESS_FLAGS_STDERR_MERGE,
+                                   error);
+      if (process == NULL)
+        goto out;
+
+      if (!g_output_stream_write_all (g_subprocess_get_stdin_pipe (process),
+                                      data->passphrase->str, data->passphrase->len,
+                                      NULL, NULL, error) ||
+          !g_output_stream_close (g_subprocess_get_stdin_pipe (process), NULL, error))
+        {
+          g_subprocess_force_exit (process);
+          g_subprocess_wait (process, NULL, NULL);
+          goto out;
+        }
+
+      /* the output is read without @cancellable, cryptsetup has to be
+       * interrupted and waited for to keep the header consistent */
+      output = g_data_input_stream_new (g_subprocess_get_stdout_pipe (process));
+      while ((line = g_data_input_stream_read_line (output, NULL, NULL, NULL)) != NULL)
+        {
+          if (!g_str_has_prefix (line, "{"))
+            {
+              /* not a progress report, keep it for the error message */
+              udisks_debug ("cryptsetup reencrypt %s: %s", data->device, line);
+              g_string_append_printf (messages, "%s\n", line);
+              g_free (line);
+              continue;
+            }
+
+          done = progress_json_get (line, "device_bytes");
+          size = progress_json_get (line, "device_size");
+          g_free (line);
+
+          if (size > 0)
+            {
+              udisks_job_set_bytes (UDISKS_JOB (job), size);
+              udisks_job_set_progress (UDISKS_JOB (job), ((gdouble) done) / size);
+            }
+
+          /* when resuming, the first report already includes the bytes done before */
+          if (initial_bytes == G_MAXUINT64)
+            initial_bytes = done;
+
+          if (interrupted)
+            continue;
+
+          if (g_cancellable_is_cancelled (cancellable))
+            {
+              g_subprocess_send_signal (process, SIGINT);
+              interrupted = TRUE;
+            }
+          else if (data->max_bandwidth > 0 && done > initial_bytes)
+            {
+              elapsed = g_get_monotonic_time () - start_time;
+              due = (gint64) ((done - initial_bytes) * (gdouble) G_USEC_PER_SEC / data->max_bandwidth);
+              udisks_job_set_rate (UDISKS_JOB (job),
+                                   MIN (data->max_bandwidth,
+                                        (guint64) ((done - initial_bytes) * (gdouble) G_USEC_PER_SEC / MAX (elapsed, 1))));
+              /* pausing for less than a second is not worth a new run */
+              if (due - elapsed >= G_USEC_PER_SEC && done < size)
+                {
+                  g_subprocess_send_signal (process, SIGINT);
+                  interrupted = TRUE;
+                }
+            }
+        }
+
+      if (!g_subprocess_wait (process, NULL, error))
+        goto out;
+
+      if (g_cancellable_is_cancelled (cancellable))
+        {
+          g_set_error (error,
+                       UDISKS_ERROR,
+                       UDISKS_ERROR_CANCELLED,
+                       "Re-encryption of %s was paused, run it again to resume",
+                       data->device);
+          goto out;
+        }
+
+      /* an interrupted run may exit with an error, the next run tells
+       * whether the checkpoint is usable */
+      if (!interrupted && !g_subprocess_get_successful (process))
+        {
+          g_set_error (error,
+                       UDISKS_ERROR,
+                       UDISKS_ERROR_FAILED,
+                       "Error re-encrypting %s: %s",
+                       data->device,
+                       g_strstrip (messages->str));
+          goto out;
+        }
+
+      g_clear_object (&output);
+      g_clear_object (&process);
+
+      if (!interrupted)
+        break;
+
+      /* wait for the average rate to drop below the cap */
+      elapsed = g_get_monotonic_time () - start_time;
+      due = (gint64) ((done - initial_bytes) * (gdouble) G_USEC_PER_SEC / data->max_bandwidth);
+      if (due > elapsed)
+        sleep_cancellable (cancellable, due - elapsed);
+      if (g_cancellable_is_cancelled (cancellable))
+        {
+          g_set_error (error,
+                       UDISKS_ERROR,
+                       UDISKS_ERROR_CANCELLED,
+                       "Re-encryption of %s was paused, run it again to resume",
+                       data->device);
+          goto out;
+        }
+      resume = TRUE;
+    }
+
+  udisks_job_set_progress (UDISKS_JOB (job), 1.0);
+  ret = TRUE;
+
+ out:
+  g_clear_object (&output);
+  g_clear_object (&process);
+  g_string_free (messages, TRUE);
+  g_ptr_array_free (argv, TRUE);
+  g_free (key_size);
+  g_free (hotzone_size);
+  return ret;
+}
+
 gboolean tcrypt_open_job_func (UDisksThreadedJob  *job,
                                GCancellable       *cancellable,
                                gpointer            user_data,
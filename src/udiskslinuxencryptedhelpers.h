@@ -30,6 +30,15 @@
 
 G_BEGIN_DECLS
 
+/* dm-crypt flags for opening a device, see crypto_dm_flags_from_options() */
+typedef enum {
+  CRYPTO_DM_FLAG_ALLOW_DISCARDS         = 1 << 0,
+  CRYPTO_DM_FLAG_SAME_CPU_CRYPT         = 1 << 1,
+  CRYPTO_DM_FLAG_SUBMIT_FROM_CRYPT_CPUS = 1 << 2,
+  CRYPTO_DM_FLAG_NO_READ_WORKQUEUE      = 1 << 3,
+  CRYPTO_DM_FLAG_NO_WRITE_WORKQUEUE     = 1 << 4,
+} CryptoDMFlags;
+
 typedef struct {
   const gchar *device;
   const gchar *map_name;
@@ -42,8 +51,19 @@ typedef struct {
   gboolean system;
   gboolean read_only;
   const gchar *type;
+  guint dm_flags;
+  gboolean persistent_flags;
+  const gchar *cipher;
+  guint32 key_size;
+  guint64 max_bandwidth;
 } CryptoJobData;
 
+guint crypto_dm_flags_from_options (GVariant *options);
+
+guint crypto_dm_flags_from_crypttab_options (const gchar *options);
+
+gchar *crypto_build_luks_open_command (const CryptoJobData *data);
+
 gboolean luks_format_job_func (UDisksThreadedJob  *job,
                                GCancellable       *cancellable,
                                gpointer            user_data,
@@ -64,6 +84,11 @@ gboolean luks_change_key_job_func (UDisksThreadedJob  *job,
                                    gpointer            user_data,
                                    GError            **error);
 
+gboolean luks_reencrypt_job_func (UDisksThreadedJob  *job,
+                                  GCancellable       *cancellable,
+                                  gpointer            user_data,
+                                  GError            **error);
+
 gboolean tcrypt_open_job_func (UDisksThreadedJob  *job,
                                GCancellable       *cancellable,
                                gpointer            user_data,
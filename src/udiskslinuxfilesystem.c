@@ -30,6 +30,11 @@
 #include <stdio.h>
 #include <mntent.h>
 #include <sys/sysmacros.h>
+#include <sys/ioctl.h>
+#include <sys/statvfs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/fs.h>
 #ifdef HAVE_ACL
 #include <sys/acl.h>
 #endif
@@ -56,6 +61,7 @@
 #include "udiskssimplejob.h"
 #include "udiskslinuxdriveata.h"
 #include "udiskslinuxmountoptions.h"
+#include "udisksjobscheduler.h"
 
 /**
  * SECTION:udiskslinuxfilesystem
@@ -1512,6 +1518,7 @@ handle_set_label (UDisksFilesystem      *filesystem,
   UDisksBlock *block;
   UDisksObject *object;
   UDisksDaemon *daemon;
+  gpointer reservation = NULL;
   UDisksState *state = NULL;
   const gchar *probed_fs_usage;
   const gchar *probed_fs_type;
@@ -1542,6 +1549,9 @@ handle_set_label (UDisksFilesystem      *filesystem,
   state = udisks_daemon_get_state (daemon);
   block = udisks_object_peek_block (object);
 
+  /* wait for our turn on the drive before taking the cleanup lock */
+  reservation = udisks_job_scheduler_reserve_sync (udisks_daemon_get_job_scheduler (daemon),
+                                                   object, "filesystem-modify", NULL);
   udisks_linux_block_object_lock_for_cleanup (UDISKS_LINUX_BLOCK_OBJECT (object));
   udisks_state_check_block (state, udisks_linux_block_object_get_device_number (UDISKS_LINUX_BLOCK_OBJECT (object)));
 
@@ -1700,6 +1710,8 @@ handle_set_label (UDisksFilesystem      *filesystem,
  out:
   if (object != NULL)
     udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (object));
+  if (reservation != NULL)
+    udisks_job_scheduler_release_reservation (udisks_daemon_get_job_scheduler (daemon), reservation);
   if (state != NULL)
     udisks_state_check (state);
   /* for some FSes we need to copy and modify label; free our copy */
@@ -1722,6 +1734,7 @@ handle_resize (UDisksFilesystem      *filesystem,
   UDisksBlock *block = NULL;
   UDisksObject *object = NULL;
   UDisksDaemon *daemon = NULL;
+  gpointer reservation = NULL;
   UDisksState *state = NULL;
   const gchar *probed_fs_usage = NULL;
   const gchar *probed_fs_type = NULL;
@@ -1747,6 +1760,9 @@ handle_resize (UDisksFilesystem      *filesystem,
   state = udisks_daemon_get_state (daemon);
   block = udisks_object_peek_block (object);
 
+  /* wait for our turn on the drive before taking the cleanup lock */
+  reservation = udisks_job_scheduler_reserve_sync (udisks_daemon_get_job_scheduler (daemon),
+                                                   object, "filesystem-resize", NULL);
   udisks_linux_block_object_lock_for_cleanup (UDISKS_LINUX_BLOCK_OBJECT (object));
   udisks_state_check_block (state, udisks_linux_block_object_get_device_number (UDISKS_LINUX_BLOCK_OBJECT (object)));
 
@@ -1884,6 +1900,8 @@ handle_resize (UDisksFilesystem      *filesystem,
   udisks_bd_thread_disable_progress ();
   if (object != NULL)
     udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (object));
+  if (reservation != NULL)
+    udisks_job_scheduler_release_reservation (udisks_daemon_get_job_scheduler (daemon), reservation);
   if (state != NULL)
     udisks_state_check (state);
   g_clear_object (&object);
@@ -1904,6 +1922,7 @@ handle_repair (UDisksFilesystem      *filesystem,
   UDisksBlock *block = NULL;
   UDisksObject *object = NULL;
   UDisksDaemon *daemon = NULL;
+  gpointer reservation = NULL;
   UDisksState *state = NULL;
   const gchar *probed_fs_usage = NULL;
   const gchar *probed_fs_type = NULL;
@@ -1929,6 +1948,9 @@ handle_repair (UDisksFilesystem      *filesystem,
   state = udisks_daemon_get_state (daemon);
   block = udisks_object_peek_block (object);
 
+  /* wait for our turn on the drive before taking the cleanup lock */
+  reservation = udisks_job_scheduler_reserve_sync (udisks_daemon_get_job_scheduler (daemon),
+                                                   object, "filesystem-repair", NULL);
   udisks_linux_block_object_lock_for_cleanup (UDISKS_LINUX_BLOCK_OBJECT (object));
   udisks_state_check_block (state, udisks_linux_block_object_get_device_number (UDISKS_LINUX_BLOCK_OBJECT (object)));
 
@@ -2052,6 +2074,8 @@ handle_repair (UDisksFilesystem      *filesystem,
   udisks_bd_thread_disable_progress ();
   if (object != NULL)
     udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (object));
+  if (reservation != NULL)
+    udisks_job_scheduler_release_reservation (udisks_daemon_get_job_scheduler (daemon), reservation);
   if (state != NULL)
     udisks_state_check (state);
   g_clear_object (&object);
@@ -2072,6 +2096,7 @@ handle_check (UDisksFilesystem      *filesystem,
   UDisksBlock *block = NULL;
   UDisksObject *object = NULL;
   UDisksDaemon *daemon = NULL;
+  gpointer reservation = NULL;
   UDisksState *state = NULL;
   const gchar *probed_fs_usage = NULL;
   const gchar *probed_fs_type = NULL;
@@ -2097,6 +2122,9 @@ handle_check (UDisksFilesystem      *filesystem,
   state = udisks_daemon_get_state (daemon);
   block = udisks_object_peek_block (object);
 
+  /* wait for our turn on the drive before taking the cleanup lock */
+  reservation = udisks_job_scheduler_reserve_sync (udisks_daemon_get_job_scheduler (daemon),
+                                                   object, "filesystem-check", NULL);
   udisks_linux_block_object_lock_for_cleanup (UDISKS_LINUX_BLOCK_OBJECT (object));
   udisks_state_check_block (state, udisks_linux_block_object_get_device_number (UDISKS_LINUX_BLOCK_OBJECT (object)));
 
@@ -2220,6 +2248,8 @@ handle_check (UDisksFilesystem      *filesystem,
   udisks_bd_thread_disable_progress ();
   if (object != NULL)
     udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (object));
+  if (reservation != NULL)
+    udisks_job_scheduler_release_reservation (udisks_daemon_get_job_scheduler (daemon), reservation);
   if (state != NULL)
     udisks_state_check (state);
   g_clear_object (&object);
@@ -2237,6 +2267,7 @@ handle_take_ownership (UDisksFilesystem      *filesystem,
   UDisksBlock *block = NULL;
   UDisksObject *object = NULL;
   UDisksDaemon *daemon = NULL;
+  gpointer reservation = NULL;
   UDisksState *state = NULL;
   const gchar *probed_fs_usage = NULL;
   const gchar *probed_fs_type = NULL;
@@ -2265,6 +2296,9 @@ handle_take_ownership (UDisksFilesystem      *filesystem,
   daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
   state = udisks_daemon_get_state (daemon);
 
+  /* wait for our turn on the drive before taking the cleanup lock */
+  reservation = udisks_job_scheduler_reserve_sync (udisks_daemon_get_job_scheduler (daemon),
+                                                   object, "filesystem-modify", NULL);
   udisks_linux_block_object_lock_for_cleanup (UDISKS_LINUX_BLOCK_OBJECT (object));
   udisks_state_check_block (state, udisks_linux_block_object_get_device_number (UDISKS_LINUX_BLOCK_OBJECT (object)));
 
@@ -2361,6 +2395,8 @@ handle_take_ownership (UDisksFilesystem      *filesystem,
   out:
    if (object != NULL)
      udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (object));
+  if (reservation != NULL)
+    udisks_job_scheduler_release_reservation (udisks_daemon_get_job_scheduler (daemon), reservation);
    if (state != NULL)
      udisks_state_check (state);
    g_clear_object (&object);
@@ -2371,6 +2407,702 @@ handle_take_ownership (UDisksFilesystem      *filesystem,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* FITRIM is issued in chunks so that the job can report progress and be
+ * canceled, and so that a single call doesn't keep the device busy with
+ * discards for minutes. Every filesystem is trimmed under a
+ * "filesystem-trim" reservation from the job scheduler, which runs at
+ * most one of those on each drive at a time, no matter whether the trim
+ * comes from Filesystem.Trim() or Manager.TrimAll().
+ */
+
+#define TRIM_DEFAULT_CHUNK_SIZE   (G_GUINT64_CONSTANT (1) << 30)
+#define TRIM_ALL_DEFAULT_PARALLEL 4
+#define TRIM_ALL_MAX_PARALLEL     16
+
+typedef void (*TrimProgressFunc) (guint64  bytes_done,
+                                  gpointer user_data);
+
+static void
+collect_trim_disks (const gchar *sysfs_path,
+                    GPtrArray   *disks,
+                    guint        depth)
+{
+  gchar *path;
+  GDir *dir;
+  const gchar *name;
+  gboolean has_slaves = FALSE;
+
+  if (depth > 8)
+    return;
+
+  /* partitions are discarded through their disk */
+  path = g_build_filename (sysfs_path, "partition", NULL);
+  if (g_file_test (path, G_FILE_TEST_EXISTS))
+    {
+      gchar *parent = g_path_get_dirname (sysfs_path);
+      collect_trim_disks (parent, disks, depth + 1);
+      g_free (parent);
+      g_free (path);
+      return;
+    }
+  g_free (path);
+
+  path = g_build_filename (sysfs_path, "slaves", NULL);
+  dir = g_dir_open (path, 0, NULL);
+  if (dir != NULL)
+    {
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          gchar *slave_path;
+          gchar *resolved;
+
+          slave_path = g_build_filename ("/sys/class/block", name, NULL);
+          resolved = realpath (slave_path, NULL);
+          if (resolved != NULL)
+            {
+              collect_trim_disks (resolved, disks, depth + 1);
+              has_slaves = TRUE;
+              free (resolved);
+            }
+          g_free (slave_path);
+        }
+      g_dir_close (dir);
+    }
+  g_free (path);
+
+  if (!has_slaves)
+    {
+      gchar *disk = g_path_get_basename (sysfs_path);
+      guint n;
+
+      for (n = 0; n < disks->len; n++)
+        if (g_strcmp0 (disks->pdata[n], disk) == 0)
+          break;
+      if (n < disks->len)
+        g_free (disk);
+      else
+        g_ptr_array_add (disks, disk);
+    }
+}
+
+static gint
+compare_disk_names (gconstpointer a,
+                    gconstpointer b)
+{
+  return g_strcmp0 (*(const gchar **) a, *(const gchar **) b);
+}
+
+/* Returns the sorted names of the disks @object lives on, e.g. "sda" */
+static gchar **
+get_trim_disks (UDisksLinuxBlockObject *object)
+{
+  UDisksLinuxDevice *device;
+  GPtrArray *disks;
+
+  disks = g_ptr_array_new ();
+  device = udisks_linux_block_object_get_device (object);
+  if (device != NULL)
+    {
+      collect_trim_disks (g_udev_device_get_sysfs_path (device->udev_device), disks, 0);
+      g_object_unref (device);
+    }
+  g_ptr_array_sort (disks, compare_disk_names);
+  g_ptr_array_add (disks, NULL);
+  return (gchar **) g_ptr_array_free (disks, FALSE);
+}
+
+/* Returns the size FITRIM ranges are relative to, or 0 if not known */
+static guint64
+get_trim_size (const gchar *mount_point)
+{
+  struct statvfs buf;
+
+  if (statvfs (mount_point, &buf) != 0)
+    return 0;
+  return (guint64) buf.f_blocks * buf.f_frsize;
+}
+
+static gboolean
+is_mounted_read_only (const gchar *mount_point)
+{
+  struct statvfs buf;
+
+  if (statvfs (mount_point, &buf) != 0)
+    return FALSE;
+  return (buf.f_flag & ST_RDONLY) != 0;
+}
+
+/* Issues FITRIM on the filesystem mounted at @mount_point, @chunk_size
+ * bytes (rounded up to the filesystem block size) at a time. @progress_func is called with the number of bytes
+ * covered after each chunk; together they add up to the size of the
+ * filesystem.
+ */
+static gboolean
+trim_mount_point (const gchar       *mount_point,
+                  guint64            chunk_size,
+                  guint64            minimum_size,
+                  GCancellable      *cancellable,
+                  TrimProgressFunc   progress_func,
+                  gpointer           user_data,
+                  guint64           *out_trimmed,
+                  GError           **error)
+{
+  struct fstrim_range range;
+  struct statvfs buf;
+  guint64 size;
+  guint64 offset = 0;
+  guint64 trimmed = 0;
+  gboolean ret = FALSE;
+  gint fd;
+
+  fd = open (mount_point, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error opening %s: %m", mount_point);
+      goto out;
+    }
+
+  if (fstatvfs (fd, &buf) != 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error getting the size of the filesystem mounted at %s: %m", mount_point);
+      goto out;
+    }
+  size = (guint64) buf.f_blocks * buf.f_frsize;
+
+  /* a range shorter than a block is rejected with EINVAL */
+  if (buf.f_bsize > 0 && chunk_size % buf.f_bsize != 0 && chunk_size < G_MAXUINT64 - buf.f_bsize)
+    chunk_size += buf.f_bsize - chunk_size % buf.f_bsize;
+
+  do
+    {
+      guint64 len;
+
+      if (g_cancellable_is_cancelled (cancellable))
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_CANCELLED, "Job was canceled");
+          goto out;
+        }
+
+      /* Some filesystems (e.g. XFS and Btrfs) address more than what
+       * statvfs() reports, the last chunk covers everything up to the end.
+       */
+      len = chunk_size;
+      if (offset + chunk_size >= size)
+        len = G_MAXUINT64 - offset;
+
+      memset (&range, '\0', sizeof (range));
+      range.start = offset;
+      range.len = len;
+      range.minlen = minimum_size;
+      if (ioctl (fd, FITRIM, &range) != 0)
+        {
+          if (errno == EINTR)
+            continue;
+          if (errno == EOPNOTSUPP || errno == ENOTTY)
+            g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_NOT_SUPPORTED,
+                         "The filesystem mounted at %s does not support trimming", mount_point);
+          else
+            g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                         "Error trimming the filesystem mounted at %s: %m", mount_point);
+          goto out;
+        }
+      /* on return, len is the number of bytes trimmed */
+      trimmed += range.len;
+
+      if (progress_func != NULL)
+        progress_func (MIN (len, size - offset), user_data);
+
+      offset += MIN (len, chunk_size);
+    }
+  while (offset < size);
+
+  if (out_trimmed != NULL)
+    *out_trimmed = trimmed;
+  ret = TRUE;
+
+ out:
+  if (fd >= 0)
+    close (fd);
+  return ret;
+}
+
+static void
+trim_get_authorization (UDisksDaemon  *daemon,
+                        UDisksObject  *object,
+                        UDisksBlock   *block,
+                        uid_t          caller_uid,
+                        const gchar  **out_action_id,
+                        const gchar  **out_message)
+{
+  *out_action_id = "org.freedesktop.udisks2.modify-device";
+  /* Translators: Shown in authentication dialog when the user
+   * requests trimming the filesystem.
+   *
+   * Do not translate $(drive), it's a placeholder and
+   * will be replaced by the name of the drive/device in question
+   */
+  *out_message = N_("Authentication is required to trim the filesystem on $(drive)");
+  if (! udisks_daemon_util_setup_by_user (daemon, object, caller_uid))
+    {
+      if (udisks_block_get_hint_system (block))
+        *out_action_id = "org.freedesktop.udisks2.modify-device-system";
+      else if (! udisks_daemon_util_on_user_seat (daemon, object, caller_uid))
+        *out_action_id = "org.freedesktop.udisks2.modify-device-other-seat";
+    }
+}
+
+typedef struct
+{
+  UDisksBaseJob *job;
+  guint64        size;
+  guint64        done;
+  gint64         time_of_last_update;
+} TrimJobProgress;
+
+static void
+trim_job_progress (guint64  bytes_done,
+                   gpointer user_data)
+{
+  TrimJobProgress *progress = user_data;
+  gint64 now;
+
+  progress->done += bytes_done;
+
+  /* only emit D-Bus signal at most once a second */
+  now = g_get_monotonic_time ();
+  if (progress->size > 0 && now - progress->time_of_last_update > G_USEC_PER_SEC)
+    {
+      udisks_job_set_progress (UDISKS_JOB (progress->job), MIN (((gdouble) progress->done) / progress->size, 1.0));
+      progress->time_of_last_update = now;
+    }
+}
+
+/* runs in thread dedicated to handling method call */
+static gboolean
+handle_trim (UDisksFilesystem      *filesystem,
+             GDBusMethodInvocation *invocation,
+             GVariant              *options)
+{
+  UDisksBlock *block = NULL;
+  UDisksObject *object = NULL;
+  UDisksDaemon *daemon = NULL;
+  gpointer reservation = NULL;
+  const gchar *action_id = NULL;
+  const gchar *message = NULL;
+  const gchar * const *mount_points = NULL;
+  gchar *mount_point = NULL;
+  TrimJobProgress progress;
+  guint64 chunk_size = TRIM_DEFAULT_CHUNK_SIZE;
+  guint64 minimum_size = 0;
+  guint64 trimmed = 0;
+  uid_t caller_uid;
+  GError *error = NULL;
+  UDisksBaseJob *job = NULL;
+
+  memset (&progress, '\0', sizeof (progress));
+  g_variant_lookup (options, "chunk-size", "t", &chunk_size);
+  g_variant_lookup (options, "minimum-size", "t", &minimum_size);
+
+  object = udisks_daemon_util_dup_object (filesystem, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
+  block = udisks_object_peek_block (object);
+
+  /* wait for our turn on the drive before taking the cleanup lock */
+  reservation = udisks_job_scheduler_reserve_sync (udisks_daemon_get_job_scheduler (daemon),
+                                                   object, "filesystem-trim", NULL);
+  udisks_linux_block_object_lock_for_cleanup (UDISKS_LINUX_BLOCK_OBJECT (object));
+
+  if (! udisks_daemon_util_get_caller_uid_sync (daemon,
+                                                invocation,
+                                                NULL /* GCancellable */,
+                                                &caller_uid,
+                                                &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      goto out;
+    }
+
+  if (chunk_size == 0)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             UDISKS_ERROR,
+                                             UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                                             "The chunk-size option must be positive");
+      goto out;
+    }
+
+  /* FITRIM works on a mounted filesystem, any mount point will do */
+  mount_points = udisks_filesystem_get_mount_points (filesystem);
+  if (mount_points == NULL || mount_points[0] == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             UDISKS_ERROR,
+                                             UDISKS_ERROR_NOT_MOUNTED,
+                                             "Cannot trim the filesystem on %s if unmounted",
+                                             udisks_block_get_device (block));
+      goto out;
+    }
+  mount_point = g_strdup (mount_points[0]);
+
+  if (udisks_block_get_read_only (block) || is_mounted_read_only (mount_point))
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             UDISKS_ERROR,
+                                             UDISKS_ERROR_FAILED,
+                                             "Cannot trim the filesystem on %s, it is mounted read-only",
+                                             udisks_block_get_device (block));
+      goto out;
+    }
+
+  trim_get_authorization (daemon, object, block, caller_uid, &action_id, &message);
+
+  /* Check that the user is actually authorized to trim the filesystem. */
+  if (! udisks_daemon_util_check_authorization_sync (daemon,
+                                                     object,
+                                                     action_id,
+                                                     options,
+                                                     message,
+                                                     invocation))
+    goto out;
+
+  job = udisks_daemon_launch_simple_job (daemon,
+                                         UDISKS_OBJECT (object),
+                                         "filesystem-trim",
+                                         caller_uid,
+                                         NULL);
+  if (job == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "Failed to create a job object");
+      goto out;
+    }
+  udisks_base_job_set_auto_estimate (job, TRUE);
+  udisks_job_set_progress_valid (UDISKS_JOB (job), TRUE);
+
+  progress.job = job;
+  progress.size = get_trim_size (mount_point);
+  progress.time_of_last_update = g_get_monotonic_time ();
+  udisks_job_set_bytes (UDISKS_JOB (job), progress.size);
+
+  if (! trim_mount_point (mount_point,
+                          chunk_size,
+                          minimum_size,
+                          udisks_base_job_get_cancellable (job),
+                          trim_job_progress,
+                          &progress,
+                          &trimmed,
+                          &error))
+    goto job_failed;
+
+  udisks_filesystem_complete_trim (filesystem, invocation, trimmed);
+  udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), TRUE, NULL);
+  goto out;
+
+ job_failed:
+  udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+  g_dbus_method_invocation_take_error (invocation, error);
+
+ out:
+  if (object != NULL)
+    udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (object));
+  if (reservation != NULL)
+    udisks_job_scheduler_release_reservation (udisks_daemon_get_job_scheduler (daemon), reservation);
+  g_clear_object (&object);
+  g_free (mount_point);
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  UDisksObject *object;
+  gchar        *mount_point;
+  gchar       **disks;
+  guint64       size;
+  guint64       trimmed;
+  GError       *error;
+} TrimAllFilesystem;
+
+/* State shared by the workers of one Manager.TrimAll() call */
+typedef struct
+{
+  GMutex           lock;
+  UDisksDaemon    *daemon;
+  TrimJobProgress  progress;
+  guint64          chunk_size;
+  guint64          minimum_size;
+} TrimAll;
+
+typedef struct
+{
+  TrimAll   *all;
+  GPtrArray *filesystems;
+} TrimAllWorker;
+
+static void
+trim_all_filesystem_free (TrimAllFilesystem *filesystem)
+{
+  g_clear_object (&filesystem->object);
+  g_free (filesystem->mount_point);
+  g_strfreev (filesystem->disks);
+  g_clear_error (&filesystem->error);
+  g_free (filesystem);
+}
+
+static void
+trim_all_progress (guint64  bytes_done,
+                   gpointer user_data)
+{
+  TrimAll *all = user_data;
+
+  g_mutex_lock (&all->lock);
+  trim_job_progress (bytes_done, &all->progress);
+  g_mutex_unlock (&all->lock);
+}
+
+/* Trims the filesystems on one set of disks, one after the other */
+static void
+trim_all_worker (gpointer data,
+                 gpointer user_data)
+{
+  GPtrArray *filesystems = data;
+  TrimAll *all = user_data;
+  GCancellable *cancellable;
+  guint n;
+
+  cancellable = udisks_base_job_get_cancellable (all->progress.job);
+  for (n = 0; n < filesystems->len; n++)
+    {
+      TrimAllFilesystem *filesystem = filesystems->pdata[n];
+      gpointer reservation;
+
+      reservation = udisks_job_scheduler_reserve_sync (udisks_daemon_get_job_scheduler (all->daemon),
+                                                       filesystem->object, "filesystem-trim", cancellable);
+      trim_mount_point (filesystem->mount_point,
+                        all->chunk_size,
+                        all->minimum_size,
+                        cancellable,
+                        trim_all_progress,
+                        all,
+                        &filesystem->trimmed,
+                        &filesystem->error);
+      udisks_job_scheduler_release_reservation (udisks_daemon_get_job_scheduler (all->daemon), reservation);
+    }
+}
+
+/**
+ * udisks_linux_filesystem_trim_all_sync:
+ * @daemon: A #UDisksDaemon.
+ * @invocation: The #GDBusMethodInvocation of the Manager.TrimAll() call.
+ * @options: Options used for authorization and for trimming.
+ * @error: Return location for error or %NULL.
+ *
+ * Trims all the mounted filesystems, see the Manager.TrimAll() D-Bus
+ * method. Filesystems on the same disks are trimmed one after the other,
+ * filesystems on different disks by up to <parameter>max-parallel</parameter>
+ * threads at the same time, each under a job scheduler reservation. Progress is reported by a
+ * <literal>filesystem-trim-all</literal> job.
+ *
+ * Must not be called from the main thread.
+ *
+ * Returns: (transfer full): A #GVariant of type <literal>a(otbs)</literal>
+ * with the result for each filesystem or %NULL if @error is set. Failing
+ * to trim a filesystem doesn't set @error.
+ */
+GVariant *
+udisks_linux_filesystem_trim_all_sync (UDisksDaemon           *daemon,
+                                       GDBusMethodInvocation  *invocation,
+                                       GVariant               *options,
+                                       GError                **error)
+{
+  TrimAll all;
+  GPtrArray *filesystems;
+  GHashTable *groups;
+  GHashTableIter group_iter;
+  GPtrArray *group;
+  GThreadPool *pool;
+  GVariantBuilder builder;
+  GList *objects, *l;
+  guint max_parallel = TRIM_ALL_DEFAULT_PARALLEL;
+  guint num_failed = 0;
+  uid_t caller_uid;
+  GVariant *ret = NULL;
+  guint n;
+
+  memset (&all, '\0', sizeof (all));
+  g_mutex_init (&all.lock);
+  all.daemon = daemon;
+  all.chunk_size = TRIM_DEFAULT_CHUNK_SIZE;
+  g_variant_lookup (options, "chunk-size", "t", &all.chunk_size);
+  g_variant_lookup (options, "minimum-size", "t", &all.minimum_size);
+  g_variant_lookup (options, "max-parallel", "u", &max_parallel);
+
+  filesystems = g_ptr_array_new_with_free_func ((GDestroyNotify) trim_all_filesystem_free);
+  /* disk names -> GPtrArray of TrimAllFilesystem, not owning them; one
+   * worker per group so the workers don't all wait for the same drive */
+  groups = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_ptr_array_unref);
+  objects = udisks_daemon_get_objects (daemon);
+
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon, invocation, NULL /* GCancellable */, &caller_uid, error))
+    goto out;
+
+  if (all.chunk_size == 0 || max_parallel == 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                   "The chunk-size and max-parallel options must be positive");
+      goto out;
+    }
+  max_parallel = MIN (max_parallel, TRIM_ALL_MAX_PARALLEL);
+
+  /* The mount points come from the mount monitor through the Filesystem
+   * interface. Read-only devices and mounts can't be trimmed and are
+   * left out.
+   */
+  for (l = objects; l != NULL; l = l->next)
+    {
+      UDisksObject *object = UDISKS_OBJECT (l->data);
+      UDisksFilesystem *fs;
+      UDisksBlock *block;
+      const gchar * const *mount_points;
+      TrimAllFilesystem *filesystem;
+
+      fs = udisks_object_peek_filesystem (object);
+      block = udisks_object_peek_block (object);
+      if (fs == NULL || block == NULL || !UDISKS_IS_LINUX_BLOCK_OBJECT (object))
+        continue;
+      mount_points = udisks_filesystem_get_mount_points (fs);
+      if (mount_points == NULL || mount_points[0] == NULL || udisks_block_get_read_only (block) ||
+          is_mounted_read_only (mount_points[0]))
+        continue;
+
+      filesystem = g_new0 (TrimAllFilesystem, 1);
+      filesystem->object = g_object_ref (object);
+      filesystem->mount_point = g_strdup (mount_points[0]);
+      g_ptr_array_add (filesystems, filesystem);
+    }
+
+  /* Check authorization for all the filesystems up front, from this
+   * thread, so that the user is not asked by several threads at once.
+   */
+  for (n = 0; n < filesystems->len; n++)
+    {
+      TrimAllFilesystem *filesystem = filesystems->pdata[n];
+      const gchar *action_id;
+      const gchar *message;
+
+      trim_get_authorization (daemon, filesystem->object, udisks_object_peek_block (filesystem->object),
+                              caller_uid, &action_id, &message);
+      if (!udisks_daemon_util_check_authorization_sync_with_error (daemon,
+                                                                   filesystem->object,
+                                                                   action_id,
+                                                                   options,
+                                                                   message,
+                                                                   invocation,
+                                                                   error))
+        goto out;
+    }
+
+  all.progress.job = udisks_daemon_launch_simple_job (daemon, NULL, "filesystem-trim-all", caller_uid, NULL);
+  udisks_base_job_set_auto_estimate (all.progress.job, TRUE);
+  udisks_job_set_progress_valid (UDISKS_JOB (all.progress.job), TRUE);
+
+  for (n = 0; n < filesystems->len; n++)
+    {
+      TrimAllFilesystem *filesystem = filesystems->pdata[n];
+      gchar *key;
+
+      udisks_base_job_add_object (all.progress.job, filesystem->object);
+      filesystem->disks = get_trim_disks (UDISKS_LINUX_BLOCK_OBJECT (filesystem->object));
+      filesystem->size = get_trim_size (filesystem->mount_point);
+      all.progress.size += filesystem->size;
+
+      key = g_strjoinv (" ", filesystem->disks);
+      group = g_hash_table_lookup (groups, key);
+      if (group == NULL)
+        {
+          group = g_ptr_array_new ();
+          g_hash_table_insert (groups, key, group);
+        }
+      else
+        {
+          g_free (key);
+        }
+      g_ptr_array_add (group, filesystem);
+    }
+  udisks_job_set_bytes (UDISKS_JOB (all.progress.job), all.progress.size);
+  all.progress.time_of_last_update = g_get_monotonic_time ();
+
+  if (g_hash_table_size (groups) > 0)
+    {
+      GError *pool_error = NULL;
+
+      pool = g_thread_pool_new (trim_all_worker,
+                                &all,
+                                MIN (g_hash_table_size (groups), max_parallel),
+                                FALSE,
+                                &pool_error);
+      if (pool == NULL)
+        {
+          udisks_simple_job_complete (UDISKS_SIMPLE_JOB (all.progress.job), FALSE, pool_error->message);
+          g_propagate_error (error, pool_error);
+          goto out;
+        }
+      g_hash_table_iter_init (&group_iter, groups);
+      while (g_hash_table_iter_next (&group_iter, NULL, (gpointer *) &group))
+        g_thread_pool_push (pool, group, NULL);
+
+      /* wait for all the drives to be done */
+      g_thread_pool_free (pool, FALSE, TRUE);
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(otbs)"));
+  for (n = 0; n < filesystems->len; n++)
+    {
+      TrimAllFilesystem *filesystem = filesystems->pdata[n];
+
+      if (filesystem->error != NULL)
+        {
+          udisks_warning ("Error trimming %s: %s", filesystem->mount_point, filesystem->error->message);
+          num_failed++;
+        }
+      g_variant_builder_add (&builder, "(otbs)",
+                             g_dbus_object_get_object_path (G_DBUS_OBJECT (filesystem->object)),
+                             filesystem->trimmed,
+                             filesystem->error == NULL,
+                             filesystem->error != NULL ? filesystem->error->message : "");
+    }
+  ret = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  if (num_failed == 0)
+    {
+      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (all.progress.job), TRUE, "");
+    }
+  else
+    {
+      gchar *job_message = g_strdup_printf ("Failed to trim %u of %u filesystems", num_failed, filesystems->len);
+      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (all.progress.job), FALSE, job_message);
+      g_free (job_message);
+    }
+
+ out:
+  g_list_free_full (objects, g_object_unref);
+  g_hash_table_destroy (groups);
+  g_ptr_array_unref (filesystems);
+  g_mutex_clear (&all.lock);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static void
 filesystem_iface_init (UDisksFilesystemIface *iface)
 {
@@ -2381,4 +3113,5 @@ filesystem_iface_init (UDisksFilesystemIface *iface)
   iface->handle_repair    = handle_repair;
   iface->handle_check     = handle_check;
   iface->handle_take_ownership = handle_take_ownership;
+  iface->handle_trim      = handle_trim;
 }
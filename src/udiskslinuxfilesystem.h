@@ -33,6 +33,10 @@ GType             udisks_linux_filesystem_get_type (void) G_GNUC_CONST;
 UDisksFilesystem *udisks_linux_filesystem_new      (void);
 void              udisks_linux_filesystem_update   (UDisksLinuxFilesystem  *filesystem,
                                                     UDisksLinuxBlockObject *object);
+GVariant         *udisks_linux_filesystem_trim_all_sync (UDisksDaemon           *daemon,
+                                                         GDBusMethodInvocation  *invocation,
+                                                         GVariant               *options,
+                                                         GError                **error);
 
 G_END_DECLS
 
@@ -26,6 +26,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/loop.h>
 
 #include <pwd.h>
 #include <grp.h>
@@ -43,6 +46,9 @@
 #include "udisksdaemonutil.h"
 #include "udisksstate.h"
 #include "udiskslinuxblockobject.h"
+#include "udiskslinuxblock.h"
+#include "udiskslinuxencrypted.h"
+#include "udiskslinuxfilesystem.h"
 #include "udiskslinuxdevice.h"
 #include "udisksmodulemanager.h"
 #include "udiskslinuxfsinfo.h"
@@ -310,83 +316,207 @@ wait_for_loop_object (UDisksDaemon *daemon,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-/* runs in thread dedicated to handling @invocation */
+/* Attaches @fd to a free loop device with a single LOOP_CONFIGURE ioctl.
+ * Falls back to libblockdev and the separate ioctls on kernels older
+ * than 5.8.
+ */
 static gboolean
-handle_loop_setup (UDisksManager          *object,
-                   GDBusMethodInvocation  *invocation,
-                   GUnixFDList            *fd_list,
-                   GVariant               *fd_index,
-                   GVariant               *options)
+loop_attach (gint          fd,
+             const gchar  *path,
+             guint64       offset,
+             guint64       size,
+             gboolean      read_only,
+             gboolean      part_scan,
+             gboolean      direct_io,
+             guint32       block_size,
+             gchar       **out_loop_name,
+             GError      **error)
 {
-  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
-  GError *error;
-  gint fd_num;
-  gint fd = -1;
-  gchar proc_path[64];
-  gchar path[8192];
-  ssize_t path_len;
+  const gchar *bd_loop_name = NULL;
   gchar *loop_device = NULL;
-  const gchar *loop_name = NULL;
-  UDisksObject *loop_object = NULL;
-  gboolean option_read_only = FALSE;
-  gboolean option_no_part_scan = FALSE;
-  guint64 option_offset = 0;
-  guint64 option_size = 0;
-  uid_t caller_uid;
-  struct stat fd_statbuf;
-  gboolean fd_statbuf_valid = FALSE;
-  WaitForLoopData wait_data;
+  gint loop_fd = -1;
+  gboolean ret = FALSE;
+#ifdef LOOP_CONFIGURE
+  struct loop_config config;
+  gint control_fd;
+  gint attempt;
+  gint num;
+
+  control_fd = open ("/dev/loop-control", O_RDWR | O_CLOEXEC);
+  if (control_fd == -1)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error opening /dev/loop-control: %m");
+      goto out;
+    }
 
-  /* we need the uid of the caller for the loop file */
-  error = NULL;
-  if (!udisks_daemon_util_get_caller_uid_sync (manager->daemon, invocation, NULL /* GCancellable */, &caller_uid, &error))
+  memset (&config, 0, sizeof (config));
+  config.fd = fd;
+  config.block_size = block_size;
+  config.info.lo_offset = offset;
+  config.info.lo_sizelimit = size;
+  if (read_only)
+    config.info.lo_flags |= LO_FLAGS_READ_ONLY;
+  if (part_scan)
+    config.info.lo_flags |= LO_FLAGS_PARTSCAN;
+  if (direct_io)
+    config.info.lo_flags |= LO_FLAGS_DIRECT_IO;
+  g_strlcpy ((gchar *) config.info.lo_file_name, path, LO_NAME_SIZE);
+
+  /* another process may grab the free device before we configure it */
+  for (attempt = 0; attempt < 16; attempt++)
     {
-      g_dbus_method_invocation_return_gerror (invocation, error);
-      g_clear_error (&error);
+      gint saved_errno;
+
+      num = ioctl (control_fd, LOOP_CTL_GET_FREE);
+      if (num < 0)
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Error getting a free loop device: %m");
+          close (control_fd);
+          goto out;
+        }
+
+      g_free (loop_device);
+      loop_device = g_strdup_printf ("/dev/loop%d", num);
+      loop_fd = open (loop_device, O_RDWR | O_CLOEXEC);
+      if (loop_fd == -1)
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Error opening %s: %m", loop_device);
+          close (control_fd);
+          goto out;
+        }
+
+      if (ioctl (loop_fd, LOOP_CONFIGURE, &config) == 0)
+        {
+          *out_loop_name = g_strdup_printf ("loop%d", num);
+          close (control_fd);
+          ret = TRUE;
+          goto out;
+        }
+
+      saved_errno = errno;
+      close (loop_fd);
+      loop_fd = -1;
+      if (saved_errno == EBUSY)
+        continue;
+      if (saved_errno == EINVAL || saved_errno == ENOTTY)
+        break;  /* not supported by the kernel, @block_size has been checked by the caller */
+
+      errno = saved_errno;
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error configuring %s: %m", loop_device);
+      close (control_fd);
       goto out;
     }
+  close (control_fd);
 
-  /* Check if the user is authorized to create a loop device */
-  if (!udisks_daemon_util_check_authorization_sync (manager->daemon,
-                                                    NULL,
-                                                    "org.freedesktop.udisks2.loop-setup",
-                                                    options,
-                                                    /* Translators: Shown in authentication dialog when the user
-                                                     * requests setting up a loop device.
-                                                     */
-                                                    N_("Authentication is required to set up a loop device"),
-                                                    invocation))
+  if (attempt == 16)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error configuring a loop device: all free devices are busy");
+      goto out;
+    }
+#endif
+
+  if (!bd_loop_setup_from_fd (fd, offset, size, read_only, part_scan, &bd_loop_name, error))
     goto out;
+  *out_loop_name = g_strdup (bd_loop_name);
 
-  fd_num = g_variant_get_handle (fd_index);
-  if (fd_list == NULL || fd_num >= g_unix_fd_list_get_length (fd_list))
+  if (block_size > 0 || direct_io)
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Expected to use fd at index %d, but message has only %d fds",
-                                             fd_num,
-                                             fd_list == NULL ? 0 : g_unix_fd_list_get_length (fd_list));
-      goto out;
+      g_free (loop_device);
+      loop_device = g_strdup_printf ("/dev/%s", bd_loop_name);
+      loop_fd = open (loop_device, O_RDWR | O_CLOEXEC);
+      if (loop_fd == -1 ||
+          (block_size > 0 && ioctl (loop_fd, LOOP_SET_BLOCK_SIZE, (unsigned long) block_size) != 0) ||
+          (direct_io && ioctl (loop_fd, LOOP_SET_DIRECT_IO, 1UL) != 0))
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Error configuring %s: %m", loop_device);
+          bd_loop_teardown (bd_loop_name, NULL);
+          g_clear_pointer (out_loop_name, g_free);
+          goto out;
+        }
     }
-  error = NULL;
-  fd = g_unix_fd_list_get (fd_list, fd_num, &error);
-  if (fd == -1)
+
+  ret = TRUE;
+
+ out:
+  if (loop_fd != -1)
+    close (loop_fd);
+  g_free (loop_device);
+  g_free ((gpointer) bd_loop_name);
+  return ret;
+}
+
+/* Sets the number of requests the queue of @loop_name can hold */
+static gboolean
+loop_set_queue_depth (const gchar  *loop_name,
+                      guint32       queue_depth,
+                      GError      **error)
+{
+  gchar *sysfs_path;
+  gchar *value;
+  gint fd;
+  gboolean ret = FALSE;
+
+  sysfs_path = g_strdup_printf ("/sys/block/%s/queue/nr_requests", loop_name);
+  value = g_strdup_printf ("%u", queue_depth);
+  fd = open (sysfs_path, O_WRONLY | O_CLOEXEC);
+  if (fd == -1 || write (fd, value, strlen (value)) != (ssize_t) strlen (value))
     {
-      g_prefix_error (&error, "Error getting file descriptor %d from message: ", fd_num);
-      g_dbus_method_invocation_take_error (invocation, error);
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error setting queue depth %u for %s: %m", queue_depth, loop_name);
       goto out;
     }
 
+  ret = TRUE;
+
+ out:
+  if (fd != -1)
+    close (fd);
+  g_free (value);
+  g_free (sysfs_path);
+  return ret;
+}
+
+/* Sets up a loop device for @fd as requested by @options and records it
+ * in the state file. The caller still has to wait for the object.
+ */
+static gboolean
+loop_setup (UDisksLinuxManager  *manager,
+            gint                 fd,
+            GVariant            *options,
+            uid_t                caller_uid,
+            gchar              **out_loop_device,
+            gchar              **out_path,
+            GError             **error)
+{
+  gchar proc_path[64];
+  gchar path[8192];
+  ssize_t path_len;
+  gchar *loop_name = NULL;
+  gboolean option_read_only = FALSE;
+  gboolean option_no_part_scan = FALSE;
+  gboolean option_direct_io = FALSE;
+  guint64 option_offset = 0;
+  guint64 option_size = 0;
+  guint32 option_block_size = 0;
+  guint32 option_queue_depth = 0;
+  struct stat fd_statbuf;
+  gboolean fd_statbuf_valid = FALSE;
+
   snprintf (proc_path, sizeof (proc_path), "/proc/%d/fd/%d", getpid (), fd);
   path_len = readlink (proc_path, path, sizeof (path) - 1);
   if (path_len < 1)
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Error determining path: %m");
-      goto out;
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Error determining path: %m");
+      return FALSE;
     }
   path[path_len] = '\0';
 
@@ -394,6 +524,21 @@ handle_loop_setup (UDisksManager          *object,
   g_variant_lookup (options, "offset", "t", &option_offset);
   g_variant_lookup (options, "size", "t", &option_size);
   g_variant_lookup (options, "no-part-scan", "b", &option_no_part_scan);
+  g_variant_lookup (options, "direct-io", "b", &option_direct_io);
+  g_variant_lookup (options, "logical-block-size", "u", &option_block_size);
+  g_variant_lookup (options, "queue-depth", "u", &option_queue_depth);
+
+  if (option_block_size != 0 &&
+      (option_block_size < 512 || option_block_size > (guint32) sysconf (_SC_PAGESIZE) ||
+       (option_block_size & (option_block_size - 1)) != 0))
+    {
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                   "Invalid logical block size %u",
+                   option_block_size);
+      return FALSE;
+    }
 
   /* it's not a problem if fstat fails... for example, this can happen if the user
    * passes a fd to a file on the GVfs fuse mount
@@ -401,31 +546,131 @@ handle_loop_setup (UDisksManager          *object,
   if (fstat (fd, &fd_statbuf) == 0)
     fd_statbuf_valid = TRUE;
 
-  error = NULL;
-  if (!bd_loop_setup_from_fd (fd,
-                              option_offset,
-                              option_size,
-                              option_read_only,
-                              !option_no_part_scan,
-                              &loop_name,
-                              &error))
-    {
-      g_prefix_error (&error, "Error creating loop device: ");
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
+  if (!loop_attach (fd,
+                    path,
+                    option_offset,
+                    option_size,
+                    option_read_only,
+                    !option_no_part_scan,
+                    option_direct_io,
+                    option_block_size,
+                    &loop_name,
+                    error))
+    {
+      g_prefix_error (error, "Error creating loop device: ");
+      return FALSE;
     }
 
-  loop_device = g_strdup_printf ("/dev/%s", loop_name);
+  if (option_queue_depth > 0 && !loop_set_queue_depth (loop_name, option_queue_depth, error))
+    {
+      bd_loop_teardown (loop_name, NULL);
+      g_free (loop_name);
+      return FALSE;
+    }
+
+  *out_loop_device = g_strdup_printf ("/dev/%s", loop_name);
+  *out_path = g_strdup (path);
+  g_free (loop_name);
 
   /* Update the udisks loop state file (/run/udisks2/loop) with information
    * about the new loop device created by us.
    */
   udisks_state_add_loop (udisks_daemon_get_state (manager->daemon),
-                        loop_device,
+                        *out_loop_device,
                         path,
                         fd_statbuf_valid ? fd_statbuf.st_dev : 0,
                         caller_uid);
 
+  return TRUE;
+}
+
+static gboolean
+loop_check_authorization (UDisksLinuxManager    *manager,
+                          GDBusMethodInvocation *invocation,
+                          GVariant              *options)
+{
+  /* Check if the user is authorized to create a loop device */
+  return udisks_daemon_util_check_authorization_sync (manager->daemon,
+                                                      NULL,
+                                                      "org.freedesktop.udisks2.loop-setup",
+                                                      options,
+                                                      /* Translators: Shown in authentication dialog when the user
+                                                       * requests setting up a loop device.
+                                                       */
+                                                      N_("Authentication is required to set up a loop device"),
+                                                      invocation);
+}
+
+/* Gets the fd at the index in @fd_index out of @fd_list */
+static gint
+loop_get_fd (GUnixFDList  *fd_list,
+             GVariant     *fd_index,
+             GError      **error)
+{
+  gint fd_num;
+  gint fd;
+
+  fd_num = g_variant_get_handle (fd_index);
+  if (fd_list == NULL || fd_num >= g_unix_fd_list_get_length (fd_list))
+    {
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Expected to use fd at index %d, but message has only %d fds",
+                   fd_num,
+                   fd_list == NULL ? 0 : g_unix_fd_list_get_length (fd_list));
+      return -1;
+    }
+  fd = g_unix_fd_list_get (fd_list, fd_num, error);
+  if (fd == -1)
+    g_prefix_error (error, "Error getting file descriptor %d from message: ", fd_num);
+  return fd;
+}
+
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_loop_setup (UDisksManager          *object,
+                   GDBusMethodInvocation  *invocation,
+                   GUnixFDList            *fd_list,
+                   GVariant               *fd_index,
+                   GVariant               *options)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
+  GError *error;
+  gint fd = -1;
+  gchar *path = NULL;
+  gchar *loop_device = NULL;
+  UDisksObject *loop_object = NULL;
+  uid_t caller_uid;
+  WaitForLoopData wait_data;
+
+  /* we need the uid of the caller for the loop file */
+  error = NULL;
+  if (!udisks_daemon_util_get_caller_uid_sync (manager->daemon, invocation, NULL /* GCancellable */, &caller_uid, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  if (!loop_check_authorization (manager, invocation, options))
+    goto out;
+
+  error = NULL;
+  fd = loop_get_fd (fd_list, fd_index, &error);
+  if (fd == -1)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  error = NULL;
+  if (!loop_setup (manager, fd, options, caller_uid, &loop_device, &path, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
   /* Determine the resulting object */
   error = NULL;
   wait_data.loop_device = loop_device;
@@ -462,12 +707,211 @@ handle_loop_setup (UDisksManager          *object,
   if (loop_object != NULL)
     g_object_unref (loop_object);
   g_free (loop_device);
-  g_free ((gpointer) loop_name);
+  g_free (path);
   if (fd != -1)
     close (fd);
   return TRUE; /* returning TRUE means that we handled the method invocation */
 }
 
+/* like wait_for_loop_object() but for all the set up devices at once */
+static UDisksObject **
+wait_for_loop_objects (UDisksDaemon *daemon,
+                       gpointer      user_data)
+{
+  GPtrArray *attached = user_data;
+  UDisksObject **ret;
+  guint n;
+
+  ret = g_new0 (UDisksObject *, attached->len + 1);
+  for (n = 0; n < attached->len; n++)
+    {
+      ret[n] = wait_for_loop_object (daemon, attached->pdata[n]);
+      if (ret[n] == NULL)
+        break;
+    }
+  if (n < attached->len)
+    {
+      for (n = 0; ret[n] != NULL; n++)
+        g_object_unref (ret[n]);
+      g_clear_pointer (&ret, g_free);
+    }
+
+  return ret;
+}
+
+static void
+wait_for_loop_data_free (WaitForLoopData *data)
+{
+  g_free ((gchar *) data->loop_device);
+  g_free ((gchar *) data->path);
+  g_free (data);
+}
+
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_loop_setup_many (UDisksManager          *object,
+                        GDBusMethodInvocation  *invocation,
+                        GUnixFDList            *fd_list,
+                        GVariant               *arg_devices,
+                        GVariant               *arg_options)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
+  GVariantBuilder builder;
+  GVariantIter iter;
+  GVariant *fd_index;
+  GVariant *device_options;
+  GPtrArray *attached;
+  GPtrArray *errors;
+  GPtrArray *uevent_paths;
+  UDisksObject **loop_objects = NULL;
+  GError *error = NULL;
+  uid_t caller_uid;
+  guint n, m;
+
+  attached = g_ptr_array_new_with_free_func ((GDestroyNotify) wait_for_loop_data_free);
+  errors = g_ptr_array_new ();
+  uevent_paths = g_ptr_array_new ();
+
+  if (!udisks_daemon_util_get_caller_uid_sync (manager->daemon, invocation, NULL /* GCancellable */, &caller_uid, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  /* one authorization check for all the devices */
+  if (!loop_check_authorization (manager, invocation, arg_options))
+    goto out;
+
+  /* errors are NULL for the devices set up, attached has an entry for each of them */
+  g_variant_iter_init (&iter, arg_devices);
+  while (g_variant_iter_next (&iter, "(@h@a{sv})", &fd_index, &device_options))
+    {
+      GVariantDict dict;
+      GVariant *merged_options;
+      GVariantIter option_iter;
+      const gchar *key;
+      GVariant *value;
+      WaitForLoopData *data;
+      gchar *loop_device = NULL;
+      gchar *path = NULL;
+      gint fd;
+
+      /* per-device options take precedence over the common ones */
+      g_variant_dict_init (&dict, arg_options);
+      g_variant_iter_init (&option_iter, device_options);
+      while (g_variant_iter_next (&option_iter, "{&sv}", &key, &value))
+        {
+          g_variant_dict_insert_value (&dict, key, value);
+          g_variant_unref (value);
+        }
+      merged_options = g_variant_ref_sink (g_variant_dict_end (&dict));
+
+      fd = loop_get_fd (fd_list, fd_index, &error);
+      if (fd != -1)
+        {
+          loop_setup (manager, fd, merged_options, caller_uid, &loop_device, &path, &error);
+          close (fd);
+        }
+
+      g_ptr_array_add (errors, error);
+      error = NULL;
+      if (loop_device != NULL)
+        {
+          data = g_new0 (WaitForLoopData, 1);
+          data->loop_device = loop_device;
+          data->path = path;
+          g_ptr_array_add (attached, data);
+          g_ptr_array_add (uevent_paths, loop_device);
+        }
+
+      g_variant_unref (merged_options);
+      g_variant_unref (device_options);
+      g_variant_unref (fd_index);
+    }
+  g_ptr_array_add (uevent_paths, NULL);
+
+  /* a single settle for all the new loop devices */
+  if (attached->len > 0)
+    {
+      udisks_daemon_util_trigger_uevents_sync (manager->daemon,
+                                               (const gchar * const *) uevent_paths->pdata,
+                                               UDISKS_DEFAULT_WAIT_TIMEOUT,
+                                               NULL);
+      loop_objects = udisks_daemon_wait_for_objects_sync (manager->daemon,
+                                                          wait_for_loop_objects,
+                                                          attached,
+                                                          NULL,
+                                                          UDISKS_DEFAULT_WAIT_TIMEOUT,
+                                                          &error);
+      if (loop_objects == NULL)
+        {
+          /* pick up the devices that did show up, the others fail below */
+          loop_objects = g_new0 (UDisksObject *, attached->len + 1);
+          for (n = 0; n < attached->len; n++)
+            loop_objects[n] = wait_for_loop_object (manager->daemon, attached->pdata[n]);
+        }
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(obs)"));
+  for (n = 0, m = 0; n < errors->len; n++)
+    {
+      GError *device_error = errors->pdata[n];
+      WaitForLoopData *data;
+      gchar *message;
+      gchar *loop_name;
+
+      if (device_error != NULL)
+        {
+          g_variant_builder_add (&builder, "(obs)", "/", FALSE, device_error->message);
+          continue;
+        }
+
+      data = attached->pdata[m];
+      if (loop_objects[m] != NULL)
+        {
+          udisks_notice ("Set up loop device %s (backed by %s)", data->loop_device, data->path);
+          g_variant_builder_add (&builder, "(obs)",
+                                 g_dbus_object_get_object_path (G_DBUS_OBJECT (loop_objects[m])),
+                                 TRUE, "");
+        }
+      else
+        {
+          /* the caller has no object to detach it with */
+          message = g_strdup_printf ("Error waiting for loop object after creating '%s': %s",
+                                     data->loop_device, error->message);
+          udisks_warning ("%s", message);
+          g_variant_builder_add (&builder, "(obs)", "/", FALSE, message);
+          g_free (message);
+          loop_name = g_path_get_basename (data->loop_device);
+          bd_loop_teardown (loop_name, NULL);
+          g_free (loop_name);
+        }
+      m++;
+    }
+  g_clear_error (&error);
+
+  udisks_manager_complete_loop_setup_many (object,
+                                           invocation,
+                                           NULL, /* fd_list */
+                                           g_variant_builder_end (&builder));
+
+ out:
+  if (loop_objects != NULL)
+    {
+      for (n = 0; n < attached->len; n++)
+        if (loop_objects[n] != NULL)
+          g_object_unref (loop_objects[n]);
+      g_free (loop_objects);
+    }
+  for (n = 0; n < errors->len; n++)
+    if (errors->pdata[n] != NULL)
+      g_error_free (errors->pdata[n]);
+  g_ptr_array_free (uevent_paths, TRUE);
+  g_ptr_array_free (errors, TRUE);
+  g_ptr_array_free (attached, TRUE);
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 typedef struct
@@ -536,6 +980,7 @@ handle_mdraid_create (UDisksManager         *_object,
   UDisksBaseJob *job = NULL;
   const gchar **disks = NULL;
   guint disks_top = 0;
+  const gchar **uevent_paths = NULL;
   gboolean success = FALSE;
 
   if (!udisks_daemon_util_get_caller_uid_sync (manager->daemon,
@@ -771,9 +1216,21 @@ handle_mdraid_create (UDisksManager         *_object,
   else
     raid_device_file = g_strdup (array_name);
 
-  /* trigger uevent on the newly created md node */
-  udisks_daemon_util_trigger_uevent_sync (manager->daemon, raid_device_file, NULL,
-                                          UDISKS_DEFAULT_WAIT_TIMEOUT);
+  /* trigger uevents on the newly created md node and on the members at
+   * once - the latter so the udev database is updated for them with e.g.
+   * ID_FS_TYPE. Ideally mdadm(8) or whatever thing is writing out the RAID
+   * metadata would ensure this, but that's not how things currently work :-/
+   */
+  uevent_paths = g_new0 (const gchar *, disks_top + 2);
+  uevent_paths[0] = raid_device_file;
+  for (n = 0; n < disks_top; n++)
+    uevent_paths[n + 1] = disks[n];
+  if (!udisks_daemon_util_trigger_uevents_sync (manager->daemon, uevent_paths,
+                                                UDISKS_DEFAULT_WAIT_TIMEOUT, &error))
+    {
+      udisks_debug ("Error waiting for uevents after creating '%s': %s", raid_device_file, error->message);
+      g_clear_error (&error);
+    }
 
   /* ... then, sit and wait for raid array object to show up */
   array_object = udisks_daemon_wait_for_object_sync (manager->daemon,
@@ -837,27 +1294,6 @@ handle_mdraid_create (UDisksManager         *_object,
         }
     }
 
-  /* ... finally trigger uevents on the members - we want this so the
-   * udev database is updated for them with e.g. ID_FS_TYPE. Ideally
-   * mdadm(8) or whatever thing is writing out the RAID metadata would
-   * ensure this, but that's not how things currently work :-/
-   */
-  for (l = blocks; l != NULL; l = l->next)
-    {
-      UDisksBlock *block = UDISKS_BLOCK (l->data);
-      UDisksObject *object_for_block;
-      object_for_block = udisks_daemon_util_dup_object (block, &error);
-      if (object_for_block == NULL)
-        {
-          g_dbus_method_invocation_return_gerror (invocation, error);
-          g_clear_error (&error);
-          success = FALSE;
-          goto out;
-        }
-      udisks_linux_block_object_trigger_uevent (UDISKS_LINUX_BLOCK_OBJECT (object_for_block));
-      g_object_unref (object_for_block);
-    }
-
   /* ... and, we're done! */
   udisks_manager_complete_mdraid_create (_object,
                                          invocation,
@@ -872,6 +1308,7 @@ handle_mdraid_create (UDisksManager         *_object,
       udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), success, NULL);
     }
 
+  g_free (uevent_paths);
   g_strfreev ((gchar **) disks);
   g_free (raid_device_file);
   g_free (raid_node);
@@ -930,6 +1367,82 @@ load_modules_in_idle_cb (gpointer user_data)
   return G_SOURCE_REMOVE;
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_format_many (UDisksManager         *object,
+                    GDBusMethodInvocation *invocation,
+                    GVariant              *arg_devices,
+                    GVariant              *arg_options)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
+  GVariant *results;
+  GError *error = NULL;
+
+  results = udisks_linux_block_format_many_sync (manager->daemon, invocation, arg_devices, arg_options, &error);
+  if (results == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  udisks_manager_complete_format_many (object, invocation, results);
+  g_variant_unref (results);
+
+ out:
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_unlock_many (UDisksManager         *object,
+                    GDBusMethodInvocation *invocation,
+                    GVariant              *arg_devices,
+                    GVariant              *arg_options)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
+  GVariant *results;
+  GError *error = NULL;
+
+  results = udisks_linux_encrypted_unlock_many_sync (manager->daemon, invocation, arg_devices, arg_options, &error);
+  if (results == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  udisks_manager_complete_unlock_many (object, invocation, results);
+  g_variant_unref (results);
+
+ out:
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_trim_all (UDisksManager         *object,
+                 GDBusMethodInvocation *invocation,
+                 GVariant              *arg_options)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
+  GVariant *results;
+  GError *error = NULL;
+
+  results = udisks_linux_filesystem_trim_all_sync (manager->daemon, invocation, arg_options, &error);
+  if (results == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  udisks_manager_complete_trim_all (object, invocation, results);
+  g_variant_unref (results);
+
+ out:
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
 static gboolean
 handle_enable_modules (UDisksManager         *object,
                        GDBusMethodInvocation *invocation,
@@ -1275,7 +1788,11 @@ static void
 manager_iface_init (UDisksManagerIface *iface)
 {
   iface->handle_loop_setup = handle_loop_setup;
+  iface->handle_loop_setup_many = handle_loop_setup_many;
   iface->handle_mdraid_create = handle_mdraid_create;
+  iface->handle_format_many = handle_format_many;
+  iface->handle_unlock_many = handle_unlock_many;
+  iface->handle_trim_all = handle_trim_all;
   iface->handle_enable_modules = handle_enable_modules;
   iface->handle_enable_module = handle_enable_module;
   iface->handle_can_format = handle_can_format;
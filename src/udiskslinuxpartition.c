@@ -44,6 +44,7 @@
 #include "udiskslinuxblock.h"
 #include "udiskssimplejob.h"
 #include "udisksstate.h"
+#include "udisksjobscheduler.h"
 
 /**
  * SECTION:udiskslinuxpartition
@@ -330,6 +331,7 @@ handle_set_flags (UDisksPartition       *partition,
   UDisksBlock *block = NULL;
   UDisksObject *object = NULL;
   UDisksDaemon *daemon = NULL;
+  gpointer reservation = NULL;
   UDisksState *state = NULL;
   gchar *device_name = NULL;
   UDisksObject *partition_table_object = NULL;
@@ -364,6 +366,9 @@ handle_set_flags (UDisksPartition       *partition,
   device_name = udisks_block_dup_device (partition_table_block);
   partition_name = udisks_block_dup_device (block);
 
+  /* wait for our turn on the drive before taking the cleanup lock */
+  reservation = udisks_job_scheduler_reserve_sync (udisks_daemon_get_job_scheduler (daemon),
+                                                   object, "partition-modify", NULL);
   udisks_linux_block_object_lock_for_cleanup (UDISKS_LINUX_BLOCK_OBJECT (object));
   udisks_state_check_block (state, udisks_linux_block_object_get_device_number (UDISKS_LINUX_BLOCK_OBJECT (object)));
 
@@ -453,6 +458,8 @@ handle_set_flags (UDisksPartition       *partition,
     close (fd);
   if (object != NULL)
     udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (object));
+  if (reservation != NULL)
+    udisks_job_scheduler_release_reservation (udisks_daemon_get_job_scheduler (daemon), reservation);
   if (state != NULL)
     udisks_state_check (state);
   g_free (device_name);
@@ -480,6 +487,7 @@ handle_set_name (UDisksPartition       *partition,
   UDisksBlock *block = NULL;
   UDisksObject *object = NULL;
   UDisksDaemon *daemon = NULL;
+  gpointer reservation = NULL;
   UDisksState *state = NULL;
   gchar *device_name = NULL;
   gchar *partition_name = NULL;
@@ -507,6 +515,9 @@ handle_set_name (UDisksPartition       *partition,
   state = udisks_daemon_get_state (daemon);
   block = udisks_object_get_block (object);
 
+  /* wait for our turn on the drive before taking the cleanup lock */
+  reservation = udisks_job_scheduler_reserve_sync (udisks_daemon_get_job_scheduler (daemon),
+                                                   object, "partition-modify", NULL);
   udisks_linux_block_object_lock_for_cleanup (UDISKS_LINUX_BLOCK_OBJECT (object));
   udisks_state_check_block (state, udisks_linux_block_object_get_device_number (UDISKS_LINUX_BLOCK_OBJECT (object)));
 
@@ -580,6 +591,8 @@ handle_set_name (UDisksPartition       *partition,
     close (fd);
   if (object != NULL)
     udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (object));
+  if (reservation != NULL)
+    udisks_job_scheduler_release_reservation (udisks_daemon_get_job_scheduler (daemon), reservation);
   if (state != NULL)
     udisks_state_check (state);
   g_free (device_name);
@@ -854,6 +867,7 @@ handle_resize (UDisksPartition       *partition,
   UDisksBlock *block = NULL;
   UDisksObject *object = NULL;
   UDisksDaemon *daemon = NULL;
+  gpointer reservation = NULL;
   UDisksState *state = NULL;
   UDisksObject *partition_table_object = NULL;
   UDisksBlock *partition_table_block = NULL;
@@ -886,6 +900,9 @@ handle_resize (UDisksPartition       *partition,
   partition_table_object = udisks_daemon_find_object (daemon, udisks_partition_get_table (partition));
   partition_table_block = udisks_object_get_block (partition_table_object);
 
+  /* wait for our turn on the drive before taking the cleanup lock */
+  reservation = udisks_job_scheduler_reserve_sync (udisks_daemon_get_job_scheduler (daemon),
+                                                   object, "partition-modify", NULL);
   udisks_linux_block_object_lock_for_cleanup (UDISKS_LINUX_BLOCK_OBJECT (object));
   udisks_state_check_block (state, udisks_linux_block_object_get_device_number (UDISKS_LINUX_BLOCK_OBJECT (object)));
 
@@ -950,6 +967,8 @@ handle_resize (UDisksPartition       *partition,
  out:
   if (object != NULL)
     udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (object));
+  if (reservation != NULL)
+    udisks_job_scheduler_release_reservation (udisks_daemon_get_job_scheduler (daemon), reservation);
   if (state != NULL)
     udisks_state_check (state);
   g_clear_error (&error);
@@ -974,6 +993,7 @@ handle_delete (UDisksPartition       *partition,
   UDisksBlock *block = NULL;
   UDisksObject *object = NULL;
   UDisksDaemon *daemon = NULL;
+  gpointer reservation = NULL;
   UDisksState *state = NULL;
   gchar *device_name = NULL;
   gchar *partition_name = NULL;
@@ -1004,6 +1024,9 @@ handle_delete (UDisksPartition       *partition,
   partition_table_object = udisks_daemon_find_object (daemon, udisks_partition_get_table (partition));
   partition_table_block = udisks_object_get_block (partition_table_object);
 
+  /* wait for our turn on the drive before taking the cleanup lock */
+  reservation = udisks_job_scheduler_reserve_sync (udisks_daemon_get_job_scheduler (daemon),
+                                                   object, "partition-delete", NULL);
   udisks_linux_block_object_lock_for_cleanup (UDISKS_LINUX_BLOCK_OBJECT (object));
   udisks_state_check_block (state, udisks_linux_block_object_get_device_number (UDISKS_LINUX_BLOCK_OBJECT (object)));
 
@@ -1056,6 +1079,8 @@ handle_delete (UDisksPartition       *partition,
  out:
   if (object != NULL)
     udisks_linux_block_object_release_cleanup_lock (UDISKS_LINUX_BLOCK_OBJECT (object));
+  if (reservation != NULL)
+    udisks_job_scheduler_release_reservation (udisks_daemon_get_job_scheduler (daemon), reservation);
   if (state != NULL)
     udisks_state_check (state);
   g_free (device_name);
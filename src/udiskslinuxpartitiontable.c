@@ -245,64 +245,92 @@ wait_for_partition (UDisksDaemon *daemon,
   return ret;
 }
 
-#define MIB_SIZE (1048576L)
-
-static UDisksObject *
-udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *table,
-                                                      GDBusMethodInvocation  *invocation,
-                                                      guint64                 offset,
-                                                      guint64                 size,
-                                                      const gchar            *type,
-                                                      const gchar            *name,
-                                                      GVariant               *options)
+typedef struct
 {
-  const gchar *action_id = NULL;
-  const gchar *message = NULL;
-  UDisksBlock *block = NULL;
-  UDisksObject *object = NULL;
-  UDisksDaemon *daemon = NULL;
-  gchar *device_name = NULL;
-  WaitForPartitionData *wait_data = NULL;
-  UDisksObject *partition_object = NULL;
-  UDisksBlock *partition_block = NULL;
-  BDPartSpec *part_spec = NULL;
-  BDPartSpec *overlapping_part = NULL;
-  BDPartTypeReq part_type = 0;
-  gchar *table_type = NULL;
-  uid_t caller_uid;
-  GError *error = NULL;
-  UDisksBaseJob *job = NULL;
-  const gchar *partition_type = NULL;
+  UDisksObject *partition_table_object;
+  guint         num_partitions;
+  guint64      *pos_to_wait_for;
+  gboolean     *ignore_container;
+} WaitForPartitionsData;
+
+/* like wait_for_partition() but for several partitions at once, with a single pass over the objects */
+static UDisksObject **
+wait_for_partitions (UDisksDaemon *daemon,
+                     gpointer      user_data)
+{
+  WaitForPartitionsData *data = user_data;
+  UDisksObject **ret = NULL;
+  GList *objects, *l;
+  guint found = 0;
+  guint n;
 
-  object = udisks_daemon_util_dup_object (table, &error);
-  if (object == NULL)
+  ret = g_new0 (UDisksObject *, data->num_partitions + 1);
+  objects = udisks_daemon_get_objects (daemon);
+  for (l = objects; l != NULL && found < data->num_partitions; l = l->next)
     {
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
-    }
+      UDisksObject *object = UDISKS_OBJECT (l->data);
+      UDisksPartition *partition = udisks_object_peek_partition (object);
+      guint64 offset;
+      guint64 size;
 
-  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
+      if (partition == NULL)
+        continue;
+      if (g_strcmp0 (udisks_partition_get_table (partition),
+                     g_dbus_object_get_object_path (G_DBUS_OBJECT (data->partition_table_object))) != 0)
+        continue;
 
-  g_variant_lookup (options, "partition-type", "&s", &partition_type);
+      offset = udisks_partition_get_offset (partition);
+      size = udisks_partition_get_size (partition);
+      for (n = 0; n < data->num_partitions; n++)
+        {
+          if (ret[n] != NULL)
+            continue;
+          if (data->pos_to_wait_for[n] >= offset && data->pos_to_wait_for[n] < offset + size &&
+              !(udisks_partition_get_is_container (partition) && data->ignore_container[n]))
+            {
+              ret[n] = g_object_ref (object);
+              found++;
+              break;
+            }
+        }
+    }
+  g_list_free_full (objects, g_object_unref);
 
-  block = udisks_object_get_block (object);
-  if (block == NULL)
+  if (found < data->num_partitions)
     {
-      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                             "Partition table object is not a block device");
-      goto out;
+      for (n = 0; n < data->num_partitions; n++)
+        g_clear_object (&ret[n]);
+      g_free (ret);
+      ret = NULL;
     }
 
-  error = NULL;
+  return ret;
+}
+
+#define MIB_SIZE (1048576L)
+
+/* checks that the caller may create partitions on @object, returns FALSE if @invocation has been handled */
+static gboolean
+check_create_partition_authorization (UDisksDaemon          *daemon,
+                                      UDisksObject          *object,
+                                      UDisksBlock           *block,
+                                      GDBusMethodInvocation *invocation,
+                                      GVariant              *options,
+                                      uid_t                 *out_caller_uid)
+{
+  const gchar *action_id = NULL;
+  const gchar *message = NULL;
+  GError *error = NULL;
+
   if (!udisks_daemon_util_get_caller_uid_sync (daemon,
                                                invocation,
                                                NULL /* GCancellable */,
-                                               &caller_uid,
+                                               out_caller_uid,
                                                &error))
     {
       g_dbus_method_invocation_return_gerror (invocation, error);
       g_clear_error (&error);
-      goto out;
+      return FALSE;
     }
 
   action_id = "org.freedesktop.udisks2.modify-device";
@@ -313,30 +341,35 @@ udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *ta
    * will be replaced by the name of the drive/device in question
    */
   message = N_("Authentication is required to create a partition on $(drive)");
-  if (!udisks_daemon_util_setup_by_user (daemon, object, caller_uid))
+  if (!udisks_daemon_util_setup_by_user (daemon, object, *out_caller_uid))
     {
       if (udisks_block_get_hint_system (block))
         {
           action_id = "org.freedesktop.udisks2.modify-device-system";
         }
-      else if (!udisks_daemon_util_on_user_seat (daemon, object, caller_uid))
+      else if (!udisks_daemon_util_on_user_seat (daemon, object, *out_caller_uid))
         {
           action_id = "org.freedesktop.udisks2.modify-device-other-seat";
         }
     }
 
-  if (!udisks_daemon_util_check_authorization_sync (daemon,
-                                                    object,
-                                                    action_id,
-                                                    options,
-                                                    message,
-                                                    invocation))
-    goto out;
-
-  device_name = g_strdup (udisks_block_get_device (block));
+  return udisks_daemon_util_check_authorization_sync (daemon,
+                                                      object,
+                                                      action_id,
+                                                      options,
+                                                      message,
+                                                      invocation);
+}
 
-  table_type = udisks_partition_table_dup_type_ (table);
-  wait_data = g_new0 (WaitForPartitionData, 1);
+/* determines whether to create a primary, extended or logical partition */
+static gboolean
+get_part_type_req (const gchar    *table_type,
+                   const gchar    *type,
+                   const gchar    *name,
+                   const gchar    *partition_type,
+                   BDPartTypeReq  *out_part_type,
+                   GError        **error)
+{
   if (g_strcmp0 (table_type, "dos") == 0)
     {
       char *endp;
@@ -344,68 +377,73 @@ udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *ta
 
       if (strlen (name) > 0)
         {
-          g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                                 "MBR partition table does not support names");
-          goto out;
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "MBR partition table does not support names");
+          return FALSE;
         }
 
       type_as_int = strtol (type, &endp, 0);
 
-      /* Determine whether we are creating a primary, extended or logical partition */
       if (partition_type != NULL)
         {
           if (g_strcmp0 (partition_type, "primary") == 0)
             {
-              part_type = BD_PART_TYPE_REQ_NORMAL;
+              *out_part_type = BD_PART_TYPE_REQ_NORMAL;
             }
           else if (g_strcmp0 (partition_type, "extended") == 0)
             {
-              part_type = BD_PART_TYPE_REQ_EXTENDED;
+              *out_part_type = BD_PART_TYPE_REQ_EXTENDED;
             }
           else if (g_strcmp0 (partition_type, "logical") == 0)
             {
-              part_type = BD_PART_TYPE_REQ_LOGICAL;
+              *out_part_type = BD_PART_TYPE_REQ_LOGICAL;
             }
           else
             {
-              g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                                     "Don't know how to create partition of type `%s'",
-                                                     partition_type);
-              goto out;
+              g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                           "Don't know how to create partition of type `%s'",
+                           partition_type);
+              return FALSE;
             }
         }
       else if (type[0] != '\0' && *endp == '\0' &&
                (type_as_int == 0x05 || type_as_int == 0x0f || type_as_int == 0x85))
         {
-          part_type = BD_PART_TYPE_REQ_EXTENDED;
+          *out_part_type = BD_PART_TYPE_REQ_EXTENDED;
         }
       else
-        part_type = BD_PART_TYPE_REQ_NEXT;
+        *out_part_type = BD_PART_TYPE_REQ_NEXT;
     }
   else if (g_strcmp0 (table_type, "gpt") == 0)
     {
-      part_type = BD_PART_TYPE_REQ_NORMAL;
+      *out_part_type = BD_PART_TYPE_REQ_NORMAL;
     }
   else
     {
-      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                             "Don't know how to create partitions this partition table of type `%s'",
-                                             table_type);
-      goto out;
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Don't know how to create partitions this partition table of type `%s'",
+                   table_type);
+      return FALSE;
     }
 
-  job = udisks_daemon_launch_simple_job (daemon,
-                                         UDISKS_OBJECT (object),
-                                         "partition-create",
-                                         caller_uid,
-                                         NULL);
+  return TRUE;
+}
 
-  if (job == NULL)
-    {
-      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                             "Failed to create a job object");
-      goto out;
-    }
+/* Creates the partition, sets its name and type and wipes it. Doesn't wait for it to appear. */
+static BDPartSpec *
+create_partition_sync (const gchar    *device_name,
+                       const gchar    *table_type,
+                       BDPartTypeReq   part_type,
+                       guint64         offset,
+                       guint64         size,
+                       const gchar    *type,
+                       const gchar    *name,
+                       GError        **error)
+{
+  BDPartSpec *part_spec = NULL;
+  BDPartSpec *overlapping_part = NULL;
+  GError *local_error = NULL;
+  gboolean ret;
 
   /* Users might want to specify logical partitions start and size using size of
    * of the extended partition. If this happens we need to shift start (offset)
@@ -416,7 +454,7 @@ udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *ta
    *      use case. But we should definitely provide some functionality to get
    *      right "numbers" and stop doing this.
   */
-  overlapping_part = bd_part_get_part_by_pos (device_name, offset, &error);
+  overlapping_part = bd_part_get_part_by_pos (device_name, offset, &local_error);
   if (overlapping_part != NULL && ! (overlapping_part->type & BD_PART_TYPE_FREESPACE))
     {
       /* extended partition or metadata of the extended partition */
@@ -434,58 +472,50 @@ udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *ta
       else
         {
           /* overlapping partition is not a free space nor an extended part -> error */
-          g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                                 "Requested start for the new partition %"G_GUINT64_FORMAT" "
-                                                 "overlaps with existing partition %s.",
-                                                  offset, overlapping_part->path);
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Requested start for the new partition %"G_GUINT64_FORMAT" "
+                       "overlaps with existing partition %s.",
+                       offset, overlapping_part->path);
           goto out;
         }
     }
   else
-    g_clear_error (&error);
+    g_clear_error (&local_error);
 
   part_spec = bd_part_create_part (device_name, part_type, offset,
-                                   size, BD_PART_ALIGN_OPTIMAL, &error);
+                                   size, BD_PART_ALIGN_OPTIMAL, &local_error);
   if (!part_spec)
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Error creating partition on %s: %s",
-                                             udisks_block_get_device (block),
-                                             error->message);
-      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error creating partition on %s: %s",
+                   device_name,
+                   local_error->message);
       goto out;
     }
 
   /* set name if given */
   if (g_strcmp0 (table_type, "gpt") == 0 && strlen (name) > 0)
     {
-      if (!bd_part_set_part_name (device_name, part_spec->path, name, &error))
+      if (!bd_part_set_part_name (device_name, part_spec->path, name, &local_error))
         {
-          g_prefix_error (&error, "Error setting name for newly created partition: ");
-          g_dbus_method_invocation_take_error (invocation, error);
-          udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
-          goto out;
+          g_prefix_error (&local_error, "Error setting name for newly created partition: ");
+          goto fail;
         }
     }
 
   /* set type if given and if not extended partition */
   if (part_spec->type != BD_PART_TYPE_EXTENDED && strlen (type) > 0)
     {
-      gboolean ret = FALSE;
-
+      ret = FALSE;
       if (g_strcmp0 (table_type, "gpt") == 0)
-          ret = bd_part_set_part_type (device_name, part_spec->path, type, &error);
+          ret = bd_part_set_part_type (device_name, part_spec->path, type, &local_error);
       else if (g_strcmp0 (table_type, "dos") == 0)
-          ret = bd_part_set_part_id (device_name, part_spec->path, type, &error);
+          ret = bd_part_set_part_id (device_name, part_spec->path, type, &local_error);
 
       if (!ret)
         {
-          g_prefix_error (&error, "Error setting type for newly created partition: ");
-          g_dbus_method_invocation_take_error (invocation, error);
-          udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
-          goto out;
+          g_prefix_error (&local_error, "Error setting type for newly created partition: ");
+          goto fail;
         }
     }
 
@@ -493,26 +523,118 @@ udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *ta
   if (part_spec->type != BD_PART_TYPE_EXTENDED)
     {
 #ifdef HAVE_LIBBLOCKDEV3
-      if (!bd_fs_wipe (part_spec->path, TRUE, FALSE, &error))
+      if (!bd_fs_wipe (part_spec->path, TRUE, FALSE, &local_error))
 #else
-      if (!bd_fs_wipe_force (part_spec->path, TRUE, FALSE, &error))
+      if (!bd_fs_wipe_force (part_spec->path, TRUE, FALSE, &local_error))
 #endif
         {
-          if (g_error_matches (error, BD_FS_ERROR, BD_FS_ERROR_NOFS))
-            g_clear_error (&error);
+          if (g_error_matches (local_error, BD_FS_ERROR, BD_FS_ERROR_NOFS))
+            g_clear_error (&local_error);
           else
             {
-              g_dbus_method_invocation_return_error (invocation,
-                                                     UDISKS_ERROR,
-                                                     UDISKS_ERROR_FAILED,
-                                                     "Error wiping newly created partition %s: %s",
-                                                     part_spec->path,
-                                                     error->message);
-              udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+              g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                           "Error wiping newly created partition %s: %s",
+                           part_spec->path,
+                           local_error->message);
+              bd_part_spec_free (part_spec);
+              part_spec = NULL;
               goto out;
             }
         }
     }
+  goto out;
+
+ fail:
+  g_propagate_error (error, local_error);
+  local_error = NULL;
+  bd_part_spec_free (part_spec);
+  part_spec = NULL;
+
+ out:
+  g_clear_error (&local_error);
+  if (overlapping_part)
+    bd_part_spec_free (overlapping_part);
+  return part_spec;
+}
+
+static UDisksObject *
+udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *table,
+                                                      GDBusMethodInvocation  *invocation,
+                                                      guint64                 offset,
+                                                      guint64                 size,
+                                                      const gchar            *type,
+                                                      const gchar            *name,
+                                                      GVariant               *options)
+{
+  UDisksBlock *block = NULL;
+  UDisksObject *object = NULL;
+  UDisksDaemon *daemon = NULL;
+  gchar *device_name = NULL;
+  WaitForPartitionData *wait_data = NULL;
+  UDisksObject *partition_object = NULL;
+  UDisksBlock *partition_block = NULL;
+  BDPartSpec *part_spec = NULL;
+  BDPartTypeReq part_type = 0;
+  gchar *table_type = NULL;
+  uid_t caller_uid;
+  GError *error = NULL;
+  UDisksBaseJob *job = NULL;
+  const gchar *partition_type = NULL;
+
+  object = udisks_daemon_util_dup_object (table, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
+
+  g_variant_lookup (options, "partition-type", "&s", &partition_type);
+
+  block = udisks_object_get_block (object);
+  if (block == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "Partition table object is not a block device");
+      goto out;
+    }
+
+  if (!check_create_partition_authorization (daemon, object, block, invocation, options, &caller_uid))
+    goto out;
+
+  device_name = g_strdup (udisks_block_get_device (block));
+
+  table_type = udisks_partition_table_dup_type_ (table);
+  wait_data = g_new0 (WaitForPartitionData, 1);
+  if (!get_part_type_req (table_type, type, name, partition_type, &part_type, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      error = NULL;
+      goto out;
+    }
+
+  job = udisks_daemon_launch_simple_job (daemon,
+                                         UDISKS_OBJECT (object),
+                                         "partition-create",
+                                         caller_uid,
+                                         NULL);
+
+  if (job == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "Failed to create a job object");
+      goto out;
+    }
+
+  part_spec = create_partition_sync (device_name, table_type, part_type, offset, size, type, name, &error);
+  if (!part_spec)
+    {
+      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+      g_dbus_method_invocation_take_error (invocation, error);
+      error = NULL;
+      goto out;
+    }
 
   wait_data->ignore_container = (part_spec->type == BD_PART_TYPE_LOGICAL);
   wait_data->pos_to_wait_for = part_spec->start + (part_spec->size / 2L);
@@ -530,8 +652,9 @@ udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *ta
   if (partition_object == NULL)
     {
       g_prefix_error (&error, "Error waiting for partition to appear: ");
-      g_dbus_method_invocation_take_error (invocation, error);
       udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+      g_dbus_method_invocation_take_error (invocation, error);
+      error = NULL;
       goto out;
     }
   partition_block = udisks_object_get_block (partition_object);
@@ -563,8 +686,6 @@ udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *ta
   g_clear_object (&block);
   if (part_spec)
     bd_part_spec_free (part_spec);
-  if (overlapping_part)
-    bd_part_spec_free (overlapping_part);
   return partition_object;
 }
 
@@ -701,9 +822,398 @@ handle_create_partition_and_format (UDisksPartitionTable   *table,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+typedef struct
+{
+  guint64      offset;
+  guint64      size;
+  const gchar *type;
+  const gchar *name;
+  GVariant    *options;
+  const gchar *format_type;
+  GVariant    *format_options;
+  BDPartTypeReq part_type;
+  BDPartSpec  *part_spec;
+  /* set by validate_partition_layout() */
+  guint64      end;
+  gboolean     logical;
+} PartitionRequest;
+
+static void
+partition_request_clear (PartitionRequest *request)
+{
+  if (request->part_spec != NULL)
+    bd_part_spec_free (request->part_spec);
+  g_clear_pointer (&request->options, g_variant_unref);
+  g_clear_pointer (&request->format_options, g_variant_unref);
+}
+
+static gboolean
+ranges_overlap (guint64 start1, guint64 end1,
+                guint64 start2, guint64 end2)
+{
+  return start1 < end2 && start2 < end1;
+}
+
+/* Checks that @requests fit on the disk and overlap neither each other nor
+ * the existing partitions, except for logical partitions inside an extended
+ * one. A size of 0 extends a partition up to the next existing partition or
+ * the end of the disk (or the extended partition), as libblockdev does.
+ */
+static gboolean
+validate_partition_layout (const gchar       *device_name,
+                           guint64            disk_size,
+                           PartitionRequest  *requests,
+                           guint              num_requests,
+                           GError           **error)
+{
+  BDPartSpec **existing;
+  GError *local_error = NULL;
+  gboolean ret = FALSE;
+  guint n, m;
+
+  existing = bd_part_get_disk_parts (device_name, &local_error);
+  if (existing == NULL && local_error != NULL)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error getting the partitions on %s: %s", device_name, local_error->message);
+      g_clear_error (&local_error);
+      goto out;
+    }
+
+  for (n = 0; n < num_requests; n++)
+    {
+      PartitionRequest *request = &requests[n];
+      guint64 container_start = 0;
+      guint64 container_end = disk_size;
+      gboolean in_extended = FALSE;
+
+      if (request->offset >= disk_size ||
+          (request->size > 0 && request->size > disk_size - request->offset))
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Partition %u: does not fit on %s", n, device_name);
+          goto out;
+        }
+
+      /* the extended partition, existing or requested, the partition starts in */
+      for (m = 0; existing != NULL && existing[m] != NULL; m++)
+        {
+          if ((existing[m]->type & BD_PART_TYPE_EXTENDED) &&
+              request->offset >= existing[m]->start &&
+              request->offset < existing[m]->start + existing[m]->size)
+            {
+              container_start = existing[m]->start;
+              container_end = existing[m]->start + existing[m]->size;
+              in_extended = TRUE;
+            }
+        }
+      for (m = 0; m < n; m++)
+        {
+          if (requests[m].part_type == BD_PART_TYPE_REQ_EXTENDED &&
+              request->offset >= requests[m].offset && request->offset < requests[m].end)
+            {
+              container_start = requests[m].offset;
+              container_end = requests[m].end;
+              in_extended = TRUE;
+            }
+        }
+      request->logical = request->part_type == BD_PART_TYPE_REQ_LOGICAL ||
+                         (request->part_type == BD_PART_TYPE_REQ_NEXT && in_extended);
+      if (request->logical && !in_extended)
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Partition %u: logical partition outside of an extended partition", n);
+          goto out;
+        }
+      if (!request->logical)
+        {
+          container_start = 0;
+          container_end = disk_size;
+        }
+
+      if (request->size > 0)
+        {
+          request->end = request->offset + request->size;
+        }
+      else
+        {
+          request->end = container_end;
+          for (m = 0; existing != NULL && existing[m] != NULL; m++)
+            {
+              guint64 start = existing[m]->start;
+
+              /* only partitions on the same level stop the new one */
+              if (((existing[m]->type & BD_PART_TYPE_LOGICAL) != 0) != request->logical)
+                continue;
+              if (start > request->offset && start < request->end && start >= container_start)
+                request->end = start;
+            }
+        }
+      if (request->end > container_end)
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Partition %u: does not fit in the extended partition", n);
+          goto out;
+        }
+
+      for (m = 0; existing != NULL && existing[m] != NULL; m++)
+        {
+          BDPartSpec *part = existing[m];
+
+          if (request->logical && (part->type & BD_PART_TYPE_EXTENDED))
+            continue;
+          if (!request->logical && (part->type & BD_PART_TYPE_LOGICAL))
+            continue;
+          if (ranges_overlap (request->offset, request->end, part->start, part->start + part->size))
+            {
+              g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                           "Partition %u: overlaps with existing partition %s", n, part->path);
+              goto out;
+            }
+        }
+      for (m = 0; m < n; m++)
+        {
+          PartitionRequest *other = &requests[m];
+
+          if (request->logical != other->logical &&
+              (request->part_type == BD_PART_TYPE_REQ_EXTENDED || other->part_type == BD_PART_TYPE_REQ_EXTENDED))
+            continue;
+          if (ranges_overlap (request->offset, request->end, other->offset, other->end))
+            {
+              g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                           "Partition %u: overlaps with partition %u", n, m);
+              goto out;
+            }
+        }
+    }
+
+  ret = TRUE;
+
+ out:
+  if (existing != NULL)
+    {
+      for (m = 0; existing[m] != NULL; m++)
+        bd_part_spec_free (existing[m]);
+      g_free (existing);
+    }
+  return ret;
+}
+
+static void
+handle_create_partitions_format_complete (gpointer user_data)
+{
+  gboolean *formatted = user_data;
+  *formatted = TRUE;
+}
+
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_create_partitions (UDisksPartitionTable   *table,
+                          GDBusMethodInvocation  *invocation,
+                          GVariant               *partitions,
+                          GVariant               *options)
+{
+  UDisksBlock *block = NULL;
+  UDisksObject *object = NULL;
+  UDisksDaemon *daemon = NULL;
+  UDisksObject **partition_objects = NULL;
+  PartitionRequest *requests = NULL;
+  WaitForPartitionsData wait_data;
+  const gchar **partition_object_paths = NULL;
+  gchar *device_name = NULL;
+  gchar *table_type = NULL;
+  uid_t caller_uid;
+  GError *error = NULL;
+  UDisksBaseJob *job = NULL;
+  GVariantIter iter;
+  guint num_partitions = 0;
+  guint n;
+  int fd;
+
+  /* See handle_create_partition for a motivation of taking the lock. It is
+   * held for the whole layout so that udevd re-reads the table only once.
+   */
+  fd = flock_block_dev (table);
+  memset (&wait_data, '\0', sizeof (wait_data));
+
+  object = udisks_daemon_util_dup_object (table, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
+
+  block = udisks_object_get_block (object);
+  if (block == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "Partition table object is not a block device");
+      goto out;
+    }
+
+  if (!check_create_partition_authorization (daemon, object, block, invocation, options, &caller_uid))
+    goto out;
+
+  device_name = g_strdup (udisks_block_get_device (block));
+  table_type = udisks_partition_table_dup_type_ (table);
+
+  /* validate the whole layout before touching the disk */
+  num_partitions = g_variant_n_children (partitions);
+  if (num_partitions == 0)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "No partitions given");
+      goto out;
+    }
+  requests = g_new0 (PartitionRequest, num_partitions);
+  g_variant_iter_init (&iter, partitions);
+  for (n = 0; n < num_partitions; n++)
+    {
+      PartitionRequest *request = &requests[n];
+      const gchar *partition_type = NULL;
+
+      g_variant_iter_next (&iter, "(tt&s&s@a{sv}&s@a{sv})",
+                           &request->offset,
+                           &request->size,
+                           &request->type,
+                           &request->name,
+                           &request->options,
+                           &request->format_type,
+                           &request->format_options);
+      g_variant_lookup (request->options, "partition-type", "&s", &partition_type);
+      if (!get_part_type_req (table_type, request->type, request->name, partition_type, &request->part_type, &error))
+        {
+          g_prefix_error (&error, "Partition %u: ", n);
+          g_dbus_method_invocation_take_error (invocation, error);
+          error = NULL;
+          goto out;
+        }
+    }
+  if (!validate_partition_layout (device_name, udisks_block_get_size (block), requests, num_partitions, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      error = NULL;
+      goto out;
+    }
+
+  job = udisks_daemon_launch_simple_job (daemon,
+                                         UDISKS_OBJECT (object),
+                                         "partition-create",
+                                         caller_uid,
+                                         NULL);
+  if (job == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "Failed to create a job object");
+      goto out;
+    }
+
+  for (n = 0; n < num_partitions; n++)
+    {
+      PartitionRequest *request = &requests[n];
+
+      request->part_spec = create_partition_sync (device_name, table_type, request->part_type,
+                                                  request->offset, request->size,
+                                                  request->type, request->name, &error);
+      if (request->part_spec == NULL)
+        {
+          g_prefix_error (&error, "Partition %u: ", n);
+          udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+          g_dbus_method_invocation_take_error (invocation, error);
+          error = NULL;
+          goto out;
+        }
+    }
+
+  /* sit and wait for all the partitions to show up */
+  wait_data.partition_table_object = object;
+  wait_data.num_partitions = num_partitions;
+  wait_data.pos_to_wait_for = g_new0 (guint64, num_partitions);
+  wait_data.ignore_container = g_new0 (gboolean, num_partitions);
+  for (n = 0; n < num_partitions; n++)
+    {
+      wait_data.ignore_container[n] = (requests[n].part_spec->type == BD_PART_TYPE_LOGICAL);
+      wait_data.pos_to_wait_for[n] = requests[n].part_spec->start + (requests[n].part_spec->size / 2L);
+    }
+  partition_objects = udisks_daemon_wait_for_objects_sync (daemon,
+                                                           wait_for_partitions,
+                                                           &wait_data,
+                                                           NULL,
+                                                           UDISKS_DEFAULT_WAIT_TIMEOUT,
+                                                           &error);
+  if (partition_objects == NULL)
+    {
+      g_prefix_error (&error, "Error waiting for partitions to appear: ");
+      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+      g_dbus_method_invocation_take_error (invocation, error);
+      error = NULL;
+      goto out;
+    }
+
+  /* a single uevent on the disk to update the "Partitions" property, see
+   * udisks_linux_partition_table_handle_create_partition()
+   */
+  udisks_linux_block_object_trigger_uevent_sync (UDISKS_LINUX_BLOCK_OBJECT (object),
+                                                 UDISKS_DEFAULT_WAIT_TIMEOUT);
+
+  udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), TRUE, NULL);
+
+  for (n = 0; n < num_partitions; n++)
+    {
+      gboolean formatted = FALSE;
+
+      if (strlen (requests[n].format_type) == 0)
+        continue;
+
+      /* on failure the error has already been returned */
+      udisks_linux_block_handle_format (udisks_object_peek_block (partition_objects[n]),
+                                        invocation,
+                                        requests[n].format_type,
+                                        requests[n].format_options,
+                                        handle_create_partitions_format_complete,
+                                        &formatted);
+      if (!formatted)
+        goto out;
+    }
+
+  partition_object_paths = g_new0 (const gchar *, num_partitions + 1);
+  for (n = 0; n < num_partitions; n++)
+    partition_object_paths[n] = g_dbus_object_get_object_path (G_DBUS_OBJECT (partition_objects[n]));
+  udisks_partition_table_complete_create_partitions (table, invocation, partition_object_paths);
+
+ out:
+  g_free (partition_object_paths);
+  if (partition_objects != NULL)
+    {
+      for (n = 0; partition_objects[n] != NULL; n++)
+        g_object_unref (partition_objects[n]);
+      g_free (partition_objects);
+    }
+  g_free (wait_data.pos_to_wait_for);
+  g_free (wait_data.ignore_container);
+  if (requests != NULL)
+    {
+      for (n = 0; n < num_partitions; n++)
+        partition_request_clear (&requests[n]);
+      g_free (requests);
+    }
+  g_free (table_type);
+  g_free (device_name);
+  g_clear_object (&block);
+  g_clear_object (&object);
+  unflock_block_dev (fd);
+
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static void
 partition_table_iface_init (UDisksPartitionTableIface *iface)
 {
   iface->handle_create_partition = handle_create_partition;
   iface->handle_create_partition_and_format = handle_create_partition_and_format;
+  iface->handle_create_partitions = handle_create_partitions;
 }
@@ -38,7 +38,9 @@
 #include "udisksmodule.h"
 #include "udisksmoduleobject.h"
 #include "udisksdaemonutil.h"
-#include "udisksconfigmanager.h"
+#include "udisksdriveconfigstore.h"
+#include "udisksdevicegraph.h"
+#include "udisksstats.h"
 
 /**
  * SECTION:udiskslinuxprovider
@@ -81,9 +83,10 @@ struct _UDisksLinuxProvider
 
   /* maps from UDisksModule to nested hashtables containing object skeleton instances */
   GHashTable *module_objects;
+  /* maps from UDisksModule to nested hashtables mapping claim keys to object skeleton instances */
+  GHashTable *module_claims;
 
   GUnixMountMonitor *mount_monitor;
-  GFileMonitor *etc_udisks2_dir_monitor;
 
   /* Module interfaces hashtable */
   GHashTable *module_ifaces;
@@ -135,11 +138,9 @@ static void utab_monitor_on_entry_removed (UDisksUtabMonitor *monitor,
                                            gpointer           user_data);
 #endif
 
-static void on_etc_udisks2_dir_monitor_changed (GFileMonitor     *monitor,
-                                                GFile            *file,
-                                                GFile            *other_file,
-                                                GFileMonitorEvent event_type,
-                                                gpointer          user_data);
+static void on_drive_config_store_changed (UDisksDriveConfigStore *store,
+                                           const gchar            *id,
+                                           gpointer                user_data);
 
 gpointer probe_request_thread_func (gpointer user_data);
 
@@ -174,13 +175,9 @@ udisks_linux_provider_finalize (GObject *object)
   g_signal_handlers_disconnect_by_func (module_manager, ensure_modules, provider);
   detach_module_interfaces (provider);
 
-  if (provider->etc_udisks2_dir_monitor != NULL)
-    {
-      g_signal_handlers_disconnect_by_func (provider->etc_udisks2_dir_monitor,
-                                            G_CALLBACK (on_etc_udisks2_dir_monitor_changed),
-                                            provider);
-      g_object_unref (provider->etc_udisks2_dir_monitor);
-    }
+  g_signal_handlers_disconnect_by_func (udisks_daemon_get_drive_config_store (daemon),
+                                        G_CALLBACK (on_drive_config_store_changed),
+                                        provider);
 
   g_hash_table_unref (provider->sysfs_to_block);
   g_hash_table_unref (provider->vpd_to_drive);
@@ -188,6 +185,7 @@ udisks_linux_provider_finalize (GObject *object)
   g_hash_table_unref (provider->uuid_to_mdraid);
   g_hash_table_unref (provider->sysfs_path_to_mdraid);
   g_hash_table_unref (provider->sysfs_path_to_mdraid_members);
+  g_hash_table_unref (provider->module_claims);
   g_hash_table_unref (provider->module_objects);
   g_object_unref (provider->gudev_client);
 
@@ -241,6 +239,8 @@ static gboolean
 on_idle_with_probed_uevent (gpointer user_data)
 {
   ProbeRequest *request = user_data;
+  gint64 begin_time = udisks_stats_begin ();
+
   udisks_linux_provider_handle_uevent (request->provider,
                                        g_udev_device_get_action (request->udev_device),
                                        request->udisks_device);
@@ -250,6 +250,7 @@ on_idle_with_probed_uevent (gpointer user_data)
                  g_udev_device_get_action (request->udev_device),
                  request->udisks_device);
   probe_request_free (request);
+  udisks_stats_end ("source", "on_idle_with_probed_uevent", begin_time);
   return FALSE; /* remove source */
 }
 
@@ -366,12 +367,8 @@ udisks_linux_provider_constructed (GObject *object)
   const gchar *subsystems[] = {"block", "iscsi_connection", "scsi", NULL};
   UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (object);
   UDisksDaemon *daemon;
-  UDisksConfigManager *config_manager;
-  GFile *file;
-  GError *error = NULL;
 
   daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
-  config_manager = udisks_daemon_get_config_manager (daemon);
 
   /* get ourselves an udev client */
   provider->gudev_client = g_udev_client_new (subsystems);
@@ -390,26 +387,10 @@ udisks_linux_provider_constructed (GObject *object)
 
   provider->module_ifaces = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
 
-  file = g_file_new_for_path (udisks_config_manager_get_config_dir (config_manager));
-  provider->etc_udisks2_dir_monitor = g_file_monitor_directory (file,
-                                                                G_FILE_MONITOR_NONE,
-                                                                NULL,
-                                                                &error);
-  if (provider->etc_udisks2_dir_monitor != NULL)
-    {
-      g_signal_connect (provider->etc_udisks2_dir_monitor,
-                        "changed",
-                        G_CALLBACK (on_etc_udisks2_dir_monitor_changed),
-                        provider);
-    }
-  else
-    {
-      udisks_warning ("Error monitoring directory %s: %s (%s, %d)",
-                      udisks_config_manager_get_config_dir (config_manager),
-                      error->message, g_quark_to_string (error->domain), error->code);
-      g_clear_error (&error);
-    }
-  g_object_unref (file);
+  g_signal_connect (udisks_daemon_get_drive_config_store (daemon),
+                    "changed",
+                    G_CALLBACK (on_drive_config_store_changed),
+                    provider);
 }
 
 static void
@@ -437,41 +418,14 @@ synthesize_uevent_for_id (UDisksLinuxProvider *provider,
     }
 }
 
-static gchar *
-dup_id_from_config_name (const gchar *conf_filename)
-{
-  gchar *id;
-
-  udisks_debug ("Found config file %s", conf_filename);
-
-  if (g_str_has_suffix (conf_filename, ".conf"))
-    {
-      id = g_strndup (conf_filename, strlen (conf_filename) - 5);
-      return id;
-    }
-  return NULL;
-}
-
 static void
-on_etc_udisks2_dir_monitor_changed (GFileMonitor     *monitor,
-                                    GFile            *file,
-                                    GFile            *other_file,
-                                    GFileMonitorEvent event_type,
-                                    gpointer          user_data)
+on_drive_config_store_changed (UDisksDriveConfigStore *store,
+                               const gchar            *id,
+                               gpointer                user_data)
 {
   UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
 
-  if (event_type == G_FILE_MONITOR_EVENT_CREATED ||
-      event_type == G_FILE_MONITOR_EVENT_DELETED ||
-      event_type == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
-    {
-      gchar *filename = g_file_get_basename (file);
-      gchar *id = dup_id_from_config_name (filename);
-      if (id)
-          synthesize_uevent_for_id (provider, id, "change");
-      g_free (id);
-      g_free (filename);
-    }
+  synthesize_uevent_for_id (provider, id, "change");
 }
 
 static guint
@@ -634,15 +588,12 @@ on_system_sleep_signal (GDBusConnection *connection,
 {
   UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
   UDisksDaemon *daemon;
-  UDisksConfigManager *config_manager;
-  GDir *etc_dir;
-  GError *error;
-  const gchar *filename;
+  gchar **ids;
   GVariant *tmp_bool;
   gboolean suspending;
+  guint n;
 
   daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
-  config_manager = udisks_daemon_get_config_manager (daemon);
 
   if (g_variant_n_children(parameters) != 1)
     {
@@ -661,25 +612,10 @@ on_system_sleep_signal (GDBusConnection *connection,
   if (suspending)
     return;
 
-  etc_dir = g_dir_open (udisks_config_manager_get_config_dir (config_manager), 0, &error);
-  if (!etc_dir)
-    {
-      udisks_warning ("Error reading directory %s: %s (%s, %d)",
-                      udisks_config_manager_get_config_dir (config_manager),
-                      error->message, g_quark_to_string (error->domain), error->code);
-      g_clear_error (&error);
-      return;
-    }
-
-  while ((filename = g_dir_read_name (etc_dir)))
-    if (g_str_has_suffix (filename, ".conf"))
-      {
-        gchar *id = dup_id_from_config_name (filename);
-        synthesize_uevent_for_id (provider, id, "reconfigure");
-        g_free (id);
-      }
-
-  g_dir_close (etc_dir);
+  ids = udisks_drive_config_store_get_ids (udisks_daemon_get_drive_config_store (daemon));
+  for (n = 0; ids[n] != NULL; n++)
+    synthesize_uevent_for_id (provider, ids[n], "reconfigure");
+  g_strfreev (ids);
 }
 
 static void
@@ -726,6 +662,10 @@ udisks_linux_provider_start (UDisksProvider *_provider)
                                                     g_direct_equal,
                                                     NULL,
                                                     (GDestroyNotify) g_hash_table_unref);
+  provider->module_claims = g_hash_table_new_full (g_direct_hash,
+                                                   g_direct_equal,
+                                                   NULL,
+                                                   (GDestroyNotify) g_hash_table_unref);
 
   daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
 
@@ -1207,6 +1147,7 @@ handle_block_uevent_for_block (UDisksLinuxProvider *provider,
            *       the block object may never get freed.
            */
           block_pre_remove (provider, object);
+          udisks_device_graph_remove (udisks_daemon_get_device_graph (daemon), sysfs_path);
           g_dbus_object_manager_server_unexport (udisks_daemon_get_object_manager (daemon),
                                                  g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
           g_warn_if_fail (g_hash_table_remove (provider->sysfs_to_block, sysfs_path));
@@ -1226,11 +1167,78 @@ handle_block_uevent_for_block (UDisksLinuxProvider *provider,
                                                         G_DBUS_OBJECT_SKELETON (object));
           g_hash_table_insert (provider->sysfs_to_block, g_strdup (sysfs_path), object);
         }
+      /* slaves of device-mapper devices may change with a new table */
+      udisks_device_graph_update (udisks_daemon_get_device_graph (daemon), object, device);
     }
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* called with lock held */
+static void
+unindex_module_object (GHashTable          *claims,
+                       GPtrArray           *claim_keys,
+                       GDBusObjectSkeleton *object)
+{
+  guint n;
+
+  for (n = 0; n < claim_keys->len; n++)
+    {
+      GPtrArray *claimants;
+
+      claimants = g_hash_table_lookup (claims, claim_keys->pdata[n]);
+      if (claimants == NULL)
+        continue;
+      g_ptr_array_remove_fast (claimants, object);
+      if (claimants->len == 0)
+        g_hash_table_remove (claims, claim_keys->pdata[n]);
+    }
+  g_ptr_array_set_size (claim_keys, 0);
+}
+
+/* called with lock held */
+static void
+index_module_object (UDisksLinuxProvider *provider,
+                     UDisksModule        *module,
+                     GHashTable          *inst_table,
+                     GDBusObjectSkeleton *object)
+{
+  GHashTable *claims;
+  GPtrArray *claim_keys;
+  gchar **keys;
+  gchar **k;
+
+  claims = g_hash_table_lookup (provider->module_claims, module);
+  if (claims == NULL)
+    {
+      claims = g_hash_table_new_full (g_str_hash,
+                                      g_str_equal,
+                                      g_free,
+                                      (GDestroyNotify) g_ptr_array_unref);
+      g_hash_table_insert (provider->module_claims, module, claims);
+    }
+
+  claim_keys = g_hash_table_lookup (inst_table, object);
+  g_warn_if_fail (claim_keys != NULL);
+  unindex_module_object (claims, claim_keys, object);
+
+  keys = udisks_module_object_get_claim_keys (UDISKS_MODULE_OBJECT (object));
+  for (k = keys; k != NULL && *k != NULL; k++)
+    {
+      GPtrArray *claimants;
+
+      claimants = g_hash_table_lookup (claims, *k);
+      if (claimants == NULL)
+        {
+          claimants = g_ptr_array_new ();
+          g_hash_table_insert (claims, g_strdup (*k), claimants);
+        }
+      g_ptr_array_add (claimants, object);
+      g_ptr_array_add (claim_keys, g_strdup (*k));
+    }
+  g_strfreev (keys);
+}
+
 /* called with lock held */
 static void
 handle_block_uevent_for_modules (UDisksLinuxProvider *provider,
@@ -1253,13 +1261,20 @@ handle_block_uevent_for_modules (UDisksLinuxProvider *provider,
    *      key: pointer to #UDisksModule
    *      value: nested hashtable
    *          key: a #UDisksObjectSkeleton instance implementing the #UDisksModuleObject interface
-   *          value: -- unused
+   *          value: #GPtrArray of claim keys returned by udisks_module_object_get_claim_keys()
+   *
+   *   provider->module_claims
+   *      key: pointer to #UDisksModule
+   *      value: nested hashtable
+   *          key: claim key
+   *          value: #GPtrArray of #UDisksObjectSkeleton instances claiming the key (not referenced)
    */
 
   /* The following algorithm brings some guarantees to existing instances:
    *  - every instance can claim one or more devices
    *  - existing instances are asked first and only when none is interested in claiming the device
    *    a new instance for the current UDisksModule is attempted to be created
+   *  - when the module provides a claim key for the device, only instances claiming that key are asked
    */
   modules = udisks_module_manager_get_modules (module_manager);
   for (l = modules; l; l = l->next)
@@ -1267,18 +1282,49 @@ handle_block_uevent_for_modules (UDisksLinuxProvider *provider,
       UDisksModule *module = l->data;
       gboolean handled = FALSE;
       GList *instances_to_remove = NULL;
+      GList *instances_to_reindex = NULL;
       GHashTable *inst_table;
+      gchar *claim_key = NULL;
+
+      /* Skip modules not interested in this device at all. */
+      if (! udisks_module_filter_uevent (module, action, device, &claim_key))
+        continue;
 
       inst_table = g_hash_table_lookup (provider->module_objects, module);
       if (inst_table)
         {
-          GHashTableIter iter;
+          GPtrArray *candidates;
+          GList *ll;
+          guint n;
+
+          /* Find the existing objects to ask, copied as processing may change the claims. */
+          candidates = g_ptr_array_new ();
+          if (claim_key != NULL)
+            {
+              GHashTable *claims;
+              GPtrArray *claimants = NULL;
+
+              claims = g_hash_table_lookup (provider->module_claims, module);
+              if (claims != NULL)
+                claimants = g_hash_table_lookup (claims, claim_key);
+              for (n = 0; claimants != NULL && n < claimants->len; n++)
+                g_ptr_array_add (candidates, claimants->pdata[n]);
+            }
+          else
+            {
+              GHashTableIter iter;
+
+              g_hash_table_iter_init (&iter, inst_table);
+              while (g_hash_table_iter_next (&iter, (gpointer *) &object, NULL))
+                g_ptr_array_add (candidates, object);
+            }
 
           /* First try existing objects and ask them to process the uevent. */
-          g_hash_table_iter_init (&iter, inst_table);
-          while (g_hash_table_iter_next (&iter, (gpointer *) &object, NULL))
+          for (n = 0; n < candidates->len; n++)
             {
               gboolean keep = TRUE;
+
+              object = candidates->pdata[n];
               if (udisks_module_object_process_uevent (UDISKS_MODULE_OBJECT (object), action, device, &keep))
                 {
                   handled = TRUE;
@@ -1287,17 +1333,30 @@ handle_block_uevent_for_modules (UDisksLinuxProvider *provider,
                       /* Queue for removal. */
                       instances_to_remove = g_list_append (instances_to_remove, object);
                     }
+                  else
+                    {
+                      /* Claims may have changed. */
+                      instances_to_reindex = g_list_append (instances_to_reindex, object);
+                    }
                 }
             }
+          g_ptr_array_free (candidates, TRUE);
+
+          for (ll = instances_to_reindex; ll; ll = ll->next)
+            index_module_object (provider, module, inst_table, ll->data);
+          g_list_free (instances_to_reindex);
 
           /* Batch remove instances to prevent uevent storm. */
           if (instances_to_remove != NULL)
             {
-              GList *ll;
+              GHashTable *claims;
 
+              claims = g_hash_table_lookup (provider->module_claims, module);
               for (ll = instances_to_remove; ll; ll = ll->next)
                 {
                   object = ll->data;
+                  if (claims != NULL)
+                    unindex_module_object (claims, g_hash_table_lookup (inst_table, object), object);
                   g_dbus_object_manager_server_unexport (udisks_daemon_get_object_manager (daemon),
                                                          g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
                   g_warn_if_fail (g_hash_table_remove (inst_table, object));
@@ -1311,6 +1370,7 @@ handle_block_uevent_for_modules (UDisksLinuxProvider *provider,
               g_list_free (instances_to_remove);
             }
         }
+      g_free (claim_key);
 
       /* No module object claimed or was interested in this device, try creating new instance for the current module. */
       if (! handled)
@@ -1327,10 +1387,11 @@ handle_block_uevent_for_modules (UDisksLinuxProvider *provider,
                   inst_table = g_hash_table_new_full (g_direct_hash,
                                                       g_direct_equal,
                                                       (GDestroyNotify) g_object_unref,
-                                                      NULL);
+                                                      (GDestroyNotify) g_ptr_array_unref);
                   g_hash_table_insert (provider->module_objects, module, inst_table);
                 }
-              g_hash_table_add (inst_table, *ll);
+              g_hash_table_insert (inst_table, *ll, g_ptr_array_new_with_free_func (g_free));
+              index_module_object (provider, module, inst_table, *ll);
             }
           g_free (objects);
         }
@@ -1341,8 +1402,9 @@ handle_block_uevent_for_modules (UDisksLinuxProvider *provider,
     {
       for (l = modules_to_remove; l; l = l->next)
         {
-          g_warn_if_fail (g_hash_table_size (l->data) == 0);
+          g_warn_if_fail (g_hash_table_size (g_hash_table_lookup (provider->module_objects, l->data)) == 0);
           g_warn_if_fail (g_hash_table_remove (provider->module_objects, l->data));
+          g_hash_table_remove (provider->module_claims, l->data);
         }
       g_list_free (modules_to_remove);
     }
@@ -1352,6 +1414,14 @@ handle_block_uevent_for_modules (UDisksLinuxProvider *provider,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* records the time spent in each part of uevent processing */
+#define TIMED_UEVENT_HANDLER(func, provider, action, device)     \
+  G_STMT_START {                                                \
+    gint64 _begin_time = udisks_stats_begin ();                 \
+    func (provider, action, device);                            \
+    udisks_stats_end ("uevent", #func, _begin_time);            \
+  } G_STMT_END
+
 /* called with lock held */
 static void
 handle_block_uevent (UDisksLinuxProvider *provider,
@@ -1369,10 +1439,10 @@ handle_block_uevent (UDisksLinuxProvider *provider,
    */
   if (g_strcmp0 (action, "remove") == 0)
     {
-      handle_block_uevent_for_block (provider, action, device);
-      handle_block_uevent_for_drive (provider, action, device);
-      handle_block_uevent_for_mdraid (provider, action, device);
-      handle_block_uevent_for_modules (provider, action, device);
+      TIMED_UEVENT_HANDLER (handle_block_uevent_for_block, provider, action, device);
+      TIMED_UEVENT_HANDLER (handle_block_uevent_for_drive, provider, action, device);
+      TIMED_UEVENT_HANDLER (handle_block_uevent_for_mdraid, provider, action, device);
+      TIMED_UEVENT_HANDLER (handle_block_uevent_for_modules, provider, action, device);
     }
   else
     {
@@ -1389,17 +1459,23 @@ handle_block_uevent (UDisksLinuxProvider *provider,
         }
       else
         {
-          handle_block_uevent_for_modules (provider, action, device);
-          handle_block_uevent_for_mdraid (provider, action, device);
-          handle_block_uevent_for_drive (provider, action, device);
-          handle_block_uevent_for_block (provider, action, device);
+          TIMED_UEVENT_HANDLER (handle_block_uevent_for_modules, provider, action, device);
+          TIMED_UEVENT_HANDLER (handle_block_uevent_for_mdraid, provider, action, device);
+          TIMED_UEVENT_HANDLER (handle_block_uevent_for_drive, provider, action, device);
+          TIMED_UEVENT_HANDLER (handle_block_uevent_for_block, provider, action, device);
         }
     }
 
   if (g_strcmp0 (action, "add") != 0)
     {
-      /* Possibly need to clean up */
-      udisks_state_check (udisks_daemon_get_state (udisks_provider_get_daemon (UDISKS_PROVIDER (provider))));
+      UDisksState *state = udisks_daemon_get_state (udisks_provider_get_daemon (UDISKS_PROVIDER (provider)));
+      dev_t dev = g_udev_device_get_device_number (device->udev_device);
+
+      /* Possibly need to clean up, only entries related to this device */
+      if (dev != 0)
+        udisks_state_check_device (state, dev);
+      else
+        udisks_state_check (state);
     }
 }
 
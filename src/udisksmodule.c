@@ -192,6 +192,16 @@ udisks_module_new_object_default (UDisksModule      *module,
   return NULL;
 }
 
+static gboolean
+udisks_module_filter_uevent_default (UDisksModule       *module,
+                                     const gchar        *action,
+                                     UDisksLinuxDevice  *device,
+                                     gchar             **out_claim_key)
+{
+  *out_claim_key = NULL;
+  return TRUE;
+}
+
 static gchar *
 udisks_module_track_parent_default (UDisksModule  *module,
                                     const gchar   *path,
@@ -247,6 +257,7 @@ udisks_module_class_init (UDisksModuleClass *klass)
   klass->get_drive_object_interface_types = udisks_module_get_drive_object_interface_types_default;
   klass->new_block_object_interface       = udisks_module_new_block_object_interface_default;
   klass->new_drive_object_interface       = udisks_module_new_drive_object_interface_default;
+  klass->filter_uevent                    = udisks_module_filter_uevent_default;
 
   /**
    * UDisksModule:daemon:
@@ -379,6 +390,10 @@ udisks_module_new_manager (UDisksModule *module)
  * This works always in the scope of a particular module, i.e. existing module objects
  * and their claims are always considered separately for each module.
  *
+ * Before that, udisks_module_filter_uevent() is called to let the module skip
+ * the uevent entirely or narrow down the set of existing objects to those
+ * that claimed the particular @device.
+ *
  * The uevent routing works as follows:
  *   1. Existing module objects are asked first to process the uevent for a particular
  *      @device via the udisks_module_object_process_uevent() method on the
@@ -415,6 +430,44 @@ udisks_module_new_object (UDisksModule      *module,
   return UDISKS_MODULE_GET_CLASS (module)->new_object (module, device);
 }
 
+/**
+ * udisks_module_filter_uevent:
+ * @module: A #UDisksModule.
+ * @action: uevent action, common values are <literal>add</literal>, <literal>change</literal> and <literal>remove</literal>.
+ * @device: A #UDisksLinuxDevice device object.
+ * @out_claim_key: (out) (transfer full) (nullable): Return location for the claim key of @device.
+ *
+ * Called by #UDisksLinuxProvider before routing a uevent to the module objects
+ * as described in udisks_module_new_object(). This lets a module skip uevents it
+ * never cares about and avoid asking every existing object about the @device.
+ *
+ * A return value of %FALSE means the module is not interested in the @device
+ * at all: neither udisks_module_object_process_uevent() nor
+ * udisks_module_new_object() is called for it.
+ *
+ * Otherwise @out_claim_key may be set to a string identifying the @device,
+ * e.g. a sysfs path, a device number or the value of an udev property. Only
+ * the existing module objects that returned the same key from
+ * udisks_module_object_get_claim_keys() are then asked to process the uevent.
+ * If @out_claim_key is set to %NULL the uevent is passed to all existing
+ * module objects of the @module.
+ *
+ * Returns: %TRUE if the uevent should be routed to the module objects, %FALSE otherwise.
+ *
+ * Since: 2.10.0
+ */
+gboolean
+udisks_module_filter_uevent (UDisksModule       *module,
+                             const gchar        *action,
+                             UDisksLinuxDevice  *device,
+                             gchar             **out_claim_key)
+{
+  g_return_val_if_fail (UDISKS_IS_MODULE (module), FALSE);
+  g_return_val_if_fail (out_claim_key != NULL, FALSE);
+
+  return UDISKS_MODULE_GET_CLASS (module)->filter_uevent (module, action, device, out_claim_key);
+}
+
 /**
  * udisks_module_track_parent:
  * @module: A #UDisksModule.
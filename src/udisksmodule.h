@@ -94,6 +94,7 @@ typedef UDisksModule* (*UDisksModuleNewFunc) (UDisksDaemon  *daemon,
  * @get_drive_object_interface_types: Virtual function for udisks_module_get_drive_object_interface_types(). The default implementation returns %NULL.
  * @new_block_object_interface: Virtual function for udisks_module_new_block_object_interface(). The default implementation returns %NULL.
  * @new_drive_object_interface: Virtual function for udisks_module_new_drive_object_interface(). The default implementation returns %NULL.
+ * @filter_uevent: Virtual function for udisks_module_filter_uevent(). The default implementation returns %TRUE without a claim key.
  *
  * Class structure for #UDisksModule.
  */
@@ -115,6 +116,12 @@ struct _UDisksModuleClass
   GDBusInterfaceSkeleton  * (*new_drive_object_interface)       (UDisksModule           *module,
                                                                  UDisksLinuxDriveObject *object,
                                                                  GType                   interface_type);
+
+  /* added after 2.9, at the end to keep the class layout */
+  gboolean                  (*filter_uevent)                    (UDisksModule           *module,
+                                                                 const gchar            *action,
+                                                                 UDisksLinuxDevice      *device,
+                                                                 gchar                 **out_claim_key);
 };
 
 
@@ -128,6 +135,10 @@ UDisksDaemon            *udisks_module_get_daemon                       (UDisksM
 GDBusInterfaceSkeleton  *udisks_module_new_manager                      (UDisksModule           *module);
 GDBusObjectSkeleton    **udisks_module_new_object                       (UDisksModule           *module,
                                                                          UDisksLinuxDevice      *device);
+gboolean                 udisks_module_filter_uevent                    (UDisksModule           *module,
+                                                                         const gchar            *action,
+                                                                         UDisksLinuxDevice      *device,
+                                                                         gchar                 **out_claim_key);
 gchar                   *udisks_module_track_parent                     (UDisksModule           *module,
                                                                          const gchar            *path,
                                                                          gchar                 **uuid);
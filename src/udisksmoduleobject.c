@@ -105,3 +105,28 @@ udisks_module_object_housekeeping (UDisksModuleObject  *object,
 {
   return UDISKS_MODULE_OBJECT_GET_IFACE (object)->housekeeping (object, secs_since_last, cancellable, error);
 }
+
+/**
+ * udisks_module_object_get_claim_keys:
+ * @object: A #UDisksModuleObject.
+ *
+ * Gets the keys of the devices currently claimed by @object, in the same
+ * format as returned by udisks_module_filter_uevent() for the module that
+ * created @object. #UDisksLinuxProvider uses these to route uevents only to
+ * the interested objects and queries them again after every processed uevent.
+ *
+ * Returns: (transfer full) (nullable): A %NULL-terminated array of claim keys or %NULL
+ *          if @object doesn't claim any devices by key. Free with g_strfreev().
+ *
+ * Since: 2.10.0
+ */
+gchar **
+udisks_module_object_get_claim_keys (UDisksModuleObject *object)
+{
+  UDisksModuleObjectIface *iface = UDISKS_MODULE_OBJECT_GET_IFACE (object);
+
+  if (iface->get_claim_keys == NULL)
+    return NULL;
+
+  return iface->get_claim_keys (object);
+}
@@ -48,6 +48,7 @@ typedef struct _UDisksModuleObjectIface    UDisksModuleObjectIface;
  * @parent_iface: The parent interface.
  * @process_uevent: Virtual function for udisks_module_object_process_uevent().
  * @housekeeping: Virtual function for udisks_module_object_housekeeping().
+ * @get_claim_keys: Virtual function for udisks_module_object_get_claim_keys(). May be %NULL.
  *
  * Object interface structure for #UDisksModuleObject.
  */
@@ -64,6 +65,8 @@ struct _UDisksModuleObjectIface
                             guint                secs_since_last,
                             GCancellable        *cancellable,
                             GError             **error);
+
+  gchar ** (*get_claim_keys) (UDisksModuleObject  *object);
 };
 
 GType udisks_module_object_get_type (void) G_GNUC_CONST;
@@ -78,6 +81,8 @@ gboolean udisks_module_object_housekeeping   (UDisksModuleObject  *object,
                                               GCancellable        *cancellable,
                                               GError             **error);
 
+gchar  **udisks_module_object_get_claim_keys (UDisksModuleObject  *object);
+
 G_END_DECLS
 
 #endif /* __UDISKS_MODULE_OBJECT_H__ */
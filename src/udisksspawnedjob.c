@@ -18,14 +18,23 @@
  *
  */
 
+#define _GNU_SOURCE /* for clone() */
+
 #include "config.h"
 #include <glib/gi18n-lib.h>
 
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
 #include <pwd.h>
 #include <grp.h>
 #include <stdlib.h>
@@ -43,8 +52,29 @@
  *
  * This type provides an implementation of the #UDisksJob interface
  * for jobs that are implemented by spawning a command line.
+ *
+ * The command is started with posix_spawn() or, when credentials need
+ * to be switched, with a clone(CLONE_VM|CLONE_VFORK) child sharing the
+ * address space of the daemon. Neither copies the page tables of the
+ * daemon so the cost of spawning does not grow with the daemon RSS.
+ *
+ * Only the most recent output of the command is kept, up to
+ * #UDisksSpawnedJob:output-limit bytes, and it can be consumed line by
+ * line while the command is running through the
+ * #UDisksSpawnedJob::output-line signal.
  */
 
+/* Lines longer than this are delivered in pieces */
+#define MAX_LINE_LENGTH 4096
+
+/* Default for the output-limit property, per stream */
+#define DEFAULT_OUTPUT_LIMIT (1024 * 1024)
+
+/* Stack for the clone() child - it only runs a handful of syscalls */
+#define CHILD_STACK_SIZE (64 * 1024)
+
+extern char **environ;
+
 typedef struct _UDisksSpawnedJobClass   UDisksSpawnedJobClass;
 
 /**
@@ -69,9 +99,12 @@ struct _UDisksSpawnedJob
   gid_t real_egid;
   gid_t real_gid;
   uid_t real_uid;
-  char *real_pwname;
+  gid_t *real_groups;
+  gint n_real_groups;
   const gchar *input_string_cursor;
 
+  guint output_limit;
+
   GPid child_pid;
   gint child_stdin_fd;
   gint child_stdout_fd;
@@ -88,6 +121,11 @@ struct _UDisksSpawnedJob
 
   GString *child_stdout;
   GString *child_stderr;
+
+  GString *child_stdout_line;
+  GString *child_stderr_line;
+  gboolean child_stdout_cr;
+  gboolean child_stderr_cr;
 };
 
 struct _UDisksSpawnedJobClass
@@ -109,12 +147,14 @@ enum
   PROP_COMMAND_LINE,
   PROP_INPUT_STRING,
   PROP_RUN_AS_UID,
-  PROP_RUN_AS_EUID
+  PROP_RUN_AS_EUID,
+  PROP_OUTPUT_LIMIT
 };
 
 enum
 {
   SPAWNED_JOB_COMPLETED_SIGNAL,
+  OUTPUT_LINE_SIGNAL,
   LAST_SIGNAL
 };
 
@@ -173,6 +213,10 @@ udisks_spawned_job_get_property (GObject    *object,
       g_value_set_string (value, udisks_spawned_job_get_command_line (job));
       break;
 
+    case PROP_OUTPUT_LIMIT:
+      g_value_set_uint (value, job->output_limit);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -211,6 +255,10 @@ udisks_spawned_job_set_property (GObject      *object,
       job->run_as_euid = g_value_get_uint (value);
       break;
 
+    case PROP_OUTPUT_LIMIT:
+      udisks_spawned_job_set_output_limit (job, g_value_get_uint (value));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -282,18 +330,139 @@ on_cancelled (GCancellable *cancellable,
   g_clear_error (&error);
 }
 
+/* appends @len bytes of @data to @string, keeping only the last @limit bytes */
+static void
+append_bounded (GString     *string,
+                const gchar *data,
+                gsize        len,
+                gsize        limit)
+{
+  if (limit > 0 && len >= limit)
+    {
+      g_string_truncate (string, 0);
+      g_string_append_len (string, data + len - limit, limit);
+      return;
+    }
+
+  g_string_append_len (string, data, len);
+  if (limit > 0 && string->len > limit)
+    g_string_erase (string, 0, string->len - limit);
+}
+
+static void
+emit_output_line (UDisksSpawnedJob *job,
+                  gint              stream,
+                  GString          *line)
+{
+  g_signal_emit (job, signals[OUTPUT_LINE_SIGNAL], 0, stream, line->str);
+  g_string_truncate (line, 0);
+}
+
+/* feeds output read from the child into the capture buffer and the line splitter */
+static void
+handle_child_output (UDisksSpawnedJob *job,
+                     gint              stream,
+                     const gchar      *buf,
+                     gsize             len)
+{
+  GString *capture;
+  GString *line;
+  gboolean *after_cr;
+  gsize n;
+
+  if (stream == STDOUT_FILENO)
+    {
+      capture = job->child_stdout;
+      line = job->child_stdout_line;
+      after_cr = &job->child_stdout_cr;
+    }
+  else
+    {
+      capture = job->child_stderr;
+      line = job->child_stderr_line;
+      after_cr = &job->child_stderr_cr;
+    }
+
+  append_bounded (capture, buf, len, job->output_limit);
+
+  /* don't bother splitting lines if nobody is listening */
+  if (!g_signal_has_handler_pending (job, signals[OUTPUT_LINE_SIGNAL], 0, TRUE))
+    return;
+
+  /* progress meters commonly rewrite the current line using \r, \r\n
+   * is a single terminator though, even when split between two reads;
+   * others, like mke2fs, back up over the number they just printed */
+  for (n = 0; n < len; n++)
+    {
+      if (buf[n] == '\n')
+        {
+          if (!*after_cr)
+            emit_output_line (job, stream, line);
+          *after_cr = FALSE;
+        }
+      else if (buf[n] == '\r')
+        {
+          /* an empty line is left for the \n, if any */
+          *after_cr = line->len > 0;
+          if (*after_cr)
+            emit_output_line (job, stream, line);
+        }
+      else if (buf[n] == '\b')
+        {
+          /* a run of backspaces ends the line, just once */
+          if (line->len > 0)
+            emit_output_line (job, stream, line);
+          *after_cr = FALSE;
+        }
+      else
+        {
+          g_string_append_c (line, buf[n]);
+          if (line->len >= MAX_LINE_LENGTH)
+            emit_output_line (job, stream, line);
+          *after_cr = FALSE;
+        }
+    }
+}
+
+static void
+flush_child_output_lines (UDisksSpawnedJob *job)
+{
+  if (job->child_stdout_line->len > 0)
+    emit_output_line (job, STDOUT_FILENO, job->child_stdout_line);
+  if (job->child_stderr_line->len > 0)
+    emit_output_line (job, STDERR_FILENO, job->child_stderr_line);
+}
+
+static gboolean
+read_child_output (UDisksSpawnedJob  *job,
+                   GIOChannel        *channel,
+                   gint               stream,
+                   GSource          **source)
+{
+  gchar buf[8192];
+  gsize bytes_read = 0;
+  GIOStatus status;
+
+  status = g_io_channel_read_chars (channel, buf, sizeof buf, &bytes_read, NULL);
+  if (bytes_read > 0)
+    handle_child_output (job, stream, buf, bytes_read);
+
+  if (status == G_IO_STATUS_EOF || status == G_IO_STATUS_ERROR)
+    {
+      /* the source is freed once we return FALSE, don't keep a dangling pointer */
+      *source = NULL;
+      return FALSE;
+    }
+  return TRUE;
+}
+
 static gboolean
 read_child_stderr (GIOChannel *channel,
                    GIOCondition condition,
                    gpointer user_data)
 {
   UDisksSpawnedJob *job = UDISKS_SPAWNED_JOB (user_data);
-  gchar buf[1024];
-  gsize bytes_read = 0;
-
-  g_io_channel_read_chars (channel, buf, sizeof buf, &bytes_read, NULL);
-  g_string_append_len (job->child_stderr, buf, bytes_read);
-  return TRUE;
+  return read_child_output (job, channel, STDERR_FILENO, &job->child_stderr_source);
 }
 
 static gboolean
@@ -302,12 +471,7 @@ read_child_stdout (GIOChannel *channel,
                    gpointer user_data)
 {
   UDisksSpawnedJob *job = UDISKS_SPAWNED_JOB (user_data);
-  gchar buf[1024];
-  gsize bytes_read = 0;
-
-  g_io_channel_read_chars (channel, buf, sizeof buf, &bytes_read, NULL);
-  g_string_append_len (job->child_stdout, buf, bytes_read);
-  return TRUE;
+  return read_child_output (job, channel, STDOUT_FILENO, &job->child_stdout_source);
 }
 
 static gboolean
@@ -358,23 +522,25 @@ child_watch_cb (GPid     pid,
   gsize buf_size;
   gboolean ret;
 
+  /* take a reference so it's safe for a signal-handler to release the last one */
+  g_object_ref (job);
+
   buf_size = 0;
   if (g_io_channel_read_to_end (job->child_stdout_channel, &buf, &buf_size, NULL) == G_IO_STATUS_NORMAL)
     {
-      g_string_append_len (job->child_stdout, buf, buf_size);
+      handle_child_output (job, STDOUT_FILENO, buf, buf_size);
       g_free (buf);
     }
   buf_size = 0;
   if (g_io_channel_read_to_end (job->child_stderr_channel, &buf, &buf_size, NULL) == G_IO_STATUS_NORMAL)
     {
-      g_string_append_len (job->child_stderr, buf, buf_size);
+      handle_child_output (job, STDERR_FILENO, buf, buf_size);
       g_free (buf);
     }
+  flush_child_output_lines (job);
 
   //g_debug ("helper(pid %5d): completed with exit code %d\n", job->child_pid, WEXITSTATUS (status));
 
-  /* take a reference so it's safe for a signal-handler to release the last one */
-  g_object_ref (job);
   g_signal_emit (job,
                  signals[SPAWNED_JOB_COMPLETED_SIGNAL],
                  0,
@@ -389,14 +555,99 @@ child_watch_cb (GPid     pid,
   g_object_unref (job);
 }
 
-/* careful, this is in the fork()'ed child so all utility threads etc are not available */
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  UDisksSpawnedJob *job;
+  const gchar      *program;
+  gchar           **argv;
+  gint              stdin_fd;
+  gint              stdout_fd;
+  gint              stderr_fd;
+  gint              max_fd;
+
+  /* written by the child, read by the parent once the child has exec()ed or exited */
+  gint              child_errno;
+  const gchar      *child_failed_step;
+} SpawnData;
+
 static void
-child_setup (gpointer user_data)
+set_spawn_error (GError      **error,
+                 const gchar  *program,
+                 const gchar  *failed_step,
+                 gint          errsv)
 {
-  UDisksSpawnedJob *job = UDISKS_SPAWNED_JOB (user_data);
+  gint code;
+
+  switch (errsv)
+    {
+    case ENOENT:
+      code = G_SPAWN_ERROR_NOENT;
+      break;
+    case EACCES:
+      code = G_SPAWN_ERROR_ACCES;
+      break;
+    case ENOMEM:
+      code = G_SPAWN_ERROR_NOMEM;
+      break;
+    default:
+      code = G_SPAWN_ERROR_FAILED;
+      break;
+    }
+
+  if (failed_step != NULL)
+    g_set_error (error, G_SPAWN_ERROR, code,
+                 "Failed to switch credentials for child process \"%s\" (%s: %s)",
+                 program, failed_step, g_strerror (errsv));
+  else
+    g_set_error (error, G_SPAWN_ERROR, code,
+                 "Failed to execute child process \"%s\" (%s)",
+                 program, g_strerror (errsv));
+}
+
+/* Careful, this runs in a clone(CLONE_VM|CLONE_VFORK) child sharing the
+ * address space with the (suspended) calling thread of the daemon. Only
+ * raw syscalls are allowed here - no malloc(), no locks and no glibc
+ * set*id() wrappers since those would try to synchronize credentials
+ * with all the threads of the daemon.
+ */
+static int
+spawn_child_with_credentials (gpointer user_data)
+{
+  SpawnData *data = user_data;
+  UDisksSpawnedJob *job = data->job;
+  struct sigaction sa;
+  sigset_t mask;
+  gint n;
+
+  /* signal handlers are not shared (no CLONE_SIGHAND), reset them to their defaults */
+  memset (&sa, 0, sizeof sa);
+  sa.sa_handler = SIG_DFL;
+  for (n = 1; n < NSIG; n++)
+    sigaction (n, &sa, NULL);
+  sigemptyset (&mask);
+  sigprocmask (SIG_SETMASK, &mask, NULL);
+
+  if (dup2 (data->stdin_fd, STDIN_FILENO) < 0 ||
+      dup2 (data->stdout_fd, STDOUT_FILENO) < 0 ||
+      dup2 (data->stderr_fd, STDERR_FILENO) < 0)
+    {
+      data->child_failed_step = "dup2";
+      goto fail;
+    }
+
+  /* don't leak any descriptors of the daemon into the program */
+#ifdef SYS_close_range
+  if (syscall (SYS_close_range, 3, ~0U, 4 /* CLOSE_RANGE_CLOEXEC */) != 0)
+#endif
+    {
+      for (n = 3; n <= data->max_fd; n++)
+        fcntl (n, F_SETFD, FD_CLOEXEC);
+    }
 
-  if (job->run_as_uid == getuid () && job->run_as_euid == geteuid ())
-    goto out;
+  if (job->n_real_groups < 0)
+    goto exec;
 
   /* become the user...
    *
@@ -406,32 +657,158 @@ child_setup (gpointer user_data)
    * right. What we really need is some library function to
    * impersonate a pid or uid. What a mess.
    */
-  if (setgroups (0, NULL) != 0)
+#ifdef SYS_setgroups32
+  if (syscall (SYS_setgroups32, job->n_real_groups, job->real_groups) != 0)
+#else
+  if (syscall (SYS_setgroups, job->n_real_groups, job->real_groups) != 0)
+#endif
     {
-      g_printerr ("Error resetting groups: %m\n");
-      abort ();
+      data->child_failed_step = "setgroups";
+      goto fail;
     }
-  if (initgroups (job->real_pwname, job->real_gid) != 0)
+#ifdef SYS_setregid32
+  if (syscall (SYS_setregid32, job->real_gid, job->real_egid) != 0)
+#else
+  if (syscall (SYS_setregid, job->real_gid, job->real_egid) != 0)
+#endif
     {
-      g_printerr ("Error initializing groups for user %s and group %d: %m\n",
-                  job->real_pwname, (gint) job->real_gid);
-      abort ();
+      data->child_failed_step = "setregid";
+      goto fail;
     }
-  if (setregid (job->real_gid, job->real_egid) != 0)
+#ifdef SYS_setreuid32
+  if (syscall (SYS_setreuid32, job->real_uid, job->run_as_euid) != 0)
+#else
+  if (syscall (SYS_setreuid, job->real_uid, job->run_as_euid) != 0)
+#endif
     {
-      g_printerr ("Error setting real+effective gid %d and %d: %m\n",
-                  (gint) job->real_gid, (gint) job->real_egid);
-      abort ();
+      data->child_failed_step = "setreuid";
+      goto fail;
     }
-  if (setreuid (job->real_uid, job->run_as_euid) != 0)
+
+ exec:
+  execve (data->program, data->argv, environ);
+
+ fail:
+  data->child_errno = errno;
+  _exit (127);
+}
+
+static gboolean
+spawn_child_clone (SpawnData  *data,
+                   GPid       *out_pid,
+                   GError    **error)
+{
+  gpointer stack;
+  sigset_t all_signals;
+  sigset_t old_mask;
+  pid_t pid;
+  gint errsv;
+
+  stack = mmap (NULL, CHILD_STACK_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+  if (stack == MAP_FAILED)
     {
-      g_printerr ("Error setting real+effective uid %d and %d: %m\n",
-                  (gint) job->real_uid, (gint) job->run_as_euid);
-      abort ();
+      set_spawn_error (error, data->program, NULL, errno);
+      return FALSE;
     }
 
- out:
-  ;
+  /* make sure no signal handler of the daemon runs in the child before it resets them */
+  sigfillset (&all_signals);
+  pthread_sigmask (SIG_BLOCK, &all_signals, &old_mask);
+
+  data->child_errno = 0;
+  data->child_failed_step = NULL;
+  /* the calling thread is suspended until the child calls execve() or _exit() */
+  pid = clone (spawn_child_with_credentials,
+               (gchar *) stack + CHILD_STACK_SIZE,
+               CLONE_VM | CLONE_VFORK | SIGCHLD,
+               data);
+  errsv = errno;
+
+  pthread_sigmask (SIG_SETMASK, &old_mask, NULL);
+  munmap (stack, CHILD_STACK_SIZE);
+
+  if (pid < 0)
+    {
+      set_spawn_error (error, data->program, NULL, errsv);
+      return FALSE;
+    }
+
+  if (data->child_errno != 0)
+    {
+      /* the child never got to exec(), reap it right away */
+      while (waitpid (pid, NULL, 0) < 0 && errno == EINTR)
+        ;
+      set_spawn_error (error, data->program, data->child_failed_step, data->child_errno);
+      return FALSE;
+    }
+
+  *out_pid = pid;
+  return TRUE;
+}
+
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+static gboolean
+spawn_child_posix (SpawnData  *data,
+                   GPid       *out_pid,
+                   GError    **error)
+{
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  sigset_t mask;
+  pid_t pid;
+  gint rc;
+
+  posix_spawn_file_actions_init (&actions);
+  posix_spawn_file_actions_adddup2 (&actions, data->stdin_fd, STDIN_FILENO);
+  posix_spawn_file_actions_adddup2 (&actions, data->stdout_fd, STDOUT_FILENO);
+  posix_spawn_file_actions_adddup2 (&actions, data->stderr_fd, STDERR_FILENO);
+  /* don't leak any descriptors of the daemon into the program */
+  posix_spawn_file_actions_addclosefrom_np (&actions, 3);
+
+  posix_spawnattr_init (&attr);
+  sigemptyset (&mask);
+  posix_spawnattr_setsigmask (&attr, &mask);
+  sigfillset (&mask);
+  posix_spawnattr_setsigdefault (&attr, &mask);
+  posix_spawnattr_setflags (&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+  rc = posix_spawn (&pid, data->program, &actions, &attr, data->argv, environ);
+
+  posix_spawnattr_destroy (&attr);
+  posix_spawn_file_actions_destroy (&actions);
+
+  if (rc != 0)
+    {
+      set_spawn_error (error, data->program, NULL, rc);
+      return FALSE;
+    }
+
+  *out_pid = pid;
+  return TRUE;
+}
+#endif
+
+static void
+close_fd_if_open (gint fd)
+{
+  if (fd != -1)
+    g_warn_if_fail (close (fd) == 0);
+}
+
+/* Spawns @data->program without duplicating the address space of the daemon */
+static gboolean
+spawn_child (SpawnData  *data,
+             GPid       *out_pid,
+             GError    **error)
+{
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+  if (data->job->n_real_groups < 0)
+    return spawn_child_posix (data, out_pid, error);
+#endif
+
+  data->max_fd = (gint) sysconf (_SC_OPEN_MAX) - 1;
+  return spawn_child_clone (data, out_pid, error);
 }
 
 static void
@@ -439,9 +816,13 @@ udisks_spawned_job_init (UDisksSpawnedJob *job)
 {
   job->child_stdout = g_string_new (NULL);
   job->child_stderr = g_string_new (NULL);
+  job->child_stdout_line = g_string_new (NULL);
+  job->child_stderr_line = g_string_new (NULL);
+  job->n_real_groups = -1;
   job->child_stdin_fd = -1;
   job->child_stdout_fd = -1;
   job->child_stderr_fd = -1;
+  job->output_limit = DEFAULT_OUTPUT_LIMIT;
 }
 
 static void
@@ -521,6 +902,26 @@ udisks_spawned_job_class_init (UDisksSpawnedJobClass *klass)
                                                       G_PARAM_CONSTRUCT_ONLY |
                                                       G_PARAM_STATIC_STRINGS));
 
+  /**
+   * UDisksSpawnedJob:output-limit:
+   *
+   * The maximum number of bytes of standard output and standard error
+   * (each) that is kept for #UDisksSpawnedJob::spawned-job-completed.
+   * If the program writes more, only the most recent output is kept.
+   * The default of 1 MiB is plenty for error messages and for parsing
+   * the output of the programs udisks runs; set it to 0 to keep
+   * everything.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_OUTPUT_LIMIT,
+                                   g_param_spec_uint ("output-limit",
+                                                      "Output Limit",
+                                                      "Maximum number of bytes of output to keep",
+                                                      0, G_MAXUINT, DEFAULT_OUTPUT_LIMIT,
+                                                      G_PARAM_READABLE |
+                                                      G_PARAM_WRITABLE |
+                                                      G_PARAM_STATIC_STRINGS));
+
   /**
    * UDisksSpawnedJob::spawned-job-completed:
    * @job: The #UDisksSpawnedJob emitting the signal.
@@ -564,6 +965,39 @@ udisks_spawned_job_class_init (UDisksSpawnedJobClass *klass)
                   G_TYPE_INT,
                   G_TYPE_GSTRING,
                   G_TYPE_GSTRING);
+
+  /**
+   * UDisksSpawnedJob::output-line:
+   * @job: The #UDisksSpawnedJob emitting the signal.
+   * @stream: %STDOUT_FILENO or %STDERR_FILENO.
+   * @line: The line without the terminating newline.
+   *
+   * Emitted for every line the spawned program writes to its standard
+   * output or standard error while it is running. Newline, carriage
+   * return and the two of them in sequence terminate a line, a
+   * carriage return alone doesn't produce an empty line. So does a
+   * run of backspaces, which some programs use to overwrite a
+   * progress counter. Lines are only split while a handler is
+   * connected.
+   *
+   * This is independent of #UDisksSpawnedJob:output-limit.
+   *
+   * This signal is emitted in the
+   * <link linkend="g-main-context-push-thread-default">thread-default main loop</link>
+   * of the thread that @job was started in.
+   */
+  signals[OUTPUT_LINE_SIGNAL] =
+    g_signal_new ("output-line",
+                  UDISKS_TYPE_SPAWNED_JOB,
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL,
+                  NULL,
+                  NULL, /* generic marshaller */
+                  G_TYPE_NONE,
+                  2,
+                  G_TYPE_INT,
+                  G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE);
 }
 
 /**
@@ -622,6 +1056,26 @@ udisks_spawned_job_get_command_line (UDisksSpawnedJob *job)
   return job->command_line;
 }
 
+/**
+ * udisks_spawned_job_set_output_limit:
+ * @job: A #UDisksSpawnedJob.
+ * @output_limit: Maximum number of bytes to keep or 0 for no limit.
+ *
+ * Sets the #UDisksSpawnedJob:output-limit property. Must be called
+ * before udisks_spawned_job_start().
+ */
+void
+udisks_spawned_job_set_output_limit (UDisksSpawnedJob *job,
+                                     guint             output_limit)
+{
+  g_return_if_fail (UDISKS_IS_SPAWNED_JOB (job));
+  if (job->output_limit != output_limit)
+    {
+      job->output_limit = output_limit;
+      g_object_notify (G_OBJECT (job), "output-limit");
+    }
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static void
@@ -829,6 +1283,18 @@ udisks_spawned_job_release_resources (UDisksSpawnedJob *job)
       job->child_stderr = NULL;
     }
 
+  if (job->child_stdout_line != NULL)
+    {
+      g_string_free (job->child_stdout_line, TRUE);
+      job->child_stdout_line = NULL;
+    }
+
+  if (job->child_stderr_line != NULL)
+    {
+      g_string_free (job->child_stderr_line, TRUE);
+      job->child_stderr_line = NULL;
+    }
+
   if (job->child_stdin_channel != NULL)
     {
       g_io_channel_unref (job->child_stdin_channel);
@@ -883,11 +1349,7 @@ udisks_spawned_job_release_resources (UDisksSpawnedJob *job)
       job->cancellable_handler_id = 0;
     }
 
-  if (job->real_pwname != NULL)
-    {
-      free (job->real_pwname);
-      job->real_pwname = NULL;
-    }
+  g_clear_pointer (&job->real_groups, g_free);
 }
 
 /**
@@ -903,10 +1365,16 @@ void udisks_spawned_job_start (UDisksSpawnedJob *job)
   GError *error;
   gint child_argc;
   gchar **child_argv = NULL;
+  gchar *program = NULL;
   struct passwd pwstruct;
   gchar pwbuf[8192];
   struct passwd *pw = NULL;
   int rc;
+  gint stdin_pipe[2] = { -1, -1 };
+  gint stdout_pipe[2] = { -1, -1 };
+  gint stderr_pipe[2] = { -1, -1 };
+  SpawnData spawn_data;
+  gboolean spawned;
 
   job->main_context = g_main_context_get_thread_default ();
   if (job->main_context != NULL)
@@ -940,9 +1408,13 @@ void udisks_spawned_job_start (UDisksSpawnedJob *job)
       goto out;
     }
 
-  /* Save real egid and gid info for the child process */
+  /* Save real egid, gid and the supplementary groups for the child process,
+   * it can't look them up itself without fork()ing the whole daemon
+   */
   if (job->run_as_uid != getuid () || job->run_as_euid != geteuid ())
     {
+      gint n_groups;
+
       rc = getpwuid_r (job->run_as_euid, &pwstruct, pwbuf, sizeof pwbuf, &pw);
       if (rc != 0 || pw == NULL)
         {
@@ -965,22 +1437,55 @@ void udisks_spawned_job_start (UDisksSpawnedJob *job)
         }
       job->real_gid = pw->pw_gid;
       job->real_uid = pw->pw_uid;
-      job->real_pwname = strdup (pw->pw_name);
+
+      n_groups = 32;
+      job->real_groups = g_new0 (gid_t, n_groups);
+      while (getgrouplist (pw->pw_name, job->real_gid, job->real_groups, &n_groups) < 0)
+        job->real_groups = g_renew (gid_t, job->real_groups, n_groups);
+      job->n_real_groups = n_groups;
     }
 
-  error = NULL;
-  if (!g_spawn_async_with_pipes (NULL, /* working directory */
-                                 child_argv,
-                                 NULL, /* envp */
-                                 G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
-                                 child_setup, /* child_setup */
-                                 job, /* child_setup's user_data */
-                                 &(job->child_pid),
-                                 job->input_string != NULL ? &(job->child_stdin_fd) : NULL,
-                                 &(job->child_stdout_fd),
-                                 &(job->child_stderr_fd),
-                                 &error))
+  if (strchr (child_argv[0], '/') != NULL)
+    program = g_strdup (child_argv[0]);
+  else
+    program = g_find_program_in_path (child_argv[0]);
+
+  spawned = FALSE;
+  if (program == NULL)
+    {
+      set_spawn_error (&error, child_argv[0], NULL, ENOENT);
+    }
+  else if ((job->input_string != NULL ? pipe2 (stdin_pipe, O_CLOEXEC)
+                                      : (stdin_pipe[0] = open ("/dev/null", O_RDONLY | O_CLOEXEC))) < 0 ||
+           pipe2 (stdout_pipe, O_CLOEXEC) != 0 ||
+           pipe2 (stderr_pipe, O_CLOEXEC) != 0)
+    {
+      g_set_error (&error, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED,
+                   "Failed to create pipe for communicating with child process (%s)",
+                   g_strerror (errno));
+    }
+  else
+    {
+      spawn_data.job = job;
+      spawn_data.program = program;
+      spawn_data.argv = child_argv;
+      spawn_data.stdin_fd = stdin_pipe[0];
+      spawn_data.stdout_fd = stdout_pipe[1];
+      spawn_data.stderr_fd = stderr_pipe[1];
+      spawned = spawn_child (&spawn_data, &(job->child_pid), &error);
+    }
+
+  /* the child's ends of the pipes are not needed anymore, keep ours */
+  close_fd_if_open (stdin_pipe[0]);
+  close_fd_if_open (stdout_pipe[1]);
+  close_fd_if_open (stderr_pipe[1]);
+  job->child_stdin_fd = stdin_pipe[1];
+  job->child_stdout_fd = stdout_pipe[0];
+  job->child_stderr_fd = stderr_pipe[0];
+
+  if (!spawned)
     {
+      /* our ends are closed in udisks_spawned_job_release_resources() */
       g_prefix_error (&error,
                       "Error spawning command-line `%s': ",
                       job->command_line);
@@ -1072,6 +1577,7 @@ void udisks_spawned_job_start (UDisksSpawnedJob *job)
   g_source_unref (job->child_stderr_source);
 
  out:
+  g_free (program);
   g_strfreev (child_argv);
 }
 
@@ -31,6 +31,7 @@
 #include <linux/loop.h>
 
 #include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
 
@@ -192,8 +193,21 @@ struct _UDisksState
 
   /* key-path -> GVariant */
   GHashTable *cache;
+
+  /* checks requested but not yet performed, protected by pending_lock */
+  GMutex pending_lock;
+  GArray *pending_devices;
+  gboolean pending_full;
+  GSource *pending_source;
+  gboolean pending_source_immediate;
 };
 
+/* how long to wait for more devices before performing a targeted check */
+#define CHECK_COALESCE_MSEC 200
+
+/* interval of the full check performed regardless of uevents */
+#define FULL_CHECK_INTERVAL_SECONDS 300
+
 typedef struct _UDisksStateClass UDisksStateClass;
 
 struct _UDisksStateClass
@@ -207,20 +221,25 @@ enum
   PROP_DAEMON
 };
 
-static void      udisks_state_check_in_thread     (UDisksState          *state);
+static void      udisks_state_check_in_thread     (UDisksState          *state,
+                                                   GArray               *match_devices);
 static void      udisks_state_check_mounted_fs    (UDisksState          *state,
                                                    const gchar          *key,
                                                    GArray               *devs_to_clean,
-                                                   dev_t                 match_block_device);
+                                                   dev_t                 match_block_device,
+                                                   GArray               *match_devices);
 static void      udisks_state_check_unlocked_crypto_dev (UDisksState          *state,
                                                          gboolean              check_only,
-                                                         GArray               *devs_to_clean);
+                                                         GArray               *devs_to_clean,
+                                                         GArray               *match_devices);
 static void      udisks_state_check_loop          (UDisksState          *state,
                                                    gboolean              check_only,
-                                                   GArray               *devs_to_clean);
+                                                   GArray               *devs_to_clean,
+                                                   GArray               *match_devices);
 static void      udisks_state_check_mdraid        (UDisksState          *state,
                                                    gboolean              check_only,
-                                                   GArray               *devs_to_clean);
+                                                   GArray               *devs_to_clean,
+                                                   GArray               *match_devices);
 static gchar    *get_state_file_path              (const gchar          *key);
 static GVariant *udisks_state_get                 (UDisksState          *state,
                                                    const gchar          *key,
@@ -237,6 +256,8 @@ udisks_state_init (UDisksState *state)
 {
   g_mutex_init (&state->lock);
   state->cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_variant_unref);
+  g_mutex_init (&state->pending_lock);
+  state->pending_devices = g_array_new (FALSE, FALSE, sizeof (dev_t));
 }
 
 static void
@@ -246,6 +267,10 @@ udisks_state_finalize (GObject *object)
 
   g_hash_table_unref (state->cache);
   g_mutex_clear (&state->lock);
+  if (state->pending_source != NULL)
+    g_source_unref (state->pending_source);
+  g_array_free (state->pending_devices, TRUE);
+  g_mutex_clear (&state->pending_lock);
 
   G_OBJECT_CLASS (udisks_state_parent_class)->finalize (object);
 }
@@ -357,6 +382,85 @@ udisks_state_thread_func (gpointer user_data)
 }
 
 
+static gboolean
+dev_in_array (GArray *devs,
+              dev_t   dev)
+{
+  guint n;
+
+  for (n = 0; devs != NULL && n < devs->len; n++)
+    {
+      if (g_array_index (devs, dev_t, n) == dev)
+        return TRUE;
+    }
+  return FALSE;
+}
+
+/* runs in the cleanup thread */
+static gboolean
+udisks_state_pending_check_func (gpointer user_data)
+{
+  UDisksState *state = UDISKS_STATE (user_data);
+  GArray *devices;
+  gboolean full;
+
+  g_mutex_lock (&state->pending_lock);
+  if (state->pending_source == g_main_current_source ())
+    {
+      g_source_unref (state->pending_source);
+      state->pending_source = NULL;
+    }
+  full = state->pending_full;
+  devices = state->pending_devices;
+  state->pending_full = FALSE;
+  state->pending_devices = g_array_new (FALSE, FALSE, sizeof (dev_t));
+  g_mutex_unlock (&state->pending_lock);
+
+  if (full)
+    udisks_state_check_in_thread (state, NULL);
+  else if (devices->len > 0)
+    udisks_state_check_in_thread (state, devices);
+
+  g_array_free (devices, TRUE);
+  return G_SOURCE_REMOVE;
+}
+
+/* called with pending_lock held */
+static void
+schedule_pending_check (UDisksState *state,
+                        guint        delay_msec)
+{
+  if (state->pending_source != NULL)
+    {
+      /* already scheduled, unless a delayed check needs to happen right away */
+      if (delay_msec > 0 || state->pending_source_immediate)
+        return;
+      g_source_destroy (state->pending_source);
+      g_source_unref (state->pending_source);
+    }
+
+  if (delay_msec > 0)
+    state->pending_source = g_timeout_source_new (delay_msec);
+  else
+    state->pending_source = g_idle_source_new ();
+  state->pending_source_immediate = (delay_msec == 0);
+  g_source_set_callback (state->pending_source, udisks_state_pending_check_func, state, NULL);
+  g_source_attach (state->pending_source, state->context);
+}
+
+static gboolean
+udisks_state_full_check_func (gpointer user_data)
+{
+  UDisksState *state = UDISKS_STATE (user_data);
+
+  g_mutex_lock (&state->pending_lock);
+  state->pending_full = TRUE;
+  schedule_pending_check (state, 0);
+  g_mutex_unlock (&state->pending_lock);
+
+  return G_SOURCE_CONTINUE;
+}
+
 /**
  * udisks_state_start_cleanup:
  * @state: A #UDisksState.
@@ -369,11 +473,20 @@ udisks_state_thread_func (gpointer user_data)
 void
 udisks_state_start_cleanup (UDisksState *state)
 {
+  GSource *source;
+
   g_return_if_fail (UDISKS_IS_STATE (state));
   g_return_if_fail (state->thread == NULL);
 
   state->context = g_main_context_new ();
   state->loop = g_main_loop_new (state->context, FALSE);
+
+  /* safety net for anything targeted checks might have missed */
+  source = g_timeout_source_new_seconds (FULL_CHECK_INTERVAL_SECONDS);
+  g_source_set_callback (source, udisks_state_full_check_func, state, NULL);
+  g_source_attach (source, state->context);
+  g_source_unref (source);
+
   state->thread = g_thread_new ("cleanup",
                                 udisks_state_thread_func,
                                 g_object_ref (state));
@@ -398,14 +511,6 @@ udisks_state_stop_cleanup (UDisksState *state)
   g_thread_join (thread);
 }
 
-static gboolean
-udisks_state_check_func (gpointer user_data)
-{
-  UDisksState *state = UDISKS_STATE (user_data);
-  udisks_state_check_in_thread (state);
-  return FALSE;
-}
-
 /**
  * udisks_state_check:
  * @state: A #UDisksState.
@@ -420,9 +525,39 @@ udisks_state_check (UDisksState *state)
   g_return_if_fail (UDISKS_IS_STATE (state));
   g_return_if_fail (state->thread != NULL);
 
-  g_main_context_invoke (state->context,
-                         udisks_state_check_func,
-                         state);
+  g_mutex_lock (&state->pending_lock);
+  state->pending_full = TRUE;
+  schedule_pending_check (state, 0);
+  g_mutex_unlock (&state->pending_lock);
+}
+
+/**
+ * udisks_state_check_device:
+ * @state: A #UDisksState.
+ * @device: Device number of a block device that has changed or was removed.
+ *
+ * Like udisks_state_check() but only checks the entries related to
+ * @device, i.e. entries for @device itself, for partitions on @device
+ * and for devices set up on top of @device, as well as mounts of the
+ * devices about to be cleaned up.
+ *
+ * Requests are coalesced over a short period of time so a burst of
+ * uevents results in a single check of all the devices involved.
+ *
+ * This can be called from any thread and will not block the calling thread.
+ */
+void
+udisks_state_check_device (UDisksState *state,
+                           dev_t        device)
+{
+  g_return_if_fail (UDISKS_IS_STATE (state));
+  g_return_if_fail (state->thread != NULL);
+
+  g_mutex_lock (&state->pending_lock);
+  if (!state->pending_full && !dev_in_array (state->pending_devices, device))
+    g_array_append_val (state->pending_devices, device);
+  schedule_pending_check (state, CHECK_COALESCE_MSEC);
+  g_mutex_unlock (&state->pending_lock);
 }
 
 
@@ -437,7 +572,7 @@ typedef struct
 static gboolean
 udisks_state_check_sync_func (UDisksStateCheckSyncData *data)
 {
-  udisks_state_check_in_thread (data->state);
+  udisks_state_check_in_thread (data->state, NULL);
 
   /* signal the calling thread the cleanup has finished */
   g_mutex_lock (&data->data_mutex);
@@ -505,11 +640,13 @@ udisks_state_check_block (UDisksState   *state,
   udisks_state_check_mounted_fs (state,
                                  UDISKS_STATE_FILE_MOUNTED_FS,
                                  NULL,
-                                 block_device);
+                                 block_device,
+                                 NULL);
   udisks_state_check_mounted_fs (state,
                                  UDISKS_STATE_FILE_MOUNTED_FS_PERSISTENT,
                                  NULL,
-                                 block_device);
+                                 block_device,
+                                 NULL);
 
   g_mutex_unlock (&state->lock);
 }
@@ -531,11 +668,16 @@ udisks_state_get_daemon (UDisksState *state)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-/* must be called from state thread */
+/* must be called from state thread
+ *
+ * If @match_devices is not %NULL, only entries related to the given devices are checked.
+ */
 static void
-udisks_state_check_in_thread (UDisksState *state)
+udisks_state_check_in_thread (UDisksState *state,
+                              GArray      *match_devices)
 {
   GArray *devs_to_clean;
+  GArray *match_mounted_devices = NULL;
 
   g_mutex_lock (&state->lock);
 
@@ -543,7 +685,10 @@ udisks_state_check_in_thread (UDisksState *state)
    * can't be stopped if they are in use
    */
 
-  udisks_info ("Cleanup check start");
+  if (match_devices != NULL)
+    udisks_info ("Cleanup check start (%u devices)", match_devices->len);
+  else
+    udisks_info ("Cleanup check start");
 
   /* First go through all block devices we might tear down
    * but only check + record devices marked for cleaning
@@ -551,42 +696,59 @@ udisks_state_check_in_thread (UDisksState *state)
   devs_to_clean = g_array_new (FALSE, FALSE, sizeof (dev_t));
   udisks_state_check_unlocked_crypto_dev (state,
                                           TRUE, /* check_only */
-                                          devs_to_clean);
+                                          devs_to_clean,
+                                          match_devices);
   udisks_state_check_loop (state,
                            TRUE, /* check_only */
-                           devs_to_clean);
+                           devs_to_clean,
+                           match_devices);
 
   udisks_state_check_mdraid (state,
                              TRUE, /* check_only */
-                             devs_to_clean);
+                             devs_to_clean,
+                             match_devices);
 
   /* Then go through all mounted filesystems and pass the
    * devices that we intend to clean...
    */
+  if (match_devices != NULL)
+    {
+      /* ... which need to be checked as well even if unrelated to match_devices */
+      match_mounted_devices = g_array_new (FALSE, FALSE, sizeof (dev_t));
+      g_array_append_vals (match_mounted_devices, match_devices->data, match_devices->len);
+      g_array_append_vals (match_mounted_devices, devs_to_clean->data, devs_to_clean->len);
+    }
   udisks_state_check_mounted_fs (state,
                                  UDISKS_STATE_FILE_MOUNTED_FS,
                                  devs_to_clean,
-                                 0);
+                                 0,
+                                 match_mounted_devices);
   udisks_state_check_mounted_fs (state,
                                  UDISKS_STATE_FILE_MOUNTED_FS_PERSISTENT,
                                  devs_to_clean,
-                                 0);
+                                 0,
+                                 match_mounted_devices);
 
   /* Then go through all block devices and clear them up
    * ... for real this time
    */
   udisks_state_check_unlocked_crypto_dev (state,
                                           FALSE, /* check_only */
-                                          NULL);
+                                          NULL,
+                                          match_devices);
   udisks_state_check_loop (state,
                            FALSE, /* check_only */
-                           NULL);
+                           NULL,
+                           match_devices);
 
   udisks_state_check_mdraid (state,
                              FALSE, /* check_only */
-                             NULL);
+                             NULL,
+                             match_devices);
 
   g_array_free (devs_to_clean, TRUE);
+  if (match_mounted_devices != NULL)
+    g_array_free (match_mounted_devices, TRUE);
 
   udisks_info ("Cleanup check end");
 
@@ -595,6 +757,34 @@ udisks_state_check_in_thread (UDisksState *state)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Gets the device number of the disk containing the partition @dev or 0
+ * if @dev is not a partition. Uses sysfs directly as this is called for
+ * every entry during targeted checks.
+ */
+static dev_t
+get_enclosing_disk (dev_t dev)
+{
+  gchar *path;
+  gchar *contents = NULL;
+  guint disk_major, disk_minor;
+  dev_t ret = 0;
+
+  path = g_strdup_printf ("/sys/dev/block/%u:%u/partition", major (dev), minor (dev));
+  if (!g_file_test (path, G_FILE_TEST_EXISTS))
+    goto out;
+
+  g_free (path);
+  path = g_strdup_printf ("/sys/dev/block/%u:%u/../dev", major (dev), minor (dev));
+  if (g_file_get_contents (path, &contents, NULL, NULL)
+      && sscanf (contents, "%u:%u", &disk_major, &disk_minor) == 2)
+    ret = makedev (disk_major, disk_minor);
+
+ out:
+  g_free (contents);
+  g_free (path);
+  return ret;
+}
+
 static GVariant *
 lookup_asv (GVariant    *asv,
             const gchar *key)
@@ -632,7 +822,8 @@ static gboolean
 udisks_state_check_mounted_fs_entry (UDisksState  *state,
                                      GVariant     *value,
                                      GArray       *devs_to_clean,
-                                     dev_t         match_block_device)
+                                     dev_t         match_block_device,
+                                     GArray       *match_devices)
 {
   const gchar *mount_point_str;
   gchar mount_point[PATH_MAX] = { '\0', };
@@ -651,7 +842,6 @@ udisks_state_check_mounted_fs_entry (UDisksState  *state,
   UDisksMountMonitor *monitor;
   GUdevClient *udev_client;
   GUdevDevice *udev_device;
-  guint n;
   gchar *change_sysfs_path = NULL;
   UDisksObject *block_object = NULL;
   gboolean locked;
@@ -690,6 +880,15 @@ udisks_state_check_mounted_fs_entry (UDisksState  *state,
       goto out;
     }
 
+  if (match_devices != NULL
+      && !dev_in_array (match_devices, block_device)
+      && !dev_in_array (match_devices, get_enclosing_disk (block_device)))
+    {
+      /* unrelated to the devices being checked */
+      keep = TRUE;
+      goto out;
+    }
+
   block_object = udisks_daemon_find_block (state->daemon, block_device);
   /* skip locking if called from udisks_state_check_block() */
   if (block_object != NULL && match_block_device == 0)
@@ -796,16 +995,7 @@ udisks_state_check_mounted_fs_entry (UDisksState  *state,
     }
 
   /* Figure out if the device is about to be cleaned up */
-  if (devs_to_clean != NULL)
-    for (n = 0; n < devs_to_clean->len; n++)
-      {
-        dev_t dev_to_clean = g_array_index (devs_to_clean, dev_t, n);
-        if (dev_to_clean == block_device)
-          {
-            device_to_be_cleaned = TRUE;
-            break;
-          }
-      }
+  device_to_be_cleaned = dev_in_array (devs_to_clean, block_device);
 
   if (is_mounted && device_exists && !device_to_be_cleaned)
     keep = TRUE;
@@ -908,7 +1098,8 @@ static void
 udisks_state_check_mounted_fs (UDisksState *state,
                                const gchar *key,
                                GArray      *devs_to_clean,
-                               dev_t        match_block_device)
+                               dev_t        match_block_device,
+                               GArray      *match_devices)
 {
   gboolean changed;
   GVariant *value;
@@ -931,7 +1122,7 @@ udisks_state_check_mounted_fs (UDisksState *state,
       g_variant_iter_init (&iter, value);
       while ((child = g_variant_iter_next_value (&iter)) != NULL)
         {
-          if (udisks_state_check_mounted_fs_entry (state, child, devs_to_clean, match_block_device))
+          if (udisks_state_check_mounted_fs_entry (state, child, devs_to_clean, match_block_device, match_devices))
             g_variant_builder_add_value (&builder, child);
           else
             changed = TRUE;
@@ -1181,7 +1372,8 @@ static gboolean
 udisks_state_check_unlocked_crypto_dev_entry (UDisksState  *state,
                                               GVariant     *value,
                                               gboolean      check_only,
-                                              GArray       *devs_to_clean)
+                                              GArray       *devs_to_clean,
+                                              GArray       *match_devices)
 {
   guint64 cleartext_device;
   GVariant *details;
@@ -1226,6 +1418,16 @@ udisks_state_check_unlocked_crypto_dev_entry (UDisksState  *state,
     }
   crypto_device = g_variant_get_uint64 (crypto_device_value);
 
+  if (match_devices != NULL
+      && !dev_in_array (match_devices, cleartext_device)
+      && !dev_in_array (match_devices, crypto_device)
+      && !dev_in_array (match_devices, get_enclosing_disk (crypto_device)))
+    {
+      /* unrelated to the devices being checked */
+      keep = TRUE;
+      goto out;
+    }
+
   dm_uuid_value = lookup_asv (details, "dm-uuid");
   if (dm_uuid_value == NULL)
     {
@@ -1341,7 +1543,8 @@ udisks_state_check_unlocked_crypto_dev_entry (UDisksState  *state,
 static void
 udisks_state_check_unlocked_crypto_dev (UDisksState *state,
                                         gboolean     check_only,
-                                        GArray      *devs_to_clean)
+                                        GArray      *devs_to_clean,
+                                        GArray      *match_devices)
 {
   gboolean changed;
   GVariant *value;
@@ -1364,7 +1567,7 @@ udisks_state_check_unlocked_crypto_dev (UDisksState *state,
       g_variant_iter_init (&iter, value);
       while ((child = g_variant_iter_next_value (&iter)) != NULL)
         {
-          if (udisks_state_check_unlocked_crypto_dev_entry (state, child, check_only, devs_to_clean))
+          if (udisks_state_check_unlocked_crypto_dev_entry (state, child, check_only, devs_to_clean, match_devices))
             g_variant_builder_add_value (&builder, child);
           else
             changed = TRUE;
@@ -1577,7 +1780,8 @@ static gboolean
 udisks_state_check_loop_entry (UDisksState  *state,
                                GVariant     *value,
                                gboolean      check_only,
-                               GArray       *devs_to_clean)
+                               GArray       *devs_to_clean,
+                               GArray       *match_devices)
 {
   const gchar *loop_device;
   GVariant *details = NULL;
@@ -1595,6 +1799,19 @@ udisks_state_check_loop_entry (UDisksState  *state,
                  &loop_device,
                  &details);
 
+  if (match_devices != NULL)
+    {
+      struct stat statbuf;
+
+      /* a loop device that can't be stat()'ed anymore is always checked */
+      if (stat (loop_device, &statbuf) == 0 && !dev_in_array (match_devices, statbuf.st_rdev))
+        {
+          /* unrelated to the devices being checked */
+          keep = TRUE;
+          goto out;
+        }
+    }
+
   backing_file_value = lookup_asv (details, "backing-file");
   if (backing_file_value == NULL)
     {
@@ -1668,7 +1885,8 @@ udisks_state_check_loop_entry (UDisksState  *state,
 static void
 udisks_state_check_loop (UDisksState *state,
                          gboolean     check_only,
-                         GArray      *devs_to_clean)
+                         GArray      *devs_to_clean,
+                         GArray      *match_devices)
 {
   gboolean changed;
   GVariant *value;
@@ -1691,7 +1909,7 @@ udisks_state_check_loop (UDisksState *state,
       g_variant_iter_init (&iter, value);
       while ((child = g_variant_iter_next_value (&iter)) != NULL)
         {
-          if (udisks_state_check_loop_entry (state, child, check_only, devs_to_clean))
+          if (udisks_state_check_loop_entry (state, child, check_only, devs_to_clean, match_devices))
             g_variant_builder_add_value (&builder, child);
           else
             changed = TRUE;
@@ -1933,7 +2151,8 @@ static gboolean
 udisks_state_check_mdraid_entry (UDisksState  *state,
                                  GVariant     *value,
                                  gboolean      check_only,
-                                 GArray       *devs_to_clean)
+                                 GArray       *devs_to_clean,
+                                 GArray       *match_devices)
 {
   dev_t raid_device;
   GVariant *details = NULL;
@@ -1949,6 +2168,13 @@ udisks_state_check_mdraid_entry (UDisksState  *state,
                  &raid_device,
                  &details);
 
+  if (match_devices != NULL && !dev_in_array (match_devices, raid_device))
+    {
+      /* unrelated to the devices being checked */
+      keep = TRUE;
+      goto out;
+    }
+
   /* check if the RAID device is still set up */
   device = g_udev_client_query_by_device_number (udev_client, G_UDEV_DEVICE_TYPE_BLOCK, raid_device);
   if (device == NULL)
@@ -2000,7 +2226,8 @@ udisks_state_check_mdraid_entry (UDisksState  *state,
 static void
 udisks_state_check_mdraid (UDisksState *state,
                            gboolean     check_only,
-                           GArray      *devs_to_clean)
+                           GArray      *devs_to_clean,
+                           GArray      *match_devices)
 {
   gboolean changed;
   GVariant *value;
@@ -2023,7 +2250,7 @@ udisks_state_check_mdraid (UDisksState *state,
       g_variant_iter_init (&iter, value);
       while ((child = g_variant_iter_next_value (&iter)) != NULL)
         {
-          if (udisks_state_check_mdraid_entry (state, child, check_only, devs_to_clean))
+          if (udisks_state_check_mdraid_entry (state, child, check_only, devs_to_clean, match_devices))
             g_variant_builder_add_value (&builder, child);
           else
             changed = TRUE;
@@ -0,0 +1,407 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+
+#include <glib/gi18n-lib.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "udisksstatisticssampler.h"
+#include "udiskslogging.h"
+#include "udisksstats.h"
+
+/**
+ * SECTION:udisksstatisticssampler
+ * @title: UDisksStatisticsSampler
+ * @short_description: Shared sampler for block device I/O statistics
+ *
+ * This type periodically reads the <filename>stat</filename> sysfs
+ * files of block devices and publishes the derived rates on their
+ * #UDisksBlockStatistics interfaces.
+ *
+ * A single timer serves all devices and it only runs while at least one
+ * device is registered with udisks_statistics_sampler_add(), i.e. while
+ * at least one client is subscribed to the statistics of some device.
+ * The <filename>stat</filename> files are kept open while a device is
+ * registered and re-read with pread(2) on every tick so no path lookups
+ * are done while sampling.
+ *
+ * All properties of a device are updated together and only when their
+ * value changed, which results in at most one
+ * <literal>PropertiesChanged</literal> signal per device and interval.
+ */
+
+typedef struct _UDisksStatisticsSamplerClass UDisksStatisticsSamplerClass;
+
+/**
+ * UDisksStatisticsSampler:
+ *
+ * The #UDisksStatisticsSampler structure contains only private data and
+ * should only be accessed using the provided API.
+ */
+struct _UDisksStatisticsSampler
+{
+  GObject parent_instance;
+
+  guint interval;
+
+  /* protects everything below */
+  GMutex lock;
+
+  /* UDisksBlockStatistics* -> SamplerEntry*, owns the entries */
+  GHashTable *entries;
+  GSource *timeout_source;
+};
+
+struct _UDisksStatisticsSamplerClass
+{
+  GObjectClass parent_class;
+};
+
+/* Fields of the stat file, see Documentation/block/stat.rst in the kernel sources */
+enum
+{
+  STAT_READ_IOS,
+  STAT_READ_MERGES,
+  STAT_READ_SECTORS,
+  STAT_READ_TICKS,
+  STAT_WRITE_IOS,
+  STAT_WRITE_MERGES,
+  STAT_WRITE_SECTORS,
+  STAT_WRITE_TICKS,
+  STAT_IN_FLIGHT,
+  STAT_N_FIELDS
+};
+
+/* the stat file always counts in 512 byte sectors */
+#define STAT_SECTOR_SIZE 512
+
+#define MIN_INTERVAL 100
+
+typedef struct
+{
+  /* not referenced, the entry is removed in udisks_statistics_sampler_remove() */
+  UDisksBlockStatistics *statistics;
+  gchar *path;
+  gint fd;
+  gint64 timestamp;
+  guint64 fields[STAT_N_FIELDS];
+} SamplerEntry;
+
+G_DEFINE_TYPE (UDisksStatisticsSampler, udisks_statistics_sampler, G_TYPE_OBJECT);
+
+static void
+sampler_entry_free (SamplerEntry *entry)
+{
+  if (entry->fd >= 0)
+    close (entry->fd);
+  g_free (entry->path);
+  g_free (entry);
+}
+
+static void
+udisks_statistics_sampler_init (UDisksStatisticsSampler *sampler)
+{
+  g_mutex_init (&sampler->lock);
+  sampler->entries = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) sampler_entry_free);
+}
+
+static void
+udisks_statistics_sampler_finalize (GObject *object)
+{
+  UDisksStatisticsSampler *sampler = UDISKS_STATISTICS_SAMPLER (object);
+
+  if (sampler->timeout_source != NULL)
+    {
+      g_source_destroy (sampler->timeout_source);
+      g_source_unref (sampler->timeout_source);
+    }
+  g_hash_table_unref (sampler->entries);
+  g_mutex_clear (&sampler->lock);
+
+  G_OBJECT_CLASS (udisks_statistics_sampler_parent_class)->finalize (object);
+}
+
+static void
+udisks_statistics_sampler_class_init (UDisksStatisticsSamplerClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = udisks_statistics_sampler_finalize;
+}
+
+/**
+ * udisks_statistics_sampler_new:
+ * @interval: The sampling interval in milliseconds.
+ *
+ * Creates a new #UDisksStatisticsSampler. Intervals shorter than 100
+ * milliseconds are rounded up.
+ *
+ * Returns: A #UDisksStatisticsSampler. Free with g_object_unref().
+ */
+UDisksStatisticsSampler *
+udisks_statistics_sampler_new (guint interval)
+{
+  UDisksStatisticsSampler *sampler;
+
+  sampler = UDISKS_STATISTICS_SAMPLER (g_object_new (UDISKS_TYPE_STATISTICS_SAMPLER, NULL));
+  sampler->interval = MAX (interval, MIN_INTERVAL);
+
+  return sampler;
+}
+
+/**
+ * udisks_statistics_sampler_get_interval:
+ * @sampler: A #UDisksStatisticsSampler.
+ *
+ * Gets the sampling interval used by @sampler.
+ *
+ * Returns: The interval in milliseconds.
+ */
+guint
+udisks_statistics_sampler_get_interval (UDisksStatisticsSampler *sampler)
+{
+  g_return_val_if_fail (UDISKS_IS_STATISTICS_SAMPLER (sampler), 0);
+  return sampler->interval;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+read_fields (SamplerEntry  *entry,
+             guint64       *fields,
+             GError       **error)
+{
+  gchar buf[512];
+  gchar *s;
+  gchar *endp;
+  ssize_t len;
+  guint n;
+
+  len = pread (entry->fd, buf, sizeof (buf) - 1, 0);
+  if (len < 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error reading %s: %m", entry->path);
+      return FALSE;
+    }
+  buf[len] = '\0';
+
+  s = buf;
+  for (n = 0; n < STAT_N_FIELDS; n++)
+    {
+      fields[n] = g_ascii_strtoull (s, &endp, 10);
+      if (endp == s)
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Error parsing %s: expected %d fields, got %u",
+                       entry->path, STAT_N_FIELDS, n);
+          return FALSE;
+        }
+      s = endp;
+    }
+
+  return TRUE;
+}
+
+/* counters are only reset when the device goes away, don't report bogus rates if that races with us */
+static guint64
+delta (const guint64 *now,
+       const guint64 *before,
+       guint          field)
+{
+  return now[field] >= before[field] ? now[field] - before[field] : 0;
+}
+
+static void
+sample_entry (SamplerEntry *entry)
+{
+  guint64 fields[STAT_N_FIELDS];
+  gint64 now;
+  gint64 elapsed;
+  guint64 read_ios;
+  guint64 write_ios;
+  GError *error = NULL;
+
+  now = g_get_monotonic_time ();
+  if (!read_fields (entry, fields, &error))
+    {
+      udisks_debug ("%s", error->message);
+      g_clear_error (&error);
+      return;
+    }
+
+  elapsed = now - entry->timestamp;
+  if (elapsed <= 0)
+    return;
+
+  read_ios = delta (fields, entry->fields, STAT_READ_IOS);
+  write_ios = delta (fields, entry->fields, STAT_WRITE_IOS);
+
+  g_object_freeze_notify (G_OBJECT (entry->statistics));
+  udisks_block_statistics_set_read_iops (entry->statistics, (gdouble) read_ios * G_USEC_PER_SEC / elapsed);
+  udisks_block_statistics_set_write_iops (entry->statistics, (gdouble) write_ios * G_USEC_PER_SEC / elapsed);
+  udisks_block_statistics_set_read_bytes_per_second (entry->statistics,
+                                                     delta (fields, entry->fields, STAT_READ_SECTORS)
+                                                     * STAT_SECTOR_SIZE * G_USEC_PER_SEC / elapsed);
+  udisks_block_statistics_set_write_bytes_per_second (entry->statistics,
+                                                      delta (fields, entry->fields, STAT_WRITE_SECTORS)
+                                                      * STAT_SECTOR_SIZE * G_USEC_PER_SEC / elapsed);
+  /* ticks are in milliseconds */
+  udisks_block_statistics_set_read_latency (entry->statistics,
+                                            read_ios > 0 ? delta (fields, entry->fields, STAT_READ_TICKS) * 1000 / read_ios : 0);
+  udisks_block_statistics_set_write_latency (entry->statistics,
+                                             write_ios > 0 ? delta (fields, entry->fields, STAT_WRITE_TICKS) * 1000 / write_ios : 0);
+  udisks_block_statistics_set_in_flight (entry->statistics, fields[STAT_IN_FLIGHT]);
+  g_object_thaw_notify (G_OBJECT (entry->statistics));
+
+  memcpy (entry->fields, fields, sizeof (fields));
+  entry->timestamp = now;
+}
+
+static gboolean
+on_timeout (gpointer user_data)
+{
+  UDisksStatisticsSampler *sampler = UDISKS_STATISTICS_SAMPLER (user_data);
+  GHashTableIter iter;
+  SamplerEntry *entry;
+  gint64 begin_time;
+
+  begin_time = udisks_stats_begin ();
+
+  g_mutex_lock (&sampler->lock);
+  g_hash_table_iter_init (&iter, sampler->entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    sample_entry (entry);
+  g_mutex_unlock (&sampler->lock);
+
+  udisks_stats_end ("timeout", "statistics-sampler", begin_time);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/**
+ * udisks_statistics_sampler_add:
+ * @sampler: A #UDisksStatisticsSampler.
+ * @statistics: The #UDisksBlockStatistics interface to update.
+ * @sysfs_path: The sysfs path of the block device.
+ * @error: Return location for error or %NULL.
+ *
+ * Starts sampling the statistics of the block device at @sysfs_path
+ * and publishing them on @statistics. The sampler does not take a
+ * reference to @statistics, it must be removed with
+ * udisks_statistics_sampler_remove() before it is finalized.
+ *
+ * Adding @statistics again has no effect.
+ *
+ * Returns: %TRUE if sampling started, %FALSE if @error is set.
+ */
+gboolean
+udisks_statistics_sampler_add (UDisksStatisticsSampler  *sampler,
+                               UDisksBlockStatistics    *statistics,
+                               const gchar              *sysfs_path,
+                               GError                  **error)
+{
+  SamplerEntry *entry;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (UDISKS_IS_STATISTICS_SAMPLER (sampler), FALSE);
+  g_return_val_if_fail (UDISKS_IS_BLOCK_STATISTICS (statistics), FALSE);
+  g_return_val_if_fail (sysfs_path != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  g_mutex_lock (&sampler->lock);
+
+  if (g_hash_table_contains (sampler->entries, statistics))
+    {
+      ret = TRUE;
+      goto out;
+    }
+
+  entry = g_new0 (SamplerEntry, 1);
+  entry->statistics = statistics;
+  entry->path = g_build_filename (sysfs_path, "stat", NULL);
+  entry->fd = open (entry->path, O_RDONLY | O_CLOEXEC);
+  if (entry->fd < 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error opening %s: %m", entry->path);
+      sampler_entry_free (entry);
+      goto out;
+    }
+
+  /* take the baseline, the rates are published from the first tick on */
+  entry->timestamp = g_get_monotonic_time ();
+  if (!read_fields (entry, entry->fields, error))
+    {
+      sampler_entry_free (entry);
+      goto out;
+    }
+  udisks_block_statistics_set_in_flight (statistics, entry->fields[STAT_IN_FLIGHT]);
+
+  g_hash_table_insert (sampler->entries, statistics, entry);
+
+  if (sampler->timeout_source == NULL)
+    {
+      udisks_debug ("Starting to sample I/O statistics every %u ms", sampler->interval);
+      sampler->timeout_source = g_timeout_source_new (sampler->interval);
+      g_source_set_name (sampler->timeout_source, "[udisks] statistics sampler");
+      g_source_set_callback (sampler->timeout_source, on_timeout, sampler, NULL);
+      g_source_attach (sampler->timeout_source, NULL);
+    }
+
+  ret = TRUE;
+
+ out:
+  g_mutex_unlock (&sampler->lock);
+  return ret;
+}
+
+/**
+ * udisks_statistics_sampler_remove:
+ * @sampler: A #UDisksStatisticsSampler.
+ * @statistics: A #UDisksBlockStatistics interface.
+ *
+ * Stops sampling the statistics published on @statistics. The timer is
+ * stopped when no device is left to sample. Removing an interface that
+ * was not added has no effect.
+ */
+void
+udisks_statistics_sampler_remove (UDisksStatisticsSampler  *sampler,
+                                  UDisksBlockStatistics    *statistics)
+{
+  g_return_if_fail (UDISKS_IS_STATISTICS_SAMPLER (sampler));
+
+  g_mutex_lock (&sampler->lock);
+
+  g_hash_table_remove (sampler->entries, statistics);
+
+  if (g_hash_table_size (sampler->entries) == 0 && sampler->timeout_source != NULL)
+    {
+      udisks_debug ("No subscribers left, stopping to sample I/O statistics");
+      g_source_destroy (sampler->timeout_source);
+      g_source_unref (sampler->timeout_source);
+      sampler->timeout_source = NULL;
+    }
+
+  g_mutex_unlock (&sampler->lock);
+}
@@ -0,0 +1,42 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __UDISKS_STATISTICS_SAMPLER_H__
+#define __UDISKS_STATISTICS_SAMPLER_H__
+
+#include "udisksdaemontypes.h"
+
+G_BEGIN_DECLS
+
+#define UDISKS_TYPE_STATISTICS_SAMPLER         (udisks_statistics_sampler_get_type ())
+#define UDISKS_STATISTICS_SAMPLER(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), UDISKS_TYPE_STATISTICS_SAMPLER, UDisksStatisticsSampler))
+#define UDISKS_IS_STATISTICS_SAMPLER(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), UDISKS_TYPE_STATISTICS_SAMPLER))
+
+GType                     udisks_statistics_sampler_get_type      (void) G_GNUC_CONST;
+UDisksStatisticsSampler  *udisks_statistics_sampler_new           (guint                     interval);
+guint                     udisks_statistics_sampler_get_interval  (UDisksStatisticsSampler  *sampler);
+gboolean                  udisks_statistics_sampler_add           (UDisksStatisticsSampler  *sampler,
+                                                                   UDisksBlockStatistics    *statistics,
+                                                                   const gchar              *sysfs_path,
+                                                                   GError                  **error);
+void                      udisks_statistics_sampler_remove        (UDisksStatisticsSampler  *sampler,
+                                                                   UDisksBlockStatistics    *statistics);
+
+G_END_DECLS
+
+#endif /* __UDISKS_STATISTICS_SAMPLER_H__ */
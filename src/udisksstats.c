@@ -0,0 +1,344 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include "udisksstats.h"
+#include "udiskslogging.h"
+
+/**
+ * SECTION:udisksstats
+ * @title: Statistics
+ * @short_description: Main loop latency instrumentation
+ *
+ * Lightweight timing of handlers running in the daemon. Each handler
+ * is identified by a category and a name, both static strings, and
+ * its durations are aggregated into a histogram with power-of-two
+ * buckets. This is cheap enough to be always enabled.
+ *
+ * Once udisks_stats_init() has been called, the time spent outside of
+ * poll() in every iteration of the default main context is recorded
+ * as <literal>main-loop/iteration</literal>, handlers taking longer
+ * than the configured threshold are logged, and the statistics are
+ * periodically written to a file, by default
+ * <filename>/run/udisks2/main-loop-stats</filename>.
+ *
+ * GLib has no hook around the dispatch of individual sources, so
+ * <literal>main-loop/iteration</literal> only covers whole
+ * iterations. Individual sources are timed only where they call
+ * udisks_stats_begin() and udisks_stats_end() themselves, which the
+ * uevent handlers, the block interface updates and the statistics
+ * sampler do. A slow iteration without a matching slow handler points
+ * at a source that isn't instrumented, such as a D-Bus method call
+ * dispatched in the main thread.
+ */
+
+/* bucket n holds durations below 2^n microseconds, the last one everything else */
+#define NUM_BUCKETS 32
+
+/* how often to write out the stats file, if changed */
+#define STATS_FILE_INTERVAL_SECONDS 10
+
+typedef struct
+{
+  guint64 count;
+  guint64 total_usec;
+  guint64 max_usec;
+  guint64 buckets[NUM_BUCKETS];
+} StatsEntry;
+
+G_LOCK_DEFINE_STATIC (stats_lock);
+
+/* category -> (name -> StatsEntry*), keys are static strings */
+static GHashTable *stats_categories = NULL;
+static gboolean stats_dirty = FALSE;
+static guint stats_slow_threshold_usec = 0;
+static gchar *stats_file_path = NULL;
+
+static GPollFunc stats_default_poll_func = NULL;
+static gint64 stats_iteration_begin = 0;
+
+static guint
+duration_to_bucket (guint64 usec)
+{
+  guint n = 0;
+
+  while (usec != 0 && n < NUM_BUCKETS - 1)
+    {
+      usec >>= 1;
+      n++;
+    }
+  return n;
+}
+
+/* must be called with stats_lock held */
+static StatsEntry *
+lookup_entry (const gchar *category,
+              const gchar *name)
+{
+  GHashTable *names;
+  StatsEntry *entry;
+
+  if (stats_categories == NULL)
+    stats_categories = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) g_hash_table_unref);
+
+  names = g_hash_table_lookup (stats_categories, category);
+  if (names == NULL)
+    {
+      names = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+      g_hash_table_insert (stats_categories, (gpointer) category, names);
+    }
+
+  entry = g_hash_table_lookup (names, name);
+  if (entry == NULL)
+    {
+      entry = g_new0 (StatsEntry, 1);
+      g_hash_table_insert (names, (gpointer) name, entry);
+    }
+
+  return entry;
+}
+
+/**
+ * udisks_stats_begin:
+ *
+ * Gets a timestamp to pass to udisks_stats_end().
+ *
+ * Returns: The current monotonic time.
+ */
+gint64
+udisks_stats_begin (void)
+{
+  return g_get_monotonic_time ();
+}
+
+/**
+ * udisks_stats_end:
+ * @category: The handler category, e.g. <literal>uevent</literal>. Must be a static string.
+ * @name: The handler name. Must be a static string, e.g. a literal or a type name.
+ * @begin_time: The value returned by udisks_stats_begin() when the handler started.
+ *
+ * Records the time elapsed since @begin_time for the handler
+ * identified by @category and @name. Logs a message if the handler
+ * took longer than the threshold set in udisks_stats_init().
+ *
+ * This function is thread-safe.
+ */
+void
+udisks_stats_end (const gchar *category,
+                  const gchar *name,
+                  gint64       begin_time)
+{
+  StatsEntry *entry;
+  gint64 duration;
+
+  duration = g_get_monotonic_time () - begin_time;
+  if (duration < 0)
+    duration = 0;
+
+  G_LOCK (stats_lock);
+  entry = lookup_entry (category, name);
+  entry->count++;
+  entry->total_usec += duration;
+  entry->max_usec = MAX (entry->max_usec, (guint64) duration);
+  entry->buckets[duration_to_bucket (duration)]++;
+  stats_dirty = TRUE;
+  G_UNLOCK (stats_lock);
+
+  if (stats_slow_threshold_usec > 0 && duration >= stats_slow_threshold_usec)
+    udisks_notice ("Slow handler %s/%s took %" G_GINT64_FORMAT " ms",
+                   category, name, duration / 1000);
+}
+
+/* upper bound of the bucket containing the given percentile */
+static guint64
+get_percentile (const StatsEntry *entry,
+                gdouble           percentile)
+{
+  guint64 target;
+  guint64 seen = 0;
+  guint n;
+
+  target = (guint64) (percentile * entry->count + 0.5);
+  if (target == 0)
+    target = 1;
+
+  for (n = 0; n < NUM_BUCKETS; n++)
+    {
+      seen += entry->buckets[n];
+      if (seen >= target)
+        return MIN (((guint64) 1) << n, entry->max_usec);
+    }
+  return entry->max_usec;
+}
+
+static gint
+compare_strings (gconstpointer a,
+                 gconstpointer b)
+{
+  return g_strcmp0 (*(const gchar **) a, *(const gchar **) b);
+}
+
+/**
+ * udisks_stats_dump:
+ *
+ * Formats all statistics gathered so far, one handler per line,
+ * sorted by category and name. Durations are in microseconds,
+ * percentiles are the upper bounds of their histogram buckets.
+ *
+ * Returns: (transfer full): A string that should be freed with g_free().
+ */
+gchar *
+udisks_stats_dump (void)
+{
+  GString *str;
+  GPtrArray *categories;
+  guint n, m, b;
+
+  str = g_string_new ("# category/name count total max mean p50 p90 p99 histogram(<usec:count)\n");
+
+  G_LOCK (stats_lock);
+  categories = g_ptr_array_new ();
+  if (stats_categories != NULL)
+    {
+      GHashTableIter iter;
+      gpointer key;
+
+      g_hash_table_iter_init (&iter, stats_categories);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        g_ptr_array_add (categories, key);
+    }
+  g_ptr_array_sort (categories, compare_strings);
+
+  for (n = 0; n < categories->len; n++)
+    {
+      const gchar *category = categories->pdata[n];
+      GHashTable *names;
+      GPtrArray *sorted_names;
+      GHashTableIter iter;
+      gpointer key;
+
+      names = g_hash_table_lookup (stats_categories, category);
+      sorted_names = g_ptr_array_new ();
+      g_hash_table_iter_init (&iter, names);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        g_ptr_array_add (sorted_names, key);
+      g_ptr_array_sort (sorted_names, compare_strings);
+
+      for (m = 0; m < sorted_names->len; m++)
+        {
+          const gchar *name = sorted_names->pdata[m];
+          StatsEntry *entry = g_hash_table_lookup (names, name);
+
+          g_string_append_printf (str,
+                                  "%s/%s %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT
+                                  " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT,
+                                  category, name,
+                                  entry->count,
+                                  entry->total_usec,
+                                  entry->max_usec,
+                                  entry->count > 0 ? entry->total_usec / entry->count : 0,
+                                  get_percentile (entry, 0.50),
+                                  get_percentile (entry, 0.90),
+                                  get_percentile (entry, 0.99));
+          for (b = 0; b < NUM_BUCKETS; b++)
+            {
+              if (entry->buckets[b] == 0)
+                continue;
+              if (b == NUM_BUCKETS - 1)
+                g_string_append_printf (str, " inf:%" G_GUINT64_FORMAT, entry->buckets[b]);
+              else
+                g_string_append_printf (str, " %" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT,
+                                        ((guint64) 1) << b, entry->buckets[b]);
+            }
+          g_string_append_c (str, '\n');
+        }
+      g_ptr_array_free (sorted_names, TRUE);
+    }
+  g_ptr_array_free (categories, TRUE);
+  G_UNLOCK (stats_lock);
+
+  return g_string_free (str, FALSE);
+}
+
+static gboolean
+write_stats_file_cb (gpointer user_data)
+{
+  GError *error = NULL;
+  gboolean dirty;
+  gchar *contents;
+
+  G_LOCK (stats_lock);
+  dirty = stats_dirty;
+  stats_dirty = FALSE;
+  G_UNLOCK (stats_lock);
+
+  if (!dirty)
+    return G_SOURCE_CONTINUE;
+
+  contents = udisks_stats_dump ();
+  if (!g_file_set_contents (stats_file_path, contents, -1, &error))
+    {
+      udisks_warning ("Error writing %s: %s", stats_file_path, error->message);
+      g_clear_error (&error);
+    }
+  g_free (contents);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* records the time spent between two polls, i.e. in dispatching sources */
+static gint
+stats_poll_func (GPollFD *ufds,
+                 guint    nfds,
+                 gint     timeout)
+{
+  gint ret;
+
+  if (stats_iteration_begin != 0)
+    udisks_stats_end ("main-loop", "iteration", stats_iteration_begin);
+
+  ret = stats_default_poll_func (ufds, nfds, timeout);
+
+  stats_iteration_begin = udisks_stats_begin ();
+  return ret;
+}
+
+/**
+ * udisks_stats_init:
+ * @slow_threshold_msec: Log handlers taking at least this many milliseconds or 0 to never log.
+ * @stats_file: (allow-none): File to periodically write the statistics to or %NULL for the default.
+ *
+ * Starts instrumenting the default main context and writing the
+ * statistics to @stats_file. Must be called once from the main thread.
+ */
+void
+udisks_stats_init (guint        slow_threshold_msec,
+                   const gchar *stats_file)
+{
+  g_return_if_fail (stats_file_path == NULL);
+
+  stats_slow_threshold_usec = slow_threshold_msec * 1000;
+  stats_file_path = g_strdup (stats_file != NULL ? stats_file : "/run/udisks2/main-loop-stats");
+
+  stats_default_poll_func = g_main_context_get_poll_func (NULL);
+  g_main_context_set_poll_func (NULL, stats_poll_func);
+
+  g_timeout_add_seconds (STATS_FILE_INTERVAL_SECONDS, write_stats_file_cb, NULL);
+}
@@ -0,0 +1,36 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __UDISKS_STATS_H__
+#define __UDISKS_STATS_H__
+
+#include "udisksdaemontypes.h"
+
+G_BEGIN_DECLS
+
+void    udisks_stats_init        (guint        slow_threshold_msec,
+                                  const gchar *stats_file);
+gint64  udisks_stats_begin       (void);
+void    udisks_stats_end         (const gchar *category,
+                                  const gchar *name,
+                                  gint64       begin_time);
+gchar  *udisks_stats_dump        (void);
+
+G_END_DECLS
+
+#endif /* __UDISKS_STATS_H__ */
@@ -30,10 +30,12 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <termios.h>
 #include <unistd.h>
 
 #include <locale.h>
+#include <math.h>
 
 #include <polkit/polkit.h>
 #define POLKIT_AGENT_I_KNOW_API_IS_SUBJECT_TO_CHANGE
@@ -374,6 +376,310 @@ print_object (UDisksObject *object,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Appends @s as a JSON string, or null if @s is %NULL */
+static void
+json_append_string (GString     *str,
+                    const gchar *s)
+{
+  const gchar *p;
+
+  if (s == NULL)
+    {
+      g_string_append (str, "null");
+      return;
+    }
+
+  g_string_append_c (str, '"');
+  for (p = s; *p != '\0'; p++)
+    {
+      switch (*p)
+        {
+        case '"':
+          g_string_append (str, "\\\"");
+          break;
+        case '\\':
+          g_string_append (str, "\\\\");
+          break;
+        case '\n':
+          g_string_append (str, "\\n");
+          break;
+        case '\r':
+          g_string_append (str, "\\r");
+          break;
+        case '\t':
+          g_string_append (str, "\\t");
+          break;
+        default:
+          if ((guchar) *p < 0x20)
+            g_string_append_printf (str, "\\u%04x", (guint) *p);
+          else
+            g_string_append_c (str, *p);
+          break;
+        }
+    }
+  g_string_append_c (str, '"');
+}
+
+static void
+json_append_variant (GString  *str,
+                     GVariant *value)
+{
+  GVariantIter iter;
+  GVariant *child;
+  GVariant *key;
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+  const gchar *bytes;
+  gsize len;
+  gboolean first;
+  gdouble d;
+
+  switch (g_variant_classify (value))
+    {
+    case G_VARIANT_CLASS_BOOLEAN:
+      g_string_append (str, g_variant_get_boolean (value) ? "true" : "false");
+      break;
+    case G_VARIANT_CLASS_BYTE:
+      g_string_append_printf (str, "%u", (guint) g_variant_get_byte (value));
+      break;
+    case G_VARIANT_CLASS_INT16:
+      g_string_append_printf (str, "%d", (gint) g_variant_get_int16 (value));
+      break;
+    case G_VARIANT_CLASS_UINT16:
+      g_string_append_printf (str, "%u", (guint) g_variant_get_uint16 (value));
+      break;
+    case G_VARIANT_CLASS_INT32:
+      g_string_append_printf (str, "%d", g_variant_get_int32 (value));
+      break;
+    case G_VARIANT_CLASS_UINT32:
+      g_string_append_printf (str, "%u", g_variant_get_uint32 (value));
+      break;
+    case G_VARIANT_CLASS_INT64:
+      g_string_append_printf (str, "%" G_GINT64_FORMAT, g_variant_get_int64 (value));
+      break;
+    case G_VARIANT_CLASS_UINT64:
+      g_string_append_printf (str, "%" G_GUINT64_FORMAT, g_variant_get_uint64 (value));
+      break;
+    case G_VARIANT_CLASS_HANDLE:
+      g_string_append_printf (str, "%d", g_variant_get_handle (value));
+      break;
+    case G_VARIANT_CLASS_DOUBLE:
+      /* JSON has no representation for NaN and infinity */
+      d = g_variant_get_double (value);
+      if (isfinite (d))
+        g_string_append (str, g_ascii_dtostr (buf, sizeof buf, d));
+      else
+        g_string_append (str, "null");
+      break;
+    case G_VARIANT_CLASS_STRING:
+    case G_VARIANT_CLASS_OBJECT_PATH:
+    case G_VARIANT_CLASS_SIGNATURE:
+      json_append_string (str, g_variant_get_string (value, NULL));
+      break;
+    case G_VARIANT_CLASS_VARIANT:
+      child = g_variant_get_variant (value);
+      json_append_variant (str, child);
+      g_variant_unref (child);
+      break;
+    case G_VARIANT_CLASS_MAYBE:
+      child = g_variant_get_maybe (value);
+      if (child != NULL)
+        {
+          json_append_variant (str, child);
+          g_variant_unref (child);
+        }
+      else
+        {
+          g_string_append (str, "null");
+        }
+      break;
+    case G_VARIANT_CLASS_ARRAY:
+      /* NUL-terminated bytestrings, e.g. device files and mount points, are shown as strings */
+      if (g_variant_is_of_type (value, G_VARIANT_TYPE_BYTESTRING))
+        {
+          bytes = g_variant_get_fixed_array (value, &len, 1);
+          if (len > 0 && bytes[len - 1] == '\0' && strlen (bytes) == len - 1 && g_utf8_validate (bytes, -1, NULL))
+            {
+              json_append_string (str, bytes);
+              break;
+            }
+        }
+      /* dictionaries with basic keys are shown as objects */
+      if (g_variant_type_is_dict_entry (g_variant_type_element (g_variant_get_type (value))))
+        {
+          g_string_append_c (str, '{');
+          first = TRUE;
+          g_variant_iter_init (&iter, value);
+          while ((child = g_variant_iter_next_value (&iter)) != NULL)
+            {
+              GVariant *entry_value;
+
+              if (!first)
+                g_string_append_c (str, ',');
+              first = FALSE;
+              key = g_variant_get_child_value (child, 0);
+              entry_value = g_variant_get_child_value (child, 1);
+              if (g_variant_is_of_type (key, G_VARIANT_TYPE_STRING) ||
+                  g_variant_is_of_type (key, G_VARIANT_TYPE_OBJECT_PATH) ||
+                  g_variant_is_of_type (key, G_VARIANT_TYPE_SIGNATURE))
+                {
+                  json_append_variant (str, key);
+                }
+              else
+                {
+                  GString *key_str;
+
+                  key_str = g_string_new (NULL);
+                  json_append_variant (key_str, key);
+                  json_append_string (str, key_str->str);
+                  g_string_free (key_str, TRUE);
+                }
+              g_string_append_c (str, ':');
+              json_append_variant (str, entry_value);
+              g_variant_unref (entry_value);
+              g_variant_unref (key);
+              g_variant_unref (child);
+            }
+          g_string_append_c (str, '}');
+          break;
+        }
+      /* fall through */
+    case G_VARIANT_CLASS_TUPLE:
+    case G_VARIANT_CLASS_DICT_ENTRY:
+      g_string_append_c (str, '[');
+      first = TRUE;
+      g_variant_iter_init (&iter, value);
+      while ((child = g_variant_iter_next_value (&iter)) != NULL)
+        {
+          if (!first)
+            g_string_append_c (str, ',');
+          first = FALSE;
+          json_append_variant (str, child);
+          g_variant_unref (child);
+        }
+      g_string_append_c (str, ']');
+      break;
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static void
+json_append_interface_properties (GString    *str,
+                                  GDBusProxy *proxy)
+{
+  gchar **cached_properties;
+  GVariant *value;
+  guint n;
+
+  g_string_append_c (str, '{');
+  cached_properties = g_dbus_proxy_get_cached_property_names (proxy);
+  for (n = 0; cached_properties != NULL && cached_properties[n] != NULL; n++)
+    {
+      if (n > 0)
+        g_string_append_c (str, ',');
+      json_append_string (str, cached_properties[n]);
+      g_string_append_c (str, ':');
+      value = g_dbus_proxy_get_cached_property (proxy, cached_properties[n]);
+      json_append_variant (str, value);
+      g_variant_unref (value);
+    }
+  g_strfreev (cached_properties);
+  g_string_append_c (str, '}');
+}
+
+/* Interfaces may be given either fully qualified or without the org.freedesktop.UDisks2. prefix */
+static gboolean
+filter_match_interface (gchar       **interfaces,
+                        const gchar  *interface_name)
+{
+  guint n;
+
+  if (interfaces == NULL)
+    return TRUE;
+
+  for (n = 0; interfaces[n] != NULL; n++)
+    {
+      if (g_strcmp0 (interfaces[n], interface_name) == 0)
+        return TRUE;
+      if (g_str_has_prefix (interface_name, "org.freedesktop.UDisks2.") &&
+          g_strcmp0 (interfaces[n], interface_name + strlen ("org.freedesktop.UDisks2.")) == 0)
+        return TRUE;
+    }
+  return FALSE;
+}
+
+/* Object paths are prefixes, either absolute or relative to /org/freedesktop/UDisks2/ */
+static gboolean
+filter_match_object_path (gchar       **object_paths,
+                          const gchar  *object_path)
+{
+  guint n;
+
+  if (object_paths == NULL)
+    return TRUE;
+
+  for (n = 0; object_paths[n] != NULL; n++)
+    {
+      if (object_paths[n][0] == '/')
+        {
+          if (g_str_has_prefix (object_path, object_paths[n]))
+            return TRUE;
+        }
+      else
+        {
+          if (g_str_has_prefix (object_path, "/org/freedesktop/UDisks2/") &&
+              g_str_has_prefix (object_path + strlen ("/org/freedesktop/UDisks2/"), object_paths[n]))
+            return TRUE;
+        }
+    }
+  return FALSE;
+}
+
+/* Appends the matching interfaces of @object with their properties, as a JSON object
+ * member "interfaces". Returns FALSE if no interface matched.
+ */
+static gboolean
+json_append_object_interfaces (GString      *str,
+                               GDBusObject  *object,
+                               gchar       **interfaces)
+{
+  GList *interface_proxies;
+  GList *l;
+  gboolean ret = FALSE;
+
+  g_string_append (str, "\"interfaces\":{");
+  interface_proxies = g_dbus_object_get_interfaces (object);
+  for (l = interface_proxies; l != NULL; l = l->next)
+    {
+      GDBusProxy *iproxy = G_DBUS_PROXY (l->data);
+
+      if (!filter_match_interface (interfaces, g_dbus_proxy_get_interface_name (iproxy)))
+        continue;
+      if (ret)
+        g_string_append_c (str, ',');
+      ret = TRUE;
+      json_append_string (str, g_dbus_proxy_get_interface_name (iproxy));
+      g_string_append_c (str, ':');
+      json_append_interface_properties (str, iproxy);
+    }
+  g_list_free_full (interface_proxies, g_object_unref);
+  g_string_append_c (str, '}');
+
+  return ret;
+}
+
+/* prints @str followed by a newline and frees it, flushing so that consumers see complete lines */
+static void
+json_print_line (GString *str)
+{
+  g_string_append_c (str, '\n');
+  fputs (str->str, stdout);
+  fflush (stdout);
+  g_string_free (str, TRUE);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static UDisksObject *
 lookup_object_by_path (const gchar *path)
 {
@@ -2541,11 +2847,98 @@ obj_proxy_drive_sortkey_cmp (GDBusObject *a,
 }
 
 
+static gboolean  opt_dump_json = FALSE;
+static gboolean  opt_dump_ndjson = FALSE;
+static gchar   **opt_dump_interfaces = NULL;
+static gchar   **opt_dump_object_paths = NULL;
+
 static const GOptionEntry command_dump_entries[] =
 {
-  { NULL }
+  {
+    "json",
+    0, /* no short option */
+    0,
+    G_OPTION_ARG_NONE,
+    &opt_dump_json,
+    "Print all objects as a JSON array",
+    NULL
+  },
+  {
+    "ndjson",
+    0, /* no short option */
+    0,
+    G_OPTION_ARG_NONE,
+    &opt_dump_ndjson,
+    "Print each object as a JSON object on its own line",
+    NULL
+  },
+  {
+    "interface",
+    'i',
+    0,
+    G_OPTION_ARG_STRING_ARRAY,
+    &opt_dump_interfaces,
+    "Only include the given interface (JSON only, may be repeated)",
+    NULL
+  },
+  {
+    "object-path",
+    'p',
+    0,
+    G_OPTION_ARG_STRING_ARRAY,
+    &opt_dump_object_paths,
+    "Only include objects with paths starting with the given prefix (JSON only, may be repeated)",
+    NULL
+  },
+  {
+    NULL
+  }
 };
 
+/* Streams the objects straight from the proxies' property caches, in whatever order the
+ * object manager has them, reusing a single buffer.
+ */
+static void
+dump_json (gboolean as_array)
+{
+  GList *objects;
+  GList *l;
+  GString *str;
+  gboolean first;
+
+  objects = g_dbus_object_manager_get_objects (udisks_client_get_object_manager (client));
+  str = g_string_new (NULL);
+  first = TRUE;
+  if (as_array)
+    fputs ("[", stdout);
+  for (l = objects; l != NULL; l = l->next)
+    {
+      GDBusObject *object = G_DBUS_OBJECT (l->data);
+
+      if (!filter_match_object_path (opt_dump_object_paths, g_dbus_object_get_object_path (object)))
+        continue;
+
+      g_string_truncate (str, 0);
+      g_string_append (str, "{\"object_path\":");
+      json_append_string (str, g_dbus_object_get_object_path (object));
+      g_string_append_c (str, ',');
+      if (!json_append_object_interfaces (str, object, opt_dump_interfaces) && opt_dump_interfaces != NULL)
+        continue;
+      g_string_append_c (str, '}');
+
+      if (as_array && !first)
+        fputs (",", stdout);
+      first = FALSE;
+      fwrite (str->str, 1, str->len, stdout);
+      if (!as_array)
+        fputs ("\n", stdout);
+    }
+  if (as_array)
+    fputs ("]\n", stdout);
+  g_string_free (str, TRUE);
+  g_list_free_full (objects, g_object_unref);
+}
+
 static gint
 handle_command_dump (gint        *argc,
                      gchar      **argv[],
@@ -2561,6 +2954,10 @@ handle_command_dump (gint        *argc,
   gboolean first;
 
   ret = 1;
+  opt_dump_json = FALSE;
+  opt_dump_ndjson = FALSE;
+  opt_dump_interfaces = NULL;
+  opt_dump_object_paths = NULL;
 
   modify_argv0_for_command (argc, argv, "dump");
 
@@ -2582,9 +2979,18 @@ handle_command_dump (gint        *argc,
         }
     }
 
-  /* done with completion */
   if (request_completion)
-    goto out;
+    {
+      list_options (command_dump_entries);
+      goto out;
+    }
+
+  if (opt_dump_json || opt_dump_ndjson)
+    {
+      dump_json (opt_dump_json);
+      ret = 0;
+      goto out;
+    }
 
   _color_run_pager ();
 
@@ -2611,6 +3017,8 @@ handle_command_dump (gint        *argc,
 
  out:
   g_option_context_free (o);
+  g_strfreev (opt_dump_interfaces);
+  g_strfreev (opt_dump_object_paths);
   return ret;
 }
 
@@ -2846,63 +3254,310 @@ monitor_on_interface_proxy_signal (GDBusObjectManagerClient  *manager,
   ;
 }
 
+static gboolean  opt_monitor_json = FALSE;
+static gchar   **opt_monitor_interfaces = NULL;
+static gchar   **opt_monitor_object_paths = NULL;
 
-static const GOptionEntry command_monitor_entries[] =
+/* the --json variant of the monitor prints one compact event per line */
+static GString *
+monitor_json_begin (const gchar *event,
+                    const gchar *object_path)
 {
-  { NULL }
-};
+  GString *str;
 
-static gint
-handle_command_monitor (gint        *argc,
-                        gchar      **argv[],
-                        gboolean     request_completion,
-                        const gchar *completion_cur,
-                        const gchar *completion_prev)
+  str = g_string_new (NULL);
+  g_string_append_printf (str, "{\"time\":%" G_GINT64_FORMAT ",\"event\":", g_get_real_time ());
+  json_append_string (str, event);
+  if (object_path != NULL)
+    {
+      g_string_append (str, ",\"object_path\":");
+      json_append_string (str, object_path);
+    }
+  return str;
+}
+
+static gboolean
+monitor_json_match (GDBusObject *object,
+                    GDBusProxy  *interface_proxy)
 {
-  gint ret;
-  GOptionContext *o;
-  gchar *s;
-  GDBusObjectManager *manager;
+  if (!monitor_has_name_owner ())
+    return FALSE;
+  if (!filter_match_object_path (opt_monitor_object_paths, g_dbus_object_get_object_path (object)))
+    return FALSE;
+  if (interface_proxy != NULL &&
+      !filter_match_interface (opt_monitor_interfaces, g_dbus_proxy_get_interface_name (interface_proxy)))
+    return FALSE;
+  return TRUE;
+}
 
-  ret = 1;
+static void
+monitor_json_on_notify_name_owner (GObject    *object,
+                                   GParamSpec *pspec,
+                                   gpointer    user_data)
+{
+  GString *str;
+  gchar *name_owner;
 
-  modify_argv0_for_command (argc, argv, "monitor");
+  name_owner = g_dbus_object_manager_client_get_name_owner (G_DBUS_OBJECT_MANAGER_CLIENT (udisks_client_get_object_manager (client)));
+  str = monitor_json_begin ("name-owner-changed", NULL);
+  g_string_append (str, ",\"name_owner\":");
+  if (name_owner != NULL)
+    json_append_string (str, name_owner);
+  else
+    g_string_append (str, "null");
+  g_string_append_c (str, '}');
+  json_print_line (str);
+  g_free (name_owner);
+}
 
-  o = g_option_context_new (NULL);
-  if (request_completion)
-    g_option_context_set_ignore_unknown_options (o, TRUE);
-  g_option_context_set_help_enabled (o, FALSE);
-  g_option_context_set_summary (o, "Monitor changes to objects.");
-  g_option_context_add_main_entries (o, command_monitor_entries, NULL /* GETTEXT_PACKAGE*/);
+static void
+monitor_json_on_object_added (GDBusObjectManager  *manager,
+                              GDBusObject         *object,
+                              gpointer             user_data)
+{
+  GString *str;
 
-  if (!g_option_context_parse (o, argc, argv, NULL))
-    {
-      if (!request_completion)
-        {
-          s = g_option_context_get_help (o, FALSE, NULL);
-          g_printerr ("%s", s);
-          g_free (s);
-          goto out;
-        }
-    }
+  if (!monitor_json_match (object, NULL))
+    return;
+  str = monitor_json_begin ("object-added", g_dbus_object_get_object_path (object));
+  g_string_append_c (str, ',');
+  json_append_object_interfaces (str, object, opt_monitor_interfaces);
+  g_string_append_c (str, '}');
+  json_print_line (str);
+}
 
-  /* done with completion */
-  if (request_completion)
-    goto out;
+static void
+monitor_json_on_object_removed (GDBusObjectManager *manager,
+                                GDBusObject        *object,
+                                gpointer            user_data)
+{
+  GString *str;
 
-  g_print ("Monitoring the udisks daemon. Press Ctrl+C to exit.\n");
+  if (!monitor_json_match (object, NULL))
+    return;
+  str = monitor_json_begin ("object-removed", g_dbus_object_get_object_path (object));
+  g_string_append_c (str, '}');
+  json_print_line (str);
+}
 
-  manager = udisks_client_get_object_manager (client);
-  g_signal_connect (manager,
-                    "notify::name-owner",
-                    G_CALLBACK (monitor_on_notify_name_owner),
-                    NULL);
+static void
+monitor_json_on_interface_proxy_added (GDBusObjectManager  *manager,
+                                       GDBusObject         *object,
+                                       GDBusInterface      *interface,
+                                       gpointer             user_data)
+{
+  GString *str;
 
-  g_signal_connect (manager,
-                    "object-added",
-                    G_CALLBACK (monitor_on_object_added),
-                    NULL);
-  g_signal_connect (manager,
+  if (!monitor_json_match (object, G_DBUS_PROXY (interface)))
+    return;
+  str = monitor_json_begin ("interface-added", g_dbus_object_get_object_path (object));
+  g_string_append (str, ",\"interface\":");
+  json_append_string (str, g_dbus_proxy_get_interface_name (G_DBUS_PROXY (interface)));
+  g_string_append (str, ",\"properties\":");
+  json_append_interface_properties (str, G_DBUS_PROXY (interface));
+  g_string_append_c (str, '}');
+  json_print_line (str);
+}
+
+static void
+monitor_json_on_interface_proxy_removed (GDBusObjectManager  *manager,
+                                         GDBusObject         *object,
+                                         GDBusInterface      *interface,
+                                         gpointer             user_data)
+{
+  GString *str;
+
+  if (!monitor_json_match (object, G_DBUS_PROXY (interface)))
+    return;
+  str = monitor_json_begin ("interface-removed", g_dbus_object_get_object_path (object));
+  g_string_append (str, ",\"interface\":");
+  json_append_string (str, g_dbus_proxy_get_interface_name (G_DBUS_PROXY (interface)));
+  g_string_append_c (str, '}');
+  json_print_line (str);
+}
+
+static void
+monitor_json_on_interface_proxy_properties_changed (GDBusObjectManagerClient *manager,
+                                                    GDBusObjectProxy         *object_proxy,
+                                                    GDBusProxy               *interface_proxy,
+                                                    GVariant                 *changed_properties,
+                                                    const gchar* const       *invalidated_properties,
+                                                    gpointer                  user_data)
+{
+  GString *str;
+  guint n;
+
+  if (!monitor_json_match (G_DBUS_OBJECT (object_proxy), interface_proxy))
+    return;
+  str = monitor_json_begin ("properties-changed", g_dbus_object_get_object_path (G_DBUS_OBJECT (object_proxy)));
+  g_string_append (str, ",\"interface\":");
+  json_append_string (str, g_dbus_proxy_get_interface_name (interface_proxy));
+  g_string_append (str, ",\"changed\":");
+  json_append_variant (str, changed_properties);
+  g_string_append (str, ",\"invalidated\":[");
+  for (n = 0; invalidated_properties != NULL && invalidated_properties[n] != NULL; n++)
+    {
+      if (n > 0)
+        g_string_append_c (str, ',');
+      json_append_string (str, invalidated_properties[n]);
+    }
+  g_string_append (str, "]}");
+  json_print_line (str);
+}
+
+static void
+monitor_json_on_interface_proxy_signal (GDBusObjectManagerClient  *manager,
+                                        GDBusObjectProxy          *object_proxy,
+                                        GDBusProxy                *interface_proxy,
+                                        const gchar               *sender_name,
+                                        const gchar               *signal_name,
+                                        GVariant                  *parameters,
+                                        gpointer                   user_data)
+{
+  GString *str;
+
+  if (!monitor_json_match (G_DBUS_OBJECT (object_proxy), interface_proxy))
+    return;
+  str = monitor_json_begin ("signal", g_dbus_object_get_object_path (G_DBUS_OBJECT (object_proxy)));
+  g_string_append (str, ",\"interface\":");
+  json_append_string (str, g_dbus_proxy_get_interface_name (interface_proxy));
+  g_string_append (str, ",\"signal\":");
+  json_append_string (str, signal_name);
+  g_string_append (str, ",\"parameters\":");
+  json_append_variant (str, parameters);
+  g_string_append_c (str, '}');
+  json_print_line (str);
+}
+
+static const GOptionEntry command_monitor_entries[] =
+{
+  {
+    "json",
+    0, /* no short option */
+    0,
+    G_OPTION_ARG_NONE,
+    &opt_monitor_json,
+    "Print each event as a JSON object on its own line",
+    NULL
+  },
+  {
+    "interface",
+    'i',
+    0,
+    G_OPTION_ARG_STRING_ARRAY,
+    &opt_monitor_interfaces,
+    "Only include events for the given interface (JSON only, may be repeated)",
+    NULL
+  },
+  {
+    "object-path",
+    'p',
+    0,
+    G_OPTION_ARG_STRING_ARRAY,
+    &opt_monitor_object_paths,
+    "Only include events for objects with paths starting with the given prefix (JSON only, may be repeated)",
+    NULL
+  },
+  {
+    NULL
+  }
+};
+
+static gint
+handle_command_monitor (gint        *argc,
+                        gchar      **argv[],
+                        gboolean     request_completion,
+                        const gchar *completion_cur,
+                        const gchar *completion_prev)
+{
+  gint ret;
+  GOptionContext *o;
+  gchar *s;
+  GDBusObjectManager *manager;
+
+  ret = 1;
+  opt_monitor_json = FALSE;
+  opt_monitor_interfaces = NULL;
+  opt_monitor_object_paths = NULL;
+
+  modify_argv0_for_command (argc, argv, "monitor");
+
+  o = g_option_context_new (NULL);
+  if (request_completion)
+    g_option_context_set_ignore_unknown_options (o, TRUE);
+  g_option_context_set_help_enabled (o, FALSE);
+  g_option_context_set_summary (o, "Monitor changes to objects.");
+  g_option_context_add_main_entries (o, command_monitor_entries, NULL /* GETTEXT_PACKAGE*/);
+
+  if (!g_option_context_parse (o, argc, argv, NULL))
+    {
+      if (!request_completion)
+        {
+          s = g_option_context_get_help (o, FALSE, NULL);
+          g_printerr ("%s", s);
+          g_free (s);
+          goto out;
+        }
+    }
+
+  if (request_completion)
+    {
+      list_options (command_monitor_entries);
+      goto out;
+    }
+
+  manager = udisks_client_get_object_manager (client);
+
+  if (opt_monitor_json)
+    {
+      g_signal_connect (manager,
+                        "notify::name-owner",
+                        G_CALLBACK (monitor_json_on_notify_name_owner),
+                        NULL);
+      g_signal_connect (manager,
+                        "object-added",
+                        G_CALLBACK (monitor_json_on_object_added),
+                        NULL);
+      g_signal_connect (manager,
+                        "object-removed",
+                        G_CALLBACK (monitor_json_on_object_removed),
+                        NULL);
+      g_signal_connect (manager,
+                        "interface-added",
+                        G_CALLBACK (monitor_json_on_interface_proxy_added),
+                        NULL);
+      g_signal_connect (manager,
+                        "interface-removed",
+                        G_CALLBACK (monitor_json_on_interface_proxy_removed),
+                        NULL);
+      g_signal_connect (manager,
+                        "interface-proxy-properties-changed",
+                        G_CALLBACK (monitor_json_on_interface_proxy_properties_changed),
+                        NULL);
+      g_signal_connect (manager,
+                        "interface-proxy-signal",
+                        G_CALLBACK (monitor_json_on_interface_proxy_signal),
+                        NULL);
+
+      monitor_json_on_notify_name_owner (G_OBJECT (manager), NULL, NULL);
+
+      g_main_loop_run (loop);
+      ret = 0;
+      goto out;
+    }
+
+  g_print ("Monitoring the udisks daemon. Press Ctrl+C to exit.\n");
+
+  g_signal_connect (manager,
+                    "notify::name-owner",
+                    G_CALLBACK (monitor_on_notify_name_owner),
+                    NULL);
+
+  g_signal_connect (manager,
+                    "object-added",
+                    G_CALLBACK (monitor_on_object_added),
+                    NULL);
+  g_signal_connect (manager,
                     "object-removed",
                     G_CALLBACK (monitor_on_object_removed),
                     NULL);
@@ -2931,6 +3586,8 @@ handle_command_monitor (gint        *argc,
 
  out:
   g_option_context_free (o);
+  g_strfreev (opt_monitor_interfaces);
+  g_strfreev (opt_monitor_object_paths);
   return ret;
 }
 
@@ -2962,11 +3619,135 @@ find_blocks_for_drive (GList       *objects,
   return ret;
 }
 
+static gboolean  opt_status_json = FALSE;
+static gboolean  opt_status_ndjson = FALSE;
+static gchar   **opt_status_object_paths = NULL;
+
 static const GOptionEntry command_status_entries[] =
 {
-  { NULL }
+  {
+    "json",
+    0, /* no short option */
+    0,
+    G_OPTION_ARG_NONE,
+    &opt_status_json,
+    "Print all drives as a JSON array",
+    NULL
+  },
+  {
+    "ndjson",
+    0, /* no short option */
+    0,
+    G_OPTION_ARG_NONE,
+    &opt_status_ndjson,
+    "Print each drive as a JSON object on its own line",
+    NULL
+  },
+  {
+    "object-path",
+    'p',
+    0,
+    G_OPTION_ARG_STRING_ARRAY,
+    &opt_status_object_paths,
+    "Only include drives with paths starting with the given prefix (JSON only, may be repeated)",
+    NULL
+  },
+  {
+    NULL
+  }
 };
 
+static void
+status_json (gboolean as_array)
+{
+  GList *objects;
+  GList *l;
+  GHashTable *drive_to_devices;
+  GPtrArray *devices;
+  GString *str;
+  gboolean first;
+  guint n;
+
+  objects = g_dbus_object_manager_get_objects (udisks_client_get_object_manager (client));
+
+  /* drive object path -> non-partition device files, in a single pass */
+  drive_to_devices = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) g_ptr_array_unref);
+  for (l = objects; l != NULL; l = l->next)
+    {
+      UDisksObject *object = UDISKS_OBJECT (l->data);
+      UDisksBlock *block;
+
+      block = udisks_object_peek_block (object);
+      if (block == NULL || udisks_object_peek_partition (object) != NULL)
+        continue;
+      if (udisks_block_get_drive (block) == NULL || udisks_block_get_device (block) == NULL ||
+          g_strcmp0 (udisks_block_get_drive (block), "/") == 0)
+        continue;
+
+      devices = g_hash_table_lookup (drive_to_devices, udisks_block_get_drive (block));
+      if (devices == NULL)
+        {
+          devices = g_ptr_array_new ();
+          g_hash_table_insert (drive_to_devices, (gpointer) udisks_block_get_drive (block), devices);
+        }
+      g_ptr_array_add (devices, (gpointer) udisks_block_get_device (block));
+    }
+
+  str = g_string_new (NULL);
+  first = TRUE;
+  if (as_array)
+    fputs ("[", stdout);
+  for (l = objects; l != NULL; l = l->next)
+    {
+      UDisksObject *object = UDISKS_OBJECT (l->data);
+      const gchar *object_path;
+      UDisksDrive *drive;
+
+      drive = udisks_object_peek_drive (object);
+      if (drive == NULL)
+        continue;
+      object_path = g_dbus_object_get_object_path (G_DBUS_OBJECT (object));
+      if (!filter_match_object_path (opt_status_object_paths, object_path))
+        continue;
+
+      g_string_truncate (str, 0);
+      g_string_append (str, "{\"object_path\":");
+      json_append_string (str, object_path);
+      g_string_append (str, ",\"vendor\":");
+      json_append_string (str, udisks_drive_get_vendor (drive));
+      g_string_append (str, ",\"model\":");
+      json_append_string (str, udisks_drive_get_model (drive));
+      g_string_append (str, ",\"revision\":");
+      json_append_string (str, udisks_drive_get_revision (drive));
+      g_string_append (str, ",\"serial\":");
+      json_append_string (str, udisks_drive_get_serial (drive));
+      g_string_append (str, ",\"sort_key\":");
+      json_append_string (str, udisks_drive_get_sort_key (drive));
+      g_string_append (str, ",\"devices\":[");
+      devices = g_hash_table_lookup (drive_to_devices, object_path);
+      for (n = 0; devices != NULL && n < devices->len; n++)
+        {
+          if (n > 0)
+            g_string_append_c (str, ',');
+          json_append_string (str, devices->pdata[n]);
+        }
+      g_string_append (str, "]}");
+
+      if (as_array && !first)
+        fputs (",", stdout);
+      first = FALSE;
+      fwrite (str->str, 1, str->len, stdout);
+      if (!as_array)
+        fputs ("\n", stdout);
+    }
+  if (as_array)
+    fputs ("]\n", stdout);
+
+  g_string_free (str, TRUE);
+  g_hash_table_unref (drive_to_devices);
+  g_list_free_full (objects, g_object_unref);
+}
+
 #if 0
 static void
 print_with_padding_and_ellipsis (const gchar *str,
@@ -3009,6 +3790,9 @@ handle_command_status (gint        *argc,
   GList *objects;
 
   ret = 1;
+  opt_status_json = FALSE;
+  opt_status_ndjson = FALSE;
+  opt_status_object_paths = NULL;
 
   modify_argv0_for_command (argc, argv, "status");
 
@@ -3030,9 +3814,18 @@ handle_command_status (gint        *argc,
         }
     }
 
-  /* done with completion */
   if (request_completion)
-    goto out;
+    {
+      list_options (command_status_entries);
+      goto out;
+    }
+
+  if (opt_status_json || opt_status_ndjson)
+    {
+      status_json (opt_status_json);
+      ret = 0;
+      goto out;
+    }
 
   objects = g_dbus_object_manager_get_objects (udisks_client_get_object_manager (client));
 
@@ -3131,6 +3924,731 @@ handle_command_status (gint        *argc,
 
  out:
   g_option_context_free (o);
+  g_strfreev (opt_status_object_paths);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gchar   *opt_batch_file = NULL;
+static gint     opt_batch_max_concurrent = 8;
+static gboolean opt_batch_no_user_interaction = FALSE;
+
+static const GOptionEntry command_batch_entries[] =
+{
+  {
+    "file",
+    'f',
+    0,
+    G_OPTION_ARG_FILENAME,
+    &opt_batch_file,
+    "File to read operations from (default: standard input)",
+    NULL
+  },
+  {
+    "max-concurrent",
+    'j',
+    0,
+    G_OPTION_ARG_INT,
+    &opt_batch_max_concurrent,
+    "Maximum number of operations running at the same time (default: 8)",
+    NULL
+  },
+  {
+    "no-user-interaction",
+    0, /* no short option */
+    0,
+    G_OPTION_ARG_NONE,
+    &opt_batch_no_user_interaction,
+    "Do not authenticate the user if needed",
+    NULL
+  },
+  {
+    NULL
+  }
+};
+
+typedef enum
+{
+  BATCH_OP_MOUNT,
+  BATCH_OP_UNMOUNT,
+  BATCH_OP_UNLOCK,
+  BATCH_OP_LOCK,
+  BATCH_OP_LOOP_SETUP,
+  BATCH_OP_POWER_OFF,
+  BATCH_OP_N_TYPES
+} BatchOpType;
+
+static const gchar *batch_op_names[BATCH_OP_N_TYPES] =
+{
+  "mount",
+  "unmount",
+  "unlock",
+  "lock",
+  "loop-setup",
+  "power-off"
+};
+
+typedef struct
+{
+  guint line_number;
+  BatchOpType type;
+  gchar *target;              /* as given on the line, for reporting */
+  UDisksObject *object;       /* NULL for loop-setup */
+  gchar *file;                /* for loop-setup */
+  gboolean read_only;         /* for loop-setup */
+  GVariant *options;
+  gboolean retried;
+} BatchOp;
+
+static GQueue  *batch_pending = NULL;
+static guint    batch_n_running = 0;
+static guint    batch_n_failed = 0;
+
+typedef struct
+{
+  gchar *data;
+  gsize size;
+} BatchKey;
+
+/* don't leave key material lying around once the last user of the options is done */
+static void
+batch_key_free (gpointer user_data)
+{
+  BatchKey *key = user_data;
+
+  memset (key->data, '\0', key->size);
+  g_free (key->data);
+  g_slice_free (BatchKey, key);
+}
+
+/* Wraps @data, which is taken, in a bytestring variant without copying it */
+static GVariant *
+batch_key_new (gchar *data,
+               gsize  size)
+{
+  BatchKey *key;
+  GBytes *bytes;
+  GVariant *ret;
+
+  key = g_slice_new (BatchKey);
+  key->data = data;
+  key->size = size;
+  bytes = g_bytes_new_with_free_func (data, size, batch_key_free, key);
+  ret = g_variant_new_from_bytes (G_VARIANT_TYPE_BYTESTRING, bytes, TRUE);
+  g_bytes_unref (bytes);
+
+  return ret;
+}
+
+static void
+batch_op_free (BatchOp *op)
+{
+  if (op->options != NULL)
+    g_variant_unref (op->options);
+  g_clear_object (&op->object);
+  g_free (op->file);
+  g_free (op->target);
+  g_slice_free (BatchOp, op);
+}
+
+static void
+batch_print_result (guint        line_number,
+                    const gchar *operation,
+                    const gchar *target,
+                    const gchar *result,
+                    GError      *error)
+{
+  GString *str;
+
+  str = g_string_new (NULL);
+  g_string_append_printf (str, "{\"line\":%u,\"operation\":", line_number);
+  json_append_string (str, operation != NULL ? operation : "");
+  g_string_append (str, ",\"target\":");
+  json_append_string (str, target != NULL ? target : "");
+  if (error == NULL)
+    {
+      g_string_append (str, ",\"success\":true");
+      if (result != NULL)
+        {
+          g_string_append (str, ",\"result\":");
+          json_append_string (str, result);
+        }
+    }
+  else
+    {
+      g_string_append (str, ",\"success\":false,\"error\":");
+      json_append_string (str, error->message);
+    }
+  g_string_append_c (str, '}');
+  json_print_line (str);
+
+  if (error != NULL)
+    batch_n_failed++;
+}
+
+/* device file and symlinks -> object, to resolve all targets with a single pass over the objects */
+static GHashTable *
+batch_build_device_index (void)
+{
+  GHashTable *ret;
+  GList *objects;
+  GList *l;
+
+  ret = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+  objects = g_dbus_object_manager_get_objects (udisks_client_get_object_manager (client));
+  for (l = objects; l != NULL; l = l->next)
+    {
+      UDisksObject *object = UDISKS_OBJECT (l->data);
+      UDisksBlock *block;
+      const gchar * const *symlinks;
+      guint n;
+
+      block = udisks_object_peek_block (object);
+      if (block == NULL)
+        continue;
+
+      g_hash_table_insert (ret, g_strdup (udisks_block_get_device (block)), g_object_ref (object));
+      symlinks = udisks_block_get_symlinks (block);
+      for (n = 0; symlinks != NULL && symlinks[n] != NULL; n++)
+        g_hash_table_insert (ret, g_strdup (symlinks[n]), g_object_ref (object));
+    }
+  g_list_free_full (objects, g_object_unref);
+
+  return ret;
+}
+
+/* Parses one line of input, returns NULL and sets @error if it's invalid */
+static BatchOp *
+batch_parse_line (const gchar  *line,
+                  guint         line_number,
+                  GHashTable   *device_index,
+                  GError      **error)
+{
+  BatchOp *op = NULL;
+  GOptionContext *o = NULL;
+  gchar **line_argv = NULL;
+  gchar *object_path = NULL;
+  gchar *device = NULL;
+  gchar *mount_options = NULL;
+  gchar *filesystem_type = NULL;
+  gboolean force = FALSE;
+  gchar *key_file = NULL;
+  gchar *keyfile_contents = NULL;
+  gsize keyfile_size = 0;
+  gboolean read_only = FALSE;
+  gchar *file = NULL;
+  gint64 offset = 0;
+  gint64 size = 0;
+  gboolean no_user_interaction = FALSE;
+  UDisksObject *object = NULL;
+  UDisksDrive *drive;
+  GVariantBuilder builder;
+  guint n;
+  GOptionEntry entries[] =
+  {
+    { "object-path", 'p', 0, G_OPTION_ARG_STRING, &object_path, NULL, NULL },
+    { "block-device", 'b', 0, G_OPTION_ARG_STRING, &device, NULL, NULL },
+    { "options", 'o', 0, G_OPTION_ARG_STRING, &mount_options, NULL, NULL },
+    { "filesystem-type", 't', 0, G_OPTION_ARG_STRING, &filesystem_type, NULL, NULL },
+    { "force", 0, 0, G_OPTION_ARG_NONE, &force, NULL, NULL },
+    { "key-file", 0, 0, G_OPTION_ARG_FILENAME, &key_file, NULL, NULL },
+    { "read-only", 'r', 0, G_OPTION_ARG_NONE, &read_only, NULL, NULL },
+    { "file", 'f', 0, G_OPTION_ARG_FILENAME, &file, NULL, NULL },
+    { "offset", 0, 0, G_OPTION_ARG_INT64, &offset, NULL, NULL },
+    { "size", 0, 0, G_OPTION_ARG_INT64, &size, NULL, NULL },
+    { "no-user-interaction", 0, 0, G_OPTION_ARG_NONE, &no_user_interaction, NULL, NULL },
+    { NULL }
+  };
+
+  if (!g_shell_parse_argv (line, NULL, &line_argv, error))
+    goto out;
+
+  op = g_slice_new0 (BatchOp);
+  op->line_number = line_number;
+  for (n = 0; n < BATCH_OP_N_TYPES; n++)
+    {
+      if (g_strcmp0 (line_argv[0], batch_op_names[n]) == 0)
+        break;
+    }
+  if (n == BATCH_OP_N_TYPES)
+    {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED, "Unknown operation `%s'", line_argv[0]);
+      goto fail;
+    }
+  op->type = n;
+
+  /* g_option_context_parse_strv() skips argv[0], which is the operation */
+  o = g_option_context_new (NULL);
+  g_option_context_set_help_enabled (o, FALSE);
+  g_option_context_add_main_entries (o, entries, NULL /* GETTEXT_PACKAGE*/);
+  if (!g_option_context_parse_strv (o, &line_argv, error))
+    goto fail;
+  if (g_strv_length (line_argv) > 1)
+    {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED, "Unexpected argument `%s'", line_argv[1]);
+      goto fail;
+    }
+
+  if (op->type == BATCH_OP_LOOP_SETUP)
+    {
+      if (file == NULL)
+        {
+          g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED, "No file given");
+          goto fail;
+        }
+      op->target = g_strdup (file);
+      op->file = g_strdup (file);
+      op->read_only = read_only;
+    }
+  else
+    {
+      if (object_path != NULL)
+        {
+          op->target = g_strdup (object_path);
+          object = lookup_object_by_path (object_path);
+        }
+      else if (device != NULL)
+        {
+          op->target = g_strdup (device);
+          object = g_hash_table_lookup (device_index, device);
+          if (object != NULL)
+            g_object_ref (object);
+        }
+      else
+        {
+          g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED, "No object path or block device given");
+          goto fail;
+        }
+      if (object == NULL)
+        {
+          g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED, "Error looking up object for %s", op->target);
+          goto fail;
+        }
+
+      switch (op->type)
+        {
+        case BATCH_OP_MOUNT:
+        case BATCH_OP_UNMOUNT:
+          if (udisks_object_peek_filesystem (object) == NULL)
+            {
+              g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED, "Object %s is not a mountable filesystem",
+                           g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+              goto fail;
+            }
+          break;
+
+        case BATCH_OP_UNLOCK:
+        case BATCH_OP_LOCK:
+          if (udisks_object_peek_encrypted (object) == NULL)
+            {
+              g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED, "Object %s is not an encrypted device",
+                           g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+              goto fail;
+            }
+          break;
+
+        case BATCH_OP_POWER_OFF:
+          if (udisks_object_peek_drive (object) == NULL && udisks_object_peek_block (object) != NULL)
+            {
+              drive = udisks_client_get_drive_for_block (client, udisks_object_peek_block (object));
+              g_clear_object (&object);
+              if (drive != NULL)
+                {
+                  object = (UDisksObject *) g_dbus_interface_dup_object (G_DBUS_INTERFACE (drive));
+                  g_object_unref (drive);
+                }
+            }
+          if (object == NULL || udisks_object_peek_drive (object) == NULL)
+            {
+              g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED, "No drive for %s", op->target);
+              goto fail;
+            }
+          break;
+
+        default:
+          g_assert_not_reached ();
+        }
+      op->object = object;
+      object = NULL;
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  if (no_user_interaction || opt_batch_no_user_interaction)
+    g_variant_builder_add (&builder, "{sv}", "auth.no_user_interaction", g_variant_new_boolean (TRUE));
+  switch (op->type)
+    {
+    case BATCH_OP_MOUNT:
+      if (mount_options != NULL)
+        g_variant_builder_add (&builder, "{sv}", "options", g_variant_new_string (mount_options));
+      if (filesystem_type != NULL)
+        g_variant_builder_add (&builder, "{sv}", "fstype", g_variant_new_string (filesystem_type));
+      break;
+
+    case BATCH_OP_UNMOUNT:
+      if (force)
+        g_variant_builder_add (&builder, "{sv}", "force", g_variant_new_boolean (TRUE));
+      break;
+
+    case BATCH_OP_UNLOCK:
+      /* there is no terminal to read a passphrase from */
+      if (key_file == NULL)
+        {
+          g_variant_builder_clear (&builder);
+          g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED, "No key file given");
+          goto fail;
+        }
+      if (!g_file_get_contents (key_file, &keyfile_contents, &keyfile_size, error))
+        {
+          g_variant_builder_clear (&builder);
+          goto fail;
+        }
+      g_variant_builder_add (&builder, "{sv}", "keyfile_contents", batch_key_new (keyfile_contents, keyfile_size));
+      keyfile_contents = NULL;
+      if (read_only)
+        g_variant_builder_add (&builder, "{sv}", "read-only", g_variant_new_boolean (TRUE));
+      break;
+
+    case BATCH_OP_LOOP_SETUP:
+      if (read_only)
+        g_variant_builder_add (&builder, "{sv}", "read-only", g_variant_new_boolean (TRUE));
+      if (offset > 0)
+        g_variant_builder_add (&builder, "{sv}", "offset", g_variant_new_uint64 (offset));
+      if (size > 0)
+        g_variant_builder_add (&builder, "{sv}", "size", g_variant_new_uint64 (size));
+      break;
+
+    default:
+      break;
+    }
+  op->options = g_variant_ref_sink (g_variant_builder_end (&builder));
+  goto out;
+
+ fail:
+  batch_op_free (op);
+  op = NULL;
+
+ out:
+  if (keyfile_contents != NULL)
+    {
+      memset (keyfile_contents, '\0', keyfile_size);
+      g_free (keyfile_contents);
+    }
+  g_clear_object (&object);
+  if (o != NULL)
+    g_option_context_free (o);
+  g_strfreev (line_argv);
+  g_free (object_path);
+  g_free (device);
+  g_free (mount_options);
+  g_free (filesystem_type);
+  g_free (key_file);
+  g_free (file);
+  return op;
+}
+
+static void batch_op_start (BatchOp *op);
+
+static void
+batch_run_next (void)
+{
+  BatchOp *op;
+
+  while (batch_n_running < (guint) opt_batch_max_concurrent &&
+         (op = g_queue_pop_head (batch_pending)) != NULL)
+    {
+      batch_n_running++;
+      batch_op_start (op);
+    }
+
+  if (batch_n_running == 0 && g_queue_is_empty (batch_pending))
+    g_main_loop_quit (loop);
+}
+
+static void
+batch_op_finish (BatchOp     *op,
+                 const gchar *result,
+                 GError      *error)
+{
+  if (error != NULL &&
+      error->domain == UDISKS_ERROR &&
+      error->code == UDISKS_ERROR_NOT_AUTHORIZED_CAN_OBTAIN &&
+      !op->retried &&
+      setup_local_polkit_agent ())
+    {
+      op->retried = TRUE;
+      batch_op_start (op);
+      return;
+    }
+
+  if (error != NULL)
+    g_dbus_error_strip_remote_error (error);
+  batch_print_result (op->line_number, batch_op_names[op->type], op->target, result, error);
+  batch_op_free (op);
+
+  batch_n_running--;
+  batch_run_next ();
+}
+
+static void
+batch_on_call_done (GObject      *source_object,
+                    GAsyncResult *res,
+                    gpointer      user_data)
+{
+  BatchOp *op = user_data;
+  GError *error = NULL;
+  gchar *result = NULL;
+
+  switch (op->type)
+    {
+    case BATCH_OP_MOUNT:
+      udisks_filesystem_call_mount_finish (UDISKS_FILESYSTEM (source_object), &result, res, &error);
+      break;
+
+    case BATCH_OP_UNMOUNT:
+      udisks_filesystem_call_unmount_finish (UDISKS_FILESYSTEM (source_object), res, &error);
+      break;
+
+    case BATCH_OP_UNLOCK:
+      udisks_encrypted_call_unlock_finish (UDISKS_ENCRYPTED (source_object), &result, res, &error);
+      break;
+
+    case BATCH_OP_LOCK:
+      udisks_encrypted_call_lock_finish (UDISKS_ENCRYPTED (source_object), res, &error);
+      break;
+
+    case BATCH_OP_LOOP_SETUP:
+      udisks_manager_call_loop_setup_finish (UDISKS_MANAGER (source_object), &result, NULL, res, &error);
+      break;
+
+    case BATCH_OP_POWER_OFF:
+      udisks_drive_call_power_off_finish (UDISKS_DRIVE (source_object), res, &error);
+      break;
+
+    default:
+      g_assert_not_reached ();
+    }
+
+  batch_op_finish (op, result, error);
+  g_free (result);
+  g_clear_error (&error);
+}
+
+static void
+batch_op_start (BatchOp *op)
+{
+  GUnixFDList *fd_list;
+  GError *error = NULL;
+  gint fd;
+
+  switch (op->type)
+    {
+    case BATCH_OP_MOUNT:
+      udisks_filesystem_call_mount (udisks_object_peek_filesystem (op->object),
+                                    op->options,
+                                    NULL, /* GCancellable */
+                                    batch_on_call_done,
+                                    op);
+      break;
+
+    case BATCH_OP_UNMOUNT:
+      udisks_filesystem_call_unmount (udisks_object_peek_filesystem (op->object),
+                                      op->options,
+                                      NULL, /* GCancellable */
+                                      batch_on_call_done,
+                                      op);
+      break;
+
+    case BATCH_OP_UNLOCK:
+      udisks_encrypted_call_unlock (udisks_object_peek_encrypted (op->object),
+                                    "", /* passphrase, the key file is in the options */
+                                    op->options,
+                                    NULL, /* GCancellable */
+                                    batch_on_call_done,
+                                    op);
+      break;
+
+    case BATCH_OP_LOCK:
+      udisks_encrypted_call_lock (udisks_object_peek_encrypted (op->object),
+                                  op->options,
+                                  NULL, /* GCancellable */
+                                  batch_on_call_done,
+                                  op);
+      break;
+
+    case BATCH_OP_LOOP_SETUP:
+      /* only opened when started so at most max-concurrent files are open at a time */
+      fd = open (op->file, op->read_only ? O_RDONLY : O_RDWR);
+      if (fd == -1)
+        {
+          g_set_error (&error, G_IO_ERROR, g_io_error_from_errno (errno),
+                       "Error opening (%s) file %s: %s",
+                       op->read_only ? "ro" : "rw", op->file, g_strerror (errno));
+          batch_op_finish (op, NULL, error);
+          g_clear_error (&error);
+          break;
+        }
+      fd_list = g_unix_fd_list_new_from_array (&fd, 1); /* adopts the fd */
+      udisks_manager_call_loop_setup (udisks_client_get_manager (client),
+                                      g_variant_new_handle (0),
+                                      op->options,
+                                      fd_list,
+                                      NULL, /* GCancellable */
+                                      batch_on_call_done,
+                                      op);
+      g_object_unref (fd_list);
+      break;
+
+    case BATCH_OP_POWER_OFF:
+      udisks_drive_call_power_off (udisks_object_peek_drive (op->object),
+                                   op->options,
+                                   NULL, /* GCancellable */
+                                   batch_on_call_done,
+                                   op);
+      break;
+
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static gint
+handle_command_batch (gint        *argc,
+                      gchar      **argv[],
+                      gboolean     request_completion,
+                      const gchar *completion_cur,
+                      const gchar *completion_prev)
+{
+  gint ret;
+  GOptionContext *o;
+  gchar *s;
+  gboolean complete_files;
+  GIOChannel *channel = NULL;
+  GHashTable *device_index = NULL;
+  GError *error = NULL;
+  gchar *line;
+  gchar *stripped;
+  guint line_number;
+  BatchOp *op;
+
+  ret = 1;
+  opt_batch_file = NULL;
+  opt_batch_max_concurrent = 8;
+  opt_batch_no_user_interaction = FALSE;
+
+  modify_argv0_for_command (argc, argv, "batch");
+
+  o = g_option_context_new (NULL);
+  if (request_completion)
+    g_option_context_set_ignore_unknown_options (o, TRUE);
+  g_option_context_set_help_enabled (o, FALSE);
+  g_option_context_set_summary (o,
+                                "Run mount, unmount, unlock, lock, loop-setup and power-off operations\n"
+                                "read from a file, one per line, and print the results as JSON lines.");
+  g_option_context_add_main_entries (o,
+                                     command_batch_entries,
+                                     NULL /* GETTEXT_PACKAGE*/);
+
+  complete_files = FALSE;
+  if (request_completion && (g_strcmp0 (completion_prev, "--file") == 0 || g_strcmp0 (completion_prev, "-f") == 0 ||
+                             g_strcmp0 (completion_cur, "--file") == 0 || g_strcmp0 (completion_cur, "-f") == 0))
+    {
+      complete_files = TRUE;
+      remove_arg ((*argc) - 1, argc, argv);
+    }
+
+  if (!g_option_context_parse (o, argc, argv, NULL))
+    {
+      if (!request_completion)
+        {
+          s = g_option_context_get_help (o, FALSE, NULL);
+          g_printerr ("%s", s);
+          g_free (s);
+          goto out;
+        }
+    }
+
+  if (request_completion)
+    {
+      if (complete_files)
+        g_print ("@FILES@");
+      else
+        list_options (command_batch_entries);
+      goto out;
+    }
+
+  if (opt_batch_max_concurrent < 1)
+    {
+      g_printerr ("The maximum number of concurrent operations must be at least 1\n");
+      goto out;
+    }
+
+  if (opt_batch_file == NULL || g_strcmp0 (opt_batch_file, "-") == 0)
+    {
+      channel = g_io_channel_unix_new (STDIN_FILENO);
+    }
+  else
+    {
+      channel = g_io_channel_new_file (opt_batch_file, "r", &error);
+      if (channel == NULL)
+        {
+          g_printerr ("Error opening %s: %s\n", opt_batch_file, error->message);
+          g_clear_error (&error);
+          goto out;
+        }
+    }
+
+  /* resolve all targets against the same snapshot of objects, before anything is changed */
+  device_index = batch_build_device_index ();
+  batch_pending = g_queue_new ();
+  batch_n_running = 0;
+  batch_n_failed = 0;
+
+  line_number = 0;
+  while (g_io_channel_read_line (channel, &line, NULL, NULL, &error) == G_IO_STATUS_NORMAL)
+    {
+      line_number++;
+      stripped = g_strstrip (line);
+      if (stripped[0] != '\0' && stripped[0] != '#')
+        {
+          op = batch_parse_line (stripped, line_number, device_index, &error);
+          if (op != NULL)
+            {
+              g_queue_push_tail (batch_pending, op);
+            }
+          else
+            {
+              batch_print_result (line_number, NULL, NULL, NULL, error);
+              g_clear_error (&error);
+            }
+        }
+      g_free (line);
+    }
+  if (error != NULL)
+    {
+      g_printerr ("Error reading operations: %s\n", error->message);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  batch_run_next ();
+  if (batch_n_running > 0)
+    g_main_loop_run (loop);
+
+  ret = batch_n_failed > 0 ? 1 : 0;
+
+ out:
+  if (batch_pending != NULL)
+    {
+      g_queue_free_full (batch_pending, (GDestroyNotify) batch_op_free);
+      batch_pending = NULL;
+    }
+  if (device_index != NULL)
+    g_hash_table_unref (device_index);
+  if (channel != NULL)
+    g_io_channel_unref (channel);
+  g_option_context_free (o);
+  g_free (opt_batch_file);
   return ret;
 }
 
@@ -3165,6 +4683,7 @@ usage (gint *argc, gchar **argv[], gboolean use_stdout)
                        "  loop-setup      Set-up a loop device\n"
                        "  loop-delete     Delete a loop device\n"
                        "  power-off       Safely power off a drive\n"
+                       "  batch           Run many operations read from a file\n"
                        "  smart-simulate  Set SMART data for a drive\n"
                        "\n"
                        "Use \"%s COMMAND --help\" to get help on each command.\n",
@@ -3377,6 +4896,15 @@ main (int argc,
                                       completion_prev);
       goto out;
     }
+  else if (g_strcmp0 (command, "batch") == 0)
+    {
+      ret = handle_command_batch (&argc,
+                                  &argv,
+                                  request_completion,
+                                  completion_cur,
+                                  completion_prev);
+      goto out;
+    }
   else if (g_strcmp0 (command, "dump") == 0)
     {
       ret = handle_command_dump (&argc,
@@ -3483,6 +5011,7 @@ main (int argc,
                    "loop-setup \n"
                    "loop-delete \n"
                    "power-off \n"
+                   "batch \n"
                    "smart-simulate \n"
                    );
           ret = 0;
@@ -26,6 +26,8 @@
 #include "udiskserror.h"
 #include "udisks-generated.h"
 #include "udisksobjectinfo.h"
+#include "udisksfilteredobjectmanager.h"
+#include "udisksclientprivate.h"
 
 /**
  * SECTION:udisksclient
@@ -54,9 +56,18 @@ struct _UDisksClient
   GDBusConnection *bus_connection;
   GDBusObjectManager *object_manager;
 
+  /* if non-NULL, only these interfaces are tracked, see udisks_client_new_filtered_sync() */
+  gchar **interfaces;
+  gchar **object_path_prefixes;
+
   GMainContext *context;
 
   GSource *changed_timeout_source;
+
+  /* object path -> ObjectInfoCacheEntry, see udisks_client_get_object_info() */
+  GHashTable *object_info_cache;
+  /* group -> set of object paths in object_info_cache, see object_info_group_for_object() */
+  GHashTable *object_info_groups;
 };
 
 typedef struct
@@ -70,7 +81,9 @@ enum
   PROP_0,
   PROP_OBJECT_MANAGER,
   PROP_MANAGER,
-  PROP_BUS_CONNECTION
+  PROP_BUS_CONNECTION,
+  PROP_INTERFACES,
+  PROP_OBJECT_PATH_PREFIXES
 };
 
 enum
@@ -109,8 +122,18 @@ static void on_interface_proxy_properties_changed (GDBusObjectManagerClient   *m
                                                    const gchar *const         *invalidated_properties,
                                                    gpointer                    user_data);
 
+static void on_filtered_interface_properties_changed (UDisksFilteredObjectManager *manager,
+                                                     UDisksFilteredObject        *object,
+                                                     const gchar                 *interface_name,
+                                                     GVariant                    *changed_properties,
+                                                     const gchar *const          *invalidated_properties,
+                                                     gpointer                     user_data);
+
 static void maybe_emit_changed_now (UDisksClient *client);
 
+typedef struct ObjectInfoCacheEntry ObjectInfoCacheEntry;
+static void object_info_cache_entry_free (ObjectInfoCacheEntry *entry);
+
 static void init_interface_proxy (UDisksClient *client,
                                   GDBusProxy   *proxy);
 
@@ -150,13 +173,21 @@ udisks_client_finalize (GObject *object)
       g_signal_handlers_disconnect_by_func (client->object_manager,
                                             G_CALLBACK (on_interface_proxy_properties_changed),
                                             client);
+      g_signal_handlers_disconnect_by_func (client->object_manager,
+                                            G_CALLBACK (on_filtered_interface_properties_changed),
+                                            client);
       g_object_unref (client->object_manager);
     }
 
   if (client->context != NULL)
     g_main_context_unref (client->context);
 
+  g_hash_table_unref (client->object_info_groups);
+  g_hash_table_unref (client->object_info_cache);
+
   g_clear_object (&client->bus_connection);
+  g_strfreev (client->object_path_prefixes);
+  g_strfreev (client->interfaces);
 
   G_OBJECT_CLASS (udisks_client_parent_class)->finalize (object);
 }
@@ -171,6 +202,11 @@ udisks_client_init (UDisksClient *client)
    */
   udisks_error_domain = UDISKS_ERROR;
   udisks_error_domain; /* shut up -Wunused-but-set-variable */
+
+  client->object_info_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                     NULL, (GDestroyNotify) object_info_cache_entry_free);
+  client->object_info_groups = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                      g_free, (GDestroyNotify) g_hash_table_unref);
 }
 
 static void
@@ -195,6 +231,14 @@ udisks_client_get_property (GObject    *object,
       g_value_set_object (value, client->bus_connection);
       break;
 
+    case PROP_INTERFACES:
+      g_value_set_boxed (value, client->interfaces);
+      break;
+
+    case PROP_OBJECT_PATH_PREFIXES:
+      g_value_set_boxed (value, client->object_path_prefixes);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -217,6 +261,18 @@ udisks_client_set_property (GObject      *object,
       client->bus_connection = g_value_dup_object (value);
       break;
 
+    case PROP_INTERFACES:
+      /* Construct only. */
+      g_assert (client->interfaces == NULL);
+      client->interfaces = g_value_dup_boxed (value);
+      break;
+
+    case PROP_OBJECT_PATH_PREFIXES:
+      /* Construct only. */
+      g_assert (client->object_path_prefixes == NULL);
+      client->object_path_prefixes = g_value_dup_boxed (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -286,6 +342,43 @@ udisks_client_class_init (UDisksClientClass *klass)
                                                         G_PARAM_CONSTRUCT_ONLY |
                                                         G_PARAM_STATIC_STRINGS));
 
+  /**
+   * UDisksClient:interfaces:
+   *
+   * The D-Bus interfaces tracked by the #UDisksClient or %NULL to
+   * track all of them. See udisks_client_new_filtered_sync().
+   *
+   * Since: 2.10.0
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_INTERFACES,
+                                   g_param_spec_boxed ("interfaces",
+                                                       "Interfaces",
+                                                       "The D-Bus interfaces to track",
+                                                       G_TYPE_STRV,
+                                                       G_PARAM_READWRITE |
+                                                       G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_STATIC_STRINGS));
+
+  /**
+   * UDisksClient:object-path-prefixes:
+   *
+   * If not %NULL, only objects with an object path starting with one
+   * of these prefixes are tracked. Only used together with the
+   * #UDisksClient:interfaces property.
+   *
+   * Since: 2.10.0
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_OBJECT_PATH_PREFIXES,
+                                   g_param_spec_boxed ("object-path-prefixes",
+                                                       "Object Path Prefixes",
+                                                       "The object path prefixes of the objects to track",
+                                                       G_TYPE_STRV,
+                                                       G_PARAM_READWRITE |
+                                                       G_PARAM_CONSTRUCT_ONLY |
+                                                       G_PARAM_STATIC_STRINGS));
+
   /**
    * UDisksClient::changed:
    * @client: A #UDisksClient.
@@ -451,6 +544,125 @@ udisks_client_new_sync (GCancellable  *cancellable,
     return NULL;
 }
 
+/**
+ * udisks_client_new_filtered:
+ * @connection: (nullable): A #GDBusConnection. If %NULL, a system bus
+ *   connection will be used.
+ * @interfaces: (array zero-terminated=1): The D-Bus interfaces to track, e.g. <literal>org.freedesktop.UDisks2.Drive.Ata</literal>.
+ * @object_path_prefixes: (nullable) (array zero-terminated=1): Only track objects with an object
+ *   path starting with one of these prefixes or %NULL to track all objects.
+ * @cancellable: A #GCancellable or %NULL.
+ * @callback: Function that will be called when the result is ready.
+ * @user_data: Data to pass to @callback.
+ *
+ * Asynchronous version of udisks_client_new_filtered_sync().
+ *
+ * Since: 2.10.0
+ */
+void
+udisks_client_new_filtered (GDBusConnection     *connection,
+                            const gchar * const *interfaces,
+                            const gchar * const *object_path_prefixes,
+                            GCancellable        *cancellable,
+                            GAsyncReadyCallback  callback,
+                            gpointer             user_data)
+{
+  g_return_if_fail (connection == NULL || G_IS_DBUS_CONNECTION (connection));
+  g_return_if_fail (interfaces != NULL);
+
+  g_async_initable_new_async (UDISKS_TYPE_CLIENT,
+                              G_PRIORITY_DEFAULT,
+                              cancellable,
+                              callback,
+                              user_data,
+                              "bus-connection",
+                              connection,
+                              "interfaces",
+                              interfaces,
+                              "object-path-prefixes",
+                              object_path_prefixes,
+                              NULL);
+}
+
+/**
+ * udisks_client_new_filtered_finish:
+ * @res: A #GAsyncResult.
+ * @error: Return location for error or %NULL.
+ *
+ * Finishes an operation started with udisks_client_new_filtered().
+ *
+ * Returns: (transfer full): A #UDisksClient or %NULL if @error is set. Free
+ * with g_object_unref() when done with it.
+ *
+ * Since: 2.10.0
+ */
+UDisksClient *
+udisks_client_new_filtered_finish (GAsyncResult  *res,
+                                   GError       **error)
+{
+  return _udisks_client_new_finish (res, error);
+}
+
+/**
+ * udisks_client_new_filtered_sync:
+ * @connection: (nullable): A #GDBusConnection. If %NULL, a system bus
+ *   connection will be used.
+ * @interfaces: (array zero-terminated=1): The D-Bus interfaces to track, e.g. <literal>org.freedesktop.UDisks2.Drive.Ata</literal>.
+ * @object_path_prefixes: (nullable) (array zero-terminated=1): Only track objects with an object
+ *   path starting with one of these prefixes or %NULL to track all objects.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @error: (allow-none): Return location for error or %NULL.
+ *
+ * Synchronously gets a #UDisksClient that only tracks the given
+ * D-Bus interfaces. This is intended for programs only interested
+ * in a small part of the UDisks objects on systems with a large
+ * number of devices.
+ *
+ * Only the properties of @interfaces are kept and the client is only
+ * woken up for property changes and signals on these interfaces. The
+ * interface proxies are created when first accessed.
+ *
+ * Objects without any of the @interfaces are not included in the
+ * #UDisksClient:object-manager. In particular,
+ * udisks_client_get_manager() returns %NULL unless
+ * <literal>org.freedesktop.UDisks2.Manager</literal> is in
+ * @interfaces, and the helpers looking up related objects (for
+ * example udisks_client_get_drive_for_block()) only find objects with
+ * tracked interfaces.
+ *
+ * Returns: (transfer full): A #UDisksClient or %NULL if @error is set. Free
+ * with g_object_unref() when done with it.
+ *
+ * Since: 2.10.0
+ */
+UDisksClient *
+udisks_client_new_filtered_sync (GDBusConnection     *connection,
+                                 const gchar * const *interfaces,
+                                 const gchar * const *object_path_prefixes,
+                                 GCancellable        *cancellable,
+                                 GError             **error)
+{
+  GInitable *ret;
+
+  g_return_val_if_fail (connection == NULL || G_IS_DBUS_CONNECTION (connection), NULL);
+  g_return_val_if_fail (interfaces != NULL, NULL);
+
+  ret = g_initable_new (UDISKS_TYPE_CLIENT,
+                        cancellable,
+                        error,
+                        "bus-connection",
+                        connection,
+                        "interfaces",
+                        interfaces,
+                        "object-path-prefixes",
+                        object_path_prefixes,
+                        NULL);
+  if (ret != NULL)
+    return UDISKS_CLIENT (ret);
+  else
+    return NULL;
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static gboolean
@@ -496,28 +708,56 @@ initable_init (GInitable     *initable,
       bus_connection = g_object_ref (client->bus_connection);
     }
 
-  client->object_manager = udisks_object_manager_client_new_sync (bus_connection,
-                                                                  G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE,
-                                                                  "org.freedesktop.UDisks2",
-                                                                  "/org/freedesktop/UDisks2",
-                                                                  cancellable,
-                                                                  &client->initialization_error);
-  g_clear_object (&bus_connection);
-  if (client->object_manager == NULL)
-    goto out;
+  if (client->interfaces != NULL)
+    {
+      /* proxies are created lazily and initialized by the object manager */
+      client->object_manager = (GDBusObjectManager *)
+        udisks_filtered_object_manager_new_sync (bus_connection,
+                                                 "org.freedesktop.UDisks2",
+                                                 "/org/freedesktop/UDisks2",
+                                                 (const gchar * const *) client->interfaces,
+                                                 (const gchar * const *) client->object_path_prefixes,
+                                                 cancellable,
+                                                 &client->initialization_error);
+      g_clear_object (&bus_connection);
+      if (client->object_manager == NULL)
+        goto out;
 
-  /* init all proxies */
-  objects = g_dbus_object_manager_get_objects (client->object_manager);
-  for (l = objects; l != NULL; l = l->next)
+      g_signal_connect (client->object_manager,
+                        "interface-properties-changed",
+                        G_CALLBACK (on_filtered_interface_properties_changed),
+                        client);
+    }
+  else
     {
-      interfaces = g_dbus_object_get_interfaces (G_DBUS_OBJECT (l->data));
-      for (ll = interfaces; ll != NULL; ll = ll->next)
+      client->object_manager = udisks_object_manager_client_new_sync (bus_connection,
+                                                                      G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE,
+                                                                      "org.freedesktop.UDisks2",
+                                                                      "/org/freedesktop/UDisks2",
+                                                                      cancellable,
+                                                                      &client->initialization_error);
+      g_clear_object (&bus_connection);
+      if (client->object_manager == NULL)
+        goto out;
+
+      /* init all proxies */
+      objects = g_dbus_object_manager_get_objects (client->object_manager);
+      for (l = objects; l != NULL; l = l->next)
         {
-          init_interface_proxy (client, G_DBUS_PROXY (ll->data));
+          interfaces = g_dbus_object_get_interfaces (G_DBUS_OBJECT (l->data));
+          for (ll = interfaces; ll != NULL; ll = ll->next)
+            {
+              init_interface_proxy (client, G_DBUS_PROXY (ll->data));
+            }
+          g_list_free_full (interfaces, g_object_unref);
         }
-      g_list_free_full (interfaces, g_object_unref);
+      g_list_free_full (objects, g_object_unref);
+
+      g_signal_connect (client->object_manager,
+                        "interface-proxy-properties-changed",
+                        G_CALLBACK (on_interface_proxy_properties_changed),
+                        client);
     }
-  g_list_free_full (objects, g_object_unref);
 
   g_signal_connect (client->object_manager,
                     "object-added",
@@ -535,10 +775,6 @@ initable_init (GInitable     *initable,
                     "interface-removed",
                     G_CALLBACK (on_interface_removed),
                     client);
-  g_signal_connect (client->object_manager,
-                    "interface-proxy-properties-changed",
-                    G_CALLBACK (on_interface_proxy_properties_changed),
-                    client);
 
   ret = TRUE;
 
@@ -1613,6 +1849,219 @@ udisks_client_queue_changed (UDisksClient *client)
   ;
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* UDisksObjectInfo for an object depends on the object itself and, through
+ * udisks_client_get_drive_for_block(), udisks_client_get_block_for_drive() and
+ * friends, on the drive or RAID array it belongs to and the other block devices
+ * of that drive or array. Cached infos are therefore grouped by the drive or
+ * array object path, and a change to any object invalidates its group.
+ *
+ * Cleartext devices and partitions of devices without a drive or array, e.g.
+ * of loop devices, are grouped with their backing device or partition table
+ * so that they are invalidated when it changes too.
+ */
+struct ObjectInfoCacheEntry
+{
+  gchar *object_path;
+  gchar *group;
+  UDisksObjectInfo *info;
+};
+
+static void
+object_info_cache_entry_free (ObjectInfoCacheEntry *entry)
+{
+  g_object_unref (entry->info);
+  g_free (entry->group);
+  g_free (entry->object_path);
+  g_slice_free (ObjectInfoCacheEntry, entry);
+}
+
+/* Maximum number of backing devices and partition tables followed, guards
+ * against cycles in inconsistent data
+ */
+#define OBJECT_INFO_MAX_RELATION_DEPTH 8
+
+static gboolean
+object_path_is_set (const gchar *object_path)
+{
+  return object_path != NULL && g_strcmp0 (object_path, "/") != 0;
+}
+
+/* Returns: (transfer full): The group @object belongs to */
+static gchar *
+object_info_group_for_object (UDisksClient *client,
+                              GDBusObject  *object)
+{
+  GDBusObject *related = NULL;
+  GDBusObject *next;
+  UDisksBlock *block;
+  UDisksPartition *partition;
+  const gchar *s;
+  gchar *ret = NULL;
+  guint depth;
+
+  for (depth = 0; depth < OBJECT_INFO_MAX_RELATION_DEPTH; depth++)
+    {
+      block = udisks_object_peek_block (UDISKS_OBJECT (object));
+      partition = udisks_object_peek_partition (UDISKS_OBJECT (object));
+      if (block != NULL)
+        {
+          s = udisks_block_get_drive (block);
+          if (object_path_is_set (s))
+            {
+              ret = g_strdup (s);
+              goto out;
+            }
+          s = udisks_block_get_mdraid (block);
+          if (object_path_is_set (s))
+            {
+              ret = g_strdup (s);
+              goto out;
+            }
+        }
+
+      /* the cleartext device goes with its backing device, a partition with its table */
+      s = block != NULL ? udisks_block_get_crypto_backing_device (block) : NULL;
+      if (!object_path_is_set (s) && partition != NULL)
+        s = udisks_partition_get_table (partition);
+      if (!object_path_is_set (s))
+        break;
+
+      next = g_dbus_object_manager_get_object (client->object_manager, s);
+      if (next == NULL)
+        break;
+      g_clear_object (&related);
+      related = next;
+      object = related;
+    }
+  ret = g_strdup (g_dbus_object_get_object_path (object));
+
+ out:
+  g_clear_object (&related);
+  return ret;
+}
+
+static void
+object_info_cache_remove (UDisksClient *client,
+                          const gchar  *object_path)
+{
+  ObjectInfoCacheEntry *entry;
+  GHashTable *paths;
+
+  entry = g_hash_table_lookup (client->object_info_cache, object_path);
+  if (entry == NULL)
+    return;
+
+  paths = g_hash_table_lookup (client->object_info_groups, entry->group);
+  if (paths != NULL)
+    {
+      g_hash_table_remove (paths, object_path);
+      if (g_hash_table_size (paths) == 0)
+        g_hash_table_remove (client->object_info_groups, entry->group);
+    }
+  g_hash_table_remove (client->object_info_cache, object_path);
+}
+
+static void
+object_info_cache_remove_group (UDisksClient *client,
+                                const gchar  *group)
+{
+  GHashTable *paths;
+  GHashTableIter iter;
+  gpointer key;
+  gchar *group_key = NULL;
+
+  if (!g_hash_table_lookup_extended (client->object_info_groups, group, (gpointer *) &group_key, (gpointer *) &paths))
+    return;
+  g_hash_table_steal (client->object_info_groups, group);
+
+  g_hash_table_iter_init (&iter, paths);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    g_hash_table_remove (client->object_info_cache, key);
+
+  g_hash_table_unref (paths);
+  g_free (group_key);
+}
+
+/* Drops the cached info of @object and everything grouped with it, or the whole
+ * cache if the relations between objects may have changed.
+ */
+static void
+invalidate_object_info (UDisksClient *client,
+                        GDBusObject  *object,
+                        gboolean      relations_changed)
+{
+  const gchar *object_path;
+  gchar *group;
+
+  if (g_hash_table_size (client->object_info_cache) == 0)
+    return;
+
+  if (relations_changed)
+    {
+      g_hash_table_remove_all (client->object_info_groups);
+      g_hash_table_remove_all (client->object_info_cache);
+      return;
+    }
+
+  object_path = g_dbus_object_get_object_path (object);
+  object_info_cache_remove (client, object_path);
+  object_info_cache_remove_group (client, object_path);
+  group = object_info_group_for_object (client, object);
+  object_info_cache_remove_group (client, group);
+  g_free (group);
+}
+
+/* Returns: (transfer full): The cached info for @object or %NULL */
+UDisksObjectInfo *
+_udisks_client_lookup_object_info (UDisksClient *client,
+                                   UDisksObject *object)
+{
+  ObjectInfoCacheEntry *entry;
+
+  entry = g_hash_table_lookup (client->object_info_cache, g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+  if (entry == NULL)
+    return NULL;
+  return g_object_ref (entry->info);
+}
+
+void
+_udisks_client_cache_object_info (UDisksClient     *client,
+                                  UDisksObject     *object,
+                                  UDisksObjectInfo *info)
+{
+  ObjectInfoCacheEntry *entry;
+  GHashTable *paths;
+  GDBusObject *managed_object;
+
+  /* objects that are not (or no longer) managed would never be invalidated */
+  managed_object = g_dbus_object_manager_get_object (client->object_manager,
+                                                     g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+  if (managed_object != G_DBUS_OBJECT (object))
+    {
+      g_clear_object (&managed_object);
+      return;
+    }
+  g_object_unref (managed_object);
+
+  entry = g_slice_new0 (ObjectInfoCacheEntry);
+  entry->object_path = g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+  entry->group = object_info_group_for_object (client, G_DBUS_OBJECT (object));
+  entry->info = g_object_ref (info);
+
+  object_info_cache_remove (client, entry->object_path);
+  g_hash_table_insert (client->object_info_cache, entry->object_path, entry);
+
+  paths = g_hash_table_lookup (client->object_info_groups, entry->group);
+  if (paths == NULL)
+    {
+      paths = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+      g_hash_table_insert (client->object_info_groups, g_strdup (entry->group), paths);
+    }
+  g_hash_table_add (paths, g_strdup (entry->object_path));
+}
+
 static void
 on_object_added (GDBusObjectManager  *manager,
                  GDBusObject         *object,
@@ -1621,13 +2070,18 @@ on_object_added (GDBusObjectManager  *manager,
   UDisksClient *client = UDISKS_CLIENT (user_data);
   GList *interfaces, *l;
 
-  interfaces = g_dbus_object_get_interfaces (object);
-  for (l = interfaces; l != NULL; l = l->next)
+  /* the filtered object manager initializes its proxies when creating them */
+  if (client->interfaces == NULL)
     {
-      init_interface_proxy (client, G_DBUS_PROXY (l->data));
+      interfaces = g_dbus_object_get_interfaces (object);
+      for (l = interfaces; l != NULL; l = l->next)
+        {
+          init_interface_proxy (client, G_DBUS_PROXY (l->data));
+        }
+      g_list_free_full (interfaces, g_object_unref);
     }
-  g_list_free_full (interfaces, g_object_unref);
 
+  invalidate_object_info (client, object, FALSE);
   udisks_client_queue_changed (client);
 }
 
@@ -1637,6 +2091,7 @@ on_object_removed (GDBusObjectManager  *manager,
                    gpointer             user_data)
 {
   UDisksClient *client = UDISKS_CLIENT (user_data);
+  invalidate_object_info (client, object, FALSE);
   udisks_client_queue_changed (client);
 }
 
@@ -1658,6 +2113,7 @@ on_interface_added (GDBusObjectManager  *manager,
 
   init_interface_proxy (client, G_DBUS_PROXY (interface));
 
+  invalidate_object_info (client, object, UDISKS_IS_BLOCK (interface) || UDISKS_IS_PARTITION (interface));
   udisks_client_queue_changed (client);
 }
 
@@ -1668,25 +2124,55 @@ on_interface_removed (GDBusObjectManager  *manager,
                       gpointer             user_data)
 {
   UDisksClient *client = UDISKS_CLIENT (user_data);
+  invalidate_object_info (client, object, UDISKS_IS_BLOCK (interface) || UDISKS_IS_PARTITION (interface));
   udisks_client_queue_changed (client);
 }
 
 static void
-on_interface_proxy_properties_changed (GDBusObjectManagerClient   *manager,
-                                       GDBusObjectProxy           *object_proxy,
-                                       GDBusProxy                 *interface_proxy,
-                                       GVariant                   *changed_properties,
-                                       const gchar *const         *invalidated_properties,
-                                       gpointer                    user_data)
+invalidate_object_info_for_properties (UDisksClient *client,
+                                       GDBusObject  *object,
+                                       const gchar  *interface_name,
+                                       GVariant     *changed_properties)
+{
+  gboolean relations_changed = FALSE;
+  GVariantIter iter;
+  const gchar *property_name;
+
+  if (g_strcmp0 (interface_name, "org.freedesktop.UDisks2.Block") == 0)
+    {
+      g_variant_iter_init (&iter, changed_properties);
+      while (g_variant_iter_next (&iter, "{&sv}", &property_name, NULL))
+        {
+          if (g_strcmp0 (property_name, "Drive") == 0 ||
+              g_strcmp0 (property_name, "MDRaid") == 0 ||
+              g_strcmp0 (property_name, "CryptoBackingDevice") == 0)
+            relations_changed = TRUE;
+        }
+    }
+  else if (g_strcmp0 (interface_name, "org.freedesktop.UDisks2.Partition") == 0)
+    {
+      g_variant_iter_init (&iter, changed_properties);
+      while (g_variant_iter_next (&iter, "{&sv}", &property_name, NULL))
+        {
+          if (g_strcmp0 (property_name, "Table") == 0)
+            relations_changed = TRUE;
+        }
+    }
+  invalidate_object_info (client, object, relations_changed);
+}
+
+static void
+queue_changed_for_properties (UDisksClient *client,
+                              const gchar  *interface_name,
+                              GVariant     *changed_properties)
 {
-  UDisksClient *client = UDISKS_CLIENT (user_data);
   UDisksClientClass *client_class = UDISKS_CLIENT_GET_CLASS (client);
 
   GVariantIter iter;
   gchar *property_name = NULL;
 
   /* never emit the change signal for Job objects */
-  if (g_strcmp0 (g_dbus_proxy_get_interface_name (interface_proxy), "org.freedesktop.UDisks2.Drive.Job") == 0)
+  if (g_strcmp0 (interface_name, "org.freedesktop.UDisks2.Drive.Job") == 0)
     return;
 
   g_variant_iter_init (&iter, changed_properties);
@@ -1701,6 +2187,39 @@ on_interface_proxy_properties_changed (GDBusObjectManagerClient   *manager,
     }
 }
 
+static void
+on_interface_proxy_properties_changed (GDBusObjectManagerClient   *manager,
+                                       GDBusObjectProxy           *object_proxy,
+                                       GDBusProxy                 *interface_proxy,
+                                       GVariant                   *changed_properties,
+                                       const gchar *const         *invalidated_properties,
+                                       gpointer                    user_data)
+{
+  UDisksClient *client = UDISKS_CLIENT (user_data);
+
+  invalidate_object_info_for_properties (client,
+                                         G_DBUS_OBJECT (object_proxy),
+                                         g_dbus_proxy_get_interface_name (interface_proxy),
+                                         changed_properties);
+  queue_changed_for_properties (client,
+                                g_dbus_proxy_get_interface_name (interface_proxy),
+                                changed_properties);
+}
+
+static void
+on_filtered_interface_properties_changed (UDisksFilteredObjectManager *manager,
+                                          UDisksFilteredObject        *object,
+                                          const gchar                 *interface_name,
+                                          GVariant                    *changed_properties,
+                                          const gchar *const          *invalidated_properties,
+                                          gpointer                     user_data)
+{
+  UDisksClient *client = UDISKS_CLIENT (user_data);
+
+  invalidate_object_info_for_properties (client, G_DBUS_OBJECT (object), interface_name, changed_properties);
+  queue_changed_for_properties (client, interface_name, changed_properties);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 #define KILOBYTE_FACTOR 1000.0
@@ -2618,6 +3137,7 @@ udisks_client_get_job_description_from_operation (const gchar *operation)
       g_hash_table_insert (hash, (gpointer) "encrypted-lock",       (gpointer) C_("job", "Locking Device"));
       g_hash_table_insert (hash, (gpointer) "encrypted-modify",     (gpointer) C_("job", "Modifying Encrypted Device"));
       g_hash_table_insert (hash, (gpointer) "encrypted-resize",     (gpointer) C_("job", "Resizing Encrypted Device"));
+      g_hash_table_insert (hash, (gpointer) "encrypted-reencrypt",  (gpointer) C_("job", "Re-encrypting Encrypted Device"));
       g_hash_table_insert (hash, (gpointer) "swapspace-start",      (gpointer) C_("job", "Starting Swap Device"));
       g_hash_table_insert (hash, (gpointer) "swapspace-stop",       (gpointer) C_("job", "Stopping Swap Device"));
       g_hash_table_insert (hash, (gpointer) "swapspace-modify",     (gpointer) C_("job", "Modifying Swap Device"));
@@ -2627,8 +3147,14 @@ udisks_client_get_job_description_from_operation (const gchar *operation)
       g_hash_table_insert (hash, (gpointer) "filesystem-modify",    (gpointer) C_("job", "Modifying Filesystem"));
       g_hash_table_insert (hash, (gpointer) "filesystem-repair",    (gpointer) C_("job", "Repairing Filesystem"));
       g_hash_table_insert (hash, (gpointer) "filesystem-resize",    (gpointer) C_("job", "Resizing Filesystem"));
+      g_hash_table_insert (hash, (gpointer) "filesystem-trim",      (gpointer) C_("job", "Trimming Filesystem"));
+      g_hash_table_insert (hash, (gpointer) "filesystem-trim-all",  (gpointer) C_("job", "Trimming Filesystems"));
+      g_hash_table_insert (hash, (gpointer) "block-benchmark",      (gpointer) C_("job", "Benchmarking Device"));
+      g_hash_table_insert (hash, (gpointer) "block-backup",         (gpointer) C_("job", "Backing Up Device"));
+      g_hash_table_insert (hash, (gpointer) "block-restore",        (gpointer) C_("job", "Restoring Device"));
       g_hash_table_insert (hash, (gpointer) "format-erase",         (gpointer) C_("job", "Erasing Device"));
       g_hash_table_insert (hash, (gpointer) "format-mkfs",          (gpointer) C_("job", "Creating Filesystem"));
+      g_hash_table_insert (hash, (gpointer) "format-many",          (gpointer) C_("job", "Formatting Devices"));
       g_hash_table_insert (hash, (gpointer) "loop-setup",           (gpointer) C_("job", "Setting Up Loop Device"));
       g_hash_table_insert (hash, (gpointer) "partition-modify",     (gpointer) C_("job", "Modifying Partition"));
       g_hash_table_insert (hash, (gpointer) "partition-delete",     (gpointer) C_("job", "Deleting Partition"));
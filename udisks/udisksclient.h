@@ -49,6 +49,19 @@ UDisksClient       *udisks_client_new_for_connection_finish (GAsyncResult  *res,
                                                              GError       **error);
 UDisksClient       *udisks_client_new_sync           (GCancellable        *cancellable,
                                                       GError             **error);
+void                udisks_client_new_filtered       (GDBusConnection     *connection,
+                                                      const gchar * const *interfaces,
+                                                      const gchar * const *object_path_prefixes,
+                                                      GCancellable        *cancellable,
+                                                      GAsyncReadyCallback  callback,
+                                                      gpointer             user_data);
+UDisksClient       *udisks_client_new_filtered_finish (GAsyncResult       *res,
+                                                       GError            **error);
+UDisksClient       *udisks_client_new_filtered_sync  (GDBusConnection     *connection,
+                                                      const gchar * const *interfaces,
+                                                      const gchar * const *object_path_prefixes,
+                                                      GCancellable        *cancellable,
+                                                      GError             **error);
 GDBusObjectManager *udisks_client_get_object_manager (UDisksClient        *client);
 UDisksManager      *udisks_client_get_manager        (UDisksClient        *client);
 void                udisks_client_settle             (UDisksClient        *client);
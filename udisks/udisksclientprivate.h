@@ -0,0 +1,38 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#if !defined (UDISKS_COMPILATION)
+#error "This is a private header and must not be included outside of libudisks2."
+#endif
+
+#ifndef __UDISKS_CLIENT_PRIVATE_H__
+#define __UDISKS_CLIENT_PRIVATE_H__
+
+#include <udisks/udiskstypes.h>
+
+G_BEGIN_DECLS
+
+UDisksObjectInfo *_udisks_client_lookup_object_info (UDisksClient     *client,
+                                                     UDisksObject     *object);
+void              _udisks_client_cache_object_info  (UDisksClient     *client,
+                                                     UDisksObject     *object,
+                                                     UDisksObjectInfo *info);
+
+G_END_DECLS
+
+#endif /* __UDISKS_CLIENT_PRIVATE_H__ */
@@ -0,0 +1,1143 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <glib.h>
+
+#include "udisks-generated.h"
+#include "udisksfilteredobjectmanager.h"
+
+/*
+ * UDisksFilteredObjectManager is the #GDBusObjectManager used by
+ * #UDisksClient when only some D-Bus interfaces are of interest, see
+ * udisks_client_new_filtered_sync(). Compared to
+ * #GDBusObjectManagerClient it
+ *
+ *  - only adds match rules for PropertiesChanged and the signals of
+ *    the tracked interfaces, so the process isn't woken up for
+ *    changes it doesn't care about,
+ *
+ *  - only keeps the properties of the tracked interfaces on objects
+ *    below the given object path prefixes, and
+ *
+ *  - creates the interface proxies when they are first accessed;
+ *    until then the properties of an interface are kept in a single
+ *    a{sv} #GVariant.
+ *
+ * An object only shows up once it has at least one tracked interface.
+ */
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+struct _UDisksFilteredObject
+{
+  GObject parent_instance;
+
+  GMutex lock;
+
+  gchar *object_path;
+  GDBusConnection *connection;
+  gchar *name_owner;
+
+  /* interface name -> a{sv} GVariant, for interfaces without a proxy yet */
+  GHashTable *pending;
+  /* interface name -> GDBusProxy */
+  GHashTable *proxies;
+};
+
+typedef struct
+{
+  GObjectClass parent_class;
+} UDisksFilteredObjectClass;
+
+static void filtered_object_dbus_object_iface_init (GDBusObjectIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (UDisksFilteredObject, udisks_filtered_object, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_DBUS_OBJECT, filtered_object_dbus_object_iface_init)
+                         G_IMPLEMENT_INTERFACE (UDISKS_TYPE_OBJECT, NULL)
+                         );
+
+static void
+udisks_filtered_object_finalize (GObject *object)
+{
+  UDisksFilteredObject *fobject = UDISKS_FILTERED_OBJECT (object);
+
+  g_hash_table_unref (fobject->proxies);
+  g_hash_table_unref (fobject->pending);
+  g_free (fobject->name_owner);
+  g_object_unref (fobject->connection);
+  g_free (fobject->object_path);
+  g_mutex_clear (&fobject->lock);
+
+  G_OBJECT_CLASS (udisks_filtered_object_parent_class)->finalize (object);
+}
+
+static void
+udisks_filtered_object_init (UDisksFilteredObject *fobject)
+{
+  g_mutex_init (&fobject->lock);
+  fobject->pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_variant_unref);
+  fobject->proxies = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+}
+
+static GType
+get_proxy_type (UDisksFilteredObject *fobject,
+                const gchar          *interface_name)
+{
+  return udisks_object_manager_client_get_proxy_type (NULL, /* GDBusObjectManagerClient */
+                                                      fobject->object_path,
+                                                      interface_name,
+                                                      NULL); /* user_data */
+}
+
+/* must be called with the object lock held */
+static GDBusProxy *
+ensure_proxy_unlocked (UDisksFilteredObject *fobject,
+                       const gchar          *interface_name)
+{
+  GDBusProxy *proxy;
+  GVariant *properties;
+  GVariantIter iter;
+  const gchar *property_name;
+  GVariant *property_value;
+  GError *error = NULL;
+
+  proxy = g_hash_table_lookup (fobject->proxies, interface_name);
+  if (proxy != NULL)
+    goto out;
+
+  properties = g_hash_table_lookup (fobject->pending, interface_name);
+  if (properties == NULL)
+    goto out;
+
+  /* the properties are fed from the object manager, same as GDBusObjectManagerClient does */
+  proxy = g_initable_new (get_proxy_type (fobject, interface_name),
+                          NULL, /* GCancellable */
+                          &error,
+                          "g-connection", fobject->connection,
+                          "g-name", fobject->name_owner,
+                          "g-object-path", fobject->object_path,
+                          "g-interface-name", interface_name,
+                          "g-flags", G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES | G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                          NULL);
+  if (proxy == NULL)
+    {
+      g_critical ("Error creating proxy for %s on %s: %s", interface_name, fobject->object_path, error->message);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  g_variant_iter_init (&iter, properties);
+  while (g_variant_iter_next (&iter, "{&sv}", &property_name, &property_value))
+    {
+      g_dbus_proxy_set_cached_property (proxy, property_name, property_value);
+      g_variant_unref (property_value);
+    }
+
+  /* disable method timeouts, same as UDisksClient does for all other proxies */
+  g_dbus_proxy_set_default_timeout (proxy, G_MAXINT);
+  g_dbus_interface_set_object (G_DBUS_INTERFACE (proxy), G_DBUS_OBJECT (fobject));
+
+  g_hash_table_insert (fobject->proxies, g_strdup (interface_name), proxy);
+  g_hash_table_remove (fobject->pending, interface_name);
+
+ out:
+  return proxy;
+}
+
+static gchar **
+udisks_filtered_object_get_interface_names (UDisksFilteredObject *fobject)
+{
+  GPtrArray *names;
+  GHashTableIter iter;
+  gpointer key;
+
+  names = g_ptr_array_new ();
+  g_mutex_lock (&fobject->lock);
+  g_hash_table_iter_init (&iter, fobject->pending);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    g_ptr_array_add (names, g_strdup (key));
+  g_hash_table_iter_init (&iter, fobject->proxies);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    g_ptr_array_add (names, g_strdup (key));
+  g_mutex_unlock (&fobject->lock);
+  g_ptr_array_add (names, NULL);
+
+  return (gchar **) g_ptr_array_free (names, FALSE);
+}
+
+static void
+udisks_filtered_object_get_property (GObject    *object,
+                                     guint       prop_id,
+                                     GValue     *value,
+                                     GParamSpec *pspec)
+{
+  UDisksFilteredObject *fobject = UDISKS_FILTERED_OBJECT (object);
+  gchar **names;
+  guint n;
+
+  /* all properties are interfaces, find the one implementing the property type */
+  names = udisks_filtered_object_get_interface_names (fobject);
+  for (n = 0; names[n] != NULL; n++)
+    {
+      if (g_type_is_a (get_proxy_type (fobject, names[n]), G_PARAM_SPEC_VALUE_TYPE (pspec)))
+        {
+          g_value_take_object (value, g_dbus_object_get_interface (G_DBUS_OBJECT (fobject), names[n]));
+          break;
+        }
+    }
+  g_strfreev (names);
+}
+
+static void
+udisks_filtered_object_set_property (GObject      *object,
+                                     guint         prop_id,
+                                     const GValue *value,
+                                     GParamSpec   *pspec)
+{
+  /* the interfaces are determined by the remote object, ignore */
+}
+
+static void
+udisks_filtered_object_class_init (UDisksFilteredObjectClass *klass)
+{
+  GObjectClass *gobject_class;
+  gpointer object_iface;
+  GParamSpec **pspecs;
+  guint n_pspecs;
+  guint n;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize     = udisks_filtered_object_finalize;
+  gobject_class->get_property = udisks_filtered_object_get_property;
+  gobject_class->set_property = udisks_filtered_object_set_property;
+
+  /* UDisksObject has one property per interface, see udisks_filtered_object_get_property() */
+  object_iface = g_type_default_interface_ref (UDISKS_TYPE_OBJECT);
+  pspecs = g_object_interface_list_properties (object_iface, &n_pspecs);
+  for (n = 0; n < n_pspecs; n++)
+    g_object_class_override_property (gobject_class, n + 1, pspecs[n]->name);
+  g_free (pspecs);
+  g_type_default_interface_unref (object_iface);
+}
+
+static const gchar *
+filtered_object_get_object_path (GDBusObject *object)
+{
+  return UDISKS_FILTERED_OBJECT (object)->object_path;
+}
+
+static GDBusInterface *
+filtered_object_get_interface (GDBusObject *object,
+                               const gchar *interface_name)
+{
+  UDisksFilteredObject *fobject = UDISKS_FILTERED_OBJECT (object);
+  GDBusProxy *proxy;
+
+  g_mutex_lock (&fobject->lock);
+  proxy = ensure_proxy_unlocked (fobject, interface_name);
+  if (proxy != NULL)
+    g_object_ref (proxy);
+  g_mutex_unlock (&fobject->lock);
+
+  return (GDBusInterface *) proxy;
+}
+
+static GList *
+filtered_object_get_interfaces (GDBusObject *object)
+{
+  UDisksFilteredObject *fobject = UDISKS_FILTERED_OBJECT (object);
+  GHashTableIter iter;
+  gpointer key;
+  gchar *interface_name;
+  GList *ret;
+
+  g_mutex_lock (&fobject->lock);
+  while (g_hash_table_size (fobject->pending) > 0)
+    {
+      g_hash_table_iter_init (&iter, fobject->pending);
+      g_hash_table_iter_next (&iter, &key, NULL);
+      interface_name = g_strdup (key);
+      if (ensure_proxy_unlocked (fobject, interface_name) == NULL)
+        g_hash_table_remove (fobject->pending, interface_name);
+      g_free (interface_name);
+    }
+  ret = g_hash_table_get_values (fobject->proxies);
+  g_list_foreach (ret, (GFunc) g_object_ref, NULL);
+  g_mutex_unlock (&fobject->lock);
+
+  return ret;
+}
+
+static void
+filtered_object_dbus_object_iface_init (GDBusObjectIface *iface)
+{
+  iface->get_object_path = filtered_object_get_object_path;
+  iface->get_interfaces  = filtered_object_get_interfaces;
+  iface->get_interface   = filtered_object_get_interface;
+}
+
+static UDisksFilteredObject *
+udisks_filtered_object_new (GDBusConnection *connection,
+                            const gchar     *name_owner,
+                            const gchar     *object_path)
+{
+  UDisksFilteredObject *fobject;
+
+  fobject = g_object_new (UDISKS_TYPE_FILTERED_OBJECT, NULL);
+  fobject->connection = g_object_ref (connection);
+  fobject->name_owner = g_strdup (name_owner);
+  fobject->object_path = g_strdup (object_path);
+
+  return fobject;
+}
+
+/* Returns TRUE if @interface_name wasn't on @fobject before */
+static gboolean
+udisks_filtered_object_set_properties (UDisksFilteredObject *fobject,
+                                       const gchar          *interface_name,
+                                       GVariant             *properties)
+{
+  GDBusProxy *proxy;
+  GVariantIter iter;
+  const gchar *property_name;
+  GVariant *property_value;
+  gboolean ret = FALSE;
+
+  g_mutex_lock (&fobject->lock);
+  proxy = g_hash_table_lookup (fobject->proxies, interface_name);
+  if (proxy != NULL)
+    {
+      g_variant_iter_init (&iter, properties);
+      while (g_variant_iter_next (&iter, "{&sv}", &property_name, &property_value))
+        {
+          g_dbus_proxy_set_cached_property (proxy, property_name, property_value);
+          g_variant_unref (property_value);
+        }
+    }
+  else
+    {
+      ret = !g_hash_table_contains (fobject->pending, interface_name);
+      g_hash_table_insert (fobject->pending, g_strdup (interface_name), g_variant_ref (properties));
+    }
+  g_mutex_unlock (&fobject->lock);
+
+  return ret;
+}
+
+/* Returns the removed interface, creating the proxy if needed, or NULL if it wasn't there */
+static GDBusInterface *
+udisks_filtered_object_remove_interface (UDisksFilteredObject *fobject,
+                                         const gchar          *interface_name)
+{
+  GDBusProxy *proxy;
+
+  g_mutex_lock (&fobject->lock);
+  proxy = ensure_proxy_unlocked (fobject, interface_name);
+  if (proxy != NULL)
+    {
+      g_object_ref (proxy);
+      g_hash_table_remove (fobject->proxies, interface_name);
+    }
+  g_mutex_unlock (&fobject->lock);
+
+  return (GDBusInterface *) proxy;
+}
+
+/* Returns FALSE if @interface_name is not on @fobject */
+static gboolean
+udisks_filtered_object_update_properties (UDisksFilteredObject *fobject,
+                                          const gchar          *interface_name,
+                                          GVariant             *changed_properties,
+                                          const gchar * const  *invalidated_properties)
+{
+  GDBusProxy *proxy;
+  GVariant *properties;
+  GVariantDict dict;
+  GVariantIter iter;
+  const gchar *property_name;
+  GVariant *property_value;
+  gboolean ret = TRUE;
+  guint n;
+
+  g_mutex_lock (&fobject->lock);
+  proxy = g_hash_table_lookup (fobject->proxies, interface_name);
+  if (proxy != NULL)
+    {
+      g_object_ref (proxy);
+      g_variant_iter_init (&iter, changed_properties);
+      while (g_variant_iter_next (&iter, "{&sv}", &property_name, &property_value))
+        {
+          g_dbus_proxy_set_cached_property (proxy, property_name, property_value);
+          g_variant_unref (property_value);
+        }
+      for (n = 0; invalidated_properties[n] != NULL; n++)
+        g_dbus_proxy_set_cached_property (proxy, invalidated_properties[n], NULL);
+    }
+  else
+    {
+      properties = g_hash_table_lookup (fobject->pending, interface_name);
+      if (properties != NULL)
+        {
+          g_variant_dict_init (&dict, properties);
+          g_variant_iter_init (&iter, changed_properties);
+          while (g_variant_iter_next (&iter, "{&sv}", &property_name, &property_value))
+            {
+              g_variant_dict_insert_value (&dict, property_name, property_value);
+              g_variant_unref (property_value);
+            }
+          for (n = 0; invalidated_properties[n] != NULL; n++)
+            g_variant_dict_remove (&dict, invalidated_properties[n]);
+          g_hash_table_insert (fobject->pending,
+                               g_strdup (interface_name),
+                               g_variant_ref_sink (g_variant_dict_end (&dict)));
+        }
+      else
+        {
+          ret = FALSE;
+        }
+    }
+  g_mutex_unlock (&fobject->lock);
+
+  if (proxy != NULL)
+    {
+      g_signal_emit_by_name (proxy, "g-properties-changed", changed_properties, invalidated_properties);
+      g_object_unref (proxy);
+    }
+
+  return ret;
+}
+
+static void
+udisks_filtered_object_emit_signal (UDisksFilteredObject *fobject,
+                                    const gchar          *interface_name,
+                                    const gchar          *sender_name,
+                                    const gchar          *signal_name,
+                                    GVariant             *parameters)
+{
+  GDBusProxy *proxy;
+
+  /* nobody can be connected to a proxy that doesn't exist yet */
+  g_mutex_lock (&fobject->lock);
+  proxy = g_hash_table_lookup (fobject->proxies, interface_name);
+  if (proxy != NULL)
+    g_object_ref (proxy);
+  g_mutex_unlock (&fobject->lock);
+
+  if (proxy != NULL)
+    {
+      g_signal_emit_by_name (proxy, "g-signal", sender_name, signal_name, parameters);
+      g_object_unref (proxy);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+struct _UDisksFilteredObjectManager
+{
+  GObject parent_instance;
+
+  GDBusConnection *connection;
+  gchar *name;
+  gchar *object_path;
+  gchar **interfaces;
+  gchar **object_path_prefixes;
+
+  GArray *subscription_ids;
+
+  /* protects name_owner and objects */
+  GMutex lock;
+  gchar *name_owner;
+  /* object path -> UDisksFilteredObject */
+  GHashTable *objects;
+};
+
+typedef struct
+{
+  GObjectClass parent_class;
+} UDisksFilteredObjectManagerClass;
+
+enum
+{
+  INTERFACE_PROPERTIES_CHANGED_SIGNAL,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = { 0 };
+
+static void filtered_object_manager_iface_init (GDBusObjectManagerIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (UDisksFilteredObjectManager, udisks_filtered_object_manager, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_DBUS_OBJECT_MANAGER, filtered_object_manager_iface_init)
+                         );
+
+static void
+udisks_filtered_object_manager_finalize (GObject *object)
+{
+  UDisksFilteredObjectManager *manager = UDISKS_FILTERED_OBJECT_MANAGER (object);
+  guint n;
+
+  for (n = 0; n < manager->subscription_ids->len; n++)
+    g_dbus_connection_signal_unsubscribe (manager->connection, g_array_index (manager->subscription_ids, guint, n));
+  g_array_unref (manager->subscription_ids);
+
+  g_hash_table_unref (manager->objects);
+  g_free (manager->name_owner);
+  g_mutex_clear (&manager->lock);
+
+  g_strfreev (manager->object_path_prefixes);
+  g_strfreev (manager->interfaces);
+  g_free (manager->object_path);
+  g_free (manager->name);
+  g_clear_object (&manager->connection);
+
+  G_OBJECT_CLASS (udisks_filtered_object_manager_parent_class)->finalize (object);
+}
+
+static void
+udisks_filtered_object_manager_init (UDisksFilteredObjectManager *manager)
+{
+  g_mutex_init (&manager->lock);
+  manager->objects = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+  manager->subscription_ids = g_array_new (FALSE, FALSE, sizeof (guint));
+}
+
+static void
+udisks_filtered_object_manager_class_init (UDisksFilteredObjectManagerClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = udisks_filtered_object_manager_finalize;
+
+  /*
+   * UDisksFilteredObjectManager::interface-properties-changed:
+   * @manager: A #UDisksFilteredObjectManager.
+   * @object: The #UDisksFilteredObject the interface is on.
+   * @interface_name: The D-Bus interface name.
+   * @changed_properties: A #GVariant of type a{sv} with the changed properties.
+   * @invalidated_properties: The invalidated properties.
+   *
+   * Like #GDBusObjectManagerClient::interface-proxy-properties-changed
+   * but also emitted for interfaces without a proxy.
+   */
+  signals[INTERFACE_PROPERTIES_CHANGED_SIGNAL] = g_signal_new ("interface-properties-changed",
+                                                               G_OBJECT_CLASS_TYPE (klass),
+                                                               G_SIGNAL_RUN_LAST,
+                                                               0, /* G_STRUCT_OFFSET */
+                                                               NULL, /* accu */
+                                                               NULL, /* accu data */
+                                                               g_cclosure_marshal_generic,
+                                                               G_TYPE_NONE,
+                                                               4,
+                                                               UDISKS_TYPE_FILTERED_OBJECT,
+                                                               G_TYPE_STRING,
+                                                               G_TYPE_VARIANT,
+                                                               G_TYPE_STRV);
+}
+
+static const gchar *
+filtered_object_manager_get_object_path (GDBusObjectManager *_manager)
+{
+  return UDISKS_FILTERED_OBJECT_MANAGER (_manager)->object_path;
+}
+
+static GList *
+filtered_object_manager_get_objects (GDBusObjectManager *_manager)
+{
+  UDisksFilteredObjectManager *manager = UDISKS_FILTERED_OBJECT_MANAGER (_manager);
+  GList *ret;
+
+  g_mutex_lock (&manager->lock);
+  ret = g_hash_table_get_values (manager->objects);
+  g_list_foreach (ret, (GFunc) g_object_ref, NULL);
+  g_mutex_unlock (&manager->lock);
+
+  return ret;
+}
+
+static GDBusObject *
+filtered_object_manager_get_object (GDBusObjectManager *_manager,
+                                    const gchar        *object_path)
+{
+  UDisksFilteredObjectManager *manager = UDISKS_FILTERED_OBJECT_MANAGER (_manager);
+  GDBusObject *ret;
+
+  g_mutex_lock (&manager->lock);
+  ret = g_hash_table_lookup (manager->objects, object_path);
+  if (ret != NULL)
+    g_object_ref (ret);
+  g_mutex_unlock (&manager->lock);
+
+  return ret;
+}
+
+static GDBusInterface *
+filtered_object_manager_get_interface (GDBusObjectManager *_manager,
+                                       const gchar        *object_path,
+                                       const gchar        *interface_name)
+{
+  GDBusObject *object;
+  GDBusInterface *ret = NULL;
+
+  object = filtered_object_manager_get_object (_manager, object_path);
+  if (object != NULL)
+    {
+      ret = g_dbus_object_get_interface (object, interface_name);
+      g_object_unref (object);
+    }
+
+  return ret;
+}
+
+static void
+filtered_object_manager_iface_init (GDBusObjectManagerIface *iface)
+{
+  iface->get_object_path = filtered_object_manager_get_object_path;
+  iface->get_objects     = filtered_object_manager_get_objects;
+  iface->get_object      = filtered_object_manager_get_object;
+  iface->get_interface   = filtered_object_manager_get_interface;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+is_interface_tracked (UDisksFilteredObjectManager *manager,
+                      const gchar                 *interface_name)
+{
+  return g_strv_contains ((const gchar * const *) manager->interfaces, interface_name);
+}
+
+static gboolean
+is_object_path_tracked (UDisksFilteredObjectManager *manager,
+                        const gchar                 *object_path)
+{
+  guint n;
+
+  if (manager->object_path_prefixes == NULL)
+    return TRUE;
+
+  for (n = 0; manager->object_path_prefixes[n] != NULL; n++)
+    {
+      if (g_str_has_prefix (object_path, manager->object_path_prefixes[n]))
+        return TRUE;
+    }
+  return FALSE;
+}
+
+/* Returns a reference to the object at @object_path if it's still owned by @name_owner */
+static UDisksFilteredObject *
+lookup_object (UDisksFilteredObjectManager *manager,
+               const gchar                 *name_owner,
+               const gchar                 *object_path)
+{
+  UDisksFilteredObject *ret = NULL;
+
+  g_mutex_lock (&manager->lock);
+  if (g_strcmp0 (manager->name_owner, name_owner) == 0)
+    {
+      ret = g_hash_table_lookup (manager->objects, object_path);
+      if (ret != NULL)
+        g_object_ref (ret);
+    }
+  g_mutex_unlock (&manager->lock);
+
+  return ret;
+}
+
+static void
+add_interfaces (UDisksFilteredObjectManager *manager,
+                const gchar                 *name_owner,
+                const gchar                 *object_path,
+                GVariant                    *interfaces_and_properties)
+{
+  UDisksFilteredObject *object;
+  GDBusInterface *interface;
+  GPtrArray *added_interfaces;
+  GVariantIter iter;
+  const gchar *interface_name;
+  GVariant *properties;
+  gboolean is_new_object = FALSE;
+  guint n;
+
+  if (!is_object_path_tracked (manager, object_path))
+    return;
+
+  g_mutex_lock (&manager->lock);
+  if (g_strcmp0 (manager->name_owner, name_owner) != 0)
+    {
+      /* stale */
+      g_mutex_unlock (&manager->lock);
+      return;
+    }
+
+  object = g_hash_table_lookup (manager->objects, object_path);
+  if (object != NULL)
+    {
+      g_object_ref (object);
+    }
+  else
+    {
+      object = udisks_filtered_object_new (manager->connection, name_owner, object_path);
+      is_new_object = TRUE;
+    }
+
+  added_interfaces = g_ptr_array_new_with_free_func (g_free);
+  g_variant_iter_init (&iter, interfaces_and_properties);
+  while (g_variant_iter_next (&iter, "{&s@a{sv}}", &interface_name, &properties))
+    {
+      if (is_interface_tracked (manager, interface_name) &&
+          udisks_filtered_object_set_properties (object, interface_name, properties))
+        g_ptr_array_add (added_interfaces, g_strdup (interface_name));
+      g_variant_unref (properties);
+    }
+
+  if (is_new_object && added_interfaces->len > 0)
+    g_hash_table_insert (manager->objects, g_strdup (object_path), g_object_ref (object));
+  g_mutex_unlock (&manager->lock);
+
+  if (is_new_object)
+    {
+      if (added_interfaces->len > 0)
+        g_signal_emit_by_name (manager, "object-added", object);
+    }
+  else
+    {
+      for (n = 0; n < added_interfaces->len; n++)
+        {
+          interface = g_dbus_object_get_interface (G_DBUS_OBJECT (object), added_interfaces->pdata[n]);
+          if (interface == NULL)
+            continue;
+          g_signal_emit_by_name (object, "interface-added", interface);
+          g_signal_emit_by_name (manager, "interface-added", object, interface);
+          g_object_unref (interface);
+        }
+    }
+
+  g_ptr_array_unref (added_interfaces);
+  g_object_unref (object);
+}
+
+static void
+remove_interfaces (UDisksFilteredObjectManager *manager,
+                   const gchar                 *name_owner,
+                   const gchar                 *object_path,
+                   const gchar * const         *interface_names)
+{
+  UDisksFilteredObject *object;
+  GDBusInterface *interface;
+  gchar **current_interfaces;
+  gboolean remove_object = TRUE;
+  guint n;
+
+  g_mutex_lock (&manager->lock);
+  if (g_strcmp0 (manager->name_owner, name_owner) != 0)
+    {
+      g_mutex_unlock (&manager->lock);
+      return;
+    }
+
+  object = g_hash_table_lookup (manager->objects, object_path);
+  if (object == NULL)
+    {
+      g_mutex_unlock (&manager->lock);
+      return;
+    }
+  g_object_ref (object);
+
+  current_interfaces = udisks_filtered_object_get_interface_names (object);
+  for (n = 0; current_interfaces[n] != NULL; n++)
+    {
+      if (!g_strv_contains (interface_names, current_interfaces[n]))
+        {
+          remove_object = FALSE;
+          break;
+        }
+    }
+  g_strfreev (current_interfaces);
+
+  if (remove_object)
+    g_hash_table_remove (manager->objects, object_path);
+  g_mutex_unlock (&manager->lock);
+
+  /* same as GDBusObjectManagerClient, don't emit interface-removed if the whole object goes away */
+  if (remove_object)
+    {
+      g_signal_emit_by_name (manager, "object-removed", object);
+    }
+  else
+    {
+      for (n = 0; interface_names[n] != NULL; n++)
+        {
+          interface = udisks_filtered_object_remove_interface (object, interface_names[n]);
+          if (interface == NULL)
+            continue;
+          g_signal_emit_by_name (object, "interface-removed", interface);
+          g_signal_emit_by_name (manager, "interface-removed", object, interface);
+          g_object_unref (interface);
+        }
+    }
+
+  g_object_unref (object);
+}
+
+static void
+add_managed_objects (UDisksFilteredObjectManager *manager,
+                     const gchar                 *name_owner,
+                     GVariant                    *result)
+{
+  GVariant *objects;
+  GVariantIter iter;
+  const gchar *object_path;
+  GVariant *interfaces_and_properties;
+
+  objects = g_variant_get_child_value (result, 0);
+  g_variant_iter_init (&iter, objects);
+  while (g_variant_iter_next (&iter, "{&o@a{sa{sv}}}", &object_path, &interfaces_and_properties))
+    {
+      add_interfaces (manager, name_owner, object_path, interfaces_and_properties);
+      g_variant_unref (interfaces_and_properties);
+    }
+  g_variant_unref (objects);
+}
+
+typedef struct
+{
+  UDisksFilteredObjectManager *manager;
+  gchar *name_owner;
+} GetManagedObjectsData;
+
+static void
+get_managed_objects_cb (GObject      *source_object,
+                        GAsyncResult *res,
+                        gpointer      user_data)
+{
+  GetManagedObjectsData *data = user_data;
+  GVariant *result;
+
+  /* errors are not fatal, the daemon might be going away again */
+  result = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, NULL);
+  if (result != NULL)
+    {
+      add_managed_objects (data->manager, data->name_owner, result);
+      g_variant_unref (result);
+    }
+
+  g_object_unref (data->manager);
+  g_free (data->name_owner);
+  g_slice_free (GetManagedObjectsData, data);
+}
+
+static void
+on_name_owner_changed (GDBusConnection *connection,
+                       const gchar     *sender_name,
+                       const gchar     *object_path,
+                       const gchar     *interface_name,
+                       const gchar     *signal_name,
+                       GVariant        *parameters,
+                       gpointer         user_data)
+{
+  UDisksFilteredObjectManager *manager = UDISKS_FILTERED_OBJECT_MANAGER (user_data);
+  GetManagedObjectsData *data;
+  const gchar *name;
+  const gchar *old_owner;
+  const gchar *new_owner;
+  GList *objects, *l;
+
+  if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sss)")))
+    return;
+  g_variant_get (parameters, "(&s&s&s)", &name, &old_owner, &new_owner);
+  if (g_strcmp0 (name, manager->name) != 0)
+    return;
+
+  g_mutex_lock (&manager->lock);
+  objects = g_hash_table_get_values (manager->objects);
+  g_list_foreach (objects, (GFunc) g_object_ref, NULL);
+  g_hash_table_remove_all (manager->objects);
+  g_free (manager->name_owner);
+  manager->name_owner = strlen (new_owner) > 0 ? g_strdup (new_owner) : NULL;
+  g_mutex_unlock (&manager->lock);
+
+  for (l = objects; l != NULL; l = l->next)
+    g_signal_emit_by_name (manager, "object-removed", l->data);
+  g_list_free_full (objects, g_object_unref);
+
+  if (strlen (new_owner) > 0)
+    {
+      data = g_slice_new0 (GetManagedObjectsData);
+      data->manager = g_object_ref (manager);
+      data->name_owner = g_strdup (new_owner);
+      g_dbus_connection_call (manager->connection,
+                              new_owner,
+                              manager->object_path,
+                              "org.freedesktop.DBus.ObjectManager",
+                              "GetManagedObjects",
+                              NULL, /* parameters */
+                              G_VARIANT_TYPE ("(a{oa{sa{sv}}})"),
+                              G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                              -1, /* timeout_msec */
+                              NULL, /* GCancellable */
+                              get_managed_objects_cb,
+                              data);
+    }
+}
+
+static void
+on_interfaces_added (GDBusConnection *connection,
+                     const gchar     *sender_name,
+                     const gchar     *object_path,
+                     const gchar     *interface_name,
+                     const gchar     *signal_name,
+                     GVariant        *parameters,
+                     gpointer         user_data)
+{
+  UDisksFilteredObjectManager *manager = UDISKS_FILTERED_OBJECT_MANAGER (user_data);
+  const gchar *added_object_path;
+  GVariant *interfaces_and_properties;
+
+  if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(oa{sa{sv}})")))
+    return;
+  g_variant_get (parameters, "(&o@a{sa{sv}})", &added_object_path, &interfaces_and_properties);
+  add_interfaces (manager, sender_name, added_object_path, interfaces_and_properties);
+  g_variant_unref (interfaces_and_properties);
+}
+
+static void
+on_interfaces_removed (GDBusConnection *connection,
+                       const gchar     *sender_name,
+                       const gchar     *object_path,
+                       const gchar     *interface_name,
+                       const gchar     *signal_name,
+                       GVariant        *parameters,
+                       gpointer         user_data)
+{
+  UDisksFilteredObjectManager *manager = UDISKS_FILTERED_OBJECT_MANAGER (user_data);
+  const gchar *removed_object_path;
+  const gchar **interface_names;
+
+  if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(oas)")))
+    return;
+  g_variant_get (parameters, "(&o^a&s)", &removed_object_path, &interface_names);
+  remove_interfaces (manager, sender_name, removed_object_path, interface_names);
+  g_free (interface_names);
+}
+
+static void
+on_properties_changed (GDBusConnection *connection,
+                       const gchar     *sender_name,
+                       const gchar     *object_path,
+                       const gchar     *interface_name,
+                       const gchar     *signal_name,
+                       GVariant        *parameters,
+                       gpointer         user_data)
+{
+  UDisksFilteredObjectManager *manager = UDISKS_FILTERED_OBJECT_MANAGER (user_data);
+  UDisksFilteredObject *object;
+  const gchar *changed_interface_name;
+  GVariant *changed_properties;
+  const gchar **invalidated_properties;
+
+  if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sa{sv}as)")))
+    return;
+
+  object = lookup_object (manager, sender_name, object_path);
+  if (object == NULL)
+    return;
+
+  g_variant_get (parameters, "(&s@a{sv}^a&s)", &changed_interface_name, &changed_properties, &invalidated_properties);
+  if (udisks_filtered_object_update_properties (object, changed_interface_name, changed_properties, invalidated_properties))
+    g_signal_emit (manager, signals[INTERFACE_PROPERTIES_CHANGED_SIGNAL], 0,
+                   object, changed_interface_name, changed_properties, invalidated_properties);
+  g_variant_unref (changed_properties);
+  g_free (invalidated_properties);
+  g_object_unref (object);
+}
+
+static void
+on_interface_signal (GDBusConnection *connection,
+                     const gchar     *sender_name,
+                     const gchar     *object_path,
+                     const gchar     *interface_name,
+                     const gchar     *signal_name,
+                     GVariant        *parameters,
+                     gpointer         user_data)
+{
+  UDisksFilteredObjectManager *manager = UDISKS_FILTERED_OBJECT_MANAGER (user_data);
+  UDisksFilteredObject *object;
+
+  object = lookup_object (manager, sender_name, object_path);
+  if (object == NULL)
+    return;
+
+  udisks_filtered_object_emit_signal (object, interface_name, sender_name, signal_name, parameters);
+  g_object_unref (object);
+}
+
+static void
+subscribe (UDisksFilteredObjectManager *manager,
+           const gchar                 *sender,
+           const gchar                 *interface_name,
+           const gchar                 *member,
+           const gchar                 *object_path,
+           const gchar                 *arg0,
+           GDBusSignalCallback          callback)
+{
+  guint id;
+
+  id = g_dbus_connection_signal_subscribe (manager->connection,
+                                           sender,
+                                           interface_name,
+                                           member,
+                                           object_path,
+                                           arg0,
+                                           G_DBUS_SIGNAL_FLAGS_NONE,
+                                           callback,
+                                           manager,
+                                           NULL); /* user_data_free_func */
+  g_array_append_val (manager->subscription_ids, id);
+}
+
+static gboolean
+load_managed_objects_sync (UDisksFilteredObjectManager  *manager,
+                           GCancellable                 *cancellable,
+                           GError                      **error)
+{
+  GDBusMessage *message;
+  GDBusMessage *reply;
+  GVariant *body;
+  GError *local_error = NULL;
+  gboolean ret = FALSE;
+
+  /* not using g_dbus_connection_call_sync() since we need the sender of the reply,
+   * this also takes care of activating the service if needed
+   */
+  message = g_dbus_message_new_method_call (manager->name,
+                                            manager->object_path,
+                                            "org.freedesktop.DBus.ObjectManager",
+                                            "GetManagedObjects");
+  reply = g_dbus_connection_send_message_with_reply_sync (manager->connection,
+                                                          message,
+                                                          G_DBUS_SEND_MESSAGE_FLAGS_NONE,
+                                                          -1, /* timeout_msec */
+                                                          NULL, /* out_serial */
+                                                          cancellable,
+                                                          error);
+  g_object_unref (message);
+  if (reply == NULL)
+    goto out;
+
+  if (g_dbus_message_to_gerror (reply, &local_error))
+    {
+      if (g_error_matches (local_error, G_DBUS_ERROR, G_DBUS_ERROR_SERVICE_UNKNOWN) ||
+          g_error_matches (local_error, G_DBUS_ERROR, G_DBUS_ERROR_NAME_HAS_NO_OWNER))
+        {
+          /* not running, objects will be added once the name is owned */
+          g_clear_error (&local_error);
+          ret = TRUE;
+        }
+      else
+        {
+          g_propagate_error (error, local_error);
+        }
+      goto out;
+    }
+
+  body = g_dbus_message_get_body (reply);
+  if (body == NULL || !g_variant_is_of_type (body, G_VARIANT_TYPE ("(a{oa{sa{sv}}})")))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Unexpected reply to GetManagedObjects() on %s", manager->object_path);
+      goto out;
+    }
+
+  g_mutex_lock (&manager->lock);
+  g_free (manager->name_owner);
+  manager->name_owner = g_strdup (g_dbus_message_get_sender (reply));
+  g_mutex_unlock (&manager->lock);
+
+  add_managed_objects (manager, g_dbus_message_get_sender (reply), body);
+  ret = TRUE;
+
+ out:
+  g_clear_object (&reply);
+  return ret;
+}
+
+/*
+ * udisks_filtered_object_manager_new_sync:
+ * @connection: A #GDBusConnection.
+ * @name: The well-known name of the service.
+ * @object_path: The object path of the org.freedesktop.DBus.ObjectManager object.
+ * @interfaces: The D-Bus interfaces to track.
+ * @object_path_prefixes: (allow-none): Only track objects with a path starting with one of these or %NULL for all objects.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Creates a new object manager only tracking @interfaces. Signals are
+ * emitted in the thread-default main context of the calling thread.
+ *
+ * Returns: (transfer full): A #UDisksFilteredObjectManager or %NULL if @error is set.
+ */
+UDisksFilteredObjectManager *
+udisks_filtered_object_manager_new_sync (GDBusConnection     *connection,
+                                         const gchar         *name,
+                                         const gchar         *object_path,
+                                         const gchar * const *interfaces,
+                                         const gchar * const *object_path_prefixes,
+                                         GCancellable        *cancellable,
+                                         GError             **error)
+{
+  UDisksFilteredObjectManager *manager;
+  guint n;
+
+  g_return_val_if_fail (G_IS_DBUS_CONNECTION (connection), NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+  g_return_val_if_fail (object_path != NULL, NULL);
+  g_return_val_if_fail (interfaces != NULL, NULL);
+
+  manager = g_object_new (UDISKS_TYPE_FILTERED_OBJECT_MANAGER, NULL);
+  manager->connection = g_object_ref (connection);
+  manager->name = g_strdup (name);
+  manager->object_path = g_strdup (object_path);
+  manager->interfaces = g_strdupv ((gchar **) interfaces);
+  manager->object_path_prefixes = g_strdupv ((gchar **) object_path_prefixes);
+
+  /* subscribe first so nothing is missed between GetManagedObjects() and the signals */
+  subscribe (manager, "org.freedesktop.DBus", "org.freedesktop.DBus", "NameOwnerChanged",
+             "/org/freedesktop/DBus", name, on_name_owner_changed);
+  subscribe (manager, name, "org.freedesktop.DBus.ObjectManager", "InterfacesAdded",
+             object_path, NULL, on_interfaces_added);
+  subscribe (manager, name, "org.freedesktop.DBus.ObjectManager", "InterfacesRemoved",
+             object_path, NULL, on_interfaces_removed);
+  for (n = 0; interfaces[n] != NULL; n++)
+    {
+      subscribe (manager, name, "org.freedesktop.DBus.Properties", "PropertiesChanged",
+                 NULL, interfaces[n], on_properties_changed);
+      subscribe (manager, name, interfaces[n], NULL,
+                 NULL, NULL, on_interface_signal);
+    }
+
+  if (!load_managed_objects_sync (manager, cancellable, error))
+    {
+      g_object_unref (manager);
+      manager = NULL;
+    }
+
+  return manager;
+}
@@ -0,0 +1,54 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#if !defined (UDISKS_COMPILATION)
+#error "This is a private header and must not be included outside of libudisks2."
+#endif
+
+#ifndef __UDISKS_FILTERED_OBJECT_MANAGER_H__
+#define __UDISKS_FILTERED_OBJECT_MANAGER_H__
+
+#include <udisks/udiskstypes.h>
+
+G_BEGIN_DECLS
+
+typedef struct _UDisksFilteredObjectManager UDisksFilteredObjectManager;
+typedef struct _UDisksFilteredObject UDisksFilteredObject;
+
+#define UDISKS_TYPE_FILTERED_OBJECT_MANAGER  (udisks_filtered_object_manager_get_type ())
+#define UDISKS_FILTERED_OBJECT_MANAGER(o)    (G_TYPE_CHECK_INSTANCE_CAST ((o), UDISKS_TYPE_FILTERED_OBJECT_MANAGER, UDisksFilteredObjectManager))
+#define UDISKS_IS_FILTERED_OBJECT_MANAGER(o) (G_TYPE_CHECK_INSTANCE_TYPE ((o), UDISKS_TYPE_FILTERED_OBJECT_MANAGER))
+
+#define UDISKS_TYPE_FILTERED_OBJECT  (udisks_filtered_object_get_type ())
+#define UDISKS_FILTERED_OBJECT(o)    (G_TYPE_CHECK_INSTANCE_CAST ((o), UDISKS_TYPE_FILTERED_OBJECT, UDisksFilteredObject))
+#define UDISKS_IS_FILTERED_OBJECT(o) (G_TYPE_CHECK_INSTANCE_TYPE ((o), UDISKS_TYPE_FILTERED_OBJECT))
+
+GType                        udisks_filtered_object_manager_get_type (void) G_GNUC_CONST;
+GType                        udisks_filtered_object_get_type         (void) G_GNUC_CONST;
+
+UDisksFilteredObjectManager *udisks_filtered_object_manager_new_sync (GDBusConnection     *connection,
+                                                                      const gchar         *name,
+                                                                      const gchar         *object_path,
+                                                                      const gchar * const *interfaces,
+                                                                      const gchar * const *object_path_prefixes,
+                                                                      GCancellable        *cancellable,
+                                                                      GError             **error);
+
+G_END_DECLS
+
+#endif /* __UDISKS_FILTERED_OBJECT_MANAGER_H__ */
@@ -24,6 +24,7 @@
 #include "udisksobjectinfo.h"
 #include "udisksclient.h"
 #include "udisks-generated.h"
+#include "udisksclientprivate.h"
 
 /**
  * SECTION:udisksobjectinfo
@@ -890,6 +891,11 @@ udisks_client_get_object_info_for_drive (UDisksClient     *client,
  * present in an user interface. Information is returned in the
  * #UDisksObjectInfo object and is localized.
  *
+ * Since 2.10.0 the returned information is cached by @client until a
+ * property on @object or on a related object (such as its drive or
+ * RAID array and their other block devices) changes, so calling this
+ * repeatedly is cheap.
+ *
  * Returns: (transfer full): A #UDisksObjectInfo instance that should be freed with g_object_unref().
  *
  * Since: 2.1
@@ -908,6 +914,10 @@ udisks_client_get_object_info (UDisksClient        *client,
   g_return_val_if_fail (UDISKS_IS_CLIENT (client), NULL);
   g_return_val_if_fail (UDISKS_IS_OBJECT (object), NULL);
 
+  ret = _udisks_client_lookup_object_info (client, object);
+  if (ret != NULL)
+    return ret;
+
   ret = udisks_object_info_new (object);
   drive = udisks_object_get_drive (object);
   block = udisks_object_get_block (object);
@@ -950,6 +960,8 @@ udisks_client_get_object_info (UDisksClient        *client,
   g_clear_object (&block);
   g_clear_object (&drive);
 
+  _udisks_client_cache_object_info (client, object, ret);
+
 #if 0
   /* for debugging */
   g_print ("%s -> dd='%s', md='%s', ol='%s' and di='%s', mi='%s' sk='%s'\n",